@@ -43,6 +43,13 @@ defined in linker script */
 .word _sbss
 /* end address for the .bss section. defined in linker script */
 .word _ebss
+/* start address for the initialization values of the .ramfunc section.
+defined in linker script */
+.word _siramfunc
+/* start address for the .ramfunc section. defined in linker script */
+.word _sramfunc
+/* end address for the .ramfunc section. defined in linker script */
+.word _eramfunc
 
   .section .text.Reset_Handler
   .weak Reset_Handler
@@ -71,6 +78,23 @@ LoopCopyDataInit:
   adds r4, r0, r3
   cmp r4, r1
   bcc CopyDataInit
+
+/* Copy the RAM-resident functions from flash to SRAM */
+  ldr r0, =_sramfunc
+  ldr r1, =_eramfunc
+  ldr r2, =_siramfunc
+  movs r3, #0
+  b LoopCopyRamFuncInit
+
+CopyRamFuncInit:
+  ldr r4, [r2, r3]
+  str r4, [r0, r3]
+  adds r3, r3, #4
+
+LoopCopyRamFuncInit:
+  adds r4, r0, r3
+  cmp r4, r1
+  bcc CopyRamFuncInit
   
 /* Zero fill the bss segment. */
   ldr r2, =_sbss
@@ -86,8 +110,41 @@ LoopFillZerobss:
   cmp r2, r4
   bcc FillZerobss
 
+/* Paint the free RAM from the end of the static data up to the stack pointer with
+   STACK_PAINT (see STM32F030-Stack-lib.c), so the stack and heap high-water marks can be
+   measured later. Nothing is on the stack yet. */
+  ldr r2, =_end
+  mov r4, sp
+  ldr r3, =0xC5C5C5C5
+  b LoopPaintStack
+
+PaintStack:
+  str  r3, [r2]
+  adds r2, r2, #4
+
+LoopPaintStack:
+  cmp r2, r4
+  bcc PaintStack
+
 /* Call static constructors */
+#ifdef FREESTANDING
+/* Without the C library, walk .init_array here. When there are no constructors the
+   loop exits at once. */
+  ldr r4, =__init_array_start
+  ldr r5, =__init_array_end
+  b LoopCallInitArray
+
+CallInitArray:
+  ldr r0, [r4]
+  blx r0
+  adds r4, r4, #4
+
+LoopCallInitArray:
+  cmp r4, r5
+  bcc CallInitArray
+#else
   bl __libc_init_array
+#endif
 /* Call the application's entry point.*/
   bl main
 
@@ -0,0 +1,237 @@
+//  ==========================================================================================
+//  STM32F030-ADC-lib.c
+//  ------------------------------------------------------------------------------------------
+//  Supply voltage and die temperature from the internal VREFINT and temperature sensor
+//  channels. The ADC converts both channels over and over in continuous scan mode, and DMA
+//  channel 1 copies every result into a circular buffer. Neither the ADC nor the DMA
+//  interrupts the CPU, so the only CPU time used is when a value is asked for, which adds
+//  up the last ADC_AVG results of each channel and scales them.
+//  ------------------------------------------------------------------------------------------
+//  https://github.com/EZdenki/STM32F030-CMSIS-I2C-AHT10-lib
+//  Released under the MIT License
+//  Copyright (c) 2023
+//  Mike Shegedin, EZdenki.com
+//  ------------------------------------------------------------------------------------------
+//  Target Device: STM32F030Fxxx running at DELAY_CLK_MHZ (8 MHz by default)
+//  ------------------------------------------------------------------------------------------
+//  Routines in this Library
+//
+//  void
+//  ADC_init( uint16_t lowVddMv )
+//    Calibrate the ADC and start the scan. If lowVddMv is not 0, the analog watchdog sets
+//    ADC_lowVdd once the supply drops below lowVddMv millivolts. Calling ADC_init again
+//    after ADC_stop restarts the scan.
+//
+//  void
+//  ADC_stop( void )
+//    Stop the scan and turn off the ADC, VREFINT and the temperature sensor.
+//
+//  uint8_t
+//  ADC_ready( void )
+//    Return 1 once the buffer has been filled at least once since ADC_init.
+//
+//  uint16_t
+//  ADC_vddMv( void )
+//    Return the supply voltage (VDDA) in millivolts, or 0 if ADC_ready is not yet 1.
+//
+//  fix16_t
+//  ADC_dieTemp( void )
+//    Return the die temperature in degrees C, or 0 if ADC_ready is not yet 1.
+//  ------------------------------------------------------------------------------------------
+//  Accuracy:
+//  ---------
+//  VREFINT is measured against VREFINT_CAL, which is the factory reading at 3.3 V, so the
+//  supply voltage is good to about 1 %. The STM32F030 only has one temperature calibration
+//  point (TS_CAL1, at 30 C and 3.3 V), so the die temperature uses the typical slope of
+//  4.3 mV/C from the datasheet. Expect a few degrees of error away from 30 C, and more
+//  from part to part. The die temperature is best used for changes, such as how much
+//  warmer the board runs than the room, rather than as an absolute value.
+//  ------------------------------------------------------------------------------------------
+//  Timing:
+//  -------
+//  The ADC is clocked at PCLK/2 (4 MHz) and both channels use the longest sample time
+//  (239.5 cycles), which is well over the 4 us minimum of the internal channels. One scan
+//  of both channels takes 2 x 252 cycles, or 126 us, so the buffer is full approx. 1 ms
+//  after ADC_init. Each scan costs two DMA bus cycles and no CPU time.
+//  ==========================================================================================
+
+#ifndef __STM32F030_ADC_LIB_C
+#define __STM32F030_ADC_LIB_C
+
+#include "stm32f030x6.h"          // Primary CMSIS header file
+#include "STM32F030-Fixed-lib.c"  // fix16_t
+#include "STM32F030-Delay-lib.c"  // DELAY_POLL
+
+#ifndef ADC_AVG
+#define ADC_AVG  8                // Results of each channel to average. Power of 2, max 16.
+#endif
+
+#ifndef ADC_VREFINT_CAL           // Factory calibration. The host build supplies its own.
+#define ADC_VREFINT_CAL  (*(const uint16_t *)0x1FFFF7BA)  // VREFINT reading at 3.3 V
+#define ADC_TS_CAL1      (*(const uint16_t *)0x1FFFF7B8)  // Temp. sensor reading, 30 C/3.3 V
+#endif
+#define ADC_CAL_MV       3300     // Supply voltage of the factory calibration
+#define ADC_TS_SLOPE_Q16 12282    // 1 C per (4.3 mV/C * 4095 / 3300 mV) counts, as Q16.16
+#define ADC_CH_TS        16       // Temperature sensor channel. Converted first in the scan.
+#define ADC_CH_VREF      17       // VREFINT channel
+
+volatile uint16_t ADC_buf[ ADC_AVG * 2 ];  // Even: temperature sensor, odd: VREFINT
+volatile uint8_t  ADC_lowVdd;              // Set by the analog watchdog on a low supply
+
+
+//  void
+//  ADC1_IRQHandler( void )
+//  Analog watchdog: VREFINT read above the threshold, so the supply is below the limit.
+//  The interrupt is turned off after the first hit so that a falling battery does not
+//  interrupt the CPU after every scan. ADC_init turns it back on.
+void
+ADC1_IRQHandler( void )
+{
+  if( ADC1->ISR & ADC_ISR_AWD1 )
+  {
+    ADC_lowVdd = 1;
+    ADC1->IER  &= ~ADC_IER_AWD1IE;
+    ADC1->ISR  = ADC_ISR_AWD1;            // Write 1 to clear
+  }
+}
+
+
+//  void
+//  ADC_stop( void )
+//  Stop the conversions, then disable the ADC, the DMA channel and the internal channels.
+void
+ADC_stop( void )
+{
+  if( ADC1->CR & ADC_CR_ADSTART )
+  {
+    ADC1->CR |= ADC_CR_ADSTP;
+    while( ADC1->CR & ADC_CR_ADSTP ) DELAY_POLL( );
+  }
+  if( ADC1->CR & ADC_CR_ADEN )
+  {
+    ADC1->CR |= ADC_CR_ADDIS;
+    while( ADC1->CR & ADC_CR_ADEN ) DELAY_POLL( );
+  }
+  DMA1_Channel1->CCR = 0;
+  ADC1_COMMON->CCR &= ~( ADC_CCR_TSEN | ADC_CCR_VREFEN );
+  NVIC_DisableIRQ( ADC1_IRQn );
+}
+
+
+//  void
+//  ADC_init( uint16_t lowVddMv )
+//  Clock the ADC from PCLK/2 and calibrate it. Calibration needs the ADC disabled and DMA
+//  requests off, so any earlier scan is stopped first. Then set up DMA channel 1 as a
+//  circular copy of ADC1->DR into ADC_buf, and start continuous conversion of channels 16
+//  and 17. The ADC converts the selected channels in ascending order, so the even entries
+//  of ADC_buf always hold the temperature sensor and the odd ones VREFINT.
+//  The watchdog threshold is the VREFINT reading at lowVddMv: a lower supply gives a
+//  higher reading.
+void
+ADC_init( uint16_t lowVddMv )
+{
+  RCC->APB2ENR |= RCC_APB2ENR_ADCEN;
+  RCC->AHBENR  |= RCC_AHBENR_DMAEN;
+  ADC_stop( );
+
+  ADC1->CFGR1 = 0;                        // DMAEN must be 0 for the calibration
+  ADC1->CFGR2 = ADC_CFGR2_CKMODE_0;       // PCLK/2. Can only be changed while ADEN = 0.
+  ADC1->CR   |= ADC_CR_ADCAL;
+  while( ADC1->CR & ADC_CR_ADCAL ) DELAY_POLL( );
+
+  ADC1_COMMON->CCR |= ADC_CCR_TSEN | ADC_CCR_VREFEN;
+  ADC1->SMPR   = ADC_SMPR_SMP;            // 239.5 cycles
+  ADC1->CHSELR = ADC_CHSELR_CHSEL16 | ADC_CHSELR_CHSEL17;
+  ADC1->CFGR1  = ADC_CFGR1_CONT | ADC_CFGR1_DMACFG | ADC_CFGR1_DMAEN;
+
+  ADC_lowVdd = 0;
+  if( lowVddMv )
+  {
+    ADC1->TR     = (uint32_t)( (uint32_t)ADC_VREFINT_CAL * ADC_CAL_MV / lowVddMv ) << 16;
+    ADC1->CFGR1 |= ADC_CFGR1_AWD1EN | ADC_CFGR1_AWD1SGL |
+                   ( ADC_CH_VREF << ADC_CFGR1_AWD1CH_Pos );
+    ADC1->ISR    = ADC_ISR_AWD1;
+    ADC1->IER    = ADC_IER_AWD1IE;
+    NVIC_EnableIRQ( ADC1_IRQn );
+  }
+
+  DMA1->IFCR = DMA_IFCR_CGIF1;            // ADC_ready looks for the first wrap
+  DMA1_Channel1->CPAR  = (uint32_t)(uintptr_t)&ADC1->DR;
+  DMA1_Channel1->CMAR  = (uint32_t)(uintptr_t)ADC_buf;
+  DMA1_Channel1->CNDTR = ADC_AVG * 2;
+  DMA1_Channel1->CCR   = DMA_CCR_MSIZE_0 | DMA_CCR_PSIZE_0 | DMA_CCR_MINC | DMA_CCR_CIRC |
+                         DMA_CCR_EN;
+
+  ADC1->ISR = ADC_ISR_ADRDY;
+  ADC1->CR |= ADC_CR_ADEN;
+  while( !( ADC1->ISR & ADC_ISR_ADRDY )) DELAY_POLL( );
+  ADC1->CR |= ADC_CR_ADSTART;
+}
+
+
+//  uint8_t
+//  ADC_ready( void )
+//  The DMA transfer complete flag is set when the buffer wraps for the first time. It is
+//  never cleared while the scan runs, so it stays set.
+static inline uint8_t
+ADC_ready( void )
+{
+  return ( DMA1->ISR & DMA_ISR_TCIF1 ) != 0;
+}
+
+
+//  void
+//  ADC_sums( uint32_t *ts, uint32_t *vref )
+//  Add up the buffer. The DMA may write an entry while it is read, but each read of a
+//  16-bit entry is a single bus cycle, so every value read is a whole result.
+static void
+ADC_sums( uint32_t *ts, uint32_t *vref )
+{
+  uint32_t t = 0, v = 0;
+
+  for( uint8_t i = 0; i < ADC_AVG * 2; i += 2 )
+  {
+    t += ADC_buf[ i ];
+    v += ADC_buf[ i + 1 ];
+  }
+  *ts   = t;
+  *vref = v;
+}
+
+
+//  uint16_t
+//  ADC_vddMv( void )
+//  VDDA = 3.3 V * VREFINT_CAL / VREFINT reading. The sum of ADC_AVG readings is used as it
+//  is, with VREFINT_CAL scaled up to match.
+uint16_t
+ADC_vddMv( void )
+{
+  uint32_t ts, vref;
+
+  if( !ADC_ready( ))
+    return 0;
+  ADC_sums( &ts, &vref );
+  return ( (uint32_t)ADC_VREFINT_CAL * ADC_CAL_MV * ADC_AVG + vref / 2 ) / vref;
+}
+
+
+//  fix16_t
+//  ADC_dieTemp( void )
+//  The temperature sensor reading is first scaled to what it would have been at 3.3 V, the
+//  supply of TS_CAL1, using the VREFINT reading. The difference from TS_CAL1 is kept in
+//  units of 1/ADC_AVG count until the final multiply by the slope. The sensor voltage
+//  falls as the temperature rises, so a reading below TS_CAL1 is above 30 C.
+fix16_t
+ADC_dieTemp( void )
+{
+  uint32_t ts, vref;
+  int32_t  diff;
+
+  if( !ADC_ready( ))
+    return 0;
+  ADC_sums( &ts, &vref );
+  diff = (int32_t)ADC_TS_CAL1 * ADC_AVG - (int32_t)( ts * ADC_VREFINT_CAL * ADC_AVG / vref );
+  return FIX16( 30 ) + diff * ADC_TS_SLOPE_Q16 / ADC_AVG;
+}
+
+#endif /* __STM32F030_ADC_LIB_C */
@@ -0,0 +1,171 @@
+//  ==========================================================================================
+//  STM32F030-AHT10-Sensor-lib.c
+//  ------------------------------------------------------------------------------------------
+//  Adapter between the AHT10 routines of STM32F030-CMSIS-AHT10-lib.c and the generic sensor
+//  interface of STM32F030-Sensor-lib.c. It provides AHT10_driver, so that any number of
+//  AHT10 sensors (for example behind I2C multiplexers) can be read by the sampling engine
+//  together with other sensor types, and power gating for the single sensor read by the
+//  AHT10_ routines.
+//
+//  This is kept out of the AHT10 library so that a program that only uses AHT10_init and
+//  AHT10_getTempHumid does not pull in the sensor engine, the device handles, the
+//  multiplexer support or their RAM.
+//  ------------------------------------------------------------------------------------------
+//  https://github.com/EZdenki/STM32F030-CMSIS-I2C-AHT10-lib
+//  Released under the MIT License
+//  Copyright (c) 2023
+//  Mike Shegedin, EZdenki.com
+//  ------------------------------------------------------------------------------------------
+//  Target Devices:
+//    STM32F030Fxxx running at 8 MHz internal clock
+//    AHT10 Temperature and Humidity Module
+//  ------------------------------------------------------------------------------------------
+//  Routines in this Library
+//
+//  const Sensor_Driver AHT10_driver
+//    Driver for STM32F030-Sensor-lib.c:
+//      Sensor_init( &sensor, &AHT10_driver, I2C1, 0, 0, 0, AHT10_ADD, 0, 2000 );
+//
+//  void
+//  AHT10_powerInit( GPIO_TypeDef *port, uint8_t pin, uint8_t activeLow, uint32_t periodMs )
+//    Use pin of port (GPIOA or GPIOB) to switch the power of the sensor read by the AHT10_
+//    routines, for example through a load switch, or directly if the module runs from
+//    3.3 V. Call before the first AHT10_init. periodMs is the time between
+//    AHT10_getTempHumidGated calls.
+//
+//  uint8_t
+//  AHT10_getTempHumidGated( fix16_t *temp, fix16_t *humid )
+//    As AHT10_getTempHumid. If periodMs is long enough (see Sensor_gated in
+//    STM32F030-Sensor-lib.c), the sensor is turned on, given AHT10_POWERUP_MS, initialized
+//    with AHT10_init, read, and turned off again, with PA9 and PA10 floating while it is
+//    off. Otherwise the sensor stays on and this is the same as AHT10_getTempHumid.
+//  ==========================================================================================
+
+#ifndef __STM32F030_AHT10_SENSOR_LIB_C
+#define __STM32F030_AHT10_SENSOR_LIB_C
+
+#include "stm32f030x6.h"                // Primary CMSIS header file
+#include "STM32F030-CMSIS-AHT10-lib.c"  // AHT10 protocol and conversion
+#include "STM32F030-Sensor-lib.c"       // Generic sensor driver interface
+#include "STM32F030-Delay-lib.c"        // delay_us
+
+Sensor       AHT10_sensor;              // Gating state of the sensor of the AHT10_ routines
+Sensor_Power AHT10_power;               // Power switch set up by AHT10_powerInit
+
+
+//  The bus of the driver: the device handle of the sensor, so that it may sit behind a
+//  multiplexer or on a software I2C bus.
+static uint8_t
+AHT10_devWrite( void *dev, const uint8_t *data, uint8_t n )
+{
+  return I2C_devWrite( dev, data, n );
+}
+
+
+static uint8_t
+AHT10_devRead( void *dev, uint8_t *data, uint8_t n )
+{
+  return I2C_devRead( dev, data, n );
+}
+
+
+const AHT10_Bus AHT10_devBus = { AHT10_devWrite, AHT10_devRead };
+
+
+//  uint8_t
+//  AHT10_drvInit( Sensor *s )
+//    Load the calibration with AHT10_busInit.
+static uint8_t
+AHT10_drvInit( Sensor *s )
+{
+  return AHT10_busInit( &AHT10_devBus, &s->dev );
+}
+
+
+//  uint8_t
+//  AHT10_drvStart( Sensor *s )
+//    Trigger a measurement with AHT10_busTrigger.
+static uint8_t
+AHT10_drvStart( Sensor *s )
+{
+  return AHT10_busTrigger( &AHT10_devBus, &s->dev );
+}
+
+
+//  uint8_t
+//  AHT10_drvFetch( Sensor *s, uint8_t *raw )
+//    Read the 6 bytes of a measurement with AHT10_busRead.
+static uint8_t
+AHT10_drvFetch( Sensor *s, uint8_t *raw )
+{
+  return AHT10_busRead( &AHT10_devBus, &s->dev, raw );
+}
+
+
+//  uint8_t
+//  AHT10_drvDecode( Sensor *s, const uint8_t *raw, Sensor_Reading *r )
+//    Convert the 6 bytes with AHT10_convert. Returns SENSOR_BADDATA if the busy bit of the
+//    status byte was still set.
+static uint8_t
+AHT10_drvDecode( Sensor *s, const uint8_t *raw, Sensor_Reading *r )
+{
+  if( AHT10_convert( raw, &r->temp, &r->humid ) & AHT10_BUSY )
+    return SENSOR_BADDATA;
+  r->valid = SENSOR_TEMP | SENSOR_HUMID;
+  return I2C_OK;
+}
+
+
+//  The AHT10 has no conversion-done check that can be read separately from the data, so the
+//  engine waits AHT10_MEAS_MS and decode rejects a reading that was not finished.
+const Sensor_Driver AHT10_driver =
+{
+  "AHT10", SENSOR_TEMP | SENSOR_HUMID, 6, AHT10_POWERUP_MS, AHT10_MEAS_MS,
+  AHT10_drvInit, AHT10_drvStart, 0, AHT10_drvFetch, AHT10_drvDecode, 0
+};
+
+
+//  void
+//  AHT10_powerInit( GPIO_TypeDef *port, uint8_t pin, uint8_t activeLow, uint32_t periodMs )
+//    Set up the power switch and leave the sensor powered. The I2C1 pins, PA9 and PA10,
+//    are floated while the power is off, so no other device may share the bus. The sensor
+//    also needs the driver and period for Sensor_gated.
+void
+AHT10_powerInit( GPIO_TypeDef *port, uint8_t pin, uint8_t activeLow, uint32_t periodMs )
+{
+  Sensor_powerInit( &AHT10_power, port, pin, activeLow, GPIOA, ( 1U << 9 ) | ( 1U << 10 ));
+  AHT10_sensor.drv      = &AHT10_driver;
+  AHT10_sensor.periodMs = periodMs;
+  Sensor_setPower( &AHT10_sensor, &AHT10_power );
+}
+
+
+//  uint8_t
+//  AHT10_getTempHumidGated( fix16_t *temp, fix16_t *humid )
+//    Read the sensor with AHT10_getTempHumid. If the sensor is power gated, it is powered
+//    up and initialized first (at the speed the I2C interface last ran at), and powered
+//    down again afterwards. Returns the sensor status byte, or AHT10_ERROR.
+uint8_t
+AHT10_getTempHumidGated( fix16_t *temp, fix16_t *humid )
+{
+  uint8_t gated = Sensor_gated( &AHT10_sensor );
+  uint8_t status;
+
+  if( gated && !AHT10_power.on )
+  {
+    Sensor_powerOn( &AHT10_power, 0 );      // AHT10_init restores the I2C interface
+    delay_us( AHT10_POWERUP_MS * 1000UL );
+    if( AHT10_init( AHT10_I2C, I2C1_health.speed ) != I2C_OK )
+    {
+      Sensor_powerOff( &AHT10_power, AHT10_I2C );
+      return AHT10_ERROR;
+    }
+  }
+
+  status = AHT10_getTempHumid( temp, humid );
+  if( gated )
+    Sensor_powerOff( &AHT10_power, AHT10_I2C );
+  return status;
+}
+
+#endif /* __STM32F030_AHT10_SENSOR_LIB_C */
@@ -0,0 +1,299 @@
+//  ==========================================================================================
+//  STM32F030-BME280-lib.c
+//  ------------------------------------------------------------------------------------------
+//  Driver for the Bosch BME280 pressure, temperature and humidity sensor, for use with
+//  STM32F030-Sensor-lib.c. The sensor is used in forced mode: each sample triggers one
+//  conversion, after which the sensor goes back to sleep by itself. This is the same
+//  start / wait / fetch pattern as the AHT10, so the sampling engine can run BME280
+//  conversions at the same time as those of other sensors.
+//
+//  The factory calibration is read once, when the sensor is initialized, and kept in RAM.
+//  Each result is read in one 8-byte burst (pressure, temperature and humidity), and is
+//  compensated with the 32-bit integer formulas from the Bosch datasheet, without any
+//  floating-point code. The configuration registers are accessed through a regmap
+//  (STM32F030-Regmap-lib.c), so they are only written when they change.
+//  ------------------------------------------------------------------------------------------
+//  https://github.com/EZdenki/STM32F030-CMSIS-I2C-AHT10-lib
+//  Released under the MIT License
+//  Copyright (c) 2023
+//  Mike Shegedin, EZdenki.com
+//  ------------------------------------------------------------------------------------------
+//  Target Devices:
+//    STM32F030Fxxx
+//    BME280 at address 0x76 (SDO to GND) or 0x77 (SDO to VDDIO)
+//  ------------------------------------------------------------------------------------------
+//  Usage:
+//
+//    BME280  bmeState;                          // Calibration and register cache
+//    Sensor  bme;
+//
+//    Sensor_init( &bme, &BME280_driver, I2C1, 0, 0, 0, BME280_ADD, &bmeState, 5000 );
+//    ...
+//    Sensor_run( sensors, n );                  // bme.reading.press is in hPa
+//  ------------------------------------------------------------------------------------------
+//  Routines in this Library
+//
+//  uint8_t
+//  BME280_compensate( const BME280_Calib *cal, const uint8_t *raw, Sensor_Reading *r )
+//    Convert the 8 bytes read from 0xF7 to 0xFE into temperature (Celsius), pressure (hPa)
+//    and relative humidity (percent) as Q16.16 values. Returns I2C_OK, or SENSOR_BADDATA
+//    if the calibration is not valid.
+//
+//  const Sensor_Driver BME280_driver
+//    Driver for STM32F030-Sensor-lib.c. The priv pointer of the Sensor must point to a
+//    BME280 structure, one for each sensor.
+//
+//  Oversampling is set by BME280_OSRS_T, BME280_OSRS_P and BME280_OSRS_H (register
+//  values: 1 = x1, 2 = x2, 3 = x4, 4 = x8, 5 = x16). The defaults of x1 give a conversion
+//  time of less than BME280_MEAS_MS (10 ms).
+//  ==========================================================================================
+
+#ifndef __STM32F030_BME280_LIB_C
+#define __STM32F030_BME280_LIB_C
+
+#include "stm32f030x6.h"                // Primary CMSIS header file
+#include "STM32F030-Sensor-lib.c"       // Generic sensor driver interface
+#include "STM32F030-Regmap-lib.c"       // Register cache
+#include "STM32F030-Delay-lib.c"        // delay_us
+#include "STM32F030-Fixed-lib.c"        // fix16_t
+
+#define BME280_ADD        0x76          // Default I2C address (SDO to GND)
+#define BME280_CHIP_ID    0x60          // Value of the id register
+
+//  Registers
+#define BME280_CALIB00    0x88          // Calibration T1 .. H1, 26 bytes
+#define BME280_ID         0xD0          // Chip id
+#define BME280_RESET      0xE0          // Soft reset: write BME280_RESET_CMD
+#define BME280_CALIB26    0xE1          // Calibration H2 .. H6, 7 bytes
+#define BME280_CTRL_HUM   0xF2          // Humidity oversampling
+#define BME280_STATUS     0xF3          // Bit 3: Conversion running
+#define BME280_CTRL_MEAS  0xF4          // Temperature and pressure oversampling, mode
+#define BME280_CONFIG     0xF5          // Standby time, IIR filter
+#define BME280_DATA       0xF7          // press[3], temp[3], hum[2]
+
+#define BME280_RESET_CMD  0xB6
+#define BME280_MEASURING  0x08          // Status bit
+#define BME280_FORCED     0x01          // ctrl_meas mode bits: Forced mode
+
+#ifndef BME280_OSRS_T
+#define BME280_OSRS_T     1             // Temperature oversampling x1
+#endif
+#ifndef BME280_OSRS_P
+#define BME280_OSRS_P     1             // Pressure oversampling x1
+#endif
+#ifndef BME280_OSRS_H
+#define BME280_OSRS_H     1             // Humidity oversampling x1
+#endif
+
+#define BME280_POWERUP_MS 2             // Power-up time
+#define BME280_RESET_US   2000          // Time to load the calibration after a reset
+#define BME280_MEAS_MS    10            // Conversion time with x1 oversampling (9.3 ms max)
+#define BME280_NREGS      6             // Registers in the regmap
+
+typedef struct
+{
+  uint16_t T1;                          // Calibration values, named as in the datasheet
+  int16_t  T2, T3;
+  uint16_t P1;
+  int16_t  P2, P3, P4, P5, P6, P7, P8, P9;
+  uint8_t  H1, H3;
+  int16_t  H2, H4, H5;
+  int8_t   H6;
+} BME280_Calib;
+
+typedef struct
+{
+  BME280_Calib cal;                     // Calibration read by init
+  Regmap       map;                     // Register cache
+  uint8_t      cache[ BME280_NREGS ];
+} BME280;
+
+//  ctrl_meas is volatile, since the mode bits return to sleep after each forced conversion.
+static const Regmap_Reg BME280_regs[ BME280_NREGS ] =
+{
+  { BME280_ID,        0 },
+  { BME280_RESET,     REGMAP_VOLATILE },
+  { BME280_CTRL_HUM,  0 },
+  { BME280_STATUS,    REGMAP_VOLATILE },
+  { BME280_CTRL_MEAS, REGMAP_VOLATILE },
+  { BME280_CONFIG,    0 },
+};
+
+
+//  uint8_t
+//  BME280_init( Sensor *s )
+//  Reset the sensor, check the chip id, read the calibration, and set the humidity
+//  oversampling and filter. ctrl_hum only takes effect after the next ctrl_meas write,
+//  which is done by every start.
+static uint8_t
+BME280_init( Sensor *s )
+{
+  BME280       *b   = s->priv;
+  BME280_Calib *cal = &b->cal;
+  uint8_t       c[26], status, id;
+
+  Regmap_init( &b->map, &s->dev, BME280_regs, b->cache, BME280_NREGS, REGMAP_PAIRS );
+  if(( status = Regmap_write( &b->map, BME280_RESET, BME280_RESET_CMD )) != I2C_OK )
+    return status;
+  delay_us( BME280_RESET_US );
+  if(( status = Regmap_read( &b->map, BME280_ID, &id )) != I2C_OK )
+    return status;
+  if( id != BME280_CHIP_ID )
+    return SENSOR_BADDATA;
+
+  if(( status = Regmap_readBlock( &b->map, BME280_CALIB00, c, 26 )) != I2C_OK )
+    return status;
+  cal->T1 = c[1]  << 8 | c[0];
+  cal->T2 = c[3]  << 8 | c[2];
+  cal->T3 = c[5]  << 8 | c[4];
+  cal->P1 = c[7]  << 8 | c[6];
+  cal->P2 = c[9]  << 8 | c[8];
+  cal->P3 = c[11] << 8 | c[10];
+  cal->P4 = c[13] << 8 | c[12];
+  cal->P5 = c[15] << 8 | c[14];
+  cal->P6 = c[17] << 8 | c[16];
+  cal->P7 = c[19] << 8 | c[18];
+  cal->P8 = c[21] << 8 | c[20];
+  cal->P9 = c[23] << 8 | c[22];
+  cal->H1 = c[25];                      // 0xA1. 0xA0 is not used.
+
+  if(( status = Regmap_readBlock( &b->map, BME280_CALIB26, c, 7 )) != I2C_OK )
+    return status;
+  cal->H2 = c[1] << 8 | c[0];
+  cal->H3 = c[2];
+  cal->H4 = (int16_t)( (int8_t)c[3] * 16 | ( c[4] & 0x0F ));   // 12-bit signed values
+  cal->H5 = (int16_t)( (int8_t)c[5] * 16 | ( c[4] >> 4 ));
+  cal->H6 = (int8_t)c[6];
+
+  Regmap_set( &b->map, BME280_CTRL_HUM, 0xFF, BME280_OSRS_H );
+  Regmap_set( &b->map, BME280_CONFIG, 0xFF, 0x00 );   // No IIR filter
+  return Regmap_sync( &b->map );
+}
+
+
+//  uint8_t
+//  BME280_start( Sensor *s )
+//  Start a forced-mode conversion.
+static uint8_t
+BME280_start( Sensor *s )
+{
+  BME280 *b = s->priv;
+
+  return Regmap_write( &b->map, BME280_CTRL_MEAS,
+                       BME280_OSRS_T << 5 | BME280_OSRS_P << 2 | BME280_FORCED );
+}
+
+
+//  uint8_t
+//  BME280_ready( Sensor *s )
+//  Check the measuring bit of the status register.
+static uint8_t
+BME280_ready( Sensor *s )
+{
+  BME280 *b = s->priv;
+  uint8_t status, value;
+
+  if(( status = Regmap_read( &b->map, BME280_STATUS, &value )) != I2C_OK )
+    return status;
+  return ( value & BME280_MEASURING ) ? SENSOR_BUSY : I2C_OK;
+}
+
+
+//  uint8_t
+//  BME280_fetch( Sensor *s, uint8_t *raw )
+//  Read pressure, temperature and humidity in one 8-byte burst, so all three belong to
+//  the same conversion.
+static uint8_t
+BME280_fetch( Sensor *s, uint8_t *raw )
+{
+  BME280 *b = s->priv;
+
+  return Regmap_readBlock( &b->map, BME280_DATA, raw, 8 );
+}
+
+
+//  uint8_t
+//  BME280_compensate( const BME280_Calib *cal, const uint8_t *raw, Sensor_Reading *r )
+//  The integer compensation formulas of the BME280 datasheet (section 8.2). Temperature
+//  comes out in 0.01 degrees, pressure in Pa, and humidity in 1/1024 percent. Temperature
+//  must be done first, since t_fine is used by the other two.
+uint8_t
+BME280_compensate( const BME280_Calib *cal, const uint8_t *raw, Sensor_Reading *r )
+{
+  int32_t  adcP = raw[0] << 12 | raw[1] << 4 | raw[2] >> 4;
+  int32_t  adcT = raw[3] << 12 | raw[4] << 4 | raw[5] >> 4;
+  int32_t  adcH = raw[6] << 8  | raw[7];
+  int32_t  var1, var2, tFine, t100;
+  uint32_t p;
+
+  if( cal->P1 == 0 )
+    return SENSOR_BADDATA;
+
+  // Temperature
+  var1  = (( adcT >> 3 ) - ((int32_t)cal->T1 << 1 )) * cal->T2 >> 11;
+  var2  = (( adcT >> 4 ) - (int32_t)cal->T1 );
+  var2  = ((( var2 * var2 ) >> 12 ) * cal->T3 ) >> 14;
+  tFine = var1 + var2;
+  t100  = ( tFine * 5 + 128 ) >> 8;
+  r->temp = fix16_from100( t100 );
+
+  // Pressure, 32-bit version
+  var1 = ( tFine >> 1 ) - 64000;
+  var2 = ((( var1 >> 2 ) * ( var1 >> 2 )) >> 11 ) * cal->P6;
+  var2 = var2 + (( var1 * cal->P5 ) << 1 );
+  var2 = ( var2 >> 2 ) + ((int32_t)cal->P4 << 16 );
+  var1 = ((( cal->P3 * ((( var1 >> 2 ) * ( var1 >> 2 )) >> 13 )) >> 3 ) +
+          (( cal->P2 * var1 ) >> 1 )) >> 18;
+  var1 = (( 32768 + var1 ) * (int32_t)cal->P1 ) >> 15;
+  if( var1 == 0 )
+    return SENSOR_BADDATA;              // Avoid a division by zero
+  p = ((uint32_t)( 1048576 - adcP ) - ( var2 >> 12 )) * 3125;
+  if( p < 0x80000000 )
+    p = ( p << 1 ) / (uint32_t)var1;
+  else
+    p = ( p / (uint32_t)var1 ) * 2;
+  var1 = ( cal->P9 * (int32_t)((( p >> 3 ) * ( p >> 3 )) >> 13 )) >> 12;
+  var2 = ((int32_t)( p >> 2 ) * cal->P8 ) >> 13;
+  p    = (uint32_t)((int32_t)p + (( var1 + var2 + cal->P7 ) >> 4 ));
+  // Pa to hPa in Q16.16: p * 65536 / 100 = p * 655.36, done as p * 655 + p * 0.36. 0.36
+  // is 5898 / 16384. Stays within 32 bits up to 1100 hPa.
+  r->press = (fix16_t)( p * 655 + (( p * 5898 ) >> 14 ));
+
+  // Humidity
+  var1 = tFine - 76800;
+  var2 = (((( var1 * cal->H6 ) >> 10 ) *
+           ((( var1 * (int32_t)cal->H3 ) >> 11 ) + 32768 )) >> 10 ) + 2097152;
+  var2 = ( var2 * cal->H2 + 8192 ) >> 14;
+  var1 = (((( adcH << 14 ) - ((int32_t)cal->H4 << 20 ) - ( cal->H5 * var1 )) +
+           16384 ) >> 15 ) * var2;
+  var1 = var1 - ((((( var1 >> 15 ) * ( var1 >> 15 )) >> 7 ) * (int32_t)cal->H1 ) >> 4 );
+  if( var1 < 0 )
+    var1 = 0;
+  else if( var1 > 419430400 )
+    var1 = 419430400;
+  r->humid = ( var1 >> 12 ) << 6;       // Q22.10 to Q16.16
+
+  r->valid = SENSOR_TEMP | SENSOR_HUMID | SENSOR_PRESS;
+  return I2C_OK;
+}
+
+
+//  uint8_t
+//  BME280_decode( Sensor *s, const uint8_t *raw, Sensor_Reading *r )
+//  Compensate the raw data with the calibration of this sensor.
+static uint8_t
+BME280_decode( Sensor *s, const uint8_t *raw, Sensor_Reading *r )
+{
+  BME280 *b = s->priv;
+
+  return BME280_compensate( &b->cal, raw, r );
+}
+
+
+const Sensor_Driver BME280_driver =
+{
+  "BME280", SENSOR_TEMP | SENSOR_HUMID | SENSOR_PRESS, 8, BME280_POWERUP_MS, BME280_MEAS_MS,
+  BME280_init, BME280_start, BME280_ready, BME280_fetch, BME280_decode, 0
+};
+
+#endif /* __STM32F030_BME280_LIB_C */
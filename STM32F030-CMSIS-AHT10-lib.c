@@ -35,12 +35,13 @@
 //  ------------------------------------------------------------------------------------------
 //  Routines in this Library
 //
-//  void
+//  uint8_t
 //  AHT10_init( I2C_TypeDef *this I2C, uint32_t I2CSpeed )
 //    Initialize the specified I2C interface (I2C1) at the specified I2C speed. Then
-//    initialize the AHT10 unit to its default calibrated values.
+//    initialize the AHT10 unit to its default calibrated values. Returns I2C_OK, or the I2C
+//    error code if the sensor did not respond.
 //
-//  void
+//  uint8_t
 //  AHT10_readSensorData( uint8_t *data )
 //    Called with a pointer to an array of at least 6 uint8_t ints.
 //    Sends command to trigger a measurement. Then reads in the measured data after 75 ms.
@@ -49,19 +50,54 @@
 //    The status register should have a value of 0x19 if a normal temperature/humidity
 //    conversion occurred. A status value of 0x99 indicates that there was not sufficient time
 //    to complete the measurement.
+//    Returns I2C_OK, or the I2C error code if either transaction failed.
 //    Note that, after powering up the sensor, the AHT10_init routine must be called one time
 //    before calling this routine for the first time. Subsequent calls to this routine do not
 //    require additional calls to AHT10_init();
 //
 //  uint8_t
+//  AHT10_trigger( void )
+//  uint8_t
+//  AHT10_readResult( uint8_t *data )
+//    The two halves of AHT10_readSensorData. AHT10_trigger starts a measurement and returns
+//    at once. AHT10_readResult reads the 6 data bytes, and should be called no sooner than
+//    AHT10_MEAS_MS milliseconds later. This lets the program do other work while the sensor
+//    measures. Both return I2C_OK or an I2C error code.
+//
+//  uint8_t
+//  AHT10_busInit( const AHT10_Bus *bus, void *dev )
+//  uint8_t
+//  AHT10_busTrigger( const AHT10_Bus *bus, void *dev )
+//  uint8_t
+//  AHT10_busRead( const AHT10_Bus *bus, void *dev, uint8_t *data )
+//    The AHT10 protocol (command bytes and the waits after them) on any bus: the write and
+//    read routines of bus are called with dev. AHT10_init, AHT10_trigger and
+//    AHT10_readResult use them with AHT10_i2cBus, and AHT10_driver in
+//    STM32F030-AHT10-Sensor-lib.c with an I2C device handle.
+//
+//  uint8_t
+//  AHT10_convert( const uint8_t *data, fix16_t *temp, fix16_t *humid )
+//    Convert the 6 data bytes read from the sensor to temperature and humidity as in
+//    AHT10_getTempHumid. Returns the sensor status byte.
+//
+//  uint8_t
+//  AHT10_getTempHumid( fix16_t *temp, fix16_t *humid )
+//    Gets temperature and humidity data from the AHT10 sensor at full resolution as Q16.16
+//    fixed-point values (see STM32F030-Fixed-lib.c). temp is the temperature in Celsius,
+//    and humid is the relative humidity in percent.
+//    The return value is the sensor status byte, or AHT10_ERROR (0xFF) if the sensor could
+//    not be read over I2C.
+//
+//  uint8_t
 //  AHT10_getTempHumid100( int16_t *temp100, int16_t *humid100 )
 //    Gets temperature and humidity data from the AHT10 I2C temperature and humidity sensor.
 //    Data is passed via reference to temp100 and humid100 integer values. temp100 is 100
-//    times the value of the temperature in Celsius, and humid100 is 100 times the relative
-//    humidity.
-//    For example, temp100 = 2753 indicates an actual temperature of 27.53 degrees Celsius.
-//    Likewise, humid100 = 67 indicates an actual humidity of 0.67 (67%).
-//    The return value is the sensor status byte.
+//    times the value of the temperature in Celsius, and humid100 is the relative humidity
+//    in whole percent.
+//    For example, temp100 = 2753 indicates an actual temperature of 27.53 degrees Celsius,
+//    and humid100 = 67 indicates a relative humidity of 67%.
+//    The return value is the sensor status byte, or AHT10_ERROR (0xFF) if the sensor could
+//    not be read over I2C.
 //
 //  void
 //  i100toa( int16_t realV, char *thisString )
@@ -75,12 +111,11 @@
 #ifndef __STM32F103_CMSIS_AHT10_LIB_C
 #define __STM32F103_CMSIS_AHT10_LIB_C
 
-#include <string.h>
-#include <stdlib.h>
-
 #include "stm32f030x6.h"              // Primary CMSIS header file
+#include "STM32F030-MiniLibc-lib.c"   // strcpy, strcat, itoa, abs
 #include "STM32F030-CMSIS-I2C-lib.c"  // I2C library
 #include "STM32F030-Delay-lib.c"      // pause and delay_us library
+#include "STM32F030-Fixed-lib.c"      // Fixed-point conversions
 
 I2C_TypeDef *AHT10_I2C;               // Global variable to point to the I2C interface used for
                                       // the I2C AHT10 routines. 
@@ -95,29 +130,123 @@ I2C_TypeDef *AHT10_I2C;               // Global variable to point to the I2C int
 #define AHT10_TRIG_D1   0x00  // 3rd byte to trigger measurement
 #define AHT10_CHAR_DEG  0xDF  // Degree symbol character
 #define AHT10_CHAR_DOT  0xA5  // Center dot Character
+#define AHT10_ERROR     0xFF  // Returned instead of the status byte on an I2C error
+#define AHT10_BUSY      0x80  // Status bit set while a measurement is in progress
+#define AHT10_POWERUP_MS  40  // Wait after power-up before the first command (20 ms min.)
+#define AHT10_MEAS_MS     75  // Time from measurement trigger until the data is ready
 
+//  Write or read n bytes as one transaction with the sensor dev. Each routine returns
+//  I2C_OK or an I2C error code.
+typedef struct
+{
+  uint8_t ( *write )( void *dev, const uint8_t *data, uint8_t n );
+  uint8_t ( *read )( void *dev, uint8_t *data, uint8_t n );
+} AHT10_Bus;
 
-//  void
+
+//  uint8_t
+//  AHT10_busInit( const AHT10_Bus *bus, void *dev )
+//    Send the initialization command that loads the calibration, and give the sensor time
+//    to load it. Returns I2C_OK, or the I2C error code.
+uint8_t
+AHT10_busInit( const AHT10_Bus *bus, void *dev )
+{
+  // 0xE1: Init command, 0x08: 2nd init byte to set CAL bit, 0x00: Finish command with 0-byte
+  const uint8_t initCmd[3] = { AHT10_INIT, AHT10_INIT_D0, AHT10_INIT_D1 };
+  uint8_t status;
+
+  status = bus->write( dev, initCmd, 3 );
+  delay_us( 40 );                         // Give the sensor time to load its calibration
+  return status;
+}
+
+
+//  uint8_t
+//  AHT10_busTrigger( const AHT10_Bus *bus, void *dev )
+//    Send the command to trigger a measurement. Returns I2C_OK, or the I2C error code.
+uint8_t
+AHT10_busTrigger( const AHT10_Bus *bus, void *dev )
+{
+  // 0xAC, 0x33, 0x00: Measurement trigger command bytes
+  const uint8_t trigCmd[3] = { AHT10_TRIG_MEAS, AHT10_TRIG_D0, AHT10_TRIG_D1 };
+
+  return bus->write( dev, trigCmd, 3 );
+}
+
+
+//  uint8_t
+//  AHT10_busRead( const AHT10_Bus *bus, void *dev, uint8_t *data )
+//    Read the 6 bytes of a measurement into data: The status register, humidity [19:4],
+//    humidity [3:0] / temperature [19:16], and temperature [15:0]. Returns I2C_OK, or the
+//    I2C error code.
+uint8_t
+AHT10_busRead( const AHT10_Bus *bus, void *dev, uint8_t *data )
+{
+  uint8_t status;
+
+  status = bus->read( dev, data, 6 );     // The last byte is NAK'ed
+  delay_us( 420 );                        // Minimum gap before the next transaction
+  return status;
+}
+
+
+//  The bus of the AHT10_ routines: the sensor at AHT10_ADD on the I2C interface dev.
+static uint8_t
+AHT10_i2cWrite( void *dev, const uint8_t *data, uint8_t n )
+{
+  return I2C_writeN( dev, AHT10_ADD, data, n );
+}
+
+
+static uint8_t
+AHT10_i2cRead( void *dev, uint8_t *data, uint8_t n )
+{
+  return I2C_readN( dev, AHT10_ADD, data, n );
+}
+
+
+const AHT10_Bus AHT10_i2cBus = { AHT10_i2cWrite, AHT10_i2cRead };
+
+
+//  uint8_t
 //  AHT10_init( I2C_TypeDef *this I2C )
 //    Initialize the specified I2C interface (I2C1) at the specified I2C speed. Then
-//    initialize the AHT10 unit to its default calibrated values.
-void
+//    initialize the AHT10 unit to its default calibrated values. Returns I2C_OK, or the I2C
+//    error code if the sensor did not respond.
+uint8_t
 AHT10_init( I2C_TypeDef *thisI2C, uint32_t I2CSpeed )
 {
   AHT10_I2C = thisI2C;                     // Associate AHT10_ routines with this I2C interface
   I2C_init( AHT10_I2C, I2CSpeed );         // Initialize this I2C2 interface
-  I2C_setAddress( AHT10_I2C, AHT10_ADD );
-  I2C_setNBytes(  AHT10_I2C, 3 );
-  I2C_start( AHT10_I2C );                  // I2C start
-  I2C_write( AHT10_I2C, AHT10_INIT    );   // 0xE1: Init command
-  I2C_write( AHT10_I2C, AHT10_INIT_D0 );   // 0x08: 2nd init byte to set CAL bit
-  I2C_write( AHT10_I2C, AHT10_INIT_D1 );   // 0x00: Finish command with 0-byte
-  I2C_stop(  AHT10_I2C );                  // I2C stop
-delay_us(40);
+  return AHT10_busInit( &AHT10_i2cBus, AHT10_I2C );
 }
 
 
-//  void
+//  uint8_t
+//  AHT10_trigger( void )
+//    Send the command to trigger a measurement and return without waiting for it. The data
+//    can be read with AHT10_readResult after AHT10_MEAS_MS milliseconds. Returns I2C_OK, or
+//    the I2C error code.
+uint8_t
+AHT10_trigger( void )
+{
+  return AHT10_busTrigger( &AHT10_i2cBus, AHT10_I2C );
+}
+
+
+//  uint8_t
+//  AHT10_readResult( uint8_t *data )
+//    Read the 6 bytes of a measurement started by AHT10_trigger into data (see
+//    AHT10_busRead). If the AHT10_BUSY bit of the status byte is set, the measurement was
+//    not yet finished. Returns I2C_OK, or the I2C error code.
+uint8_t
+AHT10_readResult( uint8_t *data )
+{
+  return AHT10_busRead( &AHT10_i2cBus, AHT10_I2C, data );
+}
+
+
+//  uint8_t
 //  AHT10_readSensorData( uint8_t *data )
 //    Called with a pointer to an array of at least 6 uint8_t ints.
 //    Sends command to trigger a measurement. Then reads in the measured data after 75 ms.
@@ -126,35 +255,61 @@ delay_us(40);
 //    The status register should have a value of 0x19 if a normal temperature/humidity
 //    conversion occurred. A status value of 0x99 indicates that there was not sufficient time
 //    to complete the measurement.
+//    Returns I2C_OK, or the I2C error code if either transaction failed, in which case the
+//    contents of data are not valid.
 //    Note that, after powering up the sensor, the AHT10_init routine must be called one time
 //    before calling this routine for the first time. Subsequent calls to this routine do not
 //    require additional calls to AHT10_init();
-void
+uint8_t
 AHT10_readSensorData( uint8_t *data )
 {
-  I2C_setAddress( AHT10_I2C, AHT10_ADD );
-  I2C_setNBytes( AHT10_I2C, 3 );
-  I2C_start( AHT10_I2C );                   // Send command to trigger measurement
-  I2C_write( AHT10_I2C, AHT10_TRIG_MEAS );  // 0xAC: 1st measurement trigger command byte
-  I2C_write( AHT10_I2C, AHT10_TRIG_D0   );  // 0x33: 2nd measurement trigger command byte
-  I2C_write( AHT10_I2C, AHT10_TRIG_D1   );  // 0x00: 3rd measurement trigger command byte 
-  I2C_stop( AHT10_I2C );                    // Stop this transaction
-  
-  delay_us( 75e3 );                         // Wait for measurement to complete
-
-  I2C_setNBytes( AHT10_I2C, 6 );
-  I2C_setReadMode( AHT10_I2C );         // Set sensor to read mode
-  I2C_start( AHT10_I2C );               // Send command to read data registers
-  data[0] = I2C_read( AHT10_I2C );      // Read Status register, send ACK
-  data[1] = I2C_read( AHT10_I2C );      // Read Humidity [19:12], send ACK
-  data[2] = I2C_read( AHT10_I2C );      // Read Humidity [11:4], send ACK
-  data[3] = I2C_read( AHT10_I2C );      // Read Humidity [3:0] / Temperature [19:16],
-                                        // and send ACK.
-  data[4] = I2C_read( AHT10_I2C );      // Read Temperature [15:8], send ACK
-  data[5] = I2C_read( AHT10_I2C );      // Read Temperature [7:0], send NAK
-  I2C_stop( AHT10_I2C );                // Stop this transaction
-  I2C_setWriteMode( AHT10_I2C );        // Restore sensor to write mode
-delay_us(420);
+  uint8_t status;
+
+  status = AHT10_trigger( );                // Trigger measurement
+  if( status != I2C_OK )
+    return status;
+  delay_us( AHT10_MEAS_MS * 1000 );         // Wait for measurement to complete
+  return AHT10_readResult( data );
+}
+
+
+//  uint8_t
+//  AHT10_convert( const uint8_t *data, fix16_t *temp, fix16_t *humid )
+//    Separate the raw 20-bit humidity and temperature readings from the 6 data bytes read
+//    from the sensor, and convert them to Q16.16 temperature in Celsius and relative
+//    humidity in percent with a multiply and a shift. Returns the sensor status byte,
+//    data[0].
+uint8_t
+AHT10_convert( const uint8_t *data, fix16_t *temp, fix16_t *humid )
+{
+  uint32_t tempData, humidData;   // Contains the separated raw temperature and humidity
+                                  // data collected from the sensor
+
+  humidData = ( data[1]<<16           | data[2]<<8 | data[3] ) >> 4;
+  tempData  = ( data[3] & 0x0F ) <<16 | data[4]<<8 | data[5] ;
+
+  *temp  = fix16_fromRaw20( tempData, 200, -50 ); // tempC  = ( tempV / 2^20 ) * 200 - 50
+  *humid = fix16_fromRaw20( humidData, 100, 0 );  // humid% = ( humidV / 2^20 ) * 100
+  return data[0];                           // Return device status byte Should be 0x19. See
+                                            // datasheet for details.
+}
+
+
+//  uint8_t
+//  AHT10_getTempHumid( fix16_t *temp, fix16_t *humid )
+//    Gets temperature and humidity data from the AHT10 sensor at full resolution as Q16.16
+//    fixed-point values. temp is the temperature in Celsius, and humid is the relative
+//    humidity in percent. The raw 20-bit readings are scaled with a multiply and a shift.
+//    The return value is the sensor status byte, or AHT10_ERROR if the sensor could not be
+//    read over I2C, in which case temp and humid are not changed.
+uint8_t
+AHT10_getTempHumid( fix16_t *temp, fix16_t *humid )
+{
+  uint8_t ahtData[6];             // Contains the 6 bytes data sent from the sensor
+
+  if( AHT10_readSensorData( ahtData ) != I2C_OK )  // Read raw data from the sensor
+    return AHT10_ERROR;
+  return AHT10_convert( ahtData, temp, humid );
 }
 
 
@@ -162,34 +317,24 @@ delay_us(420);
 //  AHT10_getTempHumid100( int16_t *temp100, int16_t *humid100 )
 //    Gets temperature and humidity data from the AHT10 I2C temperature and humidity sensor.
 //    Data is passed via reference to temp100 and humid100 integer values. temp100 is 100
-//    times the value of the temperature in Celsius, and humid100 is 100 times the relative
-//    humidity.
-//    For example, temp100 = 2753 indicates an actual temperature of 27.53 degrees Celsius.
-//    Likewise, humid100 = 67 indicates an actual humidity of 0.67 (67%).
-//    The return value is the sensor status byte.
+//    times the value of the temperature in Celsius, and humid100 is the relative humidity
+//    in whole percent.
+//    For example, temp100 = 2753 indicates an actual temperature of 27.53 degrees Celsius,
+//    and humid100 = 67 indicates a relative humidity of 67%.
+//    The return value is the sensor status byte, or AHT10_ERROR if the sensor could not be
+//    read over I2C, in which case temp100 and humid100 are not changed.
 uint8_t
 AHT10_getTempHumid100( int16_t *temp100, int16_t *humid100 )
 {
-  uint8_t ahtData[6];             // Contains the 6 bytes data sent from the sensor
-  uint32_t tempData, humidData;   // Contains the separated raw temperature and humidity
-                                  // data collected from the sensor
+  fix16_t temp, humid;            // Full-resolution readings in Q16.16
+  uint8_t status;
 
-  AHT10_readSensorData( ahtData );          // Read raw data from the sensor
-
-                                            // Separate out humidity and temperature data
-  humidData = ( ahtData[1]<<16           | ahtData[2]<<8 | ahtData[3] ) >> 4;
-  tempData  = ( ahtData[3] & 0x0F ) <<16 | ahtData[4]<<8 | ahtData[5] ;
-
-  *temp100 = (tempData*625) / 32768 - 5000; // Calculate temperature x 100.
-                                            // This is done to avoid the overhead of floating-
-                                            // point math routines.
-                                            // tempC = (( tempV * 200 ) / 2^20 ) - 50
-                                            // 100 x tempC = tempV  * 20000 ) / 2^20 ) - 5000
-                                            // Reduces to: (( tempV * 625 ) / 32768 ) - 5000
-  
-  *humid100 = humidData/10486;              // Calculate humidity x 100 (i.e. 65% = 65)
-  return ahtData[0];                        // Return device status byte Should be 0x19. See
-                                            // datasheet for details.
+  status    = AHT10_getTempHumid( &temp, &humid );
+  if( status == AHT10_ERROR )
+    return status;
+  *temp100  = fix16_to100( temp );          // Round to nearest 0.01 degree
+  *humid100 = fix16_round( humid );         // Round to nearest whole percent
+  return status;
 }
 
 
@@ -200,17 +345,19 @@ AHT10_getTempHumid100( int16_t *temp100, int16_t *humid100 )
 //    in question is 12.36, then 1236 is passed via realV. The resulting string is 12.4,
 //    because 12.36 rounds up to 12.4. Negative numbers and more complex rounding work as
 //    expected. For example, -2.35, passed as -235, returns "-2.4", and 19.96, passed as 1996,
-//    "w" = -2 and "d" = 4. Also, 19.96 would return "w" = 20 and "d" = 0.
+//    returns "20.0". Values that round to zero, such as -0.04, return "0.0" with no sign.
+//    thisString must hold at least 7 characters ("-327.7" plus the terminating zero).
 void
 i100toa( int16_t realV, char *thisString )
 {
   char tmpString[6];              // Used to build output string. Might need to hold "-100\0"
 
-  int16_t  x = abs( realV );      // realV = 2596 (target: 26.0C) -> x = 2596
-  int16_t  w = x / 100;           // w (whole part) = 25
-  int16_t  f = x - ( w * 100 );   // f (fraction)   = 2596 - 2500 = 96
-  int16_t  d = f / 10;            // d (decimal)    = 9
-  int16_t  r = f - ( d * 10 );    // r (remainder)  = 96 - 90 = 6
+  int32_t  x = abs( realV );      // realV = 2596 (target: 26.0C) -> x = 2596. 32 bits are
+                                  // used so that -32768 becomes +32768 without overflow.
+  int32_t  w = x / 100;           // w (whole part) = 25
+  int32_t  f = x - ( w * 100 );   // f (fraction)   = 2596 - 2500 = 96
+  int32_t  d = f / 10;            // d (decimal)    = 9
+  int32_t  r = f - ( d * 10 );    // r (remainder)  = 96 - 90 = 6
 
   if( r>=5 )                      // Round up if needed
   {
@@ -221,8 +368,8 @@ i100toa( int16_t realV, char *thisString )
       w = w + 1;                  // w = 26   bump up w. 
     }
   }   
-  if( realV < 0 )                 // Start with negative sign if original value was negative
-    strcpy( thisString, "-" );
+  if(( realV < 0 ) && ( w || d )) // Start with negative sign if original value was negative
+    strcpy( thisString, "-" );    // and does not round to zero (-0.04 shows as "0.0").
   else                            // otherwise start with blank string.
     strcpy( thisString, "" );
 
@@ -47,29 +47,42 @@
 //    10 kHz and speeds above 400 kHz will default to 400 kHz.
 // --------------------------------------------------------------------------------------------
 //  void
+//  I2C_setSpeed( I2C_TypeDef *thisI2C, uint32_t I2CSpeed )
+//    Change the speed of an initialized interface, with the same limits as I2C_init. Must
+//    not be called in the middle of a transaction.
+// --------------------------------------------------------------------------------------------
+//  void
+//  I2C_setSpeedLimits( I2C_TypeDef *thisI2C, uint32_t minSpeed, uint32_t maxSpeed )
+//    Let the speed change automatically between minSpeed and maxSpeed according to the
+//    error rate (see Speed Adaptation below). Equal limits switch adaptation off.
+// --------------------------------------------------------------------------------------------
+//  void
+//  I2C_crcError( I2C_TypeDef *thisI2C )
+//    Called by device drivers when the checksum of data read from a device is wrong, so
+//    that corrupted data counts as an error of the bus.
+// --------------------------------------------------------------------------------------------
+//  uint8_t
 //  I2C_start( I2C_TypeDef *thisI2C )
-//    Set the start bit and wait for acknowledge that it was set.
+//    Set the start bit and wait for acknowledge that it was set. Returns I2C_OK or an error
+//    code.
 // --------------------------------------------------------------------------------------------
 //  void
 //  I2C_setAddress( I2C_TypeDef *thisI2C, uint8_t address )
 //    Write the address to the SADD bits of the CR2 register.
 // --------------------------------------------------------------------------------------------
 //   void
-//   I2C_stop( I2C_TypeDef *thisI2C )
-//     Set and then clear the stop bit.
-// --------------------------------------------------------------------------------------------
-//   void
 //   I2C_setNBytes( I2C_TypeDef *thisI2C, uint8_t nBytes )
 //     Set the number of bytes to be written.
 // --------------------------------------------------------------------------------------------
-//   void
+//   uint8_t
 //   I2C_write( I2C_TypeDef *thisI2C, uint8_t data )
-//     Write a byte of data to the I2C interface.
+//     Write a byte of data to the I2C interface. Returns I2C_OK or an error code.
 // --------------------------------------------------------------------------------------------
-//  void
+//  uint8_t
 //  I2C_stop( I2C_TypeDef *thisI2C )
-//    Send the I2C stop bit and wait 20 us to allow enough time for next I2C command to occur
-//    properly.
+//    Send the I2C stop bit and wait for it to complete. If the transfer was ended by a NACK,
+//    the interface has already sent the stop, so only the flags are cleared. Returns I2C_OK
+//    or an error code.
 // --------------------------------------------------------------------------------------------
 //   void
 //   I2C_setReadMode( I2C_TypeDef *thisI2C )
@@ -81,10 +94,56 @@
 // --------------------------------------------------------------------------------------------
 //   uint8_t
 //   I2C_read( I2C_TypeDef *thisI2C )
-//     Read a byte from the I2C interface.
+//     Read a byte from the I2C interface. Returns 0xFF if the byte could not be read, and
+//     the error is recorded in I2C_lastError.
+// --------------------------------------------------------------------------------------------
+//   uint8_t
+//   I2C_writeN( I2C_TypeDef *thisI2C, uint8_t address, const uint8_t *data, uint8_t n )
+//     Write n bytes to the device at address as one complete transaction. Returns I2C_OK or
+//     an error code.
+// --------------------------------------------------------------------------------------------
+//   uint8_t
+//   I2C_readN( I2C_TypeDef *thisI2C, uint8_t address, uint8_t *data, uint8_t n )
+//     Read n bytes from the device at address as one complete transaction. Returns I2C_OK
+//     or an error code.
+// --------------------------------------------------------------------------------------------
+//   void
+//   I2C_recover( I2C_TypeDef *thisI2C )
+//     Free a stuck bus. Clocks SCL by hand until the device holding SDA low lets go, sends
+//     a stop, and resets the I2C interface.
 //
 // --------------------------------------------------------------------------------------------
 //
+//  Error Handling:
+//  ---------------
+//  Every wait on the I2C interface is limited to I2C_TIMEOUT_US microseconds (default
+//  25 ms, the SMBus timeout), so that a missing device, a bus held low, or a device that
+//  stretches the clock too long cannot hang the program. The routines that wait return one
+//  of the following codes, which is also stored in I2C_lastError (I2C_lastError is only
+//  cleared by the program):
+//    I2C_OK        0  No error
+//    I2C_NACK      1  Address or data byte was not acknowledged
+//    I2C_BUSERR    2  Misplaced START or STOP on the bus
+//    I2C_ARLO      3  Arbitration lost to another master
+//    I2C_TIMEOUT   4  The interface did not respond in time. The bus is probably stuck.
+//  I2C_writeN and I2C_readN always finish the transaction, and call I2C_recover after a
+//  timeout.
+//
+//  Speed Adaptation:
+//  -----------------
+//  The result of every I2C_writeN and I2C_readN transaction, and every checksum error
+//  reported with I2C_crcError, is counted in I2C1_health. The totals since reset are kept
+//  in results[] (indexed by status code) and crcErrors. The errors are also counted in
+//  windows of I2C_ADAPT_WINDOW transactions (default 32). When speed limits are set with
+//  I2C_setSpeedLimits, the speed is checked at the end of each window:
+//    - More than I2C_ADAPT_MAX_ERRORS errors (default 1): The speed is halved, but not
+//      below minSpeed.
+//    - No errors in upAfter windows in a row: The speed is doubled, but not above maxSpeed.
+//      upAfter starts at I2C_ADAPT_UP_WINDOWS (default 4). Each time a step up is followed
+//      straight away by a step down, upAfter is doubled (up to 128), so a bus that only
+//      just fails at the faster speed is not retried too often.
+//  So each bus settles at the fastest speed that works reliably with its cables.
+//
 //  Normal Write Command Flow:
 //  --------------------------
 //  I2C_setAddress( I2C1, deviceI2CAddress )    (Set once per device)
@@ -105,6 +164,61 @@
 //  I2C_stop( I2C1 )
 //  I2C_setWriteMode( I2C1 )
 //
+// --------------------------------------------------------------------------------------------
+//
+//  Transaction Trace:
+//  ------------------
+//  When I2C_TRACE is defined (for example, -DI2C_TRACE), every transaction (from I2C_start
+//  to I2C_stop) is recorded into I2C_traceBuf, a compact binary log of I2C_TRACE_SIZE bytes
+//  (default 256). The log can be read out with a debugger and replayed on a PC against the
+//  simulated bus with host/i2c-replay (see there), so that a capture from the field can be
+//  used as a regression test. SysTick_init must be called for the timestamps to be valid.
+//  When I2C_TRACE is not defined, the trace hooks compile to nothing.
+//
+//  I2C_traceLen is the number of bytes used in the log. Recording stops when the log is
+//  full, and I2C_traceDropped counts the transactions that did not fit. I2C_traceReset()
+//  clears the log. Each record in the log is:
+//
+//    Byte 0     Bit 7: 1 = read, 0 = write. Bits 6:0: 7-bit device address.
+//    Byte 1     Number of data bytes n that follow the header.
+//    Byte 2     Result: I2C_TRACE_NACK, I2C_TRACE_BERR, I2C_TRACE_ARLO, I2C_TRACE_TIMEOUT,
+//               I2C_TRACE_TRUNC bits, or 0 if the transaction completed normally.
+//    Byte 3:4   Time from the start of the previous transaction, in us (little endian,
+//               0xFFFF if longer).
+//    Byte 5:6   Time from start to stop of this transaction, in us (little endian, 0xFFFF if
+//               longer).
+//    Byte 7...  The n data bytes, in the order they were sent or received.
+//
+// --------------------------------------------------------------------------------------------
+//
+//  Transaction Statistics:
+//  -----------------------
+//  When I2C_STATS is defined, I2C_writeN and I2C_readN also keep statistics in I2C_stats.
+//  Each transaction costs two SysTick_us reads and a few additions, so the statistics may
+//  be left on in normal use. SysTick_init must be called first. The results of the
+//  transactions are counted in I2C1_health.results (always on). I2C_stats holds:
+//
+//    bytes      Data bytes moved by transactions that completed without error
+//    busyMs     Time spent in transactions, in ms, plus busyUs microseconds
+//    startMs    SysTick_ms value when the statistics were last cleared
+//    dropped    Transactions with devices that did not fit in dev[]
+//    dev[]      For each of the first I2C_STATS_DEVICES (default 4) device addresses seen:
+//                 address   7-bit device address
+//                 count     Transactions, and errors: those that did not return I2C_OK
+//                 errors
+//                 maxUs     Longest transaction
+//                 hist[k]   Transactions that took 2^k to 2^(k+1)-1 us (hist[0]: 0 or
+//                           1 us). The last entry, k = I2C_STATS_BUCKETS - 1 (default
+//                           11), also counts all longer transactions (2048 us or more).
+//
+//  The counters are 32 bits wide, so at one transaction per ms they last for 49 days
+//  before they wrap. Each dev[] entry takes 60 bytes of RAM with the default
+//  I2C_STATS_BUCKETS.
+//
+//  I2C_statsLoad() returns the share of the time since startMs that the bus was busy, in
+//  tenths of a percent, and I2C_statsReset() clears the statistics. When I2C_STATS is not
+//  defined, the statistics hooks compile to nothing.
+//
 //  ==========================================================================================
 
 
@@ -113,6 +227,359 @@
 
 
 #include "stm32f030x6.h"          // Primary CMSIS header file
+#include "STM32F030-RamFunc-lib.c" // RAMFUNC placement of the byte pump routines
+#include "STM32F030-Delay-lib.c"   // DELAY_CLK_MHZ and delay_us for bus recovery
+
+//  Status codes returned by the I2C routines
+#define I2C_OK       0                // No error
+#define I2C_NACK     1                // Address or data byte was not acknowledged
+#define I2C_BUSERR   2                // Misplaced START or STOP on the bus
+#define I2C_ARLO     3                // Arbitration lost to another master
+#define I2C_TIMEOUT  4                // Interface did not respond in time
+
+#ifndef I2C_TIMEOUT_US
+#define I2C_TIMEOUT_US  25000         // Longest wait for the I2C interface
+#endif
+
+// Number of polling passes for I2C_TIMEOUT_US. A polling pass takes at least 8 clock cycles,
+// so the actual timeout is I2C_TIMEOUT_US or somewhat longer.
+#define I2C_TIMEOUT_LOOPS ( (uint32_t)I2C_TIMEOUT_US * DELAY_CLK_MHZ / 8 )
+
+uint8_t I2C_lastError;                // Last error code reported by any I2C routine
+
+#ifndef I2C_ADAPT_WINDOW
+#define I2C_ADAPT_WINDOW      32      // Transactions per error-rate window
+#endif
+#ifndef I2C_ADAPT_MAX_ERRORS
+#define I2C_ADAPT_MAX_ERRORS  1       // Errors allowed per window before slowing down
+#endif
+#ifndef I2C_ADAPT_UP_WINDOWS
+#define I2C_ADAPT_UP_WINDOWS  4       // Error-free windows needed before speeding up
+#endif
+
+typedef struct
+{
+  uint32_t speed;                     // Current speed in Hz
+  uint32_t minSpeed;                  // Speed limits for adaptation. Adaptation is off
+  uint32_t maxSpeed;                  // unless minSpeed < maxSpeed.
+  uint32_t results[ 5 ];              // Transactions by result: I2C_OK to I2C_TIMEOUT
+  uint32_t crcErrors;                 // Checksum errors reported by drivers
+  uint16_t stepsUp;                   // Number of speed changes made by adaptation
+  uint16_t stepsDown;
+  uint8_t  transfers;                 // Transactions in the current window
+  uint8_t  errors;                    // Errors in the current window
+  uint8_t  cleanWindows;              // Error-free windows in a row
+  uint8_t  upAfter;                   // Error-free windows needed to step up
+  uint8_t  justUp;                    // Set during the first window after a step up
+} I2C_Health;
+
+I2C_Health I2C1_health;               // Error counts and speed of I2C1
+
+
+#ifdef I2C_TRACE
+
+#include "STM32F030-SysTick-lib.c"    // Timestamps for the trace records
+
+#ifndef I2C_TRACE_SIZE
+#define I2C_TRACE_SIZE  256           // Size of the trace log in bytes
+#endif
+
+#define I2C_TRACE_HDR   7             // Size of a trace record header
+#define I2C_TRACE_NONE  0xFFFF        // No record is open
+
+#define I2C_TRACE_NACK  0x01          // Trace result bits: Address or data not acknowledged
+#define I2C_TRACE_BERR  0x02          //   Bus error (misplaced START or STOP)
+#define I2C_TRACE_ARLO  0x04          //   Arbitration lost
+#define I2C_TRACE_TIMEOUT 0x08        //   Interface did not respond in time
+#define I2C_TRACE_TRUNC 0x80          //   Data bytes did not fit in the log
+
+uint8_t  I2C_traceBuf[ I2C_TRACE_SIZE ];  // Trace log
+uint16_t I2C_traceLen;                    // Number of bytes used in I2C_traceBuf
+uint16_t I2C_traceDropped;                // Number of transactions that did not fit
+uint16_t I2C_traceRec = I2C_TRACE_NONE;   // Start of the record being written
+uint32_t I2C_traceStartUs;                // Start time of the current transaction
+
+
+//  void
+//  I2C_tracePut16( uint16_t index, uint32_t value )
+//  Store value in the log at index as a little-endian 16-bit value, saturating at 0xFFFF.
+static void
+I2C_tracePut16( uint16_t index, uint32_t value )
+{
+  if( value > 0xFFFF )
+    value = 0xFFFF;
+  I2C_traceBuf[ index ]     = value & 0xFF;
+  I2C_traceBuf[ index + 1 ] = value >> 8;
+}
+
+
+//  void
+//  I2C_traceBegin( I2C_TypeDef *thisI2C )
+//  Open a new trace record with the address and direction in CR2. Called by I2C_start.
+void
+I2C_traceBegin( I2C_TypeDef *thisI2C )
+{
+  uint32_t now = SysTick_us();
+
+  if( I2C_traceLen + I2C_TRACE_HDR > I2C_TRACE_SIZE )
+  {
+    I2C_traceRec = I2C_TRACE_NONE;          // No room for this transaction
+    I2C_traceDropped++;
+    return;
+  }
+  I2C_traceRec = I2C_traceLen;
+  I2C_traceBuf[ I2C_traceRec ]     = (( thisI2C->CR2 & I2C_CR2_SADD ) >> 1 ) |
+                                     (( thisI2C->CR2 & I2C_CR2_RD_WRN ) ? 0x80 : 0 );
+  I2C_traceBuf[ I2C_traceRec + 1 ] = 0;
+  I2C_traceBuf[ I2C_traceRec + 2 ] = 0;
+  I2C_tracePut16( I2C_traceRec + 3, now - I2C_traceStartUs );
+  I2C_traceStartUs = now;
+  I2C_traceLen += I2C_TRACE_HDR;
+}
+
+
+//  void
+//  I2C_traceByte( uint8_t data )
+//  Add a data byte to the open trace record. Called by I2C_write and I2C_read.
+void
+I2C_traceByte( uint8_t data )
+{
+  if( I2C_traceRec == I2C_TRACE_NONE )
+    return;
+  if( I2C_traceLen >= I2C_TRACE_SIZE )
+  {
+    I2C_traceBuf[ I2C_traceRec + 2 ] |= I2C_TRACE_TRUNC;
+    return;
+  }
+  I2C_traceBuf[ I2C_traceLen++ ] = data;
+  I2C_traceBuf[ I2C_traceRec + 1 ]++;
+}
+
+
+//  void
+//  I2C_traceEnd( I2C_TypeDef *thisI2C )
+//  Close the open trace record with the result and duration. Called by I2C_stop.
+void
+I2C_traceEnd( I2C_TypeDef *thisI2C )
+{
+  uint32_t isr = thisI2C->ISR;
+
+  if( I2C_traceRec == I2C_TRACE_NONE )
+    return;
+  I2C_traceBuf[ I2C_traceRec + 2 ] |= (( isr & I2C_ISR_NACKF ) ? I2C_TRACE_NACK : 0 ) |
+                                      (( isr & I2C_ISR_BERR  ) ? I2C_TRACE_BERR : 0 ) |
+                                      (( isr & I2C_ISR_ARLO  ) ? I2C_TRACE_ARLO : 0 );
+  I2C_tracePut16( I2C_traceRec + 5, SysTick_us() - I2C_traceStartUs );
+  I2C_traceRec = I2C_TRACE_NONE;
+}
+
+
+//  void
+//  I2C_traceTimeout( void )
+//  Mark the open trace record as timed out. Called by I2C_error, because a timeout leaves
+//  no flag in the ISR register for I2C_traceEnd to find.
+void
+I2C_traceTimeout( void )
+{
+  if( I2C_traceRec != I2C_TRACE_NONE )
+    I2C_traceBuf[ I2C_traceRec + 2 ] |= I2C_TRACE_TIMEOUT;
+}
+
+
+//  void
+//  I2C_traceReset( void )
+//  Clear the trace log.
+void
+I2C_traceReset( void )
+{
+  I2C_traceLen     = 0;
+  I2C_traceDropped = 0;
+  I2C_traceRec     = I2C_TRACE_NONE;
+}
+
+#else  /* I2C_TRACE */
+
+#define I2C_traceBegin( thisI2C )
+#define I2C_traceByte( data )
+#define I2C_traceEnd( thisI2C )
+#define I2C_traceTimeout()
+#define I2C_traceReset()
+
+#endif /* I2C_TRACE */
+
+
+#ifdef I2C_STATS
+
+#include "STM32F030-SysTick-lib.c"    // Transaction times
+
+#ifndef I2C_STATS_DEVICES
+#define I2C_STATS_DEVICES  4          // Device addresses with their own statistics
+#endif
+#ifndef I2C_STATS_BUCKETS
+#define I2C_STATS_BUCKETS  12         // Latency histogram buckets (powers of two in us)
+#endif
+
+typedef struct
+{
+  uint8_t  address;                   // 7-bit device address, 0 if the entry is unused
+  uint16_t maxUs;                     // Longest transaction in us (0xFFFF if longer)
+  uint32_t count;                     // Transactions
+  uint32_t errors;                    // Transactions that failed
+  uint32_t hist[ I2C_STATS_BUCKETS ]; // Transactions by log2 of their duration in us
+} I2C_DevStats;
+
+typedef struct
+{
+  uint32_t     bytes;                 // Data bytes moved without error
+  uint32_t     busyMs;                // Time spent in transactions: busyMs ms plus
+  uint16_t     busyUs;                //   busyUs us (always less than 1000)
+  uint32_t     dropped;               // Transactions with addresses not in dev[]
+  uint32_t     startMs;               // Time when the statistics were cleared
+  I2C_DevStats dev[ I2C_STATS_DEVICES ];
+} I2C_Stats;
+
+I2C_Stats I2C_stats;                  // Transaction statistics
+uint32_t  I2C_statsStartUs;           // Start time of the current transaction
+
+
+//  void
+//  I2C_statsBegin( void )
+//  Note the start time of a transaction. Called by I2C_writeN and I2C_readN.
+static inline void
+I2C_statsBegin( void )
+{
+  I2C_statsStartUs = SysTick_us( );
+}
+
+
+//  void
+//  I2C_statsEnd( I2C_TypeDef *thisI2C, uint8_t status )
+//  Add the finished transaction to the statistics. The address and the number of bytes
+//  are still in CR2. Called by I2C_finish.
+void
+I2C_statsEnd( I2C_TypeDef *thisI2C, uint8_t status )
+{
+  uint32_t      us      = SysTick_us( ) - I2C_statsStartUs;
+  uint8_t       address = ( thisI2C->CR2 & I2C_CR2_SADD ) >> 1;
+  uint8_t       bucket  = 0;
+  I2C_DevStats *d;
+
+  I2C_stats.busyUs += us % 1000;
+  I2C_stats.busyMs += us / 1000;
+  if( I2C_stats.busyUs >= 1000 )
+  {
+    I2C_stats.busyUs -= 1000;
+    I2C_stats.busyMs++;
+  }
+  if( status == I2C_OK )
+    I2C_stats.bytes += ( thisI2C->CR2 & I2C_CR2_NBYTES ) >> I2C_CR2_NBYTES_Pos;
+
+  // Find the entry of the device, or the first unused one
+  for( d = I2C_stats.dev; d < I2C_stats.dev + I2C_STATS_DEVICES; d++ )
+    if( d->address == address || d->address == 0 )
+      break;
+  if( d == I2C_stats.dev + I2C_STATS_DEVICES )
+  {
+    I2C_stats.dropped++;
+    return;
+  }
+  d->address = address;
+  d->count++;
+  if( status != I2C_OK )
+    d->errors++;
+  if( us > d->maxUs )
+    d->maxUs = ( us > 0xFFFF ) ? 0xFFFF : us;
+  while(( us >>= 1 ) && bucket < I2C_STATS_BUCKETS - 1 )
+    bucket++;
+  d->hist[ bucket ]++;
+}
+
+
+//  uint16_t
+//  I2C_statsLoad( void )
+//  Return the bus busy time as a share of the time since the statistics were cleared, in
+//  tenths of a percent (0 to 1000). busyMs * 1000 fits in 32 bits for the first 71 minutes
+//  of busy time; after that, the wall time is scaled down instead.
+uint16_t
+I2C_statsLoad( void )
+{
+  uint32_t wallMs = SysTick_elapsed( I2C_stats.startMs );
+
+  if( wallMs == 0 )
+    return 0;
+  if( I2C_stats.busyMs < 4000000UL )
+    return I2C_stats.busyMs * 1000 / wallMs;
+  return I2C_stats.busyMs / ( wallMs / 1000 );
+}
+
+
+//  void
+//  I2C_statsReset( void )
+//  Clear the statistics and restart the wall time.
+void
+I2C_statsReset( void )
+{
+  uint8_t *p = (uint8_t *)&I2C_stats;
+
+  for( uint16_t i = 0; i < sizeof( I2C_stats ); i++ )
+    p[i] = 0;
+  I2C_stats.startMs = SysTick_ms( );
+}
+
+#else  /* I2C_STATS */
+
+#define I2C_statsBegin()
+#define I2C_statsEnd( thisI2C, status )
+#define I2C_statsReset()
+
+#endif /* I2C_STATS */
+
+
+//  void
+//  I2C_setSpeed( I2C_TypeDef *thisI2C, uint32_t I2CSpeed )
+//    Program the timing register for the specified speed (10 kHz to 400 kHz) and enable
+//    the interface.
+//    NOTE: The timing settings assume an 8 MHz clock.
+void
+I2C_setSpeed( I2C_TypeDef *thisI2C, uint32_t I2CSpeed )
+{
+  uint8_t I2CPresc, I2CSCLL, I2CSCLH;
+
+  if( I2CSpeed > 400E3 )      // Ensure that the specified speed is within operable bounds.
+    I2CSpeed = 400E3;         // If not, then default to the high or low limit.
+  else if( I2CSpeed < 10E3 )
+    I2CSpeed = 10E3;
+
+  if( I2CSpeed < 50E3 )       // Calculate lower speeds with the prescaler set to 1
+  {
+    I2CPresc = 1;
+    I2CSCLH  = (uint32_t)2E6 / I2CSpeed - 5;
+    I2CSCLL  = I2CSCLH + 3;
+  }
+  else                        // Calculte higher speeds with the prescaler set to 0
+  {
+    I2CPresc = 0;
+    I2CSCLH  = (uint32_t)4E6 / I2CSpeed - 9;
+    I2CSCLL  = I2CSCLH + 5;
+  }
+
+  #define I2C_SCLDEL 0x0      // Supposedly these can add a little speed in some cases,
+  #define I2C_SDADEL 0x0      // but probably not strictly required.
+  
+  // Set the I2C timing values into the timing register. TIMINGR can only be written while
+  // the interface is disabled, and must be assigned, not ORed, so that the old values do
+  // not remain.
+  thisI2C->CR1 &= ~I2C_CR1_PE;            // Disable the I2C interface
+  while( thisI2C->CR1 & I2C_CR1_PE ) ;    // Wait for PE bit to be cleared
+  thisI2C->TIMINGR =  (  I2CPresc << I2C_TIMINGR_PRESC_Pos)  |
+                      (I2C_SCLDEL << I2C_TIMINGR_SCLDEL_Pos) |
+                      (I2C_SDADEL << I2C_TIMINGR_SDADEL_Pos) |
+                      (   I2CSCLH << I2C_TIMINGR_SCLH_Pos)   |
+                      (   I2CSCLL << I2C_TIMINGR_SCLL_Pos);
+
+  thisI2C->CR1 |= I2C_CR1_PE;             // Enable the I2C interface
+  I2C1_health.speed = I2CSpeed;
+}
 
 
 //  void
@@ -127,8 +594,6 @@
 void
 I2C_init( I2C_TypeDef *thisI2C, uint32_t I2CSpeed )
 {
-  uint8_t I2CPresc, I2CSCLL, I2CSCLH;
-
   if( thisI2C != I2C1 )   // Currently, only I2C1 is implemented in this library. Add code
     thisI2C = I2C1;       // to support I2C2 if and when STM32F030 chips with more than
                           // 32 pins are to be supported.
@@ -156,116 +621,162 @@ I2C_init( I2C_TypeDef *thisI2C, uint32_t I2CSpeed )
     GPIOA->AFR[1] |= (0b0100 << GPIO_AFRH_AFSEL9_Pos) | (0b0100 << GPIO_AFRH_AFSEL10_Pos);
   }
 
-  // Perform a software reset on the I2C interface. Normally a SW reset would turn the I2C
-  // interface off then on again. Here, the interface will be turned off, then the timings
-  // set, then turned on, since timing settings must also occur when the interface is off.
-  // This functionality is disabled since an initialization will only occure when the device
-  // is first turned on.
-  // thisI2C->CR1  &= ~I2C_CR1_PE;          // Disable the I2C interface
-  // while( thisI2C->CR1 && I2C_CR1_PE ) ;  // Wait for PE bit to be cleared
+  // Perform a software reset on the I2C interface. The interface is turned off here, the
+  // filters and timings are set while it is off, and I2C_setSpeed turns it on again. This
+  // makes it safe to call I2C_init again, for example to re-initialize a sensor.
+  thisI2C->CR1  &= ~I2C_CR1_PE;           // Disable the I2C interface
+  while( thisI2C->CR1 & I2C_CR1_PE ) ;    // Wait for PE bit to be cleared
 
   thisI2C->CR1 &= ~( I2C_CR1_DNF | I2C_CR1_ANFOFF | I2C_CR1_SMBHEN | I2C_CR1_SMBDEN );
   thisI2C->CR2 &= ~( I2C_CR2_RD_WRN | I2C_CR2_NACK | I2C_CR2_RELOAD | I2C_CR2_AUTOEND );
   
-  if( I2CSpeed > 400E3 )      // Ensure that the specified speed is within operable bounds.
-    I2CSpeed = 400E3;         // If not, then default to the high or low limit.
-  else if( I2CSpeed < 10E3 )
-    I2CSpeed = 10E3;
+  I2C_setSpeed( thisI2C, I2CSpeed );     // Set the timing and enable the interface
+}
 
-  if( I2CSpeed < 50E3 )       // Calculate lower speeds with the prescaler set to 1
+
+//  uint8_t
+//  I2C_error( I2C_TypeDef *thisI2C, uint8_t error )
+//  Record error in I2C_lastError and return it. If no error code is given (I2C_OK), the
+//  error is taken from the ISR error flags.
+static uint8_t
+I2C_error( I2C_TypeDef *thisI2C, uint8_t error )
+{
+  uint32_t isr = thisI2C->ISR;
+
+  if( error == I2C_OK )
   {
-    I2CPresc = 1;
-    I2CSCLH  = (uint32_t)2E6 / I2CSpeed - 5;
-    I2CSCLL  = I2CSCLH + 3;
+    if( isr & I2C_ISR_NACKF )
+      error = I2C_NACK;
+    else if( isr & I2C_ISR_ARLO )
+      error = I2C_ARLO;
+    else
+      error = I2C_BUSERR;
   }
-  else                        // Calculte higher speeds with the prescaler set to 0
+  if( error == I2C_TIMEOUT )
+    I2C_traceTimeout( );                  // Mark the trace record (if I2C_TRACE is defined)
+  I2C_lastError = error;
+  return error;
+}
+
+
+//  uint8_t
+//  I2C_waitISR( I2C_TypeDef *thisI2C, uint32_t flags )
+//  Wait until any of the flags are set in the ISR register. Returns I2C_OK, an error code
+//  if a NACK, bus error or arbitration loss occurs first, or I2C_TIMEOUT.
+RAMFUNC uint8_t
+I2C_waitISR( I2C_TypeDef *thisI2C, uint32_t flags )
+{
+  uint32_t loops = I2C_TIMEOUT_LOOPS;
+  uint32_t isr;
+
+  do
   {
-    I2CPresc = 0;
-    I2CSCLH  = (uint32_t)4E6 / I2CSpeed - 9;
-    I2CSCLL  = I2CSCLH + 5;
-  }
+    DELAY_POLL( );
+    isr = thisI2C->ISR;
+    if( isr & flags )
+      return I2C_OK;
+    if( isr & ( I2C_ISR_NACKF | I2C_ISR_BERR | I2C_ISR_ARLO ))
+      return I2C_error( thisI2C, I2C_OK );
+  } while( --loops );
+  return I2C_error( thisI2C, I2C_TIMEOUT );
+}
 
-  #define I2C_SCLDEL 0x0      // Supposedly these can add a little speed in some cases,
-  #define I2C_SDADEL 0x0      // but probably not strictly required.
-  
-  // Set the I2C timing values into the timing register
-  
-  thisI2C->TIMINGR |= (  I2CPresc << I2C_TIMINGR_PRESC_Pos)  |
-                      (I2C_SCLDEL << I2C_TIMINGR_SCLDEL_Pos) |
-                      (I2C_SDADEL << I2C_TIMINGR_SDADEL_Pos) |
-                      (   I2CSCLH << I2C_TIMINGR_SCLH_Pos)   |
-                      (   I2CSCLL << I2C_TIMINGR_SCLL_Pos);
 
-  thisI2C->CR1  |= I2C_CR1_PE;            // Enable the I2C interface
+//  uint8_t
+//  I2C_waitCR2Clear( I2C_TypeDef *thisI2C, uint32_t bit )
+//  Wait until the START or STOP bit in CR2 is cleared by the interface. Returns I2C_OK or
+//  I2C_TIMEOUT.
+static uint8_t
+I2C_waitCR2Clear( I2C_TypeDef *thisI2C, uint32_t bit )
+{
+  uint32_t loops = I2C_TIMEOUT_LOOPS;
+
+  do
+  {
+    DELAY_POLL( );
+    if( !( thisI2C->CR2 & bit ))
+      return I2C_OK;
+  } while( --loops );
+  return I2C_error( thisI2C, I2C_TIMEOUT );
 }
 
 
-//  void
+//  uint8_t
 //  I2C_start( I2C_TypeDef *thisI2c )
 //  Set the start bit and wait for acknowledge that it was set.
-void
+static inline uint8_t
 I2C_start( I2C_TypeDef *thisI2C )
 {
+  I2C_traceBegin( thisI2C );              // Open a trace record (if I2C_TRACE is defined)
   thisI2C->CR2 |= I2C_CR2_START;          // Set START bit in I2C CR2 register
-  while( thisI2C->CR2 & I2C_CR2_START ) ; // Wait until START bit is cleared
+  return I2C_waitCR2Clear( thisI2C, I2C_CR2_START );  // Wait until START bit is cleared
 }
 
 
 //  void
 //  I2C_setAddress( I2C_TypeDef *thisI2C, uint8_t address )
 //  Write the address to the SADD bits of the CR2 register.
-void
+static inline void
 I2C_setAddress( I2C_TypeDef *thisI2C, uint8_t address )
 {
-  thisI2C->CR2 &= ~I2C_CR2_SADD;                    // Clear Address bits in CR2 register
-  thisI2C->CR2 |= (( address*2) << I2C_CR2_SADD_Pos );  // Write address to CR2 register
+  // Clear the address bits and write the new address to the CR2 register in one write
+  thisI2C->CR2 = ( thisI2C->CR2 & ~I2C_CR2_SADD ) | (( address*2) << I2C_CR2_SADD_Pos );
 }
 
 
-//  void
+//  uint8_t
 //  I2C_stop( I2C_TypeDef *thisI2C )
-//  Set and then clear the stop bit.
-void
+//  Set and then clear the stop bit. If a NACK ended the transfer, the interface has already
+//  sent the stop by itself (STOPF is set), so the stop bit is not set again. The stop and
+//  error flags are then cleared so that the next transaction starts clean.
+static inline uint8_t
 I2C_stop( I2C_TypeDef *thisI2C )
 {
-  thisI2C->CR2 |= I2C_CR2_STOP;             // Set STOP bit in I2C CR2 register
-  while( thisI2C->CR2 & I2C_CR2_STOP ) ;    // Wait until STOP bit is cleared
+  uint8_t status = I2C_OK;
 
-  thisI2C->ICR |= I2C_ICR_STOPCF;           // Clear the STOPF flag in the I2C ISR register
-  while( thisI2C->ICR & I2C_ICR_STOPCF ) ;  // Wait until the STOPF flag is cleared. Note that
-                                            // the stop flag is cleared by writing to the
-                                            // ICR register but is read from the ISR register.
+  if( !( thisI2C->ISR & I2C_ISR_STOPF ))
+  {
+    thisI2C->CR2 |= I2C_CR2_STOP;           // Set STOP bit in I2C CR2 register
+    status = I2C_waitCR2Clear( thisI2C, I2C_CR2_STOP );  // Wait until STOP bit is cleared
+  }
+  I2C_traceEnd( thisI2C );                  // Close the trace record
+
+  // Clear the STOPF flag and the error flags in the I2C ISR register. Note that the flags
+  // are cleared by writing to the ICR register but are read from the ISR register.
+  thisI2C->ICR = I2C_ICR_STOPCF | I2C_ICR_NACKCF | I2C_ICR_BERRCF | I2C_ICR_ARLOCF;
+  return status;
 }
 
 
 //  void
 //  I2C_setNBytes( I2C_TypeDef *thisI2C, uint8_t nBytes )
 //    Set the number of bytes to be transferred.
-void
+static inline void
 I2C_setNBytes( I2C_TypeDef *thisI2C, uint8_t nBytes )
 {
-  thisI2C->CR2 &= ~(I2C_CR2_NBYTES);            // Mask out byte-count bits
-  thisI2C->CR2 |= (nBytes << I2C_CR2_NBYTES_Pos); // Set number of bytes to 1
+  // Mask out the byte-count bits and set the number of bytes in one write
+  thisI2C->CR2 = ( thisI2C->CR2 & ~I2C_CR2_NBYTES ) | ( nBytes << I2C_CR2_NBYTES_Pos );
 }
 
 
-//  void
+//  uint8_t
 //  I2C_write( I2C_TypeDef *thisI2C, uint8_t data )
 //  Write a byte of data to the I2C interface.
-void
+RAMFUNC uint8_t
 I2C_write( I2C_TypeDef *thisI2C, uint8_t data )
 {
-  thisI2C->TXDR = (thisI2C->TXDR & 0xFFFFFF00) | data ;
+  I2C_traceByte( data );                        // Record the byte (if I2C_TRACE is defined)
+  thisI2C->TXDR = data;                         // Only TXDR[7:0] is implemented
   // Wait until both the the TXDR register is empty (TXIS=1) and the transfer-complete
   // flag (TC) is set, indicating the end of the transfer.
-  while( !( thisI2C->ISR & ( I2C_ISR_TXIS | I2C_ISR_TC ))) ;
+  return I2C_waitISR( thisI2C, I2C_ISR_TXIS | I2C_ISR_TC );
 }
 
 
 //  void
 //  I2C_setReadMode( I2C_TypeDef *thisI2C )
 //  Set the I2C interface into the read mode.
-void
+static inline void
 I2C_setReadMode( I2C_TypeDef *thisI2C )
 {
   thisI2C->CR2 |= I2C_CR2_RD_WRN;               // Set I2C interface to read operation
@@ -275,23 +786,235 @@ I2C_setReadMode( I2C_TypeDef *thisI2C )
 //  void
 //  I2C_setWriteMode( I2C_TypeDef *thisI2C )
 //  Set the I2C interface into the write mode.
-void
+static inline void
 I2C_setWriteMode( I2C_TypeDef *thisI2C )
 {
   thisI2C->CR2 &= ~I2C_CR2_RD_WRN;              // Restore read/write bit to write
 }
 
 
+//  uint8_t
+//  I2C_readByte( I2C_TypeDef *thisI2C, uint8_t *data )
+//  Read a byte from the I2C interface into data. Returns I2C_OK or an error code.
+RAMFUNC uint8_t
+I2C_readByte( I2C_TypeDef *thisI2C, uint8_t *data )
+{
+  uint8_t status = I2C_waitISR( thisI2C, I2C_ISR_RXNE );  // Wait for byte to appear
+
+  if( status != I2C_OK )
+    return status;
+  *data = thisI2C->RXDR & 0xFF;                 // Read received byte
+  I2C_traceByte( *data );                       // Record the byte (if I2C_TRACE is defined)
+  return I2C_OK;
+}
+
+
 //  uint8_t
 //  I2C_read( I2C_TypeDef *thisI2C )
-//  Read a byte from the I2C interface.
+//  Read a byte from the I2C interface. Returns 0xFF if no byte was received, and the error
+//  is recorded in I2C_lastError.
 uint8_t
 I2C_read( I2C_TypeDef *thisI2C )
 {
-  while( !( thisI2C->ISR & I2C_ISR_RXNE )) ;    // Wait for byte to appear
-  uint8_t result = thisI2C->RXDR & 0xFF;        // Read received byte
+  uint8_t result = 0xFF;
+
+  I2C_readByte( thisI2C, &result );
   return result;
 }
 
 
+//  void
+//  I2C_recover( I2C_TypeDef *thisI2C )
+//  Free a stuck bus. A device that was interrupted in the middle of sending a byte can hold
+//  SDA low forever. The I2C interface is disabled and SCL is clocked by hand (up to 9
+//  pulses) until the device releases SDA. Then a STOP is sent by raising SDA while SCL is
+//  high, and the interface is re-enabled, which also resets its internal state.
+void
+I2C_recover( I2C_TypeDef *thisI2C )
+{
+  thisI2C->CR1 &= ~I2C_CR1_PE;              // Disable (and reset) the I2C interface
+
+  // Drive SCL (A9) and SDA (A10) as open-drain GPIO outputs, both released (high)
+  GPIOA->BSRR   = GPIO_BSRR_BS_9 | GPIO_BSRR_BS_10;
+  GPIOA->MODER  = ( GPIOA->MODER & ~( GPIO_MODER_MODER9 | GPIO_MODER_MODER10 )) |
+                  GPIO_MODER_MODER9_0 | GPIO_MODER_MODER10_0;
+  delay_us( 5 );
+
+  for( uint8_t pulse = 0; ( pulse < 9 ) && !( GPIOA->IDR & GPIO_IDR_10 ); pulse++ )
+  {
+    GPIOA->BSRR = GPIO_BSRR_BR_9;           // SCL low
+    delay_us( 5 );
+    GPIOA->BSRR = GPIO_BSRR_BS_9;           // SCL high
+    delay_us( 5 );
+  }
+
+  GPIOA->BSRR = GPIO_BSRR_BR_10;            // STOP: SDA low, then high while SCL is high
+  delay_us( 5 );
+  GPIOA->BSRR = GPIO_BSRR_BS_10;
+  delay_us( 5 );
+
+  // Return A9 and A10 to their alternate function (I2C1) and re-enable the interface
+  GPIOA->MODER  = ( GPIOA->MODER & ~( GPIO_MODER_MODER9 | GPIO_MODER_MODER10 )) |
+                  GPIO_MODER_MODER9_1 | GPIO_MODER_MODER10_1;
+  thisI2C->CR1 |= I2C_CR1_PE;
+}
+
+
+//  void
+//  I2C_setSpeedLimits( I2C_TypeDef *thisI2C, uint32_t minSpeed, uint32_t maxSpeed )
+//  Set the limits for automatic speed changes, start a new error-rate window, and bring the
+//  current speed within the limits.
+void
+I2C_setSpeedLimits( I2C_TypeDef *thisI2C, uint32_t minSpeed, uint32_t maxSpeed )
+{
+  I2C_Health *h = &I2C1_health;
+
+  h->minSpeed     = minSpeed;
+  h->maxSpeed     = maxSpeed;
+  h->transfers    = 0;
+  h->errors       = 0;
+  h->cleanWindows = 0;
+  h->upAfter      = I2C_ADAPT_UP_WINDOWS;
+  h->justUp       = 0;
+  if( h->speed < minSpeed )
+    I2C_setSpeed( thisI2C, minSpeed );
+  else if( h->speed > maxSpeed )
+    I2C_setSpeed( thisI2C, maxSpeed );
+}
+
+
+//  void
+//  I2C_adapt( I2C_TypeDef *thisI2C )
+//  Called at the end of each error-rate window. Halve the speed if there were too many
+//  errors, or double it after upAfter error-free windows. A step up that fails at once
+//  doubles the number of error-free windows needed for the next try.
+static void
+I2C_adapt( I2C_TypeDef *thisI2C )
+{
+  I2C_Health *h = &I2C1_health;
+  uint32_t    speed = h->speed;
+
+  if( h->errors > I2C_ADAPT_MAX_ERRORS )
+  {
+    h->cleanWindows = 0;
+    if( h->justUp && h->upAfter < 128 )
+      h->upAfter *= 2;
+    speed = ( speed / 2 < h->minSpeed ) ? h->minSpeed : speed / 2;
+  }
+  else if( h->errors == 0 && ++h->cleanWindows >= h->upAfter )
+  {
+    h->cleanWindows = 0;
+    speed = ( speed * 2 > h->maxSpeed ) ? h->maxSpeed : speed * 2;
+  }
+  else if( h->errors )
+    h->cleanWindows = 0;
+
+  h->justUp    = ( speed > h->speed );
+  h->transfers = 0;
+  h->errors    = 0;
+  if( speed != h->speed )
+  {
+    if( speed > h->speed )
+      h->stepsUp++;
+    else
+      h->stepsDown++;
+    I2C_setSpeed( thisI2C, speed );
+  }
+}
+
+
+//  void
+//  I2C_count( I2C_TypeDef *thisI2C, uint8_t status, uint8_t crc )
+//  Count the result of a transaction, or a checksum error if crc is set, and adapt the
+//  speed at the end of each window if speed limits are set.
+static void
+I2C_count( I2C_TypeDef *thisI2C, uint8_t status, uint8_t crc )
+{
+  I2C_Health *h = &I2C1_health;
+
+  if( crc )
+    h->crcErrors++;
+  else
+  {
+    h->results[ status ]++;
+    h->transfers++;
+  }
+  if( crc || status != I2C_OK )
+    h->errors++;
+  if( h->transfers >= I2C_ADAPT_WINDOW && h->minSpeed < h->maxSpeed )
+    I2C_adapt( thisI2C );
+}
+
+
+//  void
+//  I2C_crcError( I2C_TypeDef *thisI2C )
+//  Count a checksum error found by a device driver as an error of the bus.
+void
+I2C_crcError( I2C_TypeDef *thisI2C )
+{
+  I2C_count( thisI2C, I2C_OK, 1 );
+}
+
+
+//  uint8_t
+//  I2C_finish( I2C_TypeDef *thisI2C, uint8_t status )
+//  End a transaction started by I2C_writeN or I2C_readN. The stop is always sent, the
+//  interface is returned to write mode, and the bus is recovered after a timeout. The result
+//  is counted for speed adaptation. Returns the first error of the transaction.
+static uint8_t
+I2C_finish( I2C_TypeDef *thisI2C, uint8_t status )
+{
+  uint8_t stopStatus = I2C_stop( thisI2C );
+
+  if( status == I2C_OK )
+    status = stopStatus;
+  I2C_setWriteMode( thisI2C );
+  if( status == I2C_TIMEOUT )
+    I2C_recover( thisI2C );
+  I2C_count( thisI2C, status, 0 );
+  I2C_statsEnd( thisI2C, status );        // Update the statistics (if I2C_STATS is defined)
+  return status;
+}
+
+
+//  uint8_t
+//  I2C_writeN( I2C_TypeDef *thisI2C, uint8_t address, const uint8_t *data, uint8_t n )
+//  Write n bytes to the device at address as one complete transaction. Returns I2C_OK or
+//  an error code.
+uint8_t
+I2C_writeN( I2C_TypeDef *thisI2C, uint8_t address, const uint8_t *data, uint8_t n )
+{
+  uint8_t status;
+
+  I2C_setAddress( thisI2C, address );
+  I2C_setNBytes( thisI2C, n );
+  I2C_setWriteMode( thisI2C );
+  I2C_statsBegin( );
+  status = I2C_start( thisI2C );
+  for( uint8_t i = 0; ( i < n ) && ( status == I2C_OK ); i++ )
+    status = I2C_write( thisI2C, data[i] );
+  return I2C_finish( thisI2C, status );
+}
+
+
+//  uint8_t
+//  I2C_readN( I2C_TypeDef *thisI2C, uint8_t address, uint8_t *data, uint8_t n )
+//  Read n bytes from the device at address as one complete transaction. Returns I2C_OK or
+//  an error code.
+uint8_t
+I2C_readN( I2C_TypeDef *thisI2C, uint8_t address, uint8_t *data, uint8_t n )
+{
+  uint8_t status;
+
+  I2C_setAddress( thisI2C, address );
+  I2C_setNBytes( thisI2C, n );
+  I2C_setReadMode( thisI2C );
+  I2C_statsBegin( );
+  status = I2C_start( thisI2C );
+  for( uint8_t i = 0; ( i < n ) && ( status == I2C_OK ); i++ )
+    status = I2C_readByte( thisI2C, &data[i] );
+  return I2C_finish( thisI2C, status );
+}
+
+
 #endif /* __STM32F030_CMSIS_I2C_LIB.C */
@@ -49,14 +49,19 @@
 
 #include "stm32f030x6.h"          // Primary CMSIS header file
 #include "STM32F030-Delay-lib.c"  // Has the microsecond delay function
+#include "STM32F030-RamFunc-lib.c" // RAMFUNC placement of the nibble writers
 
 #define LCD_RS_BIT (1<<5)         // Define GPIO pin for RS
 #define LCD_EN_BIT (1<<4)         // Define GPIO pin for EN
 
-#define LCD_RS_ON()  GPIOA->ODR |=  LCD_RS_BIT  // Turn ON RS pin
-#define LCD_EN_ON()  GPIOA->ODR |=  LCD_EN_BIT  // Turn ON EN pin
-#define LCD_RS_OFF() GPIOA->ODR &= ~LCD_RS_BIT  // Turn OFF RS pin
-#define LCD_EN_OFF() GPIOA->ODR &= ~LCD_EN_BIT  // Turn OFF EN pin
+// The pin macros write the BSRR register, which sets (bits [15:0]) or resets (bits [31:16])
+// pins in a single store instead of a read-modify-write of ODR.
+#define LCD_RS_ON()  GPIOA->BSRR = LCD_RS_BIT         // Turn ON RS pin
+#define LCD_EN_ON()  GPIOA->BSRR = LCD_EN_BIT         // Turn ON EN pin
+#define LCD_RS_OFF() GPIOA->BSRR = LCD_RS_BIT << 16   // Turn OFF RS pin
+#define LCD_EN_OFF() GPIOA->BSRR = LCD_EN_BIT << 16   // Turn OFF EN pin
+#define LCD_DATA_MASK 0x0F                           // Data pins are GPIO A[3:0]
+#define LCD_POWERUP_MS 300        // Wait after power-up before the LCD accepts commands
 
 //  Defines for LCD commands
 #define LCD_CLEAR                0x01
@@ -73,25 +78,23 @@
 
 //  writeLowerNibble
 //  Puts the lower 4 bits of 'data' onto GPIO pins A[3:0]
-void
+RAMFUNC void
 LCD_writeLowerNibble( uint8_t data )
 {
-  GPIOA->ODR &= 0xFFF0;    // Clear GPIO A[3:0]
-  // Mask off the lower nibble of data, and write those bits to the newly cleared nibble
-  // at GPIO A[3:0].
-  GPIOA->ODR |= (data & 0x0F) ;
+  // Reset all of GPIO A[3:0] and set the bits of the lower nibble of data in one write.
+  // When a pin is both set and reset in BSRR, the set takes priority.
+  GPIOA->BSRR = ( LCD_DATA_MASK << 16 ) | ( data & LCD_DATA_MASK );
 }
 
 
 //  writeUpperNibble
 //  Writes the upper 4 bits of 'data' onto GPIO pins A[3:0]
-void
+RAMFUNC void
 LCD_writeUpperNibble( uint8_t data )
 {
-  GPIOA->ODR &= 0xFFF0;    // Clear GPIO A[3:0]
-  // Mask off the upper nibble of data, and shift those bits down 4 bits and write them to
-  // the newly cleared nibble at A[3:0]
-  GPIOA->ODR |= (data & 0xF0) >> 4;
+  // Reset all of GPIO A[3:0] and set the bits of the upper nibble of data, shifted down
+  // 4 bits, in one write.
+  GPIOA->BSRR = ( LCD_DATA_MASK << 16 ) | ( data >> 4 );
 }
 
 
@@ -168,16 +171,12 @@ LCD_puts( char *data )
 }
 
 
-//  LCD_init
-//  Initializes LCD by initializing required GPIO ports and pins used to talk
-//  to the LCD. Also initializes the LCD screen itself to be in 4-bit mode.
-//  This setup uses GPIO A3, A2, A1, and A0 for LCD data pins 4, 5, 6, 7 respectively.
-//  GPIO A4 is LCD RS and GPIO A5 is the LCD EN pin.
-//  Note that these GPIO pins are *not* 5 V tolerant. So they are installed with physical
-//  pull-down resistors to ground to protect the GPIO pins on the STM32F030 from 5 V from
-//  the LCD. The pins are configured as outputs in a push-pull configuration.
+//  LCD_initPins
+//  First half of LCD_init. Enables GPIO port A and sets the LCD pins as push-pull outputs.
+//  The LCD is not ready for LCD_initDisplay until LCD_POWERUP_MS milliseconds after
+//  power-up, and the program may do other work in the meantime.
 void
-LCD_init( void )
+LCD_initPins( void )
 {
   RCC->AHBENR |= RCC_AHBENR_GPIOAEN ;     // Enable GPIO Port A
   // Set the MODERx[1:0] bits to 0b01 for push-pull output configuration
@@ -187,10 +186,15 @@ LCD_init( void )
                   GPIO_MODER_MODER3_0 |
                   GPIO_MODER_MODER4_0 |
                   GPIO_MODER_MODER5_0;
+}
 
-  // Start with delay to make sure the LCD module is fully powered up.
-  // 400 ms is overkill since 300 ms works. But decided to give some leeway.
-  delay_us(300e3);
+
+//  LCD_initDisplay
+//  Second half of LCD_init. Puts the LCD into 4-bit mode, clears it, and turns it on. Must
+//  not be called before the LCD has been powered up for LCD_POWERUP_MS milliseconds.
+void
+LCD_initDisplay( void )
+{
   // Set EN and RS low
   LCD_EN_OFF();
   LCD_RS_OFF();
@@ -207,4 +211,25 @@ LCD_init( void )
   LCD_cmd( LCD_ON_NO_CURSOR );  // Display on, no cursor
 }
 
+
+//  LCD_init
+//  Initializes LCD by initializing required GPIO ports and pins used to talk
+//  to the LCD. Also initializes the LCD screen itself to be in 4-bit mode.
+//  This setup uses GPIO A3, A2, A1, and A0 for LCD data pins 4, 5, 6, 7 respectively.
+//  GPIO A4 is LCD RS and GPIO A5 is the LCD EN pin.
+//  Note that these GPIO pins are *not* 5 V tolerant. So they are installed with physical
+//  pull-down resistors to ground to protect the GPIO pins on the STM32F030 from 5 V from
+//  the LCD. The pins are configured as outputs in a push-pull configuration.
+//  This waits out the whole LCD power-up time. To do other work during that time, call
+//  LCD_initPins and LCD_initDisplay instead.
+void
+LCD_init( void )
+{
+  LCD_initPins( );
+  // Start with delay to make sure the LCD module is fully powered up.
+  // 400 ms is overkill since 300 ms works. But decided to give some leeway.
+  delay_us( LCD_POWERUP_MS * 1000 );
+  LCD_initDisplay( );
+}
+
 #endif /* __STM32F030_CMSIS_LCD_LIB_C  */
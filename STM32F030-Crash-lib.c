@@ -0,0 +1,313 @@
+//  ==========================================================================================
+//  STM32F030-Crash-lib.c
+//  ------------------------------------------------------------------------------------------
+//  HardFault capture for the STM32F030 (Cortex-M0). Instead of spinning forever in
+//  Default_Handler, a HardFault saves the registers stacked by the exception, the cause as
+//  far as it can be determined, and a short backtrace into RAM that survives a reset (the
+//  .noinit section). It then resets the microcontroller at once. On the next boot,
+//  Crash_check finds the record, copies it to Crash_last for the program to report, and
+//  saves it to the last flash page so that it also survives a power cycle.
+//
+//  The Cortex-M0 has no fault status registers, so the cause is worked out from the saved
+//  state (see CRASH_CAUSE_*). The backtrace is a guess: it lists the values on the stack
+//  above the fault that look like return addresses into the program code. Older stale
+//  values may show up as well. Look up the addresses in the .map file or with
+//  "arm-none-eabi-addr2line -e <file>.elf <address>".
+//  ------------------------------------------------------------------------------------------
+//  https://github.com/EZdenki/STM32F030-CMSIS-I2C-AHT10-lib
+//  Released under the MIT License
+//  Copyright (c) 2023
+//  Mike Shegedin, EZdenki.com
+//  ------------------------------------------------------------------------------------------
+//  Target Device: STM32F030F4xx. The linker script must provide the .noinit section and the
+//  CRASHLOG flash page (_scrashlog). In the host simulation (HOST_SIM, see
+//  STM32F030-Host-lib.c) there is no HardFault_Handler, and the flash page is a host array.
+//  ------------------------------------------------------------------------------------------
+//  Routines in this Library
+//
+//  void
+//  HardFault_Handler( void )
+//    Replaces the weak default handler from the startup file. Saves the crash record and
+//    resets.
+//
+//  uint8_t
+//  Crash_check( void )
+//    Call once, early in main(). Returns CRASH_SAVED (1) if the last reset was caused by a
+//    HardFault. The record is then in Crash_last and has been saved to flash. Returns
+//    CRASH_UNSAVED (2) if the record is in Crash_last but could not be saved to flash (the
+//    flash reported a programming or write protection error, or did not read back right).
+//    Otherwise returns CRASH_NONE (0).
+//
+//  const Crash_Record *
+//  Crash_saved( void )
+//    Return the crash record saved in flash, or 0 if there is none. This is the most recent
+//    crash, even from before a power cycle. Its count field holds the total number of
+//    crashes saved.
+//  ==========================================================================================
+
+#ifndef __STM32F030_CRASH_LIB_C
+#define __STM32F030_CRASH_LIB_C
+
+#include "stm32f030x6.h"          // Primary CMSIS header file
+
+#define CRASH_MAGIC      0xC0FFEE42UL   // Marks a valid crash record
+#define CRASH_BT_N       4              // Number of backtrace entries
+#define CRASH_SCAN_WORDS 64             // Stack words searched for the backtrace
+
+//  Crash_check return values
+#define CRASH_NONE    0           // No crash record
+#define CRASH_SAVED   1           // Crash record found and saved to flash
+#define CRASH_UNSAVED 2           // Crash record found, but saving it to flash failed
+
+//  Causes. More than one may be set.
+#define CRASH_CAUSE_HANDLER 0x01  // Fault occurred in an interrupt handler
+#define CRASH_CAUSE_PSP     0x02  // Fault occurred while using the process stack
+#define CRASH_CAUSE_BADPC   0x04  // PC was outside of the program code and RAM
+#define CRASH_CAUSE_THUMB   0x08  // T bit clear: Jump to an even address (bad function
+                                  // pointer or corrupted return address)
+#define CRASH_CAUSE_STACK   0x10  // Stack pointer was below the end of the static data:
+                                  // Stack overflow
+
+typedef struct
+{
+  uint32_t magic;                   // CRASH_MAGIC when the record is valid
+  uint32_t r0, r1, r2, r3, r12;     // Registers stacked by the exception
+  uint32_t lr, pc, xpsr;
+  uint32_t excReturn;               // EXC_RETURN value found in LR in the handler
+  uint32_t sp;                      // Stack pointer at the time of the fault
+  uint32_t cause;                   // CRASH_CAUSE_* flags
+  uint32_t backtrace[ CRASH_BT_N ]; // Likely return addresses, innermost first, or 0
+  uint32_t count;                   // Number of crashes saved to flash, including this one
+  uint32_t check;                   // Checksum of all of the words above
+} Crash_Record;
+
+//  Defined by the linker script
+extern uint32_t _etext, _estack, _enoinit;
+extern uint32_t _scrashlog[];       // Flash page of the saved record
+
+Crash_Record Crash_noinit __attribute__(( section( ".noinit" )));  // Written by the fault
+Crash_Record Crash_last;            // Record found by Crash_check, magic is 0 if none
+
+
+//  uint32_t
+//  Crash_sum( const Crash_Record *rec )
+//  Checksum of every word of the record except check itself.
+static uint32_t
+Crash_sum( const Crash_Record *rec )
+{
+  const uint32_t *w = (const uint32_t *)rec;
+  uint32_t sum = CRASH_MAGIC;
+  uint8_t  i;
+
+  for( i = 0; i < sizeof( Crash_Record ) / 4 - 1; i++ )
+    sum = ( sum << 1 | sum >> 31 ) + w[i];        // Rotate and add
+  return sum;
+}
+
+
+#ifndef HOST_SIM                  // On the host, a fault ends the simulation instead
+
+//  void
+//  Crash_hardFault( uint32_t *frame, uint32_t excReturn )
+//  Called from HardFault_Handler with the address of the stacked registers
+//  ( r0, r1, r2, r3, r12, lr, pc, xpsr ) and the EXC_RETURN value. Fills in the record in
+//  .noinit RAM and resets.
+__attribute__(( used, noreturn )) void
+Crash_hardFault( uint32_t *frame, uint32_t excReturn )
+{
+  Crash_Record *rec = &Crash_noinit;
+  uint32_t     *w;
+  uint32_t      pc = frame[6];
+  uint8_t       i, n = 0;
+
+  rec->r0   = frame[0];
+  rec->r1   = frame[1];
+  rec->r2   = frame[2];
+  rec->r3   = frame[3];
+  rec->r12  = frame[4];
+  rec->lr   = frame[5];
+  rec->pc   = pc;
+  rec->xpsr = frame[7];
+  rec->excReturn = excReturn;
+  // The frame is 8 words, plus a padding word if bit 9 of the stacked xPSR is set
+  rec->sp   = (uint32_t)( frame + 8 + (( frame[7] >> 9 ) & 1 ));
+
+  rec->cause = 0;
+  if( frame[7] & 0x3F )                             // Stacked IPSR: exception number
+    rec->cause |= CRASH_CAUSE_HANDLER;
+  if( excReturn & 0x4 )
+    rec->cause |= CRASH_CAUSE_PSP;
+  if(!(( pc >= FLASH_BASE && pc < (uint32_t)&_etext ) ||
+       ( pc >= SRAM_BASE  && pc < (uint32_t)&_estack )))
+    rec->cause |= CRASH_CAUSE_BADPC;
+  if( !( frame[7] & ( 1UL << 24 )))
+    rec->cause |= CRASH_CAUSE_THUMB;
+  if( rec->sp < (uint32_t)&_enoinit )
+    rec->cause |= CRASH_CAUSE_STACK;
+
+  // Search the stack above the frame for odd values (Thumb return addresses) that point
+  // into the program code.
+  for( w = (uint32_t *)rec->sp, i = 0;
+       w < &_estack && i < CRASH_SCAN_WORDS && n < CRASH_BT_N; w++, i++ )
+    if(( *w & 1 ) && *w > FLASH_BASE && *w < (uint32_t)&_etext )
+      rec->backtrace[n++] = *w & ~1UL;
+  while( n < CRASH_BT_N )
+    rec->backtrace[n++] = 0;
+
+  rec->count = 0;
+  rec->magic = CRASH_MAGIC;
+  rec->check = Crash_sum( rec );
+  NVIC_SystemReset( );
+}
+
+
+//  void
+//  HardFault_Handler( void )
+//  Pass the stack pointer that was in use when the fault occurred (bit 2 of EXC_RETURN
+//  selects MSP or PSP) and EXC_RETURN to Crash_hardFault. Written in assembly since the C
+//  code would push registers onto the stack first.
+__attribute__(( naked )) void
+HardFault_Handler( void )
+{
+  __asm volatile( "  movs r0, #4              \n"
+                  "  mov  r1, lr              \n"
+                  "  tst  r0, r1              \n"
+                  "  mrs  r0, msp             \n"
+                  "  beq  1f                  \n"
+                  "  mrs  r0, psp             \n"
+                  "1:                         \n"
+                  "  ldr  r2, =Crash_hardFault \n"
+                  "  bx   r2                  \n"
+                  "  .ltorg                   \n" );
+}
+
+#endif /* HOST_SIM */
+
+
+//  uint32_t
+//  Crash_flashWait( void )
+//  Wait for the current erase or program operation to finish, then clear and return its
+//  error flags: FLASH_SR_PGERR (the half-word was not erased before programming) and
+//  FLASH_SR_WRPRTERR (the page is write protected). Returns 0 if the operation succeeded.
+static uint32_t
+Crash_flashWait( void )
+{
+  uint32_t sr;
+
+  while( FLASH->SR & FLASH_SR_BSY ) ;
+  sr = FLASH->SR & ( FLASH_SR_PGERR | FLASH_SR_WRPRTERR );
+  FLASH->SR = FLASH_SR_EOP | FLASH_SR_PGERR | FLASH_SR_WRPRTERR;   // Write 1 to clear
+  return sr;
+}
+
+
+//  uint8_t
+//  Crash_flashProgram( const Crash_Record *rec )
+//  Erase the CRASHLOG flash page and write the record into it, one half-word at a time.
+//  The flash must be unlocked. Stops at the first operation that sets an error flag, or if
+//  the page does not read back as erased. Returns 1 if every operation succeeded.
+static uint8_t
+Crash_flashProgram( const Crash_Record *rec )
+{
+  volatile uint16_t *dst = (volatile uint16_t *)_scrashlog;
+  const uint16_t    *src = (const uint16_t *)rec;
+  uint8_t            i;
+
+  FLASH->CR |= FLASH_CR_PER;                        // Erase the page
+  FLASH->AR  = (uint32_t)(uintptr_t)_scrashlog;
+  FLASH->CR |= FLASH_CR_STRT;
+  if( Crash_flashWait( ))
+    return 0;
+  FLASH->CR &= ~FLASH_CR_PER;
+  for( i = 0; i < sizeof( Crash_Record ) / 2; i++ )
+    if( dst[i] != 0xFFFF )
+      return 0;
+
+  FLASH->CR |= FLASH_CR_PG;                         // Program the record
+  for( i = 0; i < sizeof( Crash_Record ) / 2; i++ )
+  {
+    dst[i] = src[i];
+    if( Crash_flashWait( ))
+      return 0;
+  }
+  return 1;
+}
+
+
+//  uint8_t
+//  Crash_flashWrite( const Crash_Record *rec )
+//  Unlock the flash, program the record, and lock the flash again whether or not that
+//  worked. Returns 1 if the programming succeeded and the record reads back correctly,
+//  otherwise 0.
+static uint8_t
+Crash_flashWrite( const Crash_Record *rec )
+{
+  const volatile uint16_t *dst = (const volatile uint16_t *)_scrashlog;
+  const uint16_t          *src = (const uint16_t *)rec;
+  uint8_t                  ok;
+  uint8_t                  i;
+
+  if( FLASH->CR & FLASH_CR_LOCK )                   // Unlock the flash controller
+  {
+    FLASH->KEYR = FLASH_KEY1;
+    FLASH->KEYR = FLASH_KEY2;
+  }
+  Crash_flashWait( );                               // Clear flags left from before
+  ok = Crash_flashProgram( rec );
+  FLASH->CR &= ~( FLASH_CR_PER | FLASH_CR_PG );
+  FLASH->CR |= FLASH_CR_LOCK;
+
+  if( !ok )
+    return 0;
+  for( i = 0; i < sizeof( Crash_Record ) / 2; i++ )
+    if( dst[i] != src[i] )
+      return 0;
+  return 1;
+}
+
+
+//  const Crash_Record *
+//  Crash_saved( void )
+//  Return the record saved in the CRASHLOG flash page if it is valid, otherwise 0.
+const Crash_Record *
+Crash_saved( void )
+{
+  const Crash_Record *rec = (const Crash_Record *)_scrashlog;
+
+  if( rec->magic == CRASH_MAGIC && rec->check == Crash_sum( rec ))
+    return rec;
+  return 0;
+}
+
+
+//  uint8_t
+//  Crash_check( void )
+//  Look for a valid record in .noinit RAM. After a power-up the RAM contents are random,
+//  so the magic number and checksum must both match. If found, copy the record to
+//  Crash_last, add it to the count of saved crashes, save it to flash, and clear the RAM
+//  copy so it is only reported once. Returns CRASH_SAVED, or CRASH_UNSAVED if the flash
+//  write failed, if a record was found, otherwise CRASH_NONE. After a failed write, the
+//  record in flash (if any) is not valid any more, so the next crash starts the count at 1.
+uint8_t
+Crash_check( void )
+{
+  const Crash_Record *saved;
+
+  if( Crash_noinit.magic != CRASH_MAGIC || Crash_noinit.check != Crash_sum( &Crash_noinit ))
+  {
+    Crash_noinit.magic = 0;
+    Crash_last.magic   = 0;
+    return CRASH_NONE;
+  }
+
+  Crash_last = Crash_noinit;
+  Crash_noinit.magic = 0;
+  saved = Crash_saved( );
+  Crash_last.count = ( saved ? saved->count : 0 ) + 1;
+  Crash_last.check = Crash_sum( &Crash_last );
+  if( !Crash_flashWrite( &Crash_last ))
+    return CRASH_UNSAVED;
+  return CRASH_SAVED;
+}
+
+#endif /* __STM32F030_CRASH_LIB_C */
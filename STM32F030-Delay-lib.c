@@ -3,10 +3,14 @@
 //  ------------------------------------------------------------------------------------------
 //  Code to implement the following routines:
 //    delay_us( uint32_t d )
-//      Delay d microseconds. Range: 5(?) to 858 million us (approx. 14 min, 18 s)
+//      Delay d microseconds. Range: 1 to 2147 million us (approx. 35 min, 47 s) at 8 MHz
 //    
 //    halt( void )
 //      Halts program by entering endless loop.
+//
+//    DELAY_POLL()
+//      Called once per pass by the loops that wait on a peripheral. Does nothing on the
+//      target. STM32F030-Host-lib.c defines it to run its virtual clock and peripheral models.
 //  ------------------------------------------------------------------------------------------
 //  https://github.com/EZdenki/STM32F030-Delay-lib
 //  Released under the MIT License
@@ -21,15 +25,31 @@
 #ifndef __STM32F103_DELAY_LIB_C
 #define __STM32F103_DELAY_LIB_C
 
+#ifndef DELAY_CLK_MHZ
+#define DELAY_CLK_MHZ 8       // CPU clock in MHz used to scale the delay loop
+#endif
+
+#ifndef DELAY_POLL
+#define DELAY_POLL()          // Hook for host builds. Nothing to do on the target.
+#endif
+
+
 //  delay_us
 //  Input: uint16_t d
-//  Causes a delay of approx d uS. The shortest time is approx. 8 us.
-//  ** Only works at clock speed of 8 MHz!
+//  Causes a delay of approx d uS. The shortest time is approx. 1 us.
+//  The loop is written in assembly so that its timing does not depend on the compiler
+//  optimization level. Each pass takes 4 clock cycles on the Cortex-M0 (SUBS = 1, taken
+//  BNE = 3) when running with zero flash wait states.
+//  ** Only works at clock speeds that are a multiple of 4 MHz!
 void
 delay_us( uint32_t d)
 {
-  d=d*5/7;
-  for( uint32_t x=0; x< d; x++) ;
+  d = d * ( DELAY_CLK_MHZ / 4 );    // Number of 4-cycle loop passes
+  if( d == 0 )
+    return;
+  __asm volatile( "1: subs %0, %0, #1 \n"
+                  "   bne  1b         \n"
+                  : "+l" ( d ) : : "cc" );
 }
 
 
@@ -0,0 +1,239 @@
+//  ==========================================================================================
+//  STM32F030-Fixed-lib.c
+//  ------------------------------------------------------------------------------------------
+//  Fixed-point arithmetic for sensor math on the STM32F030 (Cortex-M0). The Cortex-M0 has no
+//  FPU and only a 32 x 32 -> 32 bit multiply, so floating-point code pulls in large and slow
+//  software routines. The routines here use only 32-bit integer operations and shifts.
+//
+//  The main type is fix16_t, a signed Q16.16 value: 16 integer bits (including the sign) and
+//  16 fractional bits, covering -32768.0 to +32767.99998 in steps of 1/65536. Other Q formats
+//  are handled by the generic FIXQ() and fix_mulq() forms, which take the number of
+//  fractional bits as a parameter.
+//  ------------------------------------------------------------------------------------------
+//  https://github.com/EZdenki/STM32F030-CMSIS-I2C-AHT10-lib
+//  Released under the MIT License
+//  Copyright (c) 2023
+//  Mike Shegedin, EZdenki.com
+//  ------------------------------------------------------------------------------------------
+//  Target Device: STM32F030Fxxx
+//  ------------------------------------------------------------------------------------------
+//  Routines in this Library
+//
+//  FIX16( x )    FIXQ( x, q )
+//    Convert the floating-point *constant* x to Q16.16 (or Qn.q). These are meant for
+//    constants only; the compiler folds them, so no floating-point code is generated.
+//
+//  fix16_t
+//  fix16_fromInt( int32_t v )
+//    Convert a whole number to Q16.16.
+//
+//  fix16_t
+//  fix16_from100( int32_t v100 )
+//    Convert a value multiplied by 100 (2753 = 27.53) to Q16.16.
+//
+//  fix16_t
+//  fix16_fromRaw20( uint32_t raw, int32_t span, int32_t offset )
+//    Convert a 20-bit raw sensor reading, where 0 .. 2^20 maps to offset .. offset + span,
+//    to Q16.16.
+//
+//  int32_t
+//  fix16_round( fix16_t f )
+//    Round to the nearest whole number.
+//
+//  int32_t
+//  fix16_to100( fix16_t f )
+//    Round to the nearest value multiplied by 100 (27.53 -> 2753).
+//
+//  fix16_t
+//  fix16_add( fix16_t a, fix16_t b )
+//  fix16_t
+//  fix16_sub( fix16_t a, fix16_t b )
+//    Saturating add and subtract. Results clip at FIX16_MAX / FIX16_MIN instead of
+//    wrapping around.
+//
+//  int32_t
+//  fix_mulq( int32_t a, int32_t b, uint8_t q )
+//    Multiply a and b and shift the product right by q bits (1 to 31), saturating on
+//    overflow. A Qm.qa value times a Qn.qb value, shifted by q, gives a result with
+//    qa + qb - q fractional bits. The 64-bit product is built from four 16 x 16 bit
+//    multiplies, which the Cortex-M0 handles with single-cycle MULS instructions.
+//
+//  fix16_t
+//  fix16_mul( fix16_t a, fix16_t b )
+//    Saturating Q16.16 multiply, the same as fix_mulq( a, b, 16 ).
+//
+//  fix16_t
+//  fix16_lerpTable( const fix16_t *table, uint16_t n, fix16_t x0, uint8_t shift, fix16_t x )
+//    Look up x in a table of n values sampled every 2^shift Q16.16 units starting at x0,
+//    and linearly interpolate between the two nearest entries. Because the step is a power
+//    of two, the lookup needs no division.
+//  ==========================================================================================
+
+#ifndef __STM32F030_FIXED_LIB_C
+#define __STM32F030_FIXED_LIB_C
+
+#include <stdint.h>
+
+typedef int32_t fix16_t;                // Signed Q16.16 fixed-point value
+
+#define FIX16_ONE  ((fix16_t)0x00010000)  // 1.0
+#define FIX16_MAX  ((fix16_t)0x7FFFFFFF)  // Largest value,  +32767.99998
+#define FIX16_MIN  ((fix16_t)0x80000000)  // Smallest value, -32768.0
+
+//  Constant conversions. Rounds to nearest. Only use with constant arguments.
+#define FIXQ( x, q ) ((int32_t)( (x) * (double)( 1UL << (q) ) + ( (x) >= 0 ? 0.5 : -0.5 )))
+#define FIX16( x )   FIXQ( x, 16 )
+
+
+//  fix16_t
+//  fix16_fromInt( int32_t v )
+//  Convert a whole number to Q16.16.
+static inline fix16_t
+fix16_fromInt( int32_t v )
+{
+  return v * FIX16_ONE;
+}
+
+
+//  fix16_t
+//  fix16_from100( int32_t v100 )
+//  Convert a value multiplied by 100 (2753 = 27.53) to Q16.16. Multiplying by
+//  65536 / 100 = 655.36 is done as v100 * 655 + (( v100 * 23593 ) >> 16 ), where
+//  23593 / 65536 = 0.36. This avoids a division and stays within 32 bits for the full
+//  int16_t range.
+static inline fix16_t
+fix16_from100( int32_t v100 )
+{
+  return v100 * 655 + (( v100 * 23593 ) >> 16 );
+}
+
+
+//  fix16_t
+//  fix16_fromRaw20( uint32_t raw, int32_t span, int32_t offset )
+//  Convert a 20-bit raw sensor reading, where 0 .. 2^20 maps to offset .. offset + span, to
+//  Q16.16. This is ( raw / 2^20 ) * span + offset, done as a multiply and a shift. span
+//  must be 2047 or less so that raw * span fits in 32 bits.
+static inline fix16_t
+fix16_fromRaw20( uint32_t raw, int32_t span, int32_t offset )
+{
+  return (fix16_t)(( raw * (uint32_t)span ) >> 4 ) + fix16_fromInt( offset );
+}
+
+
+//  int32_t
+//  fix16_round( fix16_t f )
+//  Round a Q16.16 value to the nearest whole number. Halves round up (-2.5 -> -2).
+static inline int32_t
+fix16_round( fix16_t f )
+{
+  return ( f + ( FIX16_ONE / 2 )) >> 16;
+}
+
+
+//  int32_t
+//  fix16_to100( fix16_t f )
+//  Convert a Q16.16 value to the nearest value multiplied by 100 (27.53 -> 2753). The whole
+//  and fractional parts are scaled separately so that no intermediate result exceeds 32
+//  bits.
+static inline int32_t
+fix16_to100( fix16_t f )
+{
+  return ( f >> 16 ) * 100 + ((( f & 0xFFFF ) * 100 + 0x8000 ) >> 16 );
+}
+
+
+//  fix16_t
+//  fix16_add( fix16_t a, fix16_t b )
+//  Saturating add. Overflow can only occur when both operands have the same sign and the
+//  sign of the sum differs from it.
+static inline fix16_t
+fix16_add( fix16_t a, fix16_t b )
+{
+  uint32_t sum = (uint32_t)a + (uint32_t)b;
+
+  if( !(( a ^ b ) & 0x80000000 ) && (( a ^ sum ) & 0x80000000 ))
+    return ( a < 0 ) ? FIX16_MIN : FIX16_MAX;
+  return (fix16_t)sum;
+}
+
+
+//  fix16_t
+//  fix16_sub( fix16_t a, fix16_t b )
+//  Saturating subtract. Overflow can only occur when the operands have different signs and
+//  the sign of the difference differs from a.
+static inline fix16_t
+fix16_sub( fix16_t a, fix16_t b )
+{
+  uint32_t diff = (uint32_t)a - (uint32_t)b;
+
+  if((( a ^ b ) & 0x80000000 ) && (( a ^ diff ) & 0x80000000 ))
+    return ( a < 0 ) ? FIX16_MIN : FIX16_MAX;
+  return (fix16_t)diff;
+}
+
+
+//  int32_t
+//  fix_mulq( int32_t a, int32_t b, uint8_t q )
+//  Multiply a and b, and return the 64-bit product shifted right by q bits (1 to 31). The
+//  result rounds toward minus infinity and saturates if it does not fit in 32 bits.
+//  a = ah * 2^16 + al and b = bh * 2^16 + bl, with ah and bh signed and al and bl unsigned,
+//  so the product is ( ah*bh << 32 ) + (( ah*bl + al*bh ) << 16 ) + al*bl. Each partial
+//  product fits in 32 bits.
+static inline int32_t
+fix_mulq( int32_t a, int32_t b, uint8_t q )
+{
+  int32_t  ah = a >> 16,      bh = b >> 16;       // Signed upper halves
+  uint32_t al = a & 0xFFFF,   bl = b & 0xFFFF;    // Unsigned lower halves
+  int32_t  mid1 = ah * (int32_t)bl;               // Cross products
+  int32_t  mid2 = (int32_t)al * bh;
+  int32_t  hi = ah * bh;                          // Product bits [63:32]
+  uint32_t lo = al * bl;                          // Product bits [31:0]
+  uint32_t t;
+
+  t = (uint32_t)mid1 << 16;                       // Add in the first cross product
+  lo += t;
+  hi += ( mid1 >> 16 ) + ( lo < t );
+  t = (uint32_t)mid2 << 16;                       // Add in the second cross product
+  lo += t;
+  hi += ( mid2 >> 16 ) + ( lo < t );
+
+  // The result is product bits [q+31:q]. It fits if all bits above it (hi[31:q-1]) are
+  // copies of the sign.
+  if(( hi >> ( q - 1 )) != ( hi >> 31 ))
+    return ( hi < 0 ) ? FIX16_MIN : FIX16_MAX;
+  return (int32_t)(( (uint32_t)hi << ( 32 - q )) | ( lo >> q ));
+}
+
+
+//  fix16_t
+//  fix16_mul( fix16_t a, fix16_t b )
+//  Saturating Q16.16 multiply. Rounds toward minus infinity.
+static inline fix16_t
+fix16_mul( fix16_t a, fix16_t b )
+{
+  return fix_mulq( a, b, 16 );
+}
+
+
+//  fix16_t
+//  fix16_lerpTable( const fix16_t *table, uint16_t n, fix16_t x0, uint8_t shift, fix16_t x )
+//  Look up x in a table of n values sampled at x0, x0 + step, x0 + 2*step, etc., where the
+//  step is 2^shift in Q16.16 units (shift = 16 is a step of 1.0, shift = 13 is 0.125), and
+//  linearly interpolate between the two nearest entries. Values of x outside of the table
+//  return the first or last entry.
+static inline fix16_t
+fix16_lerpTable( const fix16_t *table, uint16_t n, fix16_t x0, uint8_t shift, fix16_t x )
+{
+  uint32_t pos, i, frac;
+
+  if( x <= x0 )
+    return table[0];
+  pos  = (uint32_t)x - (uint32_t)x0;            // Distance from the start of the table
+  i    = pos >> shift;                          // Index of the entry below x
+  if( i >= (uint32_t)( n - 1 ))
+    return table[n - 1];
+  frac = pos & (( 1UL << shift ) - 1 );         // Position between entry i and i + 1
+  return table[i] + fix_mulq( table[i + 1] - table[i], frac, shift );
+}
+
+#endif /* __STM32F030_FIXED_LIB_C */
@@ -0,0 +1,486 @@
+//  ==========================================================================================
+//  STM32F030-Fusion-lib.c
+//  ------------------------------------------------------------------------------------------
+//  Combine the readings of two to FUSION_MAX redundant sensors (for example two or three
+//  AHT10s on different addresses or buses) into one output. Each sample, the median of the
+//  sensors is taken for every field (temperature, humidity, pressure). Each sensor is
+//  compared with the median. A sensor that fails, or that disagrees with the majority for
+//  FUSION_DROP samples in a row, is dropped from the vote. It is taken back once it has
+//  agreed with the median for FUSION_REJOIN samples in a row. The median can then be
+//  smoothed by a complementary or a Kalman filter to lower the noise of the output.
+//  ------------------------------------------------------------------------------------------
+//  https://github.com/EZdenki/STM32F030-CMSIS-I2C-AHT10-lib
+//  Released under the MIT License
+//  Copyright (c) 2023
+//  Mike Shegedin, EZdenki.com
+//  ------------------------------------------------------------------------------------------
+//  Target Device: STM32F030Fxxx
+//  ------------------------------------------------------------------------------------------
+//  Usage with the sampling engine (all sensors with the same periodMs, so that they are
+//  started together):
+//
+//    Sensor  a, b, c;
+//    Sensor *room[] = { &a, &b, &c };
+//    Fusion  fused;
+//
+//    Sensor_init( &a, &AHT10_driver, I2C1, 0, 0,    0, 0x38, 0, 10000 );
+//    Sensor_init( &b, &AHT10_driver, I2C1, 0, 0,    0, 0x39, 0, 10000 );
+//    Sensor_init( &c, &AHT10_driver, I2C1, 0, &mux, 1, 0x38, 0, 10000 );
+//    Fusion_init( &fused, room, 3, FUSION_KALMAN, FIX16( 0.001 ), FIX16( 0.01 ));
+//    while( 1 )
+//    {
+//      Sensor_run( room, 3 );
+//      if( Fusion_ready( &fused ) && Fusion_update( &fused ))
+//        ...                                    // New output in fused.out
+//      __WFI( );
+//    }
+//
+//  Without the engine, Fusion_read( &fused ) takes one blocking reading of all sensors.
+//  ------------------------------------------------------------------------------------------
+//  Routines in this Library
+//
+//  void
+//  Fusion_init( Fusion *f, Sensor **sensors, uint8_t n, uint8_t mode, fix16_t a, fix16_t b )
+//    Set up fusion of n sensors (at most FUSION_MAX). mode selects the output filter:
+//      FUSION_MEDIAN  The median is output as it is. a and b are not used.
+//      FUSION_COMPL   out += a * ( median - out ). a is the weight of a new sample, from
+//                     0 to 1. For example, FIX16( 0.25 ) averages over approx. 4 samples.
+//      FUSION_KALMAN  Scalar Kalman filter for a value that drifts slowly. a is the process
+//                     noise (how much the true value may change per sample) and b the
+//                     measurement noise, both as variances: for example FIX16( 0.001 ) and
+//                     FIX16( 0.01 ) for 0.03 C and 0.1 C. The ratio sets the smoothing.
+//    The filters apply to all fields, in their own units. If the median moves by more than
+//    twice the tolerance of the field in one sample, the filter jumps to it instead of
+//    following it slowly.
+//
+//  uint8_t
+//  Fusion_ready( Fusion *f )
+//    Return 1 when every sensor in the vote has either a fresh reading or a new error,
+//    which is when Fusion_update should be called.
+//
+//  uint8_t
+//  Fusion_update( Fusion *f )
+//    Vote on the fresh readings, update the per-sensor tracking, and filter the median
+//    into out. Clears the fresh flags of the sensors. Returns the number of sensors used,
+//    or 0 if there was nothing to vote on, in which case out is not changed.
+//
+//  uint8_t
+//  Fusion_read( Fusion *f )
+//    Start a conversion on every sensor, wait for the slowest, read all of them, and call
+//    Fusion_update. For programs that do not use Sensor_run. Returns as Fusion_update.
+//
+//  After Fusion_update, f->median is the vote and f->out the filtered output. For each
+//  sensor, f->m[i] holds the number of samples it disagreed with the median or had no
+//  reading, how often it was dropped, whether it is dropped now, and how far its last
+//  temperature was from the median.
+//  ------------------------------------------------------------------------------------------
+//  Voting:
+//  -------
+//  With three or more sensors, the median belongs to the majority, and a sensor further
+//  than the tolerance from it is out of line. With two, the median is the mean and cannot
+//  tell which one is wrong. A disagreement is then counted against both, but neither is
+//  dropped for it. A sensor that fails is dropped after FUSION_DROP failures in a row
+//  however many sensors there are. If every sensor has been dropped, the median of all
+//  sensors that gave a reading is used, so that they can rejoin.
+//  ==========================================================================================
+
+#ifndef __STM32F030_FUSION_LIB_C
+#define __STM32F030_FUSION_LIB_C
+
+#include "stm32f030x6.h"          // Primary CMSIS header file
+#include "STM32F030-Fixed-lib.c"  // fix16_t
+#include "STM32F030-Sensor-lib.c" // Sensor, Sensor_Reading
+#include "STM32F030-Delay-lib.c"  // delay_us for Fusion_read
+
+#ifndef FUSION_MAX
+#define FUSION_MAX        4             // Most sensors in one group
+#endif
+#define FUSION_FIELDS     3             // temp, humid and press of Sensor_Reading
+#define FUSION_DROP       3             // Bad samples in a row before a sensor is dropped
+#define FUSION_REJOIN     5             // Good samples in a row before it is used again
+
+//  Tolerances: the largest difference from the median that still counts as agreeing
+#ifndef FUSION_TOL_TEMP
+#define FUSION_TOL_TEMP   FIX16( 1.0 )  // Degrees C
+#endif
+#ifndef FUSION_TOL_HUMID
+#define FUSION_TOL_HUMID  FIX16( 5.0 )  // Percent relative humidity
+#endif
+#ifndef FUSION_TOL_PRESS
+#define FUSION_TOL_PRESS  FIX16( 2.0 )  // hPa
+#endif
+
+//  Output filters
+#define FUSION_MEDIAN     0             // Median, not filtered
+#define FUSION_COMPL      1             // Complementary (first-order low-pass) filter
+#define FUSION_KALMAN     2             // Scalar Kalman filter
+
+typedef struct
+{
+  Sensor  *sensor;
+  uint16_t errorsSeen;                  // sensor->errors at the last update
+  uint16_t disagree;                    // Samples further than the tolerance from the median
+  uint16_t missed;                      // Samples without a reading
+  uint16_t drops;                       // Times dropped from the vote
+  fix16_t  dev;                         // Last temperature minus the median
+  uint8_t  bad;                         // Bad samples in a row
+  uint8_t  good;                        // Good samples in a row while dropped
+  uint8_t  dropped;                     // Not used in the vote
+} Fusion_Member;
+
+typedef struct
+{
+  fix16_t x;                            // Estimate
+  fix16_t p;                            // Error variance of the estimate (Kalman only)
+} Fusion_Est;
+
+typedef struct
+{
+  Fusion_Member  m[ FUSION_MAX ];
+  Fusion_Est     est[ FUSION_FIELDS ];
+  Sensor_Reading median;                // Vote of the last sample
+  Sensor_Reading out;                   // Filtered output
+  fix16_t        a, b;                  // Filter settings, see Fusion_init
+  uint8_t        n;                     // Number of sensors
+  uint8_t        mode;                  // FUSION_MEDIAN, FUSION_COMPL or FUSION_KALMAN
+  uint8_t        voters;                // Sensors used in the last vote
+} Fusion;
+
+static const fix16_t Fusion_tol[ FUSION_FIELDS ] =
+  { FUSION_TOL_TEMP, FUSION_TOL_HUMID, FUSION_TOL_PRESS };
+
+
+//  void
+//  Fusion_init( Fusion *f, Sensor **sensors, uint8_t n, uint8_t mode, fix16_t a, fix16_t b )
+//  Clear the tracking of all sensors. The errors already counted by a sensor are not held
+//  against it.
+void
+Fusion_init( Fusion *f, Sensor **sensors, uint8_t n, uint8_t mode, fix16_t a, fix16_t b )
+{
+  if( n > FUSION_MAX )
+    n = FUSION_MAX;
+  for( uint8_t i = 0; i < n; i++ )
+  {
+    Fusion_Member *m = &f->m[i];
+
+    m->sensor     = sensors[i];
+    m->errorsSeen = sensors[i]->errors;
+    m->disagree   = 0;
+    m->missed     = 0;
+    m->drops      = 0;
+    m->dev        = 0;
+    m->bad        = 0;
+    m->good       = 0;
+    m->dropped    = 0;
+  }
+  f->n            = n;
+  f->mode         = mode;
+  f->a            = a;
+  f->b            = b;
+  f->voters       = 0;
+  f->median.valid = 0;
+  f->out.valid    = 0;
+}
+
+
+//  fix16_t *
+//  Fusion_field( Sensor_Reading *r, uint8_t i )
+//  Return field i of a reading: 0 temp, 1 humid, 2 press. The valid bit of field i is
+//  1 << i.
+static fix16_t *
+Fusion_field( Sensor_Reading *r, uint8_t i )
+{
+  switch( i )
+  {
+    case 0:  return &r->temp;
+    case 1:  return &r->humid;
+    default: return &r->press;
+  }
+}
+
+
+//  uint8_t
+//  Fusion_ready( Fusion *f )
+//  A sensor that is not fresh and has no new error is still converting. Dropped sensors
+//  are not waited for, unless all of them are dropped.
+uint8_t
+Fusion_ready( Fusion *f )
+{
+  uint8_t active = 0, waiting = 0, droppedDone = 0;
+
+  for( uint8_t i = 0; i < f->n; i++ )
+  {
+    Fusion_Member *m    = &f->m[i];
+    uint8_t        done = m->sensor->fresh || m->sensor->errors != m->errorsSeen;
+
+    if( !m->dropped )
+    {
+      active++;
+      if( !done )
+        waiting++;
+    }
+    else if( done )
+      droppedDone = 1;
+  }
+  if( !active )                         // A dropped sensor is only used if all are dropped
+    return droppedDone;
+  return !waiting;
+}
+
+
+//  fix16_t
+//  Fusion_median( fix16_t *v, uint8_t k )
+//  Sort the k values (insertion sort, k is at most FUSION_MAX) and return the middle one,
+//  or the mean of the middle two for an even k.
+static fix16_t
+Fusion_median( fix16_t *v, uint8_t k )
+{
+  for( uint8_t i = 1; i < k; i++ )
+  {
+    fix16_t x = v[i];
+    uint8_t j = i;
+
+    for( ; j > 0 && v[j - 1] > x; j-- )
+      v[j] = v[j - 1];
+    v[j] = x;
+  }
+  if( k & 1 )
+    return v[ k / 2 ];
+  return v[ k / 2 - 1 ] + ( v[ k / 2 ] - v[ k / 2 - 1 ] ) / 2;
+}
+
+
+//  uint8_t
+//  Fusion_vote( Fusion *f, Sensor_Reading *r, uint8_t use )
+//  Take the median of each field over the sensors whose bit is set in use. Returns the
+//  number of sensors with a bit in use.
+static uint8_t
+Fusion_vote( Fusion *f, Sensor_Reading *r, uint8_t use )
+{
+  fix16_t v[ FUSION_MAX ];
+  uint8_t voters = 0;
+
+  for( uint8_t i = 0; i < f->n; i++ )
+    if( use & ( 1U << i ))
+      voters++;
+
+  f->median.valid = 0;
+  for( uint8_t field = 0; field < FUSION_FIELDS; field++ )
+  {
+    uint8_t k = 0;
+
+    for( uint8_t i = 0; i < f->n; i++ )
+      if(( use & ( 1U << i )) && ( r[i].valid & ( 1U << field )))
+        v[ k++ ] = *Fusion_field( &r[i], field );
+    if( k )
+    {
+      *Fusion_field( &f->median, field ) = Fusion_median( v, k );
+      f->median.valid |= 1U << field;
+    }
+  }
+  return voters;
+}
+
+
+//  void
+//  Fusion_bad( Fusion_Member *m )
+//  Count a bad sample, and drop the sensor after FUSION_DROP of them in a row.
+static void
+Fusion_bad( Fusion_Member *m )
+{
+  m->good = 0;
+  if( ++m->bad >= FUSION_DROP && !m->dropped )
+  {
+    m->dropped = 1;
+    m->drops++;
+  }
+}
+
+
+//  fix16_t
+//  Fusion_gain( fix16_t p, fix16_t s )
+//  Return p / s as Q16.16, for 0 <= p <= s. Both are shifted down until s fits in 15 bits,
+//  so that p << 16 cannot overflow. This keeps at least 14 bits of the gain.
+static fix16_t
+Fusion_gain( fix16_t p, fix16_t s )
+{
+  while( s >= ( 1 << 15 ))
+  {
+    p >>= 1;
+    s >>= 1;
+  }
+  if( s <= 0 )
+    return FIX16_ONE;
+  return ( p << 16 ) / s;
+}
+
+
+//  void
+//  Fusion_filter( Fusion *f )
+//  Move each field of out toward the median. The Kalman filter predicts that the value
+//  stays the same while its uncertainty grows by a; the gain then weighs that against
+//  the measurement noise b. For a constant a and b the gain settles after a few samples.
+static void
+Fusion_filter( Fusion *f )
+{
+  for( uint8_t field = 0; field < FUSION_FIELDS; field++ )
+  {
+    uint8_t     bit = 1U << field;
+    Fusion_Est *e   = &f->est[ field ];
+    fix16_t     z   = *Fusion_field( &f->median, field );
+    fix16_t     d;
+
+    if( !( f->median.valid & bit ))
+    {
+      f->out.valid &= ~bit;
+      continue;
+    }
+    d = fix16_sub( z, e->x );
+    if( f->mode == FUSION_MEDIAN || !( f->out.valid & bit ) ||
+        d > 2 * Fusion_tol[ field ] || d < -2 * Fusion_tol[ field ])
+    {
+      e->x = z;                         // Start, or jump to a real step change
+      e->p = f->b;
+    }
+    else if( f->mode == FUSION_COMPL )
+      e->x = fix16_add( e->x, fix16_mul( f->a, d ));
+    else
+    {
+      fix16_t k;
+
+      e->p = fix16_add( e->p, f->a );
+      k    = Fusion_gain( e->p, fix16_add( e->p, f->b ));
+      e->x = fix16_add( e->x, fix16_mul( k, d ));
+      e->p = fix16_sub( e->p, fix16_mul( k, e->p ));
+    }
+    *Fusion_field( &f->out, field ) = e->x;
+    f->out.valid |= bit;
+  }
+}
+
+
+//  uint8_t
+//  Fusion_update( Fusion *f )
+//  Collect the fresh readings, count the sensors without one, vote over the sensors that
+//  are not dropped (or over all of them if every sensor is dropped), and compare every
+//  reading with the median.
+uint8_t
+Fusion_update( Fusion *f )
+{
+  Sensor_Reading r[ FUSION_MAX ];
+  uint8_t        got = 0, use;
+
+  for( uint8_t i = 0; i < f->n; i++ )
+  {
+    Fusion_Member *m = &f->m[i];
+    Sensor        *s = m->sensor;
+
+    m->errorsSeen = s->errors;
+    if( s->fresh )
+    {
+      r[i]     = s->reading;
+      s->fresh = 0;
+      got     |= 1U << i;
+    }
+    else
+    {
+      m->missed++;
+      Fusion_bad( m );
+    }
+  }
+
+  use = 0;
+  for( uint8_t i = 0; i < f->n; i++ )
+    if( !f->m[i].dropped )
+      use |= 1U << i;
+  use &= got;
+  if( !use )
+    use = got;
+  if( !( f->voters = Fusion_vote( f, r, use )))
+    return 0;
+
+  for( uint8_t i = 0; i < f->n; i++ )
+  {
+    Fusion_Member *m     = &f->m[i];
+    uint8_t        agree = 1;
+
+    if( !( got & ( 1U << i )))
+      continue;
+    for( uint8_t field = 0; field < FUSION_FIELDS; field++ )
+    {
+      fix16_t d;
+
+      if( !( r[i].valid & f->median.valid & ( 1U << field )))
+        continue;
+      d = fix16_sub( *Fusion_field( &r[i], field ), *Fusion_field( &f->median, field ));
+      if( field == 0 )
+        m->dev = d;
+      if( d > Fusion_tol[ field ] || d < -Fusion_tol[ field ])
+        agree = 0;
+    }
+    if( agree )
+    {
+      m->bad = 0;
+      if( m->dropped && ++m->good >= FUSION_REJOIN )
+        m->dropped = 0;
+    }
+    else
+    {
+      m->disagree++;
+      if( f->voters >= 3 || m->dropped )  // Two sensors cannot outvote each other
+        Fusion_bad( m );
+    }
+  }
+
+  Fusion_filter( f );
+  return f->voters;
+}
+
+
+//  uint8_t
+//  Fusion_read( Fusion *f )
+//  Start all sensors first, so that their conversions run at the same time and measure
+//  the same moment, then wait for the slowest and finish each one. A sensor that fails
+//  gets its error counted as Sensor_run would, and has no fresh reading.
+uint8_t
+Fusion_read( Fusion *f )
+{
+  uint8_t  started = 0;
+  uint16_t wait    = 0;
+  uint8_t  status;
+
+  for( uint8_t i = 0; i < f->n; i++ )
+  {
+    Sensor *s = f->m[i].sensor;
+
+    if(( status = s->drv->start( s )) != I2C_OK )
+    {
+      s->status = status;
+      s->errors++;
+      continue;
+    }
+    started |= 1U << i;
+    if( s->drv->convMs > wait )
+      wait = s->drv->convMs;
+  }
+  delay_us( wait * 1000UL );
+
+  for( uint8_t i = 0; i < f->n; i++ )
+  {
+    Sensor        *s = f->m[i].sensor;
+    Sensor_Reading r;
+
+    if( !( started & ( 1U << i )))
+      continue;
+    if(( s->status = Sensor_finish( s, &r )) != I2C_OK )
+    {
+      s->errors++;
+      continue;
+    }
+    s->reading = r;
+    s->fresh   = 1;
+  }
+  return Fusion_update( f );
+}
+
+#endif /* __STM32F030_FUSION_LIB_C */
@@ -0,0 +1,970 @@
+//  ==========================================================================================
+//  STM32F030-Host-lib.c
+//  ------------------------------------------------------------------------------------------
+//  Runs the libraries of this project on a PC, for tests and simulation. Include this file
+//  before any other library. It maps the CMSIS peripheral pointers (GPIOA, I2C1, SysTick,
+//  etc.) to plain structs in host memory and replaces the target-only parts:
+//
+//    - delay_us, halt and the other routines of STM32F030-Delay-lib.c advance a virtual
+//      clock instead of spinning, and so do __WFI() and DELAY_POLL(), the hook that the
+//      libraries call in every loop that waits on a peripheral.
+//    - SysTick counts down with the virtual clock and calls SysTick_Handler every 1 ms
+//      while it is enabled, so SysTick_ms and SysTick_us work as on the target.
+//    - NVIC_EnableIRQ, NVIC_DisableIRQ, __disable_irq, __enable_irq and the PRIMASK access
+//      routines only keep track of the state.
+//    - GPIOA and GPIOB apply BSRR and BRR writes to ODR and update IDR. Pins that are not
+//      outputs read as Host_gpioIn (all high by default, as with pull-ups). Open-drain
+//      outputs read low if either the pin or Host_gpioIn is low, so a device can pull a
+//      line of a bit-banged bus low.
+//    - I2C1 is a model of the I2C master with the devices attached by Host_i2cAttach. It
+//      moves bytes at the speed set in TIMINGR and sets the ISR flags as the interface
+//      does, and Host_i2cFault makes it fail in the ways a real bus can.
+//    - ADC1 and DMA1 channel 1 convert the temperature sensor and VREFINT for the supply
+//      Host_vddMv and the die temperature Host_dieTemp100, into the DMA buffer ADC_buf of
+//      STM32F030-ADC-lib.c. The whole buffer is refreshed every HOST_ADC_REFRESH_MS
+//      instead of at each conversion. The analog watchdog calls ADC1_IRQHandler.
+//    - FLASH erases the page _scrashlog, which stands in for the CRASHLOG page of the
+//      linker script, once unlocked. Erasing and programming take no time.
+//    - STM32F030-Stack-lib.c is replaced, and its figures are 0: The host has no painted RAM
+//      to measure.
+//
+//  The virtual clock counts CPU cycles at DELAY_CLK_MHZ. It only moves when the program
+//  waits, so the code itself takes no time. A poll in a wait loop counts as
+//  HOST_POLL_CYCLES, the length of one polling pass on the target. A longer wait jumps
+//  from one event to the next (a SysTick, the end of an I2C bit sequence or Host_timer),
+//  so hours of virtual time pass in seconds. host/sim.c runs the whole of main.c this way.
+//
+//  For tests, HOST_CHECK( cond ) and HOST_EQ( a, b ) count and report failed checks, and
+//  Host_summary returns the exit code for the test program.
+//  ------------------------------------------------------------------------------------------
+//  https://github.com/EZdenki/STM32F030-CMSIS-I2C-AHT10-lib
+//  Released under the MIT License
+//  Copyright (c) 2023
+//  Mike Shegedin, EZdenki.com
+//  ------------------------------------------------------------------------------------------
+//  Target Device: None. Built with the host compiler (HOSTCC in the Makefile), for example:
+//    gcc -std=gnu11 -I<CMSIS includes> -I. -o test test/test-convert.c
+//  ------------------------------------------------------------------------------------------
+//  Routines in this Library
+//
+//  uint64_t
+//  Host_cycles
+//    The virtual clock, in CPU cycles since the program started.
+//
+//  uint64_t
+//  Host_us( void )
+//    Return the virtual time in microseconds.
+//
+//  void
+//  Host_advance( uint64_t cycles )
+//    Move the virtual clock forward, running SysTick and the peripheral models.
+//
+//  void
+//  Host_poll( void )
+//    Called by DELAY_POLL(): one pass of a polling loop.
+//
+//  void
+//  Host_i2cAttach( const Host_I2cDevice *dev )
+//    Put a device on the I2C1 bus. The callbacks of dev are called as the master addresses
+//    the device, writes and reads bytes, and sends the STOP.
+//
+//  void
+//  Host_i2cFault( uint8_t fault, uint8_t at, uint32_t value )
+//    Make byte at (0: the address, 1: the first data byte) of the next transaction that
+//    gets that far fail with fault:
+//      HOST_FAULT_NACK     The byte is not acknowledged.
+//      HOST_FAULT_BERR     A bus error (misplaced START or STOP) during the byte.
+//      HOST_FAULT_ARLO     Arbitration is lost during the byte.
+//      HOST_FAULT_STRETCH  The device stretches the clock for value us.
+//      HOST_FAULT_STUCK    The device holds SDA low during the byte, until SCL has been
+//                          pulsed value times by hand (see I2C_recover).
+//
+//  uint32_t
+//  Host_sclPulses
+//    SCL (PA9) pulses made by hand while the pin was a GPIO output.
+//
+//  void
+//  ( *Host_gpioWatch )( uint8_t port, uint32_t odr, uint32_t old )
+//    If set, called whenever the output levels of GPIOA (port 0) or GPIOB (1) change from
+//    old to odr. Devices wired to GPIO pins, like an LCD, are modelled this way. Changes to
+//    Host_gpioIn made here are seen in IDR at once.
+//
+//  void
+//  ( *Host_timer )( void )
+//  uint64_t
+//  Host_timerAt
+//    If set, Host_timer is called once the virtual clock reaches Host_timerAt (in cycles).
+//    It must move Host_timerAt forward or clear Host_timer, and must not wait itself.
+//
+//  char *
+//  itoa( int value, char *str, int base )
+//    The itoa of newlib, which the C library of the host does not have.
+//
+//  HOST_CHECK( cond )
+//  HOST_EQ( a, b )
+//    Count a check, and print the file, line and expression (and both values for
+//    HOST_EQ) if it fails.
+//
+//  int
+//  Host_summary( const char *name )
+//    Print the number of checks and failures. Returns 0 if all checks passed, otherwise 1.
+//  ==========================================================================================
+
+#ifndef __STM32F030_HOST_LIB_C
+#define __STM32F030_HOST_LIB_C
+
+#define HOST_SIM                        // Lets the libraries leave out target-only code
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "stm32f030x6.h"                // Primary CMSIS header file
+
+#ifndef DELAY_CLK_MHZ
+#define DELAY_CLK_MHZ 8                 // CPU clock in MHz of the virtual clock
+#endif
+
+#define HOST_POLL_CYCLES 8              // Cycles of one polling pass
+
+//  Peripherals. Each CMSIS pointer is redefined to point to a struct in host memory.
+GPIO_TypeDef        Host_gpioa, Host_gpiob;   // Reached through Host_gpioSync
+RCC_TypeDef         Host_rcc;
+I2C_TypeDef         Host_i2c1;
+ADC_TypeDef         Host_adc1;
+ADC_Common_TypeDef  Host_adcCommon;
+DMA_TypeDef         Host_dma1;
+DMA_Channel_TypeDef Host_dma1Ch1;
+FLASH_TypeDef       Host_flash = { .CR = FLASH_CR_LOCK };  // Reached through Host_flashSync
+SysTick_Type        Host_systick;
+
+#undef  GPIOA
+#define GPIOA         Host_gpioSync( &Host_gpioa )
+#undef  GPIOB
+#define GPIOB         Host_gpioSync( &Host_gpiob )
+#undef  RCC
+#define RCC           ( &Host_rcc )
+#undef  I2C1
+#define I2C1          ( &Host_i2c1 )
+#undef  ADC1
+#define ADC1          ( &Host_adc1 )
+#undef  ADC1_COMMON
+#define ADC1_COMMON   ( &Host_adcCommon )
+#undef  DMA1
+#define DMA1          ( &Host_dma1 )
+#undef  DMA1_Channel1
+#define DMA1_Channel1 ( &Host_dma1Ch1 )
+#undef  FLASH
+#define FLASH         Host_flashSync( )
+#undef  SysTick
+#define SysTick       Host_sysTick( )
+
+//  Interrupts. Handlers that the program does not define are weak and stay 0.
+void SysTick_Handler( void ) __attribute__(( weak ));
+void ADC1_IRQHandler( void ) __attribute__(( weak ));
+
+uint32_t Host_primask;                  // 1 while interrupts are disabled
+uint32_t Host_nvicEnabled;              // NVIC enable bits, by IRQ number
+uint32_t Host_tickPending;              // SysTicks that occurred while interrupts were off
+
+#undef  NVIC_EnableIRQ
+#define NVIC_EnableIRQ( irq )   ( Host_nvicEnabled |=  ( 1UL << (irq) ))
+#undef  NVIC_DisableIRQ
+#define NVIC_DisableIRQ( irq )  ( Host_nvicEnabled &= ~( 1UL << (irq) ))
+#define __disable_irq()         ( Host_primask = 1 )
+#define __enable_irq()          Host_setPrimask( 0 )
+#define __get_PRIMASK()         ( Host_primask )
+#define __set_PRIMASK( m )      Host_setPrimask( m )
+#undef  __NOP
+#define __NOP()                 Host_advance( 1 )
+#undef  __WFI
+#define __WFI()                 Host_wfi( )
+
+//  Replace STM32F030-Delay-lib.c
+#define __STM32F103_DELAY_LIB_C
+#define DELAY_POLL()            Host_poll( )
+
+//  Replace STM32F030-Stack-lib.c
+#define __STM32F030_STACK_LIB_C
+
+uint64_t Host_cycles;                   // Virtual clock in CPU cycles
+uint64_t Host_tickStart;                // Virtual time when SysTick was last enabled
+uint8_t  Host_tickOn;                   // SysTick was enabled at the last step
+
+//  GPIO
+#define HOST_SCL  ( 1U << 9 )           // I2C1 pins on port A
+#define HOST_SDA  ( 1U << 10 )
+
+uint32_t Host_gpioIn[ 2 ] = { 0xFFFF, 0xFFFF };  // Levels of the pins that are not outputs
+uint32_t Host_gpioOdr[ 2 ];             // ODR at the last sync, to find the edges
+uint32_t Host_sclPulses;                // SCL pulses made by hand
+void   (*Host_gpioWatch)( uint8_t port, uint32_t odr, uint32_t old );
+
+//  Events of the program that runs on the host
+void   (*Host_timer)( void );           // Called at Host_timerAt
+uint64_t Host_timerAt;
+
+//  I2C1
+typedef struct
+{
+  uint8_t   address;                    // 7-bit address
+  uint8_t (*start)( uint8_t read );     // Addressed for a read (1) or write. 0 to NACK.
+  uint8_t (*write)( uint8_t data );     // Byte written by the master. 0 to NACK.
+  uint8_t (*read)( void );              // Next byte to send to the master
+  void    (*stop)( void );              // End of the transaction, may be 0
+} Host_I2cDevice;
+
+#define HOST_I2C_DEVICES   8            // Devices on the bus
+
+#define HOST_FAULT_NACK    1            // Faults for Host_i2cFault
+#define HOST_FAULT_BERR    2
+#define HOST_FAULT_ARLO    3
+#define HOST_FAULT_STRETCH 4
+#define HOST_FAULT_STUCK   5
+
+#define HOST_I2C_IDLE      0            // States of the I2C1 model: Bus free
+#define HOST_I2C_ADDR      1            //   Sending START and the address byte
+#define HOST_I2C_TXWAIT    2            //   TXIS set, waiting for a write to TXDR
+#define HOST_I2C_TX        3            //   Sending a data byte
+#define HOST_I2C_RX        4            //   Receiving a data byte
+#define HOST_I2C_RXFULL    5            //   RXNE set, waiting for RXDR to be read
+#define HOST_I2C_DONE      6            //   NBYTES moved and TC set, waiting for STOP
+#define HOST_I2C_STOPPING  7            //   Sending STOP
+#define HOST_I2C_HUNG      8            //   SDA held low by a device, nothing moves
+
+#define HOST_TXDR_EMPTY    0x100        // Kept in TXDR until the program writes a byte
+
+typedef struct
+{
+  const Host_I2cDevice *dev[ HOST_I2C_DEVICES ];
+  const Host_I2cDevice *cur;            // Device addressed by the transaction, or 0
+  uint8_t  state;
+  uint8_t  read;                        // The transaction is a read
+  uint8_t  nBytes;                      // NBYTES of the transaction
+  uint8_t  done;                        // Data bytes moved
+  uint8_t  data;                        // Byte being sent
+  uint8_t  rxSeen;                      // RXNE was set when the program last polled
+  uint8_t  fault;                       // Fault set by Host_i2cFault, or 0
+  uint8_t  faultAt;
+  uint32_t faultValue;
+  uint32_t stuck;                       // SCL pulses until SDA is released, or 0
+  uint64_t until;                       // Time when the current bit sequence ends
+} Host_I2c;
+
+Host_I2c Host_i2c;
+
+//  ADC1 and DMA1 channel 1
+#define HOST_W1C           0x80000000UL // Kept in a status register that is cleared by
+                                        // writing 1s, to tell when the program wrote it
+#define HOST_ADC_REFRESH_MS 10          // Time between updates of the DMA buffer
+#define HOST_ADC_CONV_CYCLES ( 63 * DELAY_CLK_MHZ )  // One conversion: 252 cycles at 4 MHz
+
+#define ADC_VREFINT_CAL    Host_vrefintCal  // Calibration values for STM32F030-ADC-lib.c
+#define ADC_TS_CAL1        Host_tsCal1
+
+extern volatile uint16_t ADC_buf[] __attribute__(( weak ));  // DMA buffer of the ADC library
+
+uint16_t Host_vrefintCal = 1526;        // Typical VREFINT reading at 3.3 V (1.23 V)
+uint16_t Host_tsCal1     = 1775;        // Typical temperature sensor reading at 30 C, 3.3 V
+uint16_t Host_vddMv      = 3300;        // Supply voltage seen by the ADC
+int32_t  Host_dieTemp100 = 2500;        // Die temperature x 100 seen by the sensor
+uint32_t Host_adcIsr;                   // ADC ISR flags of the model
+uint8_t  Host_adcOn;                    // ADEN was set at the last step
+uint8_t  Host_adcRunning;               // Converting into the DMA buffer
+uint64_t Host_adcStart;                 // Time of the first conversion
+uint64_t Host_adcFill;                  // Time of the last update of the buffer
+
+//  FLASH
+uint32_t _scrashlog[ 256 ] = { [ 0 ... 255 ] = 0xFFFFFFFF };  // Erased 1 KB page
+uint32_t Host_flashSr;                  // FLASH SR flags of the model
+uint8_t  Host_flashKey;                 // FLASH_KEY1 was written to KEYR
+
+uint32_t Host_checks;                   // Checks made by HOST_CHECK and HOST_EQ
+uint32_t Host_failed;                   // Checks that failed
+
+
+//  GPIO_TypeDef *
+//  Host_gpioSync( GPIO_TypeDef *port )
+//  Apply the writes to BSRR and BRR, update IDR and count the SCL pulses. Called on every
+//  access to GPIOA and GPIOB, so a write to BSRR has reached ODR by the next access, and
+//  on every step of the virtual clock. Returns port.
+GPIO_TypeDef *
+Host_gpioSync( GPIO_TypeDef *port )
+{
+  uint8_t  n       = ( port == &Host_gpiob );
+  uint32_t reset   = ( port->BSRR >> 16 ) | port->BRR;
+  uint32_t outputs = 0;
+  uint32_t odr, idr;
+
+  port->ODR  = (( port->ODR & ~reset ) | port->BSRR ) & 0xFFFF;  // Set wins over reset
+  port->BSRR = 0;
+  port->BRR  = 0;
+  odr = port->ODR;
+  for( uint8_t pin = 0; pin < 16; pin++ )
+    if((( port->MODER >> ( pin * 2 )) & 3 ) == 1 )
+      outputs |= 1U << pin;
+  if( Host_gpioWatch && odr != Host_gpioOdr[ n ] )
+    Host_gpioWatch( n, odr, Host_gpioOdr[ n ] );
+  idr = ( odr & outputs & ( ~port->OTYPER | Host_gpioIn[ n ] )) |   // Open-drain: wired AND
+        ( Host_gpioIn[ n ] & ~outputs );
+
+  if( n == 0 )                          // I2C1 pins
+  {
+    if(( outputs & HOST_SCL ) && ( odr & ~Host_gpioOdr[ 0 ] & HOST_SCL ))
+    {
+      Host_sclPulses++;
+      if( Host_i2c.stuck )
+        Host_i2c.stuck--;
+    }
+    if( Host_i2c.stuck )
+      idr &= ~HOST_SDA;
+  }
+  Host_gpioOdr[ n ] = odr;
+  port->IDR = idr;
+  return port;
+}
+
+
+//  FLASH_TypeDef *
+//  Host_flashSync( void )
+//  Apply the writes to KEYR, SR and CR: The key sequence unlocks the controller, writing 1s
+//  to SR clears those flags, and STRT with PER erases the page at once. Called on every
+//  access to FLASH. Returns the FLASH registers.
+FLASH_TypeDef *
+Host_flashSync( void )
+{
+  FLASH_TypeDef *f = &Host_flash;
+
+  if( f->KEYR )
+  {
+    if( Host_flashKey && f->KEYR == FLASH_KEY2 )
+      f->CR &= ~FLASH_CR_LOCK;
+    Host_flashKey = ( f->KEYR == FLASH_KEY1 );
+    f->KEYR = 0;
+  }
+  if( !( f->SR & HOST_W1C ))
+    Host_flashSr &= ~f->SR;
+  if( f->CR & FLASH_CR_STRT )
+  {
+    if( f->CR & FLASH_CR_LOCK )
+      Host_flashSr |= FLASH_SR_WRPRTERR;
+    else if( f->CR & FLASH_CR_PER )
+    {
+      memset( _scrashlog, 0xFF, sizeof( _scrashlog ));
+      Host_flashSr |= FLASH_SR_EOP;
+    }
+    f->CR &= ~FLASH_CR_STRT;
+  }
+  f->SR = Host_flashSr | HOST_W1C;
+  return f;
+}
+
+
+//  void
+//  Host_i2cAttach( const Host_I2cDevice *dev )
+//  Put a device on the bus.
+void
+Host_i2cAttach( const Host_I2cDevice *dev )
+{
+  for( uint8_t i = 0; i < HOST_I2C_DEVICES; i++ )
+    if( !Host_i2c.dev[ i ] )
+    {
+      Host_i2c.dev[ i ] = dev;
+      return;
+    }
+  fprintf( stderr, "Host_i2cAttach: too many devices\n" );
+  exit( 2 );
+}
+
+
+//  void
+//  Host_i2cFault( uint8_t fault, uint8_t at, uint32_t value )
+//  Arm a fault for byte at of the next transaction that gets that far.
+void
+Host_i2cFault( uint8_t fault, uint8_t at, uint32_t value )
+{
+  Host_i2c.fault      = fault;
+  Host_i2c.faultAt    = at;
+  Host_i2c.faultValue = value;
+}
+
+
+//  uint8_t
+//  Host_i2cFaultAt( uint8_t at, uint8_t fault )
+//  Return 1 and disarm the fault if fault is armed for byte at.
+static uint8_t
+Host_i2cFaultAt( uint8_t at, uint8_t fault )
+{
+  if( Host_i2c.fault != fault || Host_i2c.faultAt != at )
+    return 0;
+  Host_i2c.fault = 0;
+  return 1;
+}
+
+
+//  uint64_t
+//  Host_i2cBit( void )
+//  Length of one SCL period in CPU cycles, from TIMINGR. I2CCLK is the 8 MHz HSI, and the
+//  interface adds about 4 I2CCLK cycles per period to synchronize SCL.
+static uint64_t
+Host_i2cBit( void )
+{
+  uint32_t t = I2C1->TIMINGR;
+
+  return ((( t & I2C_TIMINGR_SCLL ) >> I2C_TIMINGR_SCLL_Pos ) +
+          (( t & I2C_TIMINGR_SCLH ) >> I2C_TIMINGR_SCLH_Pos ) + 2 ) *
+         ((( t & I2C_TIMINGR_PRESC ) >> I2C_TIMINGR_PRESC_Pos ) + 1 ) * DELAY_CLK_MHZ / 8 +
+         4 * DELAY_CLK_MHZ / 8;
+}
+
+
+//  void
+//  Host_i2cBegin( uint8_t state, uint8_t bits )
+//  Start moving a byte (bits SCL periods) in state. A clock stretch or a stuck SDA armed
+//  for the byte happens here.
+static void
+Host_i2cBegin( uint8_t state, uint8_t bits )
+{
+  uint8_t at = ( state == HOST_I2C_ADDR ) ? 0 : Host_i2c.done + 1;
+
+  Host_i2c.state = state;
+  Host_i2c.until = Host_cycles + Host_i2cBit( ) * bits;
+  if( Host_i2cFaultAt( at, HOST_FAULT_STRETCH ))
+    Host_i2c.until += (uint64_t)Host_i2c.faultValue * DELAY_CLK_MHZ;
+  if( Host_i2cFaultAt( at, HOST_FAULT_STUCK ))
+  {
+    Host_i2c.state = HOST_I2C_HUNG;
+    Host_i2c.stuck = Host_i2c.faultValue;
+  }
+}
+
+
+//  void
+//  Host_i2cEnd( void )
+//  The bus is free again: tell the device, and clear BUSY.
+static void
+Host_i2cEnd( void )
+{
+  if( Host_i2c.cur && Host_i2c.cur->stop )
+    Host_i2c.cur->stop( );
+  Host_i2c.cur   = 0;
+  Host_i2c.state = HOST_I2C_IDLE;
+  I2C1->ISR     &= ~( I2C_ISR_BUSY | I2C_ISR_TXIS | I2C_ISR_TC );
+}
+
+
+//  uint8_t
+//  Host_i2cLost( uint8_t at )
+//  Apply a bus error or arbitration loss armed for byte at: The flag is set and the
+//  interface lets go of the bus. Returns 1 if there was one.
+static uint8_t
+Host_i2cLost( uint8_t at )
+{
+  uint32_t flag = Host_i2cFaultAt( at, HOST_FAULT_BERR ) ? I2C_ISR_BERR :
+                  Host_i2cFaultAt( at, HOST_FAULT_ARLO ) ? I2C_ISR_ARLO : 0;
+
+  if( !flag )
+    return 0;
+  I2C1->CR2 &= ~I2C_CR2_START;
+  I2C1->ISR |= flag;
+  Host_i2cEnd( );
+  return 1;
+}
+
+
+//  void
+//  Host_i2cNext( void )
+//  After an acknowledged byte: Move the next data byte, or set TC after the last one.
+static void
+Host_i2cNext( void )
+{
+  if( Host_i2c.done >= Host_i2c.nBytes )
+  {
+    I2C1->ISR     |= I2C_ISR_TC;
+    Host_i2c.state = HOST_I2C_DONE;
+  }
+  else if( Host_i2c.read )
+    Host_i2cBegin( HOST_I2C_RX, 9 );
+  else
+  {
+    I2C1->TXDR     = HOST_TXDR_EMPTY;
+    I2C1->ISR     |= I2C_ISR_TXIS;
+    Host_i2c.state = HOST_I2C_TXWAIT;
+  }
+}
+
+
+//  void
+//  Host_i2cAck( uint8_t ack )
+//  After the address or a written byte. A NACK sets NACKF, and the interface sends the
+//  STOP by itself.
+static void
+Host_i2cAck( uint8_t ack )
+{
+  if( ack )
+  {
+    Host_i2cNext( );
+    return;
+  }
+  I2C1->ISR     |= I2C_ISR_NACKF;
+  Host_i2c.state = HOST_I2C_STOPPING;
+  Host_i2c.until = Host_cycles + Host_i2cBit( );
+}
+
+
+//  void
+//  Host_i2cStep( void )
+//  Run the I2C1 model up to the current time.
+static void
+Host_i2cStep( void )
+{
+  Host_I2c *m = &Host_i2c;
+  uint32_t  cr2;
+
+  I2C1->ISR &= ~I2C1->ICR;              // The ICR bits clear the ISR bits in the same places
+  I2C1->ICR  = 0;
+  if( !( I2C1->CR1 & I2C_CR1_PE ))      // Disabled: the interface is reset
+  {
+    if( m->cur && m->cur->stop )
+      m->cur->stop( );
+    m->cur     = 0;
+    m->state   = HOST_I2C_IDLE;
+    I2C1->CR2 &= ~( I2C_CR2_START | I2C_CR2_STOP | I2C_CR2_NACK );
+    I2C1->ISR  = I2C_ISR_TXE;
+    return;
+  }
+  if( Host_cycles < m->until || m->state == HOST_I2C_HUNG )
+    return;
+
+  cr2 = I2C1->CR2;
+  if(( cr2 & I2C_CR2_STOP ) && m->state != HOST_I2C_STOPPING && !m->stuck &&
+     ( m->state == HOST_I2C_IDLE || m->state == HOST_I2C_TXWAIT ||
+       m->state == HOST_I2C_RXFULL || m->state == HOST_I2C_DONE ))
+  {
+    m->state = HOST_I2C_STOPPING;
+    m->until = Host_cycles + Host_i2cBit( );
+    return;
+  }
+
+  switch( m->state )
+  {
+    case HOST_I2C_IDLE:
+    case HOST_I2C_DONE:                 // A START here is a repeated start
+      if( !( cr2 & I2C_CR2_START ) || m->stuck )
+        break;
+      m->read   = ( cr2 & I2C_CR2_RD_WRN ) != 0;
+      m->nBytes = ( cr2 & I2C_CR2_NBYTES ) >> I2C_CR2_NBYTES_Pos;
+      m->done   = 0;
+      m->cur    = 0;
+      for( uint8_t i = 0; i < HOST_I2C_DEVICES; i++ )
+        if( m->dev[ i ] && m->dev[ i ]->address == (( cr2 & I2C_CR2_SADD ) >> 1 ))
+          m->cur = m->dev[ i ];
+      I2C1->ISR = ( I2C1->ISR & ~I2C_ISR_TC ) | I2C_ISR_BUSY;
+      Host_i2cBegin( HOST_I2C_ADDR, 10 );
+      break;
+
+    case HOST_I2C_ADDR:                 // START is cleared once the address is sent
+      I2C1->CR2 &= ~I2C_CR2_START;
+      if( !Host_i2cLost( 0 ))
+        Host_i2cAck( !Host_i2cFaultAt( 0, HOST_FAULT_NACK ) && m->cur &&
+                     m->cur->start( m->read ));
+      break;
+
+    case HOST_I2C_TXWAIT:
+      if( I2C1->TXDR & HOST_TXDR_EMPTY )
+        break;
+      m->data    = I2C1->TXDR;
+      I2C1->ISR &= ~I2C_ISR_TXIS;
+      Host_i2cBegin( HOST_I2C_TX, 9 );
+      break;
+
+    case HOST_I2C_TX:
+      if( Host_i2cLost( m->done + 1 ))
+        break;
+      m->done++;
+      Host_i2cAck( !Host_i2cFaultAt( m->done, HOST_FAULT_NACK ) &&
+                   ( !m->cur->write || m->cur->write( m->data )));
+      break;
+
+    case HOST_I2C_RX:
+      if( Host_i2cLost( m->done + 1 ))
+        break;
+      m->done++;
+      I2C1->RXDR = m->cur->read ? m->cur->read( ) : 0xFF;
+      I2C1->ISR |= I2C_ISR_RXNE;
+      m->state   = HOST_I2C_RXFULL;
+      break;
+
+    case HOST_I2C_RXFULL:
+      if( !( I2C1->ISR & I2C_ISR_RXNE ))
+        Host_i2cNext( );
+      break;
+
+    case HOST_I2C_STOPPING:
+      I2C1->CR2 &= ~I2C_CR2_STOP;
+      I2C1->ISR |= I2C_ISR_STOPF;
+      Host_i2cEnd( );
+      break;
+  }
+}
+
+
+//  uint16_t
+//  Host_adcRead( uint8_t ch )
+//  Result of converting channel ch: VREFINT (17) and the temperature sensor (16) at the
+//  supply and die temperature set by the program, from the calibration values. The sensor
+//  falls 4.3 mV per degree C from its reading at 30 C. Other channels read 0.
+static uint16_t
+Host_adcRead( uint8_t ch )
+{
+  int32_t v;
+
+  if( ch == 17 )
+    v = Host_vrefintCal * 3300;
+  else if( ch == 16 )
+    v = ( Host_tsCal1 - ( Host_dieTemp100 - 3000 ) * 43 * 4095 / 3300000 ) * 3300;
+  else
+    return 0;
+  v = ( v + Host_vddMv / 2 ) / Host_vddMv;             // Scale from 3.3 V to the supply
+  return ( v < 0 ) ? 0 : ( v > 4095 ) ? 4095 : v;
+}
+
+
+//  void
+//  Host_adcStep( void )
+//  Run the ADC1 and DMA1 channel 1 model up to the current time. Calibration, enabling and
+//  stopping happen at once. While the ADC converts with DMA on, the buffer is filled with
+//  the channels of CHSELR in turn, TCIF1 is set once the first pass would be done, and the
+//  analog watchdog checks its channel against TR.
+static void
+Host_adcStep( void )
+{
+  ADC_TypeDef         *adc = &Host_adc1;
+  DMA_Channel_TypeDef *dma = &Host_dma1Ch1;
+  uint32_t             tr  = adc->TR;
+  uint16_t             v;
+
+  if( !( adc->ISR & HOST_W1C ))          // The program wrote ISR: its 1s clear the flags
+    Host_adcIsr &= ~adc->ISR;
+  Host_dma1.ISR &= ~Host_dma1.IFCR;
+  Host_dma1.IFCR = 0;
+
+  adc->CR &= ~ADC_CR_ADCAL;
+  if( adc->CR & ADC_CR_ADSTP )
+    adc->CR &= ~( ADC_CR_ADSTP | ADC_CR_ADSTART );
+  if( adc->CR & ADC_CR_ADDIS )
+    adc->CR &= ~( ADC_CR_ADDIS | ADC_CR_ADEN );
+  if(( adc->CR & ADC_CR_ADEN ) && !Host_adcOn )
+    Host_adcIsr |= ADC_ISR_ADRDY;
+  Host_adcOn = ( adc->CR & ADC_CR_ADEN ) != 0;
+
+  if( !Host_adcOn || !( adc->CR & ADC_CR_ADSTART ) || !( adc->CFGR1 & ADC_CFGR1_DMAEN ) ||
+      !( dma->CCR & DMA_CCR_EN ) || !dma->CNDTR || !ADC_buf )
+    Host_adcRunning = 0;
+  else
+  {
+    if( !Host_adcRunning )
+    {
+      Host_adcRunning = 1;
+      Host_adcStart   = Host_cycles;
+      Host_adcFill    = Host_cycles - HOST_ADC_REFRESH_MS * 1000 * DELAY_CLK_MHZ;
+    }
+    if( Host_cycles - Host_adcStart >= dma->CNDTR * HOST_ADC_CONV_CYCLES )
+      Host_dma1.ISR |= DMA_ISR_TCIF1 | DMA_ISR_HTIF1 | DMA_ISR_GIF1;
+    if( Host_cycles - Host_adcFill >= HOST_ADC_REFRESH_MS * 1000 * DELAY_CLK_MHZ )
+    {
+      uint8_t ch = 18;
+
+      Host_adcFill = Host_cycles;
+      for( uint16_t i = 0; i < dma->CNDTR; i++ )
+      {
+        do                              // Next channel of the scan, lowest first
+          ch = ( ch + 1 ) % 19;
+        while( !( adc->CHSELR & ( 1UL << ch )) && adc->CHSELR );
+        ADC_buf[ i ] = Host_adcRead( ch );
+      }
+      v = Host_adcRead(( adc->CFGR1 & ADC_CFGR1_AWD1CH ) >> ADC_CFGR1_AWD1CH_Pos );
+      if(( adc->CFGR1 & ADC_CFGR1_AWD1EN ) &&
+         ( v < ( tr & ADC_TR_LT ) || v > (( tr & ADC_TR_HT ) >> ADC_TR1_HT1_Pos )))
+        Host_adcIsr |= ADC_ISR_AWD1;
+    }
+  }
+  adc->ISR = Host_adcIsr | HOST_W1C;
+
+  if(( Host_adcIsr & ADC_ISR_AWD1 ) && ( adc->IER & ADC_IER_AWD1IE ) && !Host_primask &&
+     ( Host_nvicEnabled & ( 1UL << ADC1_IRQn )) && ADC1_IRQHandler )
+    ADC1_IRQHandler( );
+}
+
+
+//  uint64_t
+//  Host_us( void )
+//  Return the virtual time in microseconds.
+static inline uint64_t
+Host_us( void )
+{
+  return Host_cycles / DELAY_CLK_MHZ;
+}
+
+
+//  void
+//  Host_tick( void )
+//  Run SysTick_Handler for one SysTick, or keep it until interrupts are enabled again.
+static void
+Host_tick( void )
+{
+  if( !( Host_systick.CTRL & SysTick_CTRL_TICKINT_Msk ) || !SysTick_Handler )
+    return;
+  if( Host_primask )
+    Host_tickPending = 1;               // Like the pending bit, only one is kept
+  else
+    SysTick_Handler( );
+}
+
+
+//  void
+//  Host_setPrimask( uint32_t m )
+//  Set PRIMASK. Enabling the interrupts runs a SysTick that occurred while they were off.
+void
+Host_setPrimask( uint32_t m )
+{
+  Host_primask = m & 1;
+  if( !Host_primask && Host_tickPending )
+  {
+    Host_tickPending = 0;
+    Host_tick( );
+  }
+}
+
+
+//  void
+//  Host_step( uint64_t from )
+//  Bring SysTick up to the current time. The counter runs from LOAD down to 0, and the
+//  interrupt happens as it reloads, every LOAD + 1 cycles. from is the time of the last
+//  step, so that no reload in between is missed.
+static void
+Host_step( uint64_t from )
+{
+  uint64_t period = ( Host_systick.LOAD & SysTick_LOAD_RELOAD_Msk ) + 1;
+  uint64_t ticks;
+
+  if( !( Host_systick.CTRL & SysTick_CTRL_ENABLE_Msk ))
+  {
+    Host_tickOn = 0;
+    return;
+  }
+  if( !Host_tickOn )                    // Just enabled: count from now
+  {
+    Host_tickOn    = 1;
+    Host_tickStart = from;
+  }
+  ticks = ( Host_cycles - Host_tickStart ) / period - ( from - Host_tickStart ) / period;
+  Host_systick.VAL = period - 1 - ( Host_cycles - Host_tickStart ) % period;
+  while( ticks-- )
+    Host_tick( );
+}
+
+
+//  SysTick_Type *
+//  Host_sysTick( void )
+//  Bring SysTick up to date before the program reads it, so that VAL is right straight
+//  after SysTick is enabled. Returns the SysTick registers.
+SysTick_Type *
+Host_sysTick( void )
+{
+  Host_step( Host_cycles );
+  return &Host_systick;
+}
+
+
+//  uint64_t
+//  Host_next( uint64_t end )
+//  Time of the next event, but no later than end: a SysTick reload, the end of the I2C bit
+//  sequence in progress, or Host_timer. Nothing else changes in between, since the
+//  program does not run while the clock moves.
+static uint64_t
+Host_next( uint64_t end )
+{
+  uint64_t period = ( Host_systick.LOAD & SysTick_LOAD_RELOAD_Msk ) + 1;
+  uint64_t next   = end;
+  uint64_t tick;
+
+  if( Host_tickOn )
+  {
+    tick = Host_cycles + period - ( Host_cycles - Host_tickStart ) % period;
+    if( tick < next )
+      next = tick;
+  }
+  if( Host_i2c.until > Host_cycles && Host_i2c.until < next )
+    next = Host_i2c.until;
+  if( Host_timer && Host_timerAt > Host_cycles && Host_timerAt < next )
+    next = Host_timerAt;
+  return next;
+}
+
+
+//  void
+//  Host_models( uint64_t from )
+//  Run SysTick and the peripheral models up to the current time, and the Host_timer when
+//  it is due. from is the time of the last run.
+static void
+Host_models( uint64_t from )
+{
+  Host_step( from );
+  Host_i2cStep( );
+  Host_adcStep( );
+  if( Host_timer && Host_cycles >= Host_timerAt )
+    Host_timer( );
+}
+
+
+//  void
+//  Host_advance( uint64_t cycles )
+//  Move the virtual clock forward by cycles. The models first take in what the program
+//  wrote since the last step, and then run at each event on the way.
+void
+Host_advance( uint64_t cycles )
+{
+  uint64_t end = Host_cycles + cycles;
+
+  Host_gpioSync( &Host_gpioa );
+  Host_gpioSync( &Host_gpiob );
+  Host_models( Host_cycles );
+  while( Host_cycles < end )
+  {
+    uint64_t from = Host_cycles;
+
+    Host_cycles = Host_next( end );
+    Host_models( from );
+  }
+}
+
+
+//  void
+//  Host_poll( void )
+//  One pass of a loop that waits on a peripheral. Reading RXDR clears RXNE, but the model
+//  cannot see the read. The libraries read RXDR as soon as a poll shows RXNE, so if RXNE
+//  was set after the last poll, it has been read by the time of this one.
+void
+Host_poll( void )
+{
+  if( Host_i2c.rxSeen )
+    I2C1->ISR &= ~I2C_ISR_RXNE;
+  Host_advance( HOST_POLL_CYCLES );
+  Host_i2c.rxSeen = ( I2C1->ISR & I2C_ISR_RXNE ) != 0;
+}
+
+
+//  void
+//  Host_wfi( void )
+//  Sleep until the next interrupt. Only SysTick wakes the virtual CPU, so this waits for
+//  the next SysTick, or a millisecond if SysTick is off.
+void
+Host_wfi( void )
+{
+  if( Host_systick.CTRL & SysTick_CTRL_ENABLE_Msk )
+    Host_advance( Host_systick.VAL + 1 );
+  else
+    Host_advance( DELAY_CLK_MHZ * 1000 );
+}
+
+
+//  void
+//  delay_us( uint32_t d )
+//  Host version of the delay loop of STM32F030-Delay-lib.c.
+void
+delay_us( uint32_t d )
+{
+  Host_advance( (uint64_t)d * DELAY_CLK_MHZ );
+}
+
+
+//  void
+//  halt( void )
+//  There is nothing to halt on the host, so the program ends.
+void
+halt( void )
+{
+  fprintf( stderr, "halt() at %llu us\n", (unsigned long long)Host_us( ));
+  exit( 2 );
+}
+
+
+//  uint32_t
+//  Stack_used( void ), Stack_now( void ), Heap_used( void ), Stack_free( void )
+//  Host versions of the routines of STM32F030-Stack-lib.c. There is nothing to measure.
+uint32_t Stack_used( void ) { return 0; }
+uint32_t Stack_now( void )  { return 0; }
+uint32_t Heap_used( void )  { return 0; }
+uint32_t Stack_free( void ) { return 0; }
+
+
+//  char *
+//  itoa( int value, char *str, int base )
+//  Write value in base (2 to 36) to str, with a minus sign if it is negative and base is
+//  10, as the itoa of newlib does. Returns str.
+char *
+itoa( int value, char *str, int base )
+{
+  unsigned int u = ( value < 0 && base == 10 ) ? -(unsigned int)value : (unsigned int)value;
+  char         tmp[ 33 ];
+  char        *p = str;
+  int          n = 0;
+
+  if( value < 0 && base == 10 )
+    *p++ = '-';
+  do
+  {
+    tmp[ n++ ] = "0123456789abcdefghijklmnopqrstuvwxyz"[ u % base ];
+    u /= base;
+  } while( u );
+  while( n )
+    *p++ = tmp[ --n ];
+  *p = 0;
+  return str;
+}
+
+
+//  void
+//  Host_check( int ok, const char *expr, const char *file, int line )
+//  Count a check and report it if it failed.
+void
+Host_check( int ok, const char *expr, const char *file, int line )
+{
+  Host_checks++;
+  if( ok )
+    return;
+  Host_failed++;
+  fprintf( stderr, "%s:%d: check failed: %s\n", file, line, expr );
+}
+
+
+//  void
+//  Host_checkEq( long long a, long long b, const char *expr, const char *file, int line )
+//  Count a check that a equals b, and report both values if it failed.
+void
+Host_checkEq( long long a, long long b, const char *expr, const char *file, int line )
+{
+  Host_checks++;
+  if( a == b )
+    return;
+  Host_failed++;
+  fprintf( stderr, "%s:%d: check failed: %s (%lld != %lld)\n", file, line, expr, a, b );
+}
+
+#define HOST_CHECK( cond )  Host_check( ( cond ) != 0, #cond, __FILE__, __LINE__ )
+#define HOST_EQ( a, b )     Host_checkEq( (long long)( a ), (long long)( b ), \
+                                          #a " == " #b, __FILE__, __LINE__ )
+
+
+//  int
+//  Host_summary( const char *name )
+//  Print the number of checks and failures, and return the exit code for the test.
+int
+Host_summary( const char *name )
+{
+  printf( "%s: %u checks, %u failed\n", name, Host_checks, Host_failed );
+  return Host_failed ? 1 : 0;
+}
+
+#endif /* __STM32F030_HOST_LIB_C */
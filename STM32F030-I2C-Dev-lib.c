@@ -0,0 +1,355 @@
+//  ==========================================================================================
+//  STM32F030-I2C-Dev-lib.c
+//  ------------------------------------------------------------------------------------------
+//  I2C device handles with support for TCA9548A I2C multiplexers. Many sensors, such as the
+//  AHT10, offer only one or two I2C addresses. A TCA9548A switch connects the main bus to
+//  any of its 8 downstream channels, so up to 8 devices with the same address can be used
+//  per multiplexer, and up to 8 multiplexers (addresses 0x70 to 0x77) per bus.
+//
+//  A device handle (I2C_Dev) holds everything needed to reach a device: the bus (hardware
+//  I2C interface or software I2C bus), the multiplexer and channel if any, and the device
+//  address. I2C_devWrite and I2C_devRead select the channel first when needed. The channel
+//  last written to each multiplexer is remembered, so consecutive accesses on the same
+//  channel do not write to the multiplexer again. After any error on a device behind a
+//  multiplexer, the remembered channel is forgotten, since the multiplexer may have been
+//  reset, and the next access writes it again.
+//
+//  A batch collects transactions (jobs) on many devices and runs them grouped by channel,
+//  starting with the channel that is already selected, so each channel is selected at most
+//  once per batch.
+//  ------------------------------------------------------------------------------------------
+//  https://github.com/EZdenki/STM32F030-CMSIS-I2C-AHT10-lib
+//  Released under the MIT License
+//  Copyright (c) 2023
+//  Mike Shegedin, EZdenki.com
+//  ------------------------------------------------------------------------------------------
+//  Target Device: STM32F030Fxxx
+//  ------------------------------------------------------------------------------------------
+//  Usage:
+//
+//    I2C_Mux mux;
+//    I2C_Dev sensor[8];
+//
+//    I2C_init( I2C1, 100e3 );
+//    I2C_muxInit( &mux, I2C1, 0, 0x70 );                       // TCA9548A at 0x70 on I2C1
+//    for( uint8_t ch = 0; ch < 8; ch++ )
+//      I2C_devInit( &sensor[ch], I2C1, 0, &mux, ch, 0x38 );    // One AHT10 on each channel
+//
+//    I2C_devWrite( &sensor[3], cmd, 3 );                       // Selects channel 3 first
+//    I2C_devRead( &sensor[3], data, 6 );                       // Channel 3 is still selected
+//
+//  Devices connected directly to the bus use a mux of 0, and must not share an address with
+//  a device behind a multiplexer. Devices with the same address may sit behind different
+//  multiplexers: before a channel of one multiplexer is selected, all channels of the
+//  multiplexer used last (I2C_muxActive) are switched off, so only one of them answers.
+//  ------------------------------------------------------------------------------------------
+//  Routines in this Library
+//
+//  void
+//  I2C_muxInit( I2C_Mux *mux, I2C_TypeDef *hw, SI2C_Bus *soft, uint8_t address )
+//    Set up a TCA9548A handle at address (0x70 to 0x77) on the hardware interface hw, or on
+//    the software bus soft if hw is 0. The bus itself must already be initialized.
+//
+//  uint8_t
+//  I2C_muxSelect( I2C_Mux *mux, uint8_t channel )
+//    Connect channel (0 to 7) to the bus, or disconnect all channels (I2C_MUX_NONE). Does
+//    nothing if the channel is already selected. Any other multiplexer with a channel
+//    selected is switched off first.
+//
+//  void
+//  I2C_devInit( I2C_Dev *dev, I2C_TypeDef *hw, SI2C_Bus *soft,
+//               I2C_Mux *mux, uint8_t channel, uint8_t address )
+//    Set up a device handle. If mux is given, the bus of the multiplexer is used and hw
+//    and soft are ignored.
+//
+//  uint8_t
+//  I2C_devWrite( I2C_Dev *dev, const uint8_t *data, uint8_t n )
+//  uint8_t
+//  I2C_devRead( I2C_Dev *dev, uint8_t *data, uint8_t n )
+//    Write or read n bytes as one complete transaction, after selecting the channel.
+//
+//  uint8_t
+//  I2C_batchAdd( I2C_Batch *batch, I2C_Dev *dev, I2C_JobFn fn, void *arg )
+//    Add a job to the batch. When the batch is run, fn( dev, arg ) is called with the
+//    channel of dev selected. Returns 0 if all I2C_BATCH_JOBS job slots are in use.
+//
+//  uint8_t
+//  I2C_batchRun( I2C_Batch *batch )
+//    Run and remove all jobs of the batch. Jobs on the same channel run in the order they
+//    were added, but jobs on different channels may run in any order. Returns the number of
+//    jobs that failed.
+//
+//  All routines that access the bus return I2C_OK or one of the error codes of
+//  STM32F030-CMSIS-I2C-lib.c. The muxSelects and muxSkips fields of I2C_Mux count the
+//  channel selections written and skipped.
+//  ==========================================================================================
+
+#ifndef __STM32F030_I2C_DEV_LIB_C
+#define __STM32F030_I2C_DEV_LIB_C
+
+#include "stm32f030x6.h"                // Primary CMSIS header file
+#include "STM32F030-CMSIS-I2C-lib.c"    // Hardware I2C transactions and status codes
+#include "STM32F030-SoftI2C-lib.c"      // Software I2C transactions
+#include "STM32F030-Pool-lib.c"         // Job storage for batches
+
+#define I2C_MUX_NONE    0xFF            // Channel number that disconnects all channels
+
+#ifndef I2C_BATCH_JOBS
+#define I2C_BATCH_JOBS  16              // Jobs that may be waiting in all batches together
+#endif
+
+typedef struct
+{
+  I2C_TypeDef *hw;                      // Hardware I2C interface, or 0 to use soft
+  SI2C_Bus    *soft;                    // Software I2C bus
+  uint8_t      address;                 // TCA9548A address, 0x70 to 0x77
+  uint8_t      control;                 // Control register value last written
+  uint8_t      known;                   // 1 if control matches the multiplexer
+  uint16_t     muxSelects;              // Channel selections written
+  uint16_t     muxSkips;                // Channel selections skipped (already selected)
+} I2C_Mux;
+
+typedef struct
+{
+  I2C_TypeDef *hw;                      // Hardware I2C interface, or 0 to use soft
+  SI2C_Bus    *soft;                    // Software I2C bus
+  I2C_Mux     *mux;                     // Multiplexer, or 0 if connected directly
+  uint8_t      channel;                 // Multiplexer channel, 0 to 7
+  uint8_t      address;                 // 7-bit device address
+} I2C_Dev;
+
+//  A job is run with the channel of its device selected, and returns I2C_OK or an error
+//  code. Drivers that take an I2C_TypeDef, such as STM32F030-CMSIS-AHT10-lib.c, can be used
+//  in a job by passing dev->hw.
+typedef uint8_t ( *I2C_JobFn )( I2C_Dev *dev, void *arg );
+
+typedef struct I2C_Job
+{
+  struct I2C_Job *next;                 // Next job in the batch
+  I2C_Dev        *dev;
+  I2C_JobFn       fn;
+  void           *arg;
+} I2C_Job;
+
+typedef struct
+{
+  I2C_Job *first;                       // Jobs in the order they were added
+  I2C_Job *last;
+} I2C_Batch;
+
+POOL_DEFINE( I2C_jobPool, sizeof( I2C_Job ), I2C_BATCH_JOBS );
+
+I2C_Mux *I2C_muxActive;                 // Multiplexer that may have a channel selected
+
+
+//  uint8_t
+//  I2C_busWrite( I2C_TypeDef *hw, SI2C_Bus *soft, uint8_t address,
+//                const uint8_t *data, uint8_t n )
+//  Write n bytes on the hardware interface hw, or on the software bus soft if hw is 0.
+static uint8_t
+I2C_busWrite( I2C_TypeDef *hw, SI2C_Bus *soft, uint8_t address, const uint8_t *data,
+              uint8_t n )
+{
+  return hw ? I2C_writeN( hw, address, data, n ) : SI2C_writeN( soft, address, data, n );
+}
+
+
+//  uint8_t
+//  I2C_busRead( I2C_TypeDef *hw, SI2C_Bus *soft, uint8_t address, uint8_t *data, uint8_t n )
+//  Read n bytes from the hardware interface hw, or from the software bus soft if hw is 0.
+static uint8_t
+I2C_busRead( I2C_TypeDef *hw, SI2C_Bus *soft, uint8_t address, uint8_t *data, uint8_t n )
+{
+  return hw ? I2C_readN( hw, address, data, n ) : SI2C_readN( soft, address, data, n );
+}
+
+
+//  void
+//  I2C_muxInit( I2C_Mux *mux, I2C_TypeDef *hw, SI2C_Bus *soft, uint8_t address )
+//  Set up the handle. The channel selected in the multiplexer is not known yet, so the
+//  first selection is always written.
+void
+I2C_muxInit( I2C_Mux *mux, I2C_TypeDef *hw, SI2C_Bus *soft, uint8_t address )
+{
+  mux->hw         = hw;
+  mux->soft       = soft;
+  mux->address    = address;
+  mux->control    = 0;
+  mux->known      = 0;
+  mux->muxSelects = 0;
+  mux->muxSkips   = 0;
+}
+
+
+//  uint8_t
+//  I2C_muxSelect( I2C_Mux *mux, uint8_t channel )
+//  The TCA9548A control register is a single byte with one bit per channel, written
+//  without a register address. Skip the write if the multiplexer already holds the value.
+//  Before a channel is connected, switch off the multiplexer used last, if it is another
+//  one. If that fails, the channel is not connected, since two devices might answer.
+//  I2C_muxActive is only cleared once the switch-off has worked.
+uint8_t
+I2C_muxSelect( I2C_Mux *mux, uint8_t channel )
+{
+  uint8_t control = ( channel == I2C_MUX_NONE ) ? 0 : 1 << ( channel & 7 );
+  uint8_t status;
+
+  if( control && I2C_muxActive && I2C_muxActive != mux &&
+      ( status = I2C_muxSelect( I2C_muxActive, I2C_MUX_NONE )) != I2C_OK )
+    return status;
+  if( mux->known && mux->control == control )
+  {
+    mux->muxSkips++;
+    return I2C_OK;
+  }
+  mux->muxSelects++;
+  status = I2C_busWrite( mux->hw, mux->soft, mux->address, &control, 1 );
+  mux->control = control;
+  mux->known   = ( status == I2C_OK );
+  if( control )
+    I2C_muxActive = mux;
+  else if( status == I2C_OK && I2C_muxActive == mux )
+    I2C_muxActive = 0;
+  return status;
+}
+
+
+//  void
+//  I2C_devInit( I2C_Dev *dev, I2C_TypeDef *hw, SI2C_Bus *soft,
+//               I2C_Mux *mux, uint8_t channel, uint8_t address )
+//  Set up a device handle. A device behind a multiplexer uses the bus of the multiplexer.
+void
+I2C_devInit( I2C_Dev *dev, I2C_TypeDef *hw, SI2C_Bus *soft,
+             I2C_Mux *mux, uint8_t channel, uint8_t address )
+{
+  dev->hw      = mux ? mux->hw : hw;
+  dev->soft    = mux ? mux->soft : soft;
+  dev->mux     = mux;
+  dev->channel = channel;
+  dev->address = address;
+}
+
+
+//  uint8_t
+//  I2C_devSelect( I2C_Dev *dev )
+//  Select the channel of the device, if it is behind a multiplexer.
+static uint8_t
+I2C_devSelect( I2C_Dev *dev )
+{
+  return dev->mux ? I2C_muxSelect( dev->mux, dev->channel ) : I2C_OK;
+}
+
+
+//  uint8_t
+//  I2C_devDone( I2C_Dev *dev, uint8_t status )
+//  After an error, forget the channel selected in the multiplexer. A NACK from the
+//  device may mean the multiplexer lost its setting, for example after a brown-out.
+static uint8_t
+I2C_devDone( I2C_Dev *dev, uint8_t status )
+{
+  if( status != I2C_OK && dev->mux )
+    dev->mux->known = 0;
+  return status;
+}
+
+
+//  uint8_t
+//  I2C_devWrite( I2C_Dev *dev, const uint8_t *data, uint8_t n )
+//  Select the channel, then write n bytes to the device.
+uint8_t
+I2C_devWrite( I2C_Dev *dev, const uint8_t *data, uint8_t n )
+{
+  uint8_t status = I2C_devSelect( dev );
+
+  if( status == I2C_OK )
+    status = I2C_busWrite( dev->hw, dev->soft, dev->address, data, n );
+  return I2C_devDone( dev, status );
+}
+
+
+//  uint8_t
+//  I2C_devRead( I2C_Dev *dev, uint8_t *data, uint8_t n )
+//  Select the channel, then read n bytes from the device.
+uint8_t
+I2C_devRead( I2C_Dev *dev, uint8_t *data, uint8_t n )
+{
+  uint8_t status = I2C_devSelect( dev );
+
+  if( status == I2C_OK )
+    status = I2C_busRead( dev->hw, dev->soft, dev->address, data, n );
+  return I2C_devDone( dev, status );
+}
+
+
+//  uint8_t
+//  I2C_batchAdd( I2C_Batch *batch, I2C_Dev *dev, I2C_JobFn fn, void *arg )
+//  Take a job from the job pool and add it to the end of the batch. Returns 1, or 0 if the
+//  pool is empty. A batch that has never been used must be all zero.
+uint8_t
+I2C_batchAdd( I2C_Batch *batch, I2C_Dev *dev, I2C_JobFn fn, void *arg )
+{
+  I2C_Job *job = Pool_alloc( &I2C_jobPool );
+
+  if( !job )
+    return 0;
+  job->next = 0;
+  job->dev  = dev;
+  job->fn   = fn;
+  job->arg  = arg;
+  if( batch->last )
+    batch->last->next = job;
+  else
+    batch->first = job;
+  batch->last = job;
+  return 1;
+}
+
+
+//  uint8_t
+//  I2C_batchRun( I2C_Batch *batch )
+//  Pick a channel: the one already selected in the multiplexer of the first waiting job
+//  if any job uses it, otherwise the channel of the first waiting job. Run and remove all
+//  jobs on that channel, in order, then pick the next channel. Devices without a
+//  multiplexer count as one channel of their own. Returns the number of failed jobs.
+uint8_t
+I2C_batchRun( I2C_Batch *batch )
+{
+  uint8_t fails = 0;
+
+  while( batch->first )
+  {
+    I2C_Mux  *mux     = batch->first->dev->mux;
+    uint8_t   channel = batch->first->dev->channel;
+    I2C_Job **link, *job;
+
+    if( mux && mux->known && mux->control )
+      for( job = batch->first; job; job = job->next )
+        if( job->dev->mux == mux && ( 1 << job->dev->channel ) == mux->control )
+        {
+          channel = job->dev->channel;
+          break;
+        }
+
+    batch->last = 0;
+    for( link = &batch->first; ( job = *link ); )
+      if( job->dev->mux == mux && ( !mux || job->dev->channel == channel ))
+      {
+        uint8_t status = I2C_devSelect( job->dev );
+
+        if( status == I2C_OK )
+          status = job->fn( job->dev, job->arg );
+        if( I2C_devDone( job->dev, status ) != I2C_OK )
+          fails++;
+        *link = job->next;
+        Pool_free( &I2C_jobPool, job );
+      }
+      else
+      {
+        batch->last = job;
+        link = &job->next;
+      }
+  }
+  return fails;
+}
+
+#endif /* __STM32F030_I2C_DEV_LIB_C */
@@ -0,0 +1,171 @@
+//  ==========================================================================================
+//  STM32F030-MiniLibc-lib.c
+//  ------------------------------------------------------------------------------------------
+//  Small replacements for the few C library routines used by this project, for building
+//  without the C library ("make FREESTANDING=1"). Without libc, the link no longer pulls in
+//  newlib's startup, __libc_init_array, or any of its support code, which saves flash and
+//  shortens the time from reset to main().
+//
+//  When FREESTANDING is not defined, this file only includes the standard <string.h> and
+//  <stdlib.h> headers, and the C library versions are used as before.
+//  ------------------------------------------------------------------------------------------
+//  https://github.com/EZdenki/STM32F030-CMSIS-I2C-AHT10-lib
+//  Released under the MIT License
+//  Copyright (c) 2023
+//  Mike Shegedin, EZdenki.com
+//  ------------------------------------------------------------------------------------------
+//  Target Device: STM32F030Fxxx
+//  ------------------------------------------------------------------------------------------
+//  Routines in this Library (FREESTANDING builds only)
+//
+//  int
+//  abs( int v )
+//    Return the absolute value of v.
+//
+//  char *
+//  itoa( int value, char *str, int base )
+//    Write value as a zero-terminated string in the given base (2 to 36) to str, and return
+//    str. As in newlib, only base 10 values are written with a minus sign. Other bases
+//    write the unsigned 32-bit value. str must hold at least 12 characters for base 10.
+//
+//  char *
+//  strcpy( char *dst, const char *src )
+//  char *
+//  strcat( char *dst, const char *src )
+//    Copy src to dst, or append src to the end of dst, and return dst.
+//
+//  void *
+//  memset( void *dst, int c, size_t n )
+//  void *
+//  memcpy( void *dst, const void *src, size_t n )
+//    Fill or copy n bytes and return dst. The compiler may call these by itself to clear or
+//    copy structures and arrays, so they must be provided even if the program does not use
+//    them.
+//  ==========================================================================================
+
+#ifndef __STM32F030_MINILIBC_LIB_C
+#define __STM32F030_MINILIBC_LIB_C
+
+#ifndef FREESTANDING
+
+#include <string.h>
+#include <stdlib.h>
+
+#else
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+//  int
+//  abs( int v )
+//  Return the absolute value of v.
+int
+abs( int v )
+{
+  return ( v < 0 ) ? -v : v;
+}
+
+
+//  char *
+//  itoa( int value, char *str, int base )
+//  Build the digits backwards in a buffer large enough for the 32 digits of a base 2 value,
+//  then copy them to str in the right order.
+char *
+itoa( int value, char *str, int base )
+{
+  char     digits[32];
+  uint32_t v;
+  uint8_t  n = 0;
+  char    *p = str;
+
+  if( base < 2 || base > 36 )
+  {
+    *str = 0;
+    return str;
+  }
+  if( base == 10 && value < 0 )
+  {
+    *p++ = '-';
+    v = -(uint32_t)value;                 // Also correct for the most negative value
+  }
+  else
+    v = (uint32_t)value;
+
+  do
+  {
+    uint32_t d = v % base;
+
+    digits[n++] = ( d < 10 ) ? '0' + d : 'a' + d - 10;
+    v /= base;
+  } while( v );
+
+  while( n )
+    *p++ = digits[--n];
+  *p = 0;
+  return str;
+}
+
+
+//  char *
+//  strcpy( char *dst, const char *src )
+//  Copy the string src, including the terminating zero, to dst.
+char *
+strcpy( char *dst, const char *src )
+{
+  char *p = dst;
+
+  while(( *p++ = *src++ ))
+    ;
+  return dst;
+}
+
+
+//  char *
+//  strcat( char *dst, const char *src )
+//  Append the string src to the end of the string in dst.
+char *
+strcat( char *dst, const char *src )
+{
+  char *p = dst;
+
+  while( *p )
+    p++;
+  strcpy( p, src );
+  return dst;
+}
+
+
+//  void *
+//  memset( void *dst, int c, size_t n )
+//  Fill n bytes at dst with c. The Makefile builds FREESTANDING with
+//  -fno-tree-loop-distribute-patterns, so this loop is not turned back into a call to
+//  memset.
+void *
+memset( void *dst, int c, size_t n )
+{
+  uint8_t *d = dst;
+
+  while( n-- )
+    *d++ = (uint8_t)c;
+  return dst;
+}
+
+
+//  void *
+//  memcpy( void *dst, const void *src, size_t n )
+//  Copy n bytes from src to dst. The areas must not overlap.
+void *
+memcpy( void *dst, const void *src, size_t n )
+{
+  uint8_t       *d = dst;
+  const uint8_t *s = src;
+
+  while( n-- )
+    *d++ = *s++;
+  return dst;
+}
+
+#endif /* FREESTANDING */
+
+#endif /* __STM32F030_MINILIBC_LIB_C */
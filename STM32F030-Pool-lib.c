@@ -0,0 +1,199 @@
+//  ==========================================================================================
+//  STM32F030-Pool-lib.c
+//  ------------------------------------------------------------------------------------------
+//  Fixed-size block pools for short-lived objects such as transaction descriptors and
+//  events. malloc is avoided on purpose: in 4 kB of RAM, mixing block sizes on a heap soon
+//  leaves it fragmented. Each pool is a static array of equal-sized blocks, sized at
+//  compile time, with a list of the free blocks. Allocating and freeing take a fixed number
+//  of steps, and may be done from interrupt handlers. Interrupts are disabled only for the
+//  few instructions that change the free list.
+//  ------------------------------------------------------------------------------------------
+//  https://github.com/EZdenki/STM32F030-CMSIS-I2C-AHT10-lib
+//  Released under the MIT License
+//  Copyright (c) 2023
+//  Mike Shegedin, EZdenki.com
+//  ------------------------------------------------------------------------------------------
+//  Target Device: STM32F030Fxxx
+//  ------------------------------------------------------------------------------------------
+//  Usage:
+//
+//    POOL_DEFINE( eventPool, sizeof( Event ), 8 );    // 8 blocks that can each hold an Event
+//
+//    Event *e = Pool_alloc( &eventPool );             // 0 if all 8 are in use
+//    ...
+//    Pool_free( &eventPool, e );
+//
+//  Define POOL_DEBUG to fill freed blocks with POOL_POISON. The fill is checked when the
+//  block is allocated again, which catches writes through a pointer to a freed block.
+//  Pool_free also checks that the block belongs to the pool and is not already free (a block
+//  that is freed again without being written to looks the same). Problems are counted in the
+//  errors field of the pool, and bad frees are ignored. Blocks get at least one word after
+//  the free list link, so that every freed block holds some poison.
+//  ------------------------------------------------------------------------------------------
+//  Routines in this Library
+//
+//  POOL_DEFINE( name, blockSize, nBlocks )
+//    Define a pool called name with nBlocks blocks of at least blockSize bytes each. Block
+//    sizes are rounded up to whole 32-bit words, and are at least the size of a pointer (one
+//    word on the target), or one word more than that with POOL_DEBUG.
+//
+//  void *
+//  Pool_alloc( Pool *pool )
+//    Return a pointer to a free block, or 0 if there is none. The block is word-aligned and
+//    its contents are undefined.
+//
+//  void
+//  Pool_free( Pool *pool, void *block )
+//    Return a block to the pool. A null pointer is ignored.
+//
+//  Statistics, read directly from the Pool structure:
+//    used    Blocks allocated right now
+//    peak    Largest number of blocks allocated at one time since reset
+//    fails   Number of times Pool_alloc returned 0 because the pool was empty
+//    errors  (POOL_DEBUG only) Blocks found to be written after being freed, blocks freed
+//            twice, or frees of blocks that are not part of the pool
+//  ==========================================================================================
+
+#ifndef __STM32F030_POOL_LIB_C
+#define __STM32F030_POOL_LIB_C
+
+#include "stm32f030x6.h"          // Primary CMSIS header file, for the PRIMASK routines
+
+#define POOL_POISON 0xDEADBEEFUL  // Fill for freed blocks when POOL_DEBUG is defined
+
+typedef struct Pool_Block
+{
+  struct Pool_Block *next;        // Next free block. Overlays the data of a free block.
+} Pool_Block;
+
+typedef struct
+{
+  Pool_Block *free;               // List of freed blocks
+  uint32_t   *mem;                // Storage for all of the blocks
+  uint16_t    words;              // Block size in 32-bit words
+  uint16_t    count;              // Number of blocks
+  uint16_t    fresh;              // Blocks at the start of mem that have been handed out at
+                                  // least once. The rest have never been used.
+  uint16_t    used;               // Blocks allocated now
+  uint16_t    peak;               // Largest value of used
+  uint16_t    fails;              // Allocations that failed because the pool was empty
+#ifdef POOL_DEBUG
+  uint16_t    errors;             // Use-after-free writes and bad frees found
+#endif
+} Pool;
+
+#define POOL_LINK_WORDS ( sizeof( Pool_Block ) / 4 )  // Words taken by the list link
+#ifdef POOL_DEBUG
+#define POOL_MIN_WORDS ( POOL_LINK_WORDS + 1 )         // Link plus a word to hold poison
+#else
+#define POOL_MIN_WORDS POOL_LINK_WORDS
+#endif
+#define POOL_WORDS( size ) ((( size ) + 3 ) / 4 > POOL_MIN_WORDS ? (( size ) + 3 ) / 4 \
+                                                               : POOL_MIN_WORDS )
+
+//  The blocks start out on no list. Pool_alloc hands out never-used blocks in order before
+//  they are ever put on the free list, so no initialization call is needed.
+#define POOL_DEFINE( name, blockSize, nBlocks )                                \
+  static uint32_t name##_mem[ ( nBlocks ) * POOL_WORDS( blockSize ) ];       \
+  Pool name = { 0, name##_mem, POOL_WORDS( blockSize ), ( nBlocks ) }
+
+
+//  void *
+//  Pool_alloc( Pool *pool )
+//  Take the first block from the free list. If the list is empty, take the next block that
+//  has never been used. PRIMASK is saved and restored, so this may be called with
+//  interrupts already disabled.
+void *
+Pool_alloc( Pool *pool )
+{
+  uint32_t    primask = __get_PRIMASK( );
+  Pool_Block *block;
+#ifdef POOL_DEBUG
+  uint8_t     reused = 0;               // Set if the block came from the free list
+#endif
+
+  __disable_irq( );
+  if(( block = pool->free ))
+  {
+    pool->free = block->next;
+#ifdef POOL_DEBUG
+    reused = 1;
+#endif
+  }
+  else if( pool->fresh < pool->count )
+    block = (Pool_Block *)( pool->mem + pool->fresh++ * pool->words );
+  else
+  {
+    pool->fails++;
+    __set_PRIMASK( primask );
+    return 0;
+  }
+  if( ++pool->used > pool->peak )
+    pool->peak = pool->used;
+  __set_PRIMASK( primask );
+
+#ifdef POOL_DEBUG
+  // A block from the free list must still hold the poison written by Pool_free, apart from
+  // the list link at its start.
+  if( reused )
+  {
+    uint32_t *w = (uint32_t *)block;
+    uint16_t  i;
+
+    for( i = POOL_LINK_WORDS; i < pool->words; i++ )
+      if( w[i] != POOL_POISON )
+      {
+        pool->errors++;
+        break;
+      }
+  }
+#endif
+  return block;
+}
+
+
+//  void
+//  Pool_free( Pool *pool, void *block )
+//  Put the block at the front of the free list.
+void
+Pool_free( Pool *pool, void *block )
+{
+  uint32_t primask;
+
+  if( !block )
+    return;
+
+#ifdef POOL_DEBUG
+  {
+    uint32_t *w   = (uint32_t *)block;
+    uint32_t  ofs = (uint32_t)( w - pool->mem );
+    uint16_t  i;
+
+    // The block must be the start of one of the blocks handed out so far
+    if( w < pool->mem || ofs >= (uint32_t)pool->fresh * pool->words || ofs % pool->words )
+    {
+      pool->errors++;
+      return;
+    }
+    // A block that is already poisoned is most likely being freed twice
+    for( i = POOL_LINK_WORDS; i < pool->words && w[i] == POOL_POISON; i++ )
+      ;
+    if( i == pool->words )
+    {
+      pool->errors++;
+      return;
+    }
+    for( i = POOL_LINK_WORDS; i < pool->words; i++ )
+      w[i] = POOL_POISON;
+  }
+#endif
+
+  primask = __get_PRIMASK( );
+  __disable_irq( );
+  ((Pool_Block *)block )->next = pool->free;
+  pool->free = block;
+  pool->used--;
+  __set_PRIMASK( primask );
+}
+
+#endif /* __STM32F030_POOL_LIB_C */
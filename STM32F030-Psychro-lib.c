@@ -0,0 +1,88 @@
+//  ==========================================================================================
+//  STM32F030-Psychro-lib.c
+//  ------------------------------------------------------------------------------------------
+//  Psychrometric calculations (the dew point, and the relative humidity at another
+//  temperature) from the temperature and relative humidity. The Magnus formula needs a
+//  logarithm and a division, which are slow without an FPU. Instead, it is split into three
+//  one-dimensional functions that are read from flash-resident tables with one lookup and
+//  one linear interpolation each.
+//
+//  The tables are in STM32F030-Psychro-tables.h, which is generated at build time by
+//  STM32F030-Psychro-tablegen.c from the reference formula. The generator also checks the
+//  worst-case error of the fixed-point result against the reference formula, and fails the
+//  build if it is larger than the tolerance. The table sizes are set by the PSY_* variables
+//  in the Makefile.
+//  ------------------------------------------------------------------------------------------
+//  https://github.com/EZdenki/STM32F030-CMSIS-I2C-AHT10-lib
+//  Released under the MIT License
+//  Copyright (c) 2023
+//  Mike Shegedin, EZdenki.com
+//  ------------------------------------------------------------------------------------------
+//  Target Device: STM32F030Fxxx
+//  ------------------------------------------------------------------------------------------
+//  Routines in this Library
+//
+//  fix16_t
+//  dewPoint( fix16_t temp, fix16_t humid )
+//    Returns the dew point in Celsius given the temperature in Celsius and the relative
+//    humidity in percent. All values are Q16.16 fixed-point.
+//
+//  fix16_t
+//  humidAt( fix16_t humid, fix16_t temp, fix16_t newTemp )
+//    Returns the relative humidity in percent of air with relative humidity humid at temp
+//    once it is at newTemp, with the same amount of water vapour. Use it to correct the
+//    humidity along with the temperature, so that both describe the same air.
+//  ==========================================================================================
+
+#ifndef __STM32F030_PSYCHRO_LIB_C
+#define __STM32F030_PSYCHRO_LIB_C
+
+#include "STM32F030-Fixed-lib.c"      // Fixed-point math and table lookup
+#include "STM32F030-Psychro-tables.h" // Generated tables
+
+
+//  fix16_t
+//  dewPoint( fix16_t temp, fix16_t humid )
+//  Returns the dew point in Celsius given the temperature in Celsius and the relative
+//  humidity in percent. All values are Q16.16 fixed-point.
+//    gamma = ln( RH / 100 ) + b * T / ( c + T )
+//    Td    = c * gamma / ( b - gamma )
+//  Humidity below the first table entry (1%) is treated as 1%.
+fix16_t
+dewPoint( fix16_t temp, fix16_t humid )
+{
+  fix16_t gamma;
+
+  gamma = fix16_lerpTable( psyLnRH,   PSY_RH_N, PSY_RH_X0, PSY_RH_SHIFT, humid ) +
+          fix16_lerpTable( psyGammaT, PSY_T_N,  PSY_T_X0,  PSY_T_SHIFT,  temp );
+  return  fix16_lerpTable( psyDew,    PSY_G_N,  PSY_G_X0,  PSY_G_SHIFT,  gamma );
+}
+
+
+//  fix16_t
+//  humidAt( fix16_t humid, fix16_t temp, fix16_t newTemp )
+//  The vapour pressure, RH * es( T ), stays the same, so RH' = RH * es( T ) / es( T' ).
+//  With the Magnus formula, ln( es( T )) = ln( 6.112 ) + gamma( T ), so
+//    RH' = RH * exp( gamma( T ) - gamma( T' ))
+//  which uses the same gamma table as dewPoint. The exponent is about 0.07 per degree of
+//  difference, so exp is taken from its series up to x^3, which is good to 0.1 % of the
+//  result for differences up to 5 degrees. The result is limited to 0 .. 100 %. The dew
+//  point of the result at newTemp is the same as that of humid at temp.
+fix16_t
+humidAt( fix16_t humid, fix16_t temp, fix16_t newTemp )
+{
+  fix16_t x, x2, e, rh;
+
+  x  = fix16_lerpTable( psyGammaT, PSY_T_N, PSY_T_X0, PSY_T_SHIFT, temp ) -
+       fix16_lerpTable( psyGammaT, PSY_T_N, PSY_T_X0, PSY_T_SHIFT, newTemp );
+  x2 = fix16_mul( x, x );
+  e  = FIX16( 1 ) + x + x2 / 2 + fix16_mul( x2, x ) / 6;
+  rh = fix16_mul( humid, e );
+  if( rh < 0 )
+    return 0;
+  if( rh > FIX16( 100 ))
+    return FIX16( 100 );
+  return rh;
+}
+
+#endif /* __STM32F030_PSYCHRO_LIB_C */
@@ -0,0 +1,215 @@
+//  ==========================================================================================
+//  STM32F030-Psychro-tablegen.c
+//  ------------------------------------------------------------------------------------------
+//  Host (PC) program that generates STM32F030-Psychro-tables.h, the flash-resident
+//  interpolation tables used by STM32F030-Psychro-lib.c to calculate the dew point. The
+//  tables are calculated from the reference Magnus formula in double precision. Then the
+//  dew point over the checked range is calculated the same way the target does it
+//  (fixed-point lookups and interpolation) and compared against the reference.
+//  If the worst-case error exceeds the tolerance, no header is written and the program exits
+//  with an error, which stops the build.
+//  ------------------------------------------------------------------------------------------
+//  https://github.com/EZdenki/STM32F030-CMSIS-I2C-AHT10-lib
+//  Released under the MIT License
+//  Copyright (c) 2023
+//  Mike Shegedin, EZdenki.com
+//  ------------------------------------------------------------------------------------------
+//  Usage:
+//    STM32F030-Psychro-tablegen <out.h> [tStep] [rhStep] [gStep] [tolerance]
+//
+//    tStep, rhStep, gStep
+//      log2 of the table step size for the temperature (degrees C), relative humidity (%)
+//      and gamma tables. For example, 2 gives a step of 4, and -3 gives a step of 0.125.
+//      Larger steps mean smaller tables but larger interpolation errors.
+//      Defaults: 2, 0, -3.
+//    tolerance
+//      Largest allowed dew point error in degrees C. Default: 0.1.
+//
+//  The Makefile builds and runs this program with the host compiler. See PSY_* in the
+//  Makefile to change the table sizes.
+//  ------------------------------------------------------------------------------------------
+//  Magnus formula (Alduchov and Eskridge coefficients):
+//    gamma( T, RH ) = ln( RH / 100 ) + b * T / ( c + T )
+//    Td             = c * gamma / ( b - gamma )
+//    b = 17.62, c = 243.12 degrees C
+//
+//  Tables (Q16.16, all sampled at power-of-two steps so the lookup needs no division):
+//    psyGammaT[]  b * T / ( c + T )    for T  from PSY_T_MIN  to PSY_T_MAX
+//    psyLnRH[]    ln( RH / 100 )       for RH from PSY_RH_MIN to 100
+//    psyDew[]     c * g / ( b - g )    for g  covering every reachable gamma
+//  ==========================================================================================
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "STM32F030-Fixed-lib.c"      // Same fixed-point lookup as used on the target
+
+#define PSY_B       17.62
+#define PSY_C       243.12
+#define PSY_T_MIN   -40               // Sensor range of the AHT10
+#define PSY_T_MAX    85
+#define PSY_RH_MIN    1               // Dew point is not defined at 0% RH
+#define PSY_RH_CHECK  5               // Errors are checked from this humidity up
+
+typedef struct
+{
+  const char *name;                   // Name of the array in the generated header
+  const char *desc;                   // Comment for the generated header
+  double      x0, x1;                 // Range covered by the table
+  int         stepLog2;               // log2 of the step size
+  uint8_t     shift;                  // Step size as a Q16.16 shift
+  int         n;                      // Number of entries
+  fix16_t    *y;                      // Table values
+} Table;
+
+
+//  double
+//  gammaT( double t ), lnRH( double rh ), dewG( double g )
+//  Reference functions for each table.
+static double gammaT( double t )  { return PSY_B * t / ( PSY_C + t ); }
+static double lnRH( double rh )   { return log( rh / 100.0 ); }
+static double dewG( double g )    { return PSY_C * g / ( PSY_B - g ); }
+
+
+//  void
+//  makeTable( Table *tbl, double (*f)( double ))
+//  Fill a table with the function f sampled from x0 in steps of 2^stepLog2, with enough
+//  entries to reach x1. x0 is rounded to Q16.16 so that the host and target agree on the
+//  sample positions.
+static void
+makeTable( Table *tbl, double (*f)( double ))
+{
+  double step = ldexp( 1.0, tbl->stepLog2 );
+
+  tbl->x0    = lround( tbl->x0 * 65536.0 ) / 65536.0;
+  tbl->shift = 16 + tbl->stepLog2;
+  tbl->n     = (int)ceil(( tbl->x1 - tbl->x0 ) / step ) + 1;
+  tbl->y     = malloc( tbl->n * sizeof( fix16_t ));
+  for( int i = 0; i < tbl->n; i++ )
+    tbl->y[i] = (fix16_t)lround( f( tbl->x0 + i * step ) * 65536.0 );
+}
+
+
+//  fix16_t
+//  lookup( const Table *tbl, fix16_t x )
+//  Table lookup as done on the target.
+static fix16_t
+lookup( const Table *tbl, fix16_t x )
+{
+  return fix16_lerpTable( tbl->y, tbl->n, (fix16_t)lround( tbl->x0 * 65536.0 ), tbl->shift,
+                          x );
+}
+
+
+//  void
+//  writeTable( FILE *out, const Table *tbl, const char *prefix )
+//  Write one table and its defines to the header.
+static void
+writeTable( FILE *out, const Table *tbl, const char *prefix )
+{
+  fprintf( out, "//  %s\n", tbl->desc );
+  fprintf( out, "#define %s_X0    %ld\n", prefix, lround( tbl->x0 * 65536.0 ));
+  fprintf( out, "#define %s_SHIFT %d\n", prefix, tbl->shift );
+  fprintf( out, "#define %s_N     %d\n", prefix, tbl->n );
+  fprintf( out, "static const fix16_t %s[ %d ] =\n{", tbl->name, tbl->n );
+  for( int i = 0; i < tbl->n; i++ )
+    fprintf( out, "%s%11ld%s", ( i % 6 ) ? " " : "\n  ", (long)tbl->y[i],
+             ( i < tbl->n - 1 ) ? "," : "" );
+  fprintf( out, "\n};\n\n" );
+}
+
+
+int
+main( int argc, char **argv )
+{
+  // shift, n and y are filled in by makeTable
+  Table tT  = { .name = "psyGammaT", .desc = "gamma( T ) = b * T / ( c + T ), T in degrees C",
+                .x0 = PSY_T_MIN, .x1 = PSY_T_MAX, .stepLog2 = 2,
+                .shift = 0, .n = 0, .y = NULL };
+  Table tRH = { .name = "psyLnRH", .desc = "ln( RH / 100 ), RH in percent",
+                .x0 = PSY_RH_MIN, .x1 = 100, .stepLog2 = 0,
+                .shift = 0, .n = 0, .y = NULL };
+  Table tG  = { .name = "psyDew", .desc = "Td( g ) = c * g / ( b - g ), Td in degrees C",
+                .x0 = 0, .x1 = 0, .stepLog2 = -3,
+                .shift = 0, .n = 0, .y = NULL };
+  double tolerance = 0.1;
+  double worst = 0, worstT = 0, worstRH = 0;
+  FILE  *out;
+
+  if( argc < 2 )
+  {
+    fprintf( stderr, "usage: %s <out.h> [tStep] [rhStep] [gStep] [tolerance]\n", argv[0] );
+    return 2;
+  }
+  if( argc > 2 ) tT.stepLog2  = atoi( argv[2] );
+  if( argc > 3 ) tRH.stepLog2 = atoi( argv[3] );
+  if( argc > 4 ) tG.stepLog2  = atoi( argv[4] );
+  if( argc > 5 ) tolerance    = atof( argv[5] );
+
+  makeTable( &tT,  gammaT );
+  makeTable( &tRH, lnRH );
+
+  // The gamma table has to cover every sum of the other two tables
+  tG.x0 = ( tRH.y[0] + tT.y[0] ) / 65536.0;
+  tG.x1 = ( tRH.y[tRH.n - 1] + tT.y[tT.n - 1] ) / 65536.0;
+  makeTable( &tG,  dewG );
+
+  // Check the inputs the target can see by stepping through the raw 20-bit sensor codes.
+  // Temperature codes are checked in steps of 64 (0.012 degrees) and humidity codes in
+  // steps of 256 (0.024 %) to keep the run time down.
+  for( uint32_t rawT = 0; rawT < ( 1UL << 20 ); rawT += 64 )
+  {
+    fix16_t t  = fix16_fromRaw20( rawT, 200, -50 );
+    double  dt = t / 65536.0;
+
+    if( dt < PSY_T_MIN || dt > PSY_T_MAX )
+      continue;
+    for( uint32_t rawRH = 0; rawRH < ( 1UL << 20 ); rawRH += 256 )
+    {
+      fix16_t rh  = fix16_fromRaw20( rawRH, 100, 0 );
+      double  drh = rh / 65536.0;
+      double  g, err;
+
+      if( drh < PSY_RH_CHECK )
+        continue;
+      g   = lnRH( drh ) + gammaT( dt );
+      err = fabs( lookup( &tG, lookup( &tRH, rh ) + lookup( &tT, t )) / 65536.0 - dewG( g ));
+      if( err > worst )
+      {
+        worst   = err;
+        worstT  = dt;
+        worstRH = drh;
+      }
+    }
+  }
+
+  fprintf( stderr, "psychro tables: %d + %d + %d entries (%d bytes), "
+           "max dew point error %.4f C at %.2f C, %.2f %%RH\n",
+           tT.n, tRH.n, tG.n, ( tT.n + tRH.n + tG.n ) * (int)sizeof( fix16_t ),
+           worst, worstT, worstRH );
+  if( worst > tolerance )
+  {
+    fprintf( stderr, "error: dew point error exceeds tolerance of %.4f C\n", tolerance );
+    return 1;
+  }
+
+  if( !( out = fopen( argv[1], "w" )))
+  {
+    perror( argv[1] );
+    return 1;
+  }
+  fprintf( out, "//  %s\n", argv[1] );
+  fprintf( out, "//  Generated by STM32F030-Psychro-tablegen.c -- do not edit.\n" );
+  fprintf( out, "//  Steps: T 2^%d C, RH 2^%d %%, gamma 2^%d. "
+           "Max dew point error %.4f C (RH >= %d %%).\n\n",
+           tT.stepLog2, tRH.stepLog2, tG.stepLog2, worst, PSY_RH_CHECK );
+  fprintf( out, "#ifndef __STM32F030_PSYCHRO_TABLES_H\n" );
+  fprintf( out, "#define __STM32F030_PSYCHRO_TABLES_H\n\n" );
+  writeTable( out, &tT,  "PSY_T" );
+  writeTable( out, &tRH, "PSY_RH" );
+  writeTable( out, &tG,  "PSY_G" );
+  fprintf( out, "#endif /* __STM32F030_PSYCHRO_TABLES_H */\n" );
+  fclose( out );
+  return 0;
+}
@@ -0,0 +1,48 @@
+//  ==========================================================================================
+//  STM32F030-RamFunc-lib.c
+//  ------------------------------------------------------------------------------------------
+//  Provides the RAMFUNC attribute macro used to place selected time-critical routines into
+//  RAM. Above 24 MHz the STM32F030 flash needs one wait state, so instruction fetches from
+//  flash stall the CPU. Routines marked with RAMFUNC are linked into the .ramfunc section,
+//  stored in flash, and copied to RAM by Reset_Handler before main() is called, so they
+//  execute with zero wait states regardless of the flash latency setting.
+//  ------------------------------------------------------------------------------------------
+//  https://github.com/EZdenki/STM32F030-CMSIS-I2C-AHT10-lib
+//  Released under the MIT License
+//  Copyright (c) 2023
+//  Mike Shegedin, EZdenki.com
+//  ------------------------------------------------------------------------------------------
+//  Target Device: STM32F030Fxxx
+//  ------------------------------------------------------------------------------------------
+//  Usage:
+//
+//  RAMFUNC void
+//  myHotRoutine( void )
+//  {
+//    ...
+//  }
+//
+//  RAM placement is only enabled when USE_RAMFUNC is defined (for example, by adding
+//  -DUSE_RAMFUNC to CFLAGS). At the default 8 MHz clock the flash runs with zero wait states,
+//  so RAMFUNC expands to nothing and the routines stay in flash, saving the RAM.
+//
+//  Notes:
+//  - Each RAM routine occupies both flash (load image) and RAM (run copy). The 4 kB RAM of
+//    the STM32F030F4 is tight, so only mark short routines that sit in busy-wait loops or
+//    in interrupt handlers.
+//  - Calls from flash to RAM span more than the +/-16 MB range of a Thumb BL instruction, so
+//    the routines are also marked long_call. noinline keeps the compiler from copying the
+//    body back into a flash-resident caller.
+//  - Any routine called from a RAM routine still runs from flash unless it is marked as well.
+//  ==========================================================================================
+
+#ifndef __STM32F030_RAMFUNC_LIB_C
+#define __STM32F030_RAMFUNC_LIB_C
+
+#ifdef USE_RAMFUNC
+  #define RAMFUNC __attribute__(( section(".ramfunc"), long_call, noinline ))
+#else
+  #define RAMFUNC
+#endif
+
+#endif /* __STM32F030_RAMFUNC_LIB_C */
@@ -0,0 +1,359 @@
+//  ==========================================================================================
+//  STM32F030-Regmap-lib.c
+//  ------------------------------------------------------------------------------------------
+//  Register map with a write-through cache for I2C devices that have 8-bit registers at
+//  8-bit register addresses, such as the BME280. A device driver declares the registers it
+//  uses in a table, and reads and writes them through the regmap instead of building the
+//  I2C transactions itself.
+//
+//  Registers are either non-volatile (configuration registers that only change when the
+//  program writes them) or volatile (REGMAP_VOLATILE: status and data registers that the
+//  device changes by itself). A non-volatile register is read from the device only once;
+//  after that, reads come from the cache, and writes of the value it already holds are
+//  skipped. Volatile registers always go to the device.
+//
+//  Changes can also be collected in the cache with Regmap_set and written together with
+//  Regmap_sync. Dirty registers with consecutive addresses are then written in a single
+//  transaction.
+//  ------------------------------------------------------------------------------------------
+//  https://github.com/EZdenki/STM32F030-CMSIS-I2C-AHT10-lib
+//  Released under the MIT License
+//  Copyright (c) 2023
+//  Mike Shegedin, EZdenki.com
+//  ------------------------------------------------------------------------------------------
+//  Target Device: STM32F030Fxxx
+//  ------------------------------------------------------------------------------------------
+//  Usage:
+//
+//    static const Regmap_Reg bmeRegs[] =        // Sorted by register address
+//    {
+//      { 0xF2, 0 },                             // ctrl_hum
+//      { 0xF3, REGMAP_VOLATILE },               // status
+//      { 0xF4, 0 },                             // ctrl_meas
+//      { 0xF5, 0 },                             // config
+//    };
+//    static uint8_t bmeCache[ 4 ];
+//    Regmap bme;
+//
+//    Regmap_init( &bme, &bmeDev, bmeRegs, bmeCache, 4, REGMAP_PAIRS );
+//    Regmap_set( &bme, 0xF2, 0x07, 0x01 );      // Change the cached values only...
+//    Regmap_set( &bme, 0xF4, 0xFF, 0x27 );
+//    Regmap_sync( &bme );                       // ...and write both in one transaction
+//
+//  Write modes, set for each regmap depending on the device:
+//    REGMAP_BURST  A multi-byte write is the first register address followed by the data
+//                  for consecutive registers (register address auto-increment).
+//    REGMAP_PAIRS  A multi-byte write is a list of register address and data pairs, as
+//                  used by the BME280.
+//  ------------------------------------------------------------------------------------------
+//  Routines in this Library
+//
+//  void
+//  Regmap_init( Regmap *map, I2C_Dev *dev, const Regmap_Reg *regs, uint8_t *cache,
+//               uint8_t n, uint8_t mode )
+//    Set up a regmap of the n registers in regs (at most REGMAP_MAX, sorted by address),
+//    with cache space for n bytes. Nothing is read from the device yet.
+//
+//  uint8_t
+//  Regmap_read( Regmap *map, uint8_t reg, uint8_t *value )
+//  uint8_t
+//  Regmap_write( Regmap *map, uint8_t reg, uint8_t value )
+//    Read or write one register, using the cache for non-volatile registers.
+//
+//  uint8_t
+//  Regmap_update( Regmap *map, uint8_t reg, uint8_t mask, uint8_t value )
+//    Change the bits in mask to the bits of value, and write the register if it changed.
+//
+//  uint8_t
+//  Regmap_set( Regmap *map, uint8_t reg, uint8_t mask, uint8_t value )
+//  uint8_t
+//  Regmap_sync( Regmap *map )
+//    Change bits in the cache only, then write all changed registers to the device.
+//
+//  uint8_t
+//  Regmap_readBlock( Regmap *map, uint8_t reg, uint8_t *data, uint8_t n )
+//    Read n consecutive registers starting at reg straight from the device, without the
+//    cache. For data registers and calibration blocks. The registers need not be declared.
+//
+//  void
+//  Regmap_invalidate( Regmap *map )
+//    Forget all cached values, for example after the device was reset.
+//
+//  REGMAP_GET( value, mask )
+//  REGMAP_PUT( mask, field )
+//    Take a bit field out of a register value, or shift a field value into place. The mask
+//    must be a constant, for example REGMAP_GET( ctrl, 0x1C ) for bits 4:2.
+//
+//  All routines that access the bus return I2C_OK or an I2C error code, or REGMAP_NOREG if
+//  the register was not declared. The reads, writes and hits fields of Regmap count the
+//  bus transactions and the accesses served by the cache.
+//  ==========================================================================================
+
+#ifndef __STM32F030_REGMAP_LIB_C
+#define __STM32F030_REGMAP_LIB_C
+
+#include "stm32f030x6.h"                // Primary CMSIS header file
+#include "STM32F030-I2C-Dev-lib.c"      // I2C device handles
+
+#define REGMAP_MAX       32             // Most registers in one regmap (bits in valid/dirty)
+#define REGMAP_SYNC_MAX  16             // Largest write transaction of Regmap_sync in bytes
+#define REGMAP_NOREG     0x10           // Error code: register not declared
+
+#define REGMAP_VOLATILE  0x01           // Register flag: Always read from the device
+
+#define REGMAP_BURST     0              // Write mode: Address, then consecutive data bytes
+#define REGMAP_PAIRS     1              // Write mode: Address and data pairs
+
+#define REGMAP_GET( value, mask )  ((( value ) & ( mask )) >> __builtin_ctz( mask ))
+#define REGMAP_PUT( mask, field )  ((( field ) << __builtin_ctz( mask )) & ( mask ))
+
+typedef struct
+{
+  uint8_t reg;                          // Register address
+  uint8_t flags;                        // REGMAP_VOLATILE or 0
+} Regmap_Reg;
+
+typedef struct
+{
+  I2C_Dev          *dev;                // Device the registers belong to
+  const Regmap_Reg *regs;               // Declared registers, sorted by address
+  uint8_t          *cache;              // Cached value of each declared register
+  uint32_t          valid;              // Bit i set: cache[i] holds the device value
+  uint32_t          dirty;              // Bit i set: cache[i] must be written to the device
+  uint8_t           n;                  // Number of declared registers
+  uint8_t           mode;               // REGMAP_BURST or REGMAP_PAIRS
+  uint16_t          reads;              // Read transactions
+  uint16_t          writes;             // Write transactions
+  uint16_t          hits;               // Reads and writes served by the cache
+} Regmap;
+
+
+//  void
+//  Regmap_init( Regmap *map, I2C_Dev *dev, const Regmap_Reg *regs, uint8_t *cache,
+//               uint8_t n, uint8_t mode )
+//  Set up the regmap with an empty cache.
+void
+Regmap_init( Regmap *map, I2C_Dev *dev, const Regmap_Reg *regs, uint8_t *cache,
+             uint8_t n, uint8_t mode )
+{
+  map->dev    = dev;
+  map->regs   = regs;
+  map->cache  = cache;
+  map->valid  = 0;
+  map->dirty  = 0;
+  map->n      = ( n > REGMAP_MAX ) ? REGMAP_MAX : n;
+  map->mode   = mode;
+  map->reads  = 0;
+  map->writes = 0;
+  map->hits   = 0;
+}
+
+
+//  void
+//  Regmap_invalidate( Regmap *map )
+//  Forget all cached values. Changes not yet written by Regmap_sync are lost.
+void
+Regmap_invalidate( Regmap *map )
+{
+  map->valid = 0;
+  map->dirty = 0;
+}
+
+
+//  int8_t
+//  Regmap_index( Regmap *map, uint8_t reg )
+//  Return the index of reg in the register table, or -1 if it is not declared.
+static int8_t
+Regmap_index( Regmap *map, uint8_t reg )
+{
+  for( uint8_t i = 0; i < map->n; i++ )
+    if( map->regs[i].reg == reg )
+      return i;
+  return -1;
+}
+
+
+//  uint8_t
+//  Regmap_readBlock( Regmap *map, uint8_t reg, uint8_t *data, uint8_t n )
+//  Write the register address, then read n bytes. The device auto-increments the address.
+uint8_t
+Regmap_readBlock( Regmap *map, uint8_t reg, uint8_t *data, uint8_t n )
+{
+  uint8_t status;
+
+  map->reads++;
+  status = I2C_devWrite( map->dev, &reg, 1 );
+  if( status == I2C_OK )
+    status = I2C_devRead( map->dev, data, n );
+  return status;
+}
+
+
+//  uint8_t
+//  Regmap_fetch( Regmap *map, int8_t i )
+//  Make sure cache[i] holds the value of a non-volatile register, reading it if needed. A
+//  dirty register holds the value about to be written, which must not be read over.
+static uint8_t
+Regmap_fetch( Regmap *map, int8_t i )
+{
+  uint8_t status;
+
+  if(( map->valid | map->dirty ) & ( 1UL << i ))
+  {
+    map->hits++;
+    return I2C_OK;
+  }
+  status = Regmap_readBlock( map, map->regs[i].reg, &map->cache[i], 1 );
+  if( status == I2C_OK )
+    map->valid |= 1UL << i;
+  return status;
+}
+
+
+//  uint8_t
+//  Regmap_read( Regmap *map, uint8_t reg, uint8_t *value )
+//  Read a register. Non-volatile registers are read from the device the first time only.
+uint8_t
+Regmap_read( Regmap *map, uint8_t reg, uint8_t *value )
+{
+  int8_t  i = Regmap_index( map, reg );
+  uint8_t status;
+
+  if( i < 0 )
+    return REGMAP_NOREG;
+  if( map->regs[i].flags & REGMAP_VOLATILE )
+    return Regmap_readBlock( map, reg, value, 1 );
+  status = Regmap_fetch( map, i );
+  *value = map->cache[i];
+  return status;
+}
+
+
+//  uint8_t
+//  Regmap_write( Regmap *map, uint8_t reg, uint8_t value )
+//  Write a register, unless it is non-volatile and already holds value. The cache is
+//  updated only if the write succeeded, otherwise the value is forgotten.
+uint8_t
+Regmap_write( Regmap *map, uint8_t reg, uint8_t value )
+{
+  int8_t  i = Regmap_index( map, reg );
+  uint8_t buf[2] = { reg, value };
+  uint8_t status;
+
+  if( i < 0 )
+    return REGMAP_NOREG;
+  if( !( map->regs[i].flags & REGMAP_VOLATILE ) && ( map->valid & ( 1UL << i )) &&
+      !( map->dirty & ( 1UL << i )) && map->cache[i] == value )
+  {
+    map->hits++;
+    return I2C_OK;
+  }
+  map->writes++;
+  status = I2C_devWrite( map->dev, buf, 2 );
+  map->cache[i] = value;
+  map->dirty   &= ~( 1UL << i );
+  if( status == I2C_OK && !( map->regs[i].flags & REGMAP_VOLATILE ))
+    map->valid |= 1UL << i;
+  else
+    map->valid &= ~( 1UL << i );
+  return status;
+}
+
+
+//  uint8_t
+//  Regmap_update( Regmap *map, uint8_t reg, uint8_t mask, uint8_t value )
+//  Read-modify-write. For a non-volatile register the read comes from the cache, and the
+//  write is skipped if no bit changes.
+uint8_t
+Regmap_update( Regmap *map, uint8_t reg, uint8_t mask, uint8_t value )
+{
+  uint8_t old;
+  uint8_t status = Regmap_read( map, reg, &old );
+
+  if( status != I2C_OK )
+    return status;
+  return Regmap_write( map, reg, ( old & ~mask ) | ( value & mask ));
+}
+
+
+//  uint8_t
+//  Regmap_set( Regmap *map, uint8_t reg, uint8_t mask, uint8_t value )
+//  Change the bits in mask in the cache only, and mark the register for Regmap_sync. The
+//  register is read first if its value is not known. Volatile registers cannot be set.
+uint8_t
+Regmap_set( Regmap *map, uint8_t reg, uint8_t mask, uint8_t value )
+{
+  int8_t  i = Regmap_index( map, reg );
+  uint8_t status, v;
+
+  if( i < 0 || ( map->regs[i].flags & REGMAP_VOLATILE ))
+    return REGMAP_NOREG;
+  if( mask != 0xFF && ( status = Regmap_fetch( map, i )) != I2C_OK )
+    return status;
+  v = ( map->cache[i] & ~mask ) | ( value & mask );
+  if( !( map->valid & ( 1UL << i )) || v != map->cache[i] )
+  {
+    map->cache[i] = v;
+    map->dirty   |= 1UL << i;
+  }
+  return I2C_OK;
+}
+
+
+//  uint8_t
+//  Regmap_sync( Regmap *map )
+//  Write all dirty registers. In REGMAP_BURST mode, dirty registers with consecutive
+//  addresses share one transaction. In REGMAP_PAIRS mode, all dirty registers share
+//  transactions regardless of their addresses. A transaction holds at most
+//  REGMAP_SYNC_MAX bytes. Returns the first error; registers that failed stay dirty.
+uint8_t
+Regmap_sync( Regmap *map )
+{
+  uint8_t  buf[ REGMAP_SYNC_MAX ];
+  uint8_t  result = I2C_OK;
+  uint8_t  i = 0;
+
+  while( i < map->n )
+  {
+    uint32_t done = 0;
+    uint8_t  len  = 0;
+    uint8_t  status;
+
+    if( !( map->dirty & ( 1UL << i )))
+    {
+      i++;
+      continue;
+    }
+    if( map->mode == REGMAP_BURST )
+    {
+      buf[ len++ ] = map->regs[i].reg;
+      do
+      {
+        buf[ len++ ] = map->cache[i];
+        done |= 1UL << i++;
+      } while( i < map->n && len < REGMAP_SYNC_MAX && ( map->dirty & ( 1UL << i )) &&
+               map->regs[i].reg == map->regs[i - 1].reg + 1 );
+    }
+    else
+      for( ; i < map->n && len + 2 <= REGMAP_SYNC_MAX; i++ )
+        if( map->dirty & ( 1UL << i ))
+        {
+          buf[ len++ ] = map->regs[i].reg;
+          buf[ len++ ] = map->cache[i];
+          done |= 1UL << i;
+        }
+
+    map->writes++;
+    status = I2C_devWrite( map->dev, buf, len );
+    if( status == I2C_OK )
+    {
+      map->dirty &= ~done;
+      map->valid |= done;
+    }
+    else if( result == I2C_OK )
+      result = status;
+  }
+  return result;
+}
+
+#endif /* __STM32F030_REGMAP_LIB_C */
@@ -0,0 +1,312 @@
+//  ==========================================================================================
+//  STM32F030-SHT-lib.c
+//  ------------------------------------------------------------------------------------------
+//  Drivers for the Sensirion SHT3x (SHT30, SHT31, SHT35) and SHT4x (SHT40, SHT41, SHT45)
+//  temperature and humidity sensors, for use with STM32F030-Sensor-lib.c. They can share a
+//  bus with AHT10 sensors, and the sampling engine runs the conversions of all of them at
+//  the same time.
+//
+//  Every temperature and humidity word sent by these sensors is followed by a CRC-8, which
+//  is checked before the data is used. The conversion to Q16.16 needs no division: the
+//  sensors scale their readings to 0 .. 65535 over the full range, and a 16-bit reading is
+//  already the fraction of that range as a Q16.16 value, so only a multiply and an
+//  addition are needed. Use fix16_to100 for the same temp100 scale as the AHT10 routines.
+//
+//  Drivers, one for each way of reading the sensors:
+//    SHT3x_driver         Single shot, no clock stretching. The engine waits SHT3X_MEAS_MS
+//                         and then reads the result. The bus is free in between.
+//    SHT3x_stretchDriver  Single shot with clock stretching. The result is read straight
+//                         after the trigger, and the sensor holds SCL low until it is
+//                         ready (up to approx. 15 ms). Simpler timing, but the bus is
+//                         blocked for the whole conversion.
+//    SHT3x_periodicDriver Periodic mode: The sensor measures once a second by itself, and
+//                         each sample just fetches the latest result. Use a period of
+//                         1000 ms or more.
+//    SHT4x_driver         Single shot, high precision. The SHT4x has no clock stretching.
+//  ------------------------------------------------------------------------------------------
+//  https://github.com/EZdenki/STM32F030-CMSIS-I2C-AHT10-lib
+//  Released under the MIT License
+//  Copyright (c) 2023
+//  Mike Shegedin, EZdenki.com
+//  ------------------------------------------------------------------------------------------
+//  Target Devices:
+//    STM32F030Fxxx
+//    SHT3x at address 0x44 (ADDR pin low) or 0x45 (ADDR pin high)
+//    SHT4x at address 0x44 (SHT4x-A), 0x45 (SHT4x-B) or 0x46 (SHT4x-C)
+//  An SHT3x and an SHT4x on the same bus must use different addresses, or different
+//  multiplexer channels.
+//  ------------------------------------------------------------------------------------------
+//  Usage:
+//
+//    Sensor  aht, sht;
+//    Sensor *sensors[] = { &aht, &sht };
+//
+//    Sensor_init( &aht, &AHT10_driver, I2C1, 0, 0, 0, AHT10_ADD, 0, 2000 );
+//    Sensor_init( &sht, &SHT3x_driver, I2C1, 0, 0, 0, SHT3X_ADD, 0, 2000 );
+//    ...
+//    Sensor_run( sensors, 2 );
+//  ------------------------------------------------------------------------------------------
+//  Routines in this Library
+//
+//  uint8_t
+//  SHT_crc8( const uint8_t *data, uint8_t n )
+//    Return the Sensirion CRC-8 (polynomial 0x31, start value 0xFF) of n bytes.
+//
+//  uint8_t
+//  SHT_convert( const uint8_t *raw, uint8_t sht4x, fix16_t *temp, fix16_t *humid )
+//    Check the CRCs of the 6 bytes read from the sensor and convert them to Q16.16
+//    temperature in Celsius and relative humidity in percent. sht4x selects the SHT4x
+//    humidity formula. Returns I2C_OK or SENSOR_CRC_ERR, in which case temp and humid are
+//    not changed.
+//
+//  const Sensor_Driver SHT3x_driver, SHT3x_stretchDriver, SHT3x_periodicDriver,
+//                      SHT4x_driver
+//    Drivers for STM32F030-Sensor-lib.c as described above.
+//  ==========================================================================================
+
+#ifndef __STM32F030_SHT_LIB_C
+#define __STM32F030_SHT_LIB_C
+
+#include "stm32f030x6.h"                // Primary CMSIS header file
+#include "STM32F030-Sensor-lib.c"       // Generic sensor driver interface
+#include "STM32F030-Delay-lib.c"        // delay_us
+#include "STM32F030-Fixed-lib.c"        // fix16_t
+
+#define SHT3X_ADD          0x44         // Default I2C address of the SHT3x
+#define SHT4X_ADD          0x44         // I2C address of the SHT4x-A
+
+//  SHT3x commands (16 bits, sent most significant byte first)
+#define SHT3X_MEAS_HIGH    0x2400       // Single shot, high repeatability, no stretching
+#define SHT3X_MEAS_STRETCH 0x2C06       // Single shot, high repeatability, clock stretching
+#define SHT3X_PERIODIC_1   0x2130       // Periodic mode, 1 measurement/s, high repeatability
+#define SHT3X_FETCH        0xE000       // Read the latest result in periodic mode
+#define SHT3X_BREAK        0x3093       // Stop periodic mode
+#define SHT3X_RESET        0x30A2       // Soft reset
+
+//  SHT4x commands (8 bits)
+#define SHT4X_MEAS_HIGH    0xFD         // Single shot, high precision
+#define SHT4X_RESET        0x94         // Soft reset
+
+#define SHT_POWERUP_MS     2            // Power-up time (SHT3x 1.5 ms, SHT4x 1 ms)
+#define SHT_RESET_US       2000         // Time for a soft reset (SHT3x 1.5 ms, SHT4x 1 ms)
+#define SHT3X_MEAS_MS      16           // High repeatability conversion time (15.5 ms max)
+#define SHT4X_MEAS_MS      9            // High precision conversion time (8.3 ms max)
+#define SHT3X_PERIOD_MS    1000         // Time between measurements in periodic mode
+
+
+//  uint8_t
+//  SHT_crc8( const uint8_t *data, uint8_t n )
+//  Bitwise CRC-8 with polynomial x^8 + x^5 + x^4 + 1 (0x31). Only 2 bytes are checked at
+//  a time, so a table would cost more flash than it saves time.
+uint8_t
+SHT_crc8( const uint8_t *data, uint8_t n )
+{
+  uint8_t crc = 0xFF;
+
+  while( n-- )
+  {
+    crc ^= *data++;
+    for( uint8_t bit = 0; bit < 8; bit++ )
+      crc = ( crc & 0x80 ) ? ( crc << 1 ) ^ 0x31 : crc << 1;
+  }
+  return crc;
+}
+
+
+//  uint8_t
+//  SHT_convert( const uint8_t *raw, uint8_t sht4x, fix16_t *temp, fix16_t *humid )
+//  raw holds the temperature word, its CRC, the humidity word and its CRC. With the raw
+//  word r, the datasheet formulas are
+//    T  = -45 + 175 * r / 65535
+//    RH =       100 * r / 65535   (SHT3x)
+//    RH =  -6 + 125 * r / 65535   (SHT4x, limited to 0 .. 100 %)
+//  Dividing by 65536 instead of 65535 makes r a Q16.16 fraction, so T = 175 * r - 45.0 in
+//  Q16.16. The error of this is less than 0.003 degrees or 0.002 %.
+uint8_t
+SHT_convert( const uint8_t *raw, uint8_t sht4x, fix16_t *temp, fix16_t *humid )
+{
+  uint32_t t = raw[0] << 8 | raw[1];
+  uint32_t h = raw[3] << 8 | raw[4];
+  fix16_t  rh;
+
+  if( SHT_crc8( raw, 2 ) != raw[2] || SHT_crc8( raw + 3, 2 ) != raw[5] )
+    return SENSOR_CRC_ERR;
+
+  *temp = (fix16_t)( t * 175 ) - FIX16( 45 );
+  if( sht4x )
+  {
+    rh = (fix16_t)( h * 125 ) - FIX16( 6 );
+    if( rh < 0 )
+      rh = 0;
+    else if( rh > FIX16( 100 ))
+      rh = FIX16( 100 );
+  }
+  else
+    rh = (fix16_t)( h * 100 );
+  *humid = rh;
+  return I2C_OK;
+}
+
+
+//  uint8_t
+//  SHT3x_command( Sensor *s, uint16_t cmd )
+//  Send a 16-bit SHT3x command.
+static uint8_t
+SHT3x_command( Sensor *s, uint16_t cmd )
+{
+  uint8_t buf[2] = { cmd >> 8, cmd & 0xFF };
+
+  return I2C_devWrite( &s->dev, buf, 2 );
+}
+
+
+//  uint8_t
+//  SHT3x_init( Sensor *s )
+//  Soft reset, which also ends periodic mode if the sensor was left in it.
+static uint8_t
+SHT3x_init( Sensor *s )
+{
+  uint8_t status = SHT3x_command( s, SHT3X_RESET );
+
+  delay_us( SHT_RESET_US );
+  return status;
+}
+
+
+//  uint8_t
+//  SHT3x_start( Sensor *s )
+//  uint8_t
+//  SHT3x_startStretch( Sensor *s )
+//  Trigger a single-shot measurement without or with clock stretching.
+static uint8_t
+SHT3x_start( Sensor *s )
+{
+  return SHT3x_command( s, SHT3X_MEAS_HIGH );
+}
+
+static uint8_t
+SHT3x_startStretch( Sensor *s )
+{
+  return SHT3x_command( s, SHT3X_MEAS_STRETCH );
+}
+
+
+//  uint8_t
+//  SHT_fetch( Sensor *s, uint8_t *raw )
+//  Read the 6 result bytes. Without clock stretching, the sensor does not acknowledge its
+//  address until the result is ready; with clock stretching, it holds SCL low instead.
+static uint8_t
+SHT_fetch( Sensor *s, uint8_t *raw )
+{
+  return I2C_devRead( &s->dev, raw, 6 );
+}
+
+
+//  uint8_t
+//  SHT3x_decode( Sensor *s, const uint8_t *raw, Sensor_Reading *r )
+//  uint8_t
+//  SHT4x_decode( Sensor *s, const uint8_t *raw, Sensor_Reading *r )
+//  Check and convert the result with the SHT3x or SHT4x humidity formula.
+static uint8_t
+SHT3x_decode( Sensor *s, const uint8_t *raw, Sensor_Reading *r )
+{
+  r->valid = SENSOR_TEMP | SENSOR_HUMID;
+  return SHT_convert( raw, 0, &r->temp, &r->humid );
+}
+
+static uint8_t
+SHT4x_decode( Sensor *s, const uint8_t *raw, Sensor_Reading *r )
+{
+  r->valid = SENSOR_TEMP | SENSOR_HUMID;
+  return SHT_convert( raw, 1, &r->temp, &r->humid );
+}
+
+
+//  uint8_t
+//  SHT3x_initPeriodic( Sensor *s )
+//  Soft reset, then start periodic mode. The first result is ready after SHT3X_PERIOD_MS.
+static uint8_t
+SHT3x_initPeriodic( Sensor *s )
+{
+  uint8_t status = SHT3x_init( s );
+
+  if( status == I2C_OK )
+    status = SHT3x_command( s, SHT3X_PERIODIC_1 );
+  return status;
+}
+
+
+//  uint8_t
+//  SHT3x_startPeriodic( Sensor *s )
+//  Nothing to start; the sensor measures by itself.
+static uint8_t
+SHT3x_startPeriodic( Sensor *s )
+{
+  return I2C_OK;
+}
+
+
+//  uint8_t
+//  SHT3x_fetchPeriodic( Sensor *s, uint8_t *raw )
+//  Ask for the latest result, then read it. If there is no new result since the last
+//  fetch, the sensor does not acknowledge the read (I2C_NACK).
+static uint8_t
+SHT3x_fetchPeriodic( Sensor *s, uint8_t *raw )
+{
+  uint8_t status = SHT3x_command( s, SHT3X_FETCH );
+
+  if( status == I2C_OK )
+    status = I2C_devRead( &s->dev, raw, 6 );
+  return status;
+}
+
+
+//  uint8_t
+//  SHT4x_init( Sensor *s )
+//  uint8_t
+//  SHT4x_start( Sensor *s )
+//  Soft reset, and trigger a high-precision measurement. SHT4x commands are one byte.
+static uint8_t
+SHT4x_init( Sensor *s )
+{
+  const uint8_t cmd = SHT4X_RESET;
+  uint8_t       status = I2C_devWrite( &s->dev, &cmd, 1 );
+
+  delay_us( SHT_RESET_US );
+  return status;
+}
+
+static uint8_t
+SHT4x_start( Sensor *s )
+{
+  const uint8_t cmd = SHT4X_MEAS_HIGH;
+
+  return I2C_devWrite( &s->dev, &cmd, 1 );
+}
+
+
+const Sensor_Driver SHT3x_driver =
+{
+  "SHT3x", SENSOR_TEMP | SENSOR_HUMID | SENSOR_CRC, 6, SHT_POWERUP_MS, SHT3X_MEAS_MS,
+  SHT3x_init, SHT3x_start, 0, SHT_fetch, SHT3x_decode, 0
+};
+
+const Sensor_Driver SHT3x_stretchDriver =
+{
+  "SHT3x", SENSOR_TEMP | SENSOR_HUMID | SENSOR_CRC, 6, SHT_POWERUP_MS, 0,
+  SHT3x_init, SHT3x_startStretch, 0, SHT_fetch, SHT3x_decode, 0
+};
+
+const Sensor_Driver SHT3x_periodicDriver =
+{
+  "SHT3x", SENSOR_TEMP | SENSOR_HUMID | SENSOR_CRC, 6, SHT_POWERUP_MS, SHT3X_PERIOD_MS,
+  SHT3x_initPeriodic, SHT3x_startPeriodic, 0, SHT3x_fetchPeriodic, SHT3x_decode, 0
+};
+
+const Sensor_Driver SHT4x_driver =
+{
+  "SHT4x", SENSOR_TEMP | SENSOR_HUMID | SENSOR_CRC, 6, SHT_POWERUP_MS, SHT4X_MEAS_MS,
+  SHT4x_init, SHT4x_start, 0, SHT_fetch, SHT4x_decode, 0
+};
+
+#endif /* __STM32F030_SHT_LIB_C */
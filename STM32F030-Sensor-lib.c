@@ -0,0 +1,542 @@
+//  ==========================================================================================
+//  STM32F030-Sensor-lib.c
+//  ------------------------------------------------------------------------------------------
+//  Common interface for I2C environmental sensors, and a sampling engine that reads any
+//  mix of them. Each sensor library provides a Sensor_Driver: a table of the routines that
+//  split a reading into its steps (init, start, ready, fetch, decode, sleep), together with
+//  what the sensor can measure (capability flags) and how long its steps take. A Sensor
+//  ties a driver to a device handle (STM32F030-I2C-Dev-lib.c), so sensors may also sit
+//  behind an I2C multiplexer or on a software I2C bus.
+//
+//  The sampling engine starts the conversion of every sensor that is due, and collects the
+//  results as each conversion finishes, so the conversion times of all sensors overlap
+//  instead of adding up. Sensor_run never waits; it returns the time until it next has
+//  work, so the program can sleep or do other things in between.
+//  ------------------------------------------------------------------------------------------
+//  https://github.com/EZdenki/STM32F030-CMSIS-I2C-AHT10-lib
+//  Released under the MIT License
+//  Copyright (c) 2023
+//  Mike Shegedin, EZdenki.com
+//  ------------------------------------------------------------------------------------------
+//  Target Device: STM32F030Fxxx. SysTick_init must be called before Sensor_run.
+//  ------------------------------------------------------------------------------------------
+//  Usage (AHT10_driver is in STM32F030-AHT10-Sensor-lib.c):
+//
+//    Sensor  inside, outside;
+//    Sensor *sensors[] = { &inside, &outside };
+//
+//    I2C_init( I2C1, 100e3 );
+//    SysTick_init( );
+//    Sensor_init( &inside,  &AHT10_driver, I2C1, 0, 0, 0, AHT10_ADD, 0, 2000 );
+//    Sensor_init( &outside, &AHT10_driver, I2C1, 0, &mux, 1, AHT10_ADD, 0, 2000 );
+//    while( 1 )
+//    {
+//      Sensor_run( sensors, 2 );
+//      if( inside.fresh ) ...                   // New reading in inside.reading
+//      __WFI( );                                // Sleep until the next SysTick
+//    }
+//
+//  Driver routines (any of ready and sleep may be 0 if the sensor does not have them):
+//    init    Prepare the sensor after power-up (soft reset, calibration readout, ...).
+//    start   Trigger one conversion.
+//    ready   Ask the sensor if the conversion is finished. Returns I2C_OK, SENSOR_BUSY,
+//            or an error code. Without it, the conversion is taken to be finished after
+//            convMs.
+//    fetch   Read the raw conversion result (rawSize bytes, at most SENSOR_RAW_MAX).
+//    decode  Convert the raw result to a Sensor_Reading. Returns I2C_OK or an error code
+//            (for example SENSOR_CRC for a checksum error).
+//    sleep   Put the sensor into its lowest power state until the next start.
+//  All routines return I2C_OK or an error code.
+//  ------------------------------------------------------------------------------------------
+//  Routines in this Library
+//
+//  void
+//  Sensor_init( Sensor *s, const Sensor_Driver *drv, I2C_TypeDef *hw, SI2C_Bus *soft,
+//               I2C_Mux *mux, uint8_t channel, uint8_t address, void *priv,
+//               uint32_t periodMs )
+//    Set up a sensor to be read every periodMs milliseconds by Sensor_run. priv is passed
+//    on to the driver for its own state (calibration data), if it needs any.
+//
+//  uint32_t
+//  Sensor_run( Sensor **sensors, uint8_t n )
+//    Do all of the work that is due for the n sensors: initialize, start conversions, and
+//    collect finished results. Returns the number of milliseconds until more work is due.
+//
+//  uint8_t
+//  Sensor_read( Sensor *s, Sensor_Reading *r )
+//    Take one reading from a single sensor, waiting for the conversion. For programs that
+//    do not use Sensor_run.
+//
+//  uint8_t
+//  Sensor_finish( Sensor *s, Sensor_Reading *r )
+//    The second half of Sensor_read, for a conversion that was started with drv->start
+//    at least convMs ago: poll ready (if the driver has it), then fetch and decode.
+//
+//  void
+//  Sensor_powerInit( Sensor_Power *p, GPIO_TypeDef *port, uint8_t pin, uint8_t activeLow,
+//                    GPIO_TypeDef *busPort, uint16_t busMask )
+//    Set up pin of port (GPIOA or GPIOB) as the power switch of a sensor, and turn the
+//    power on. The busMask pins of busPort are floated while the power is off; busPort may
+//    be 0 if the bus is shared with sensors that stay powered. Sensor_run then leaves the
+//    I2C interface on while the power is off.
+//
+//  void
+//  Sensor_powerOn( Sensor_Power *p, I2C_TypeDef *hw )
+//  void
+//  Sensor_powerOff( Sensor_Power *p, I2C_TypeDef *hw )
+//    Switch the power. hw, if not 0, is the I2C interface of the bus, which is turned off
+//    with the power.
+//
+//  void
+//  Sensor_setPower( Sensor *s, Sensor_Power *p )
+//    Let Sensor_run switch the power of s between samples (see Power Gating, below).
+//
+//  uint8_t
+//  Sensor_gated( Sensor *s )
+//    Return 1 if s has a power switch and its sample period is long enough to use it.
+//
+//  After Sensor_run, a sensor with fresh set has a new result in reading; fresh is
+//  cleared by the program. status holds the result of the last attempt and errors counts
+//  the failed attempts. After a failed attempt, the sensor is initialized again and then
+//  started at the next of its sample times (startMs plus a whole number of periods), so
+//  that it stays in step with other sensors of the same period.
+//  ------------------------------------------------------------------------------------------
+//  Power Gating:
+//  -------------
+//  A sensor may be powered from a GPIO pin (for a few mA) or through a load switch. Between
+//  samples, Sensor_run then turns the power off and floats the bus pins, so that the sensor
+//  is not powered backwards through its SDA and SCL protection diodes. The power is turned
+//  on again powerUpMs before the next sample time and the driver init routine is called,
+//  so the sample times do not change. Power-up and init cost more than keeping a sensor
+//  idle when samples are close together, so the power is only switched when periodMs is at
+//  least SENSOR_GATE_RATIO times powerUpMs + convMs. Otherwise it is left on.
+//  ==========================================================================================
+
+#ifndef __STM32F030_SENSOR_LIB_C
+#define __STM32F030_SENSOR_LIB_C
+
+#include "stm32f030x6.h"                // Primary CMSIS header file
+#include "STM32F030-I2C-Dev-lib.c"      // I2C device handles
+#include "STM32F030-SysTick-lib.c"      // Millisecond timebase
+#include "STM32F030-Delay-lib.c"        // delay_us for Sensor_read
+#include "STM32F030-Fixed-lib.c"        // fix16_t
+
+//  Capability flags
+#define SENSOR_TEMP     0x01            // Measures temperature
+#define SENSOR_HUMID    0x02            // Measures relative humidity
+#define SENSOR_PRESS    0x04            // Measures air pressure
+#define SENSOR_CRC      0x10            // Data is protected by a checksum
+#define SENSOR_SLEEP    0x20            // Has a low-power sleep mode
+
+//  Error codes, in addition to the I2C codes
+#define SENSOR_BUSY     0x20            // Conversion not finished yet
+#define SENSOR_CRC_ERR  0x21            // Checksum of the data is wrong
+#define SENSOR_BADDATA  0x22            // Data or sensor status not valid
+
+#define SENSOR_RAW_MAX  8               // Largest raw result of any driver, in bytes
+#define SENSOR_POLL_MS  2               // Wait between ready checks after convMs
+#define SENSOR_POLL_MAX 25              // Ready checks before giving up
+#ifndef SENSOR_GATE_RATIO
+#define SENSOR_GATE_RATIO 10            // Min. periodMs / ( powerUpMs + convMs ) for gating
+#endif
+
+//  Sensor states
+#define SENSOR_POWERUP  0               // Waiting for powerUpMs after Sensor_init or an error
+#define SENSOR_IDLE     1               // Waiting for the next sample time
+#define SENSOR_CONVERT  2               // Conversion running
+
+typedef struct
+{
+  fix16_t temp;                         // Temperature in Celsius
+  fix16_t humid;                        // Relative humidity in percent
+  fix16_t press;                        // Air pressure in hPa
+  uint8_t valid;                        // SENSOR_TEMP, SENSOR_HUMID, SENSOR_PRESS bits of
+                                        // the fields that hold values
+} Sensor_Reading;
+
+typedef struct
+{
+  GPIO_TypeDef *port;                   // Port of the power switch pin
+  uint16_t      mask;                   // Power switch pin
+  uint8_t       activeLow;              // 1 if the switch is on when the pin is low
+  uint8_t       on;                     // Power is on
+  GPIO_TypeDef *busPort;                // Port of the bus pins, or 0
+  uint16_t      busMask;                // Bus pins to float while the power is off
+  uint32_t      busModer;               // MODER bits of the bus pins, saved while off
+} Sensor_Power;
+
+struct Sensor;
+
+typedef struct
+{
+  const char *name;                     // Short name for displays, for example "AHT10"
+  uint8_t     caps;                     // SENSOR_* capability flags
+  uint8_t     rawSize;                  // Bytes read by fetch
+  uint16_t    powerUpMs;                // Wait from power-up until init may be called
+  uint16_t    convMs;                   // Time from start until the result is ready
+  uint8_t   ( *init )( struct Sensor *s );
+  uint8_t   ( *start )( struct Sensor *s );
+  uint8_t   ( *ready )( struct Sensor *s );
+  uint8_t   ( *fetch )( struct Sensor *s, uint8_t *raw );
+  uint8_t   ( *decode )( struct Sensor *s, const uint8_t *raw, Sensor_Reading *r );
+  uint8_t   ( *sleep )( struct Sensor *s );
+} Sensor_Driver;
+
+typedef struct Sensor
+{
+  const Sensor_Driver *drv;             // Driver of this sensor type
+  I2C_Dev              dev;             // Bus, multiplexer channel and address
+  void                *priv;            // Driver state, such as calibration data
+  Sensor_Power        *power;           // Power switch, or 0
+  uint32_t             periodMs;        // Time between samples
+  uint32_t             due;             // SysTick_ms time of the next step
+  uint32_t             startMs;         // SysTick_ms time the last conversion started, or
+                                        // was first due to start
+  Sensor_Reading       reading;         // Last good reading
+  uint16_t             errors;          // Failed attempts
+  uint8_t              state;           // SENSOR_POWERUP, SENSOR_IDLE or SENSOR_CONVERT
+  uint8_t              polls;           // Ready checks made for this conversion
+  uint8_t              status;          // Result of the last attempt
+  uint8_t              fresh;           // Set when reading is new, cleared by the program
+} Sensor;
+
+
+//  void
+//  Sensor_init( Sensor *s, const Sensor_Driver *drv, I2C_TypeDef *hw, SI2C_Bus *soft,
+//               I2C_Mux *mux, uint8_t channel, uint8_t address, void *priv,
+//               uint32_t periodMs )
+//  Set up the sensor. The driver init routine is called by Sensor_run once the power-up
+//  time has passed.
+void
+Sensor_init( Sensor *s, const Sensor_Driver *drv, I2C_TypeDef *hw, SI2C_Bus *soft,
+             I2C_Mux *mux, uint8_t channel, uint8_t address, void *priv, uint32_t periodMs )
+{
+  I2C_devInit( &s->dev, hw, soft, mux, channel, address );
+  s->drv           = drv;
+  s->priv          = priv;
+  s->power         = 0;
+  s->periodMs      = periodMs;
+  s->due           = SysTick_ms( ) + drv->powerUpMs;
+  s->startMs       = s->due;            // The sample times count from here
+  s->reading.valid = 0;
+  s->errors        = 0;
+  s->state         = SENSOR_POWERUP;
+  s->status        = I2C_OK;
+  s->fresh         = 0;
+}
+
+
+//  uint32_t
+//  Sensor_moderMask( uint16_t pins )
+//  Return the MODER bits of the given pins.
+static uint32_t
+Sensor_moderMask( uint16_t pins )
+{
+  uint32_t mask = 0;
+
+  for( uint8_t i = 0; i < 16; i++ )
+    if( pins & ( 1U << i ))
+      mask |= 0b11UL << ( i * 2 );
+  return mask;
+}
+
+
+//  void
+//  Sensor_powerOff( Sensor_Power *p, I2C_TypeDef *hw )
+//  Turn off the I2C interface first, so that it does not see the lines fall as a bus
+//  error. Then save the mode of the bus pins and make them inputs without pull-ups, and
+//  last switch the power off.
+void
+Sensor_powerOff( Sensor_Power *p, I2C_TypeDef *hw )
+{
+  if( !p->on )
+    return;
+  if( hw )
+    hw->CR1 &= ~I2C_CR1_PE;
+  if( p->busPort )
+  {
+    uint32_t mask = Sensor_moderMask( p->busMask );
+
+    p->busModer         = p->busPort->MODER & mask;
+    p->busPort->MODER  &= ~mask;                // Input
+    p->busPort->PUPDR  &= ~mask;                // No pull-up or pull-down
+  }
+  p->port->BSRR = p->activeLow ? p->mask : (uint32_t)p->mask << 16;
+  p->on = 0;
+}
+
+
+//  void
+//  Sensor_powerOn( Sensor_Power *p, I2C_TypeDef *hw )
+//  Switch the power on, give the bus pins back their saved mode, and turn the I2C
+//  interface on again. Turning PE off and on is also a software reset of the interface.
+//  The sensor still needs its powerUpMs before it can be used.
+void
+Sensor_powerOn( Sensor_Power *p, I2C_TypeDef *hw )
+{
+  if( p->on )
+    return;
+  p->port->BSRR = p->activeLow ? (uint32_t)p->mask << 16 : p->mask;
+  if( p->busPort )
+    p->busPort->MODER |= p->busModer;
+  if( hw )
+    hw->CR1 |= I2C_CR1_PE;
+  p->on = 1;
+}
+
+
+//  void
+//  Sensor_powerInit( Sensor_Power *p, GPIO_TypeDef *port, uint8_t pin, uint8_t activeLow,
+//                    GPIO_TypeDef *busPort, uint16_t busMask )
+//  Make the switch pin a push-pull output and turn the power on, so that the sensor
+//  behaves as if it had no power switch until the first Sensor_powerOff.
+void
+Sensor_powerInit( Sensor_Power *p, GPIO_TypeDef *port, uint8_t pin, uint8_t activeLow,
+                  GPIO_TypeDef *busPort, uint16_t busMask )
+{
+  p->port      = port;
+  p->mask      = 1U << pin;
+  p->activeLow = activeLow;
+  p->busPort   = busPort;
+  p->busMask   = busMask;
+  p->busModer  = 0;
+  p->on        = 0;
+  RCC->AHBENR |= ( port == GPIOB ) ? RCC_AHBENR_GPIOBEN : RCC_AHBENR_GPIOAEN;
+  Sensor_powerOn( p, 0 );                                       // Set the level first
+  port->OTYPER &= ~p->mask;                                     // Push-pull
+  port->MODER   = ( port->MODER & ~( 0b11UL << ( pin * 2 ))) | ( 0b01UL << ( pin * 2 ));
+}
+
+
+//  void
+//  Sensor_setPower( Sensor *s, Sensor_Power *p )
+//  Give the sensor a power switch that Sensor_run may use.
+static inline void
+Sensor_setPower( Sensor *s, Sensor_Power *p )
+{
+  s->power = p;
+}
+
+
+//  uint8_t
+//  Sensor_gated( Sensor *s )
+//  The power is worth switching when the time it is off is long compared to the power-up
+//  and conversion time that each sample then costs.
+static inline uint8_t
+Sensor_gated( Sensor *s )
+{
+  return s->power &&
+         s->periodMs >= SENSOR_GATE_RATIO * ( (uint32_t)s->drv->powerUpMs + s->drv->convMs );
+}
+
+
+//  I2C_TypeDef *
+//  Sensor_powerBus( Sensor *s )
+//  The I2C interface to switch with the power of s: only if the bus belongs to s alone,
+//  which is when its pins are floated (busPort is set). A shared bus stays on for the
+//  sensors that keep their power.
+static inline I2C_TypeDef *
+Sensor_powerBus( Sensor *s )
+{
+  return s->power->busPort ? s->dev.hw : 0;
+}
+
+
+//  uint32_t
+//  Sensor_nextSlot( Sensor *s )
+//  The first sample time of s that has not passed yet: startMs plus a whole number of
+//  periods.
+static uint32_t
+Sensor_nextSlot( Sensor *s )
+{
+  int32_t late = (int32_t)( SysTick_ms( ) - s->startMs );
+
+  if( late <= 0 )
+    return s->startMs;
+  return s->startMs + ( late + s->periodMs - 1 ) / s->periodMs * s->periodMs;
+}
+
+
+//  void
+//  Sensor_fail( Sensor *s, uint8_t status )
+//  Record a failed step. The sensor is initialized again after its power-up time and then
+//  tried at the next sample time (see Sensor_step).
+static void
+Sensor_fail( Sensor *s, uint8_t status )
+{
+  s->status = status;
+  s->errors++;
+  s->state  = SENSOR_POWERUP;
+  s->due    = SysTick_ms( ) + s->drv->powerUpMs;
+}
+
+
+//  void
+//  Sensor_collect( Sensor *s )
+//  Fetch and decode a finished conversion, then power the sensor off or put it to sleep.
+//  A powered-off sensor goes back to SENSOR_POWERUP, timed so that it is initialized and
+//  started at the same time as it would have been if it had stayed on.
+static void
+Sensor_collect( Sensor *s )
+{
+  uint8_t        raw[ SENSOR_RAW_MAX ];
+  Sensor_Reading r;
+  uint8_t        status = s->drv->fetch( s, raw );
+
+  if( status == I2C_OK )
+    status = s->drv->decode( s, raw, &r );
+  if( status == SENSOR_CRC_ERR && s->dev.hw )
+    I2C_crcError( s->dev.hw );          // Count it against the bus for speed adaptation
+  if( status != I2C_OK )
+  {
+    Sensor_fail( s, status );
+    return;
+  }
+  s->reading = r;
+  s->fresh   = 1;
+  s->status  = I2C_OK;
+  s->state   = SENSOR_IDLE;
+  s->due     = s->startMs + s->periodMs;
+  if( Sensor_gated( s ))
+  {
+    Sensor_powerOff( s->power, Sensor_powerBus( s ));
+    s->state = SENSOR_POWERUP;
+    s->due  -= s->drv->powerUpMs;
+  }
+  else if( s->drv->sleep )
+    s->drv->sleep( s );
+}
+
+
+//  void
+//  Sensor_step( Sensor *s )
+//  Do the next step of one sensor, if it is due.
+static void
+Sensor_step( Sensor *s )
+{
+  uint8_t status;
+
+  if( !SysTick_reached( s->due ))
+    return;
+
+  switch( s->state )
+  {
+    case SENSOR_POWERUP:
+      if( s->power && !s->power->on )
+      {
+        Sensor_powerOn( s->power, Sensor_powerBus( s ));
+        s->due = SysTick_ms( ) + s->drv->powerUpMs;
+        return;
+      }
+      if(( status = s->drv->init( s )) != I2C_OK )
+      {
+        Sensor_fail( s, status );
+        s->due += s->periodMs;          // Do not flood the bus with a missing sensor
+        return;
+      }
+      s->state = SENSOR_IDLE;
+      if( s->status != I2C_OK )         // After a failure: wait for the next sample time
+      {                                 // instead of starting out of step
+        s->due = Sensor_nextSlot( s );
+        if( !SysTick_reached( s->due ))
+          return;
+      }
+      // Fall through: Start the conversion at once
+
+    case SENSOR_IDLE:
+      s->startMs = SysTick_ms( );
+      if(( status = s->drv->start( s )) != I2C_OK )
+      {
+        Sensor_fail( s, status );
+        return;
+      }
+      s->state = SENSOR_CONVERT;
+      s->polls = 0;
+      s->due   = s->startMs + s->drv->convMs;
+      return;
+
+    case SENSOR_CONVERT:
+      if( s->drv->ready && ( status = s->drv->ready( s )) != I2C_OK )
+      {
+        if( status != SENSOR_BUSY || ++s->polls >= SENSOR_POLL_MAX )
+          Sensor_fail( s, status );
+        else
+          s->due = SysTick_ms( ) + SENSOR_POLL_MS;
+        return;
+      }
+      Sensor_collect( s );
+      return;
+  }
+}
+
+
+//  uint32_t
+//  Sensor_run( Sensor **sensors, uint8_t n )
+//  Step every sensor that is due, then return the time until the earliest next step. The
+//  first pass powers up, initializes and starts the sensors, and the second one collects
+//  the finished conversions. So all sensors that are due are started before any result is
+//  collected, and a slow fetch (such as a clock-stretched read) does not hold up the start
+//  of the other conversions.
+uint32_t
+Sensor_run( Sensor **sensors, uint8_t n )
+{
+  uint32_t next = 0xFFFFFFFF;
+  uint8_t  i;
+
+  for( i = 0; i < n; i++ )
+    if( sensors[i]->state != SENSOR_CONVERT )
+      Sensor_step( sensors[i] );
+  for( i = 0; i < n; i++ )
+    if( sensors[i]->state == SENSOR_CONVERT )
+      Sensor_step( sensors[i] );
+
+  for( i = 0; i < n; i++ )
+  {
+    int32_t wait = (int32_t)( sensors[i]->due - SysTick_ms( ));
+
+    if( wait <= 0 )
+      return 0;
+    if( (uint32_t)wait < next )
+      next = wait;
+  }
+  return next;
+}
+
+
+//  uint8_t
+//  Sensor_finish( Sensor *s, Sensor_Reading *r )
+//  Poll ready, if the driver has it, and fetch and decode the result. Does not use SysTick.
+uint8_t
+Sensor_finish( Sensor *s, Sensor_Reading *r )
+{
+  uint8_t raw[ SENSOR_RAW_MAX ];
+  uint8_t status = I2C_OK;
+  uint8_t polls  = 0;
+
+  while( s->drv->ready && ( status = s->drv->ready( s )) == SENSOR_BUSY &&
+         ++polls < SENSOR_POLL_MAX )
+    delay_us( SENSOR_POLL_MS * 1000UL );
+  if( status != I2C_OK )
+    return status;
+  if(( status = s->drv->fetch( s, raw )) != I2C_OK )
+    return status;
+  return s->drv->decode( s, raw, r );
+}
+
+
+//  uint8_t
+//  Sensor_read( Sensor *s, Sensor_Reading *r )
+//  Start a conversion, wait convMs, and finish it with Sensor_finish. Does not call init,
+//  and does not use SysTick.
+uint8_t
+Sensor_read( Sensor *s, Sensor_Reading *r )
+{
+  uint8_t status = s->drv->start( s );
+
+  if( status != I2C_OK )
+    return status;
+  delay_us( s->drv->convMs * 1000UL );
+  return Sensor_finish( s, r );
+}
+
+#endif /* __STM32F030_SENSOR_LIB_C */
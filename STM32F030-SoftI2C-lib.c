@@ -0,0 +1,399 @@
+//  ==========================================================================================
+//  STM32F030-SoftI2C-lib.c
+//  ------------------------------------------------------------------------------------------
+//  Bit-banged (software) I2C master on any two GPIO pins. The hardware I2C interface of the
+//  STM32F030F4 is only available on PA9/PA10 (I2C1). This library drives a second, separate
+//  I2C bus on any other pair of pins, for example to read a second sensor with the same I2C
+//  address. The transaction routines take the same arguments and return the same status
+//  codes as I2C_writeN and I2C_readN in STM32F030-CMSIS-I2C-lib.c.
+//
+//  Both pins are used as open-drain outputs: writing a 1 releases the line, which is then
+//  pulled high by the external pull-up resistors, and writing a 0 pulls it low. The state of
+//  the line is read back from the IDR register. This also makes clock stretching work:
+//  after releasing SCL, the master waits until SCL actually goes high.
+//  ------------------------------------------------------------------------------------------
+//  https://github.com/EZdenki/STM32F030-CMSIS-I2C-AHT10-lib
+//  Released under the MIT License
+//  Copyright (c) 2023
+//  Mike Shegedin, EZdenki.com
+//  ------------------------------------------------------------------------------------------
+//  Target Device: STM32F030Fxxx running at DELAY_CLK_MHZ (8 MHz by default)
+//  ------------------------------------------------------------------------------------------
+//  Hardware Setup:
+//    Any two free GPIO pins of port A or B, each with a pull-up resistor (approx. 4.7 k) to
+//    3.3 V, like the hardware I2C bus. On the 20-pin STM32F030F4, with the LCD on PA0..PA5
+//    and I2C1 on PA9/PA10, PA6 (pin 12), PA7 (pin 13) and PB1 (pin 14) are free.
+//
+//  Speed:
+//    Each half of a clock period is the time of the GPIO accesses plus a delay loop of 4
+//    clock cycles per pass. The number of passes is worked out from DELAY_CLK_MHZ and the
+//    requested speed, after subtracting SI2C_OVERHEAD, the cycles of a half period without
+//    the delay. SI2C_OVERHEAD is an estimate from counting the instructions of the bit
+//    routines (Cortex-M0 timings, zero wait state flash) and has not been measured on a
+//    scope. By that estimate, speeds up to approx. 100 kHz at 8 MHz are close to the
+//    request, and faster speeds run as fast as the code allows (an estimated 150 kHz).
+//    Check SCL with a scope if the exact speed matters. Clock stretching by a device only
+//    makes the bus slower.
+//  ------------------------------------------------------------------------------------------
+//  Routines in this Library
+//
+//  void
+//  SI2C_init( SI2C_Bus *bus, GPIO_TypeDef *sclPort, uint8_t sclPin,
+//             GPIO_TypeDef *sdaPort, uint8_t sdaPin, uint32_t speed )
+//    Set up bus to use the given pins (port GPIOA or GPIOB, pin number 0 to 15) at speed
+//    (in Hz, 1 kHz to 400 kHz), and release both lines.
+//
+//  uint8_t
+//  SI2C_writeN( SI2C_Bus *bus, uint8_t address, const uint8_t *data, uint8_t n )
+//    Write n bytes to the device at address as one complete transaction.
+//
+//  uint8_t
+//  SI2C_readN( SI2C_Bus *bus, uint8_t address, uint8_t *data, uint8_t n )
+//    Read n bytes from the device at address as one complete transaction. The last byte is
+//    not acknowledged, as the I2C standard requires.
+//
+//  void
+//  SI2C_recover( SI2C_Bus *bus )
+//    Free a stuck bus by clocking SCL until the device holding SDA low lets go, then send a
+//    stop.
+//
+//  The transaction routines return I2C_OK or one of the I2C error codes (see
+//  STM32F030-CMSIS-I2C-lib.c), which is also stored in bus->lastError. I2C_ARLO is returned
+//  if SDA is low when this master released it, meaning another master is using the bus,
+//  and I2C_TIMEOUT if a device stretches the clock for longer than I2C_TIMEOUT_US. After a
+//  timeout, SI2C_recover is called automatically. If SDA is held low before a start, or
+//  after a transaction that lost arbitration, SI2C_recover is called too, since a device
+//  left in the middle of a byte holds SDA the same way. The start is then tried once more.
+//  ==========================================================================================
+
+#ifndef __STM32F030_SOFTI2C_LIB_C
+#define __STM32F030_SOFTI2C_LIB_C
+
+#include "stm32f030x6.h"                // Primary CMSIS header file
+#include "STM32F030-Delay-lib.c"        // DELAY_CLK_MHZ and delay_us
+#include "STM32F030-CMSIS-I2C-lib.c"    // Status codes and I2C_TIMEOUT_LOOPS
+
+#define SI2C_OVERHEAD 24                // Estimated cycles of a half clock period without delay
+
+typedef struct
+{
+  GPIO_TypeDef *sclPort;                // GPIO port and pin mask of SCL
+  uint16_t      sclMask;
+  GPIO_TypeDef *sdaPort;                // GPIO port and pin mask of SDA
+  uint16_t      sdaMask;
+  uint16_t      halfLoops;              // Delay loop passes per half clock period
+  uint8_t       lastError;              // Last error code of a transaction on this bus
+} SI2C_Bus;
+
+
+//  void
+//  SI2C_wait( uint32_t loops )
+//  Wait loops passes of 4 clock cycles. Written in assembly, like delay_us, so the timing
+//  does not depend on the optimization level. On the host, the virtual clock moves instead.
+static inline void
+SI2C_wait( uint32_t loops )
+{
+#ifdef HOST_SIM
+  Host_advance( (uint64_t)loops * 4 );
+#else
+  if( loops == 0 )
+    return;
+  __asm volatile( "1: subs %0, %0, #1 \n"
+                  "   bne  1b         \n"
+                  : "+l" ( loops ) : : "cc" );
+#endif
+}
+
+
+//  Line control. Setting a pin releases the line, resetting it pulls the line low. On the
+//  host, each access goes through Host_gpioSync, as GPIOA and GPIOB do, so that every write
+//  to BSRR reaches the pins before the next one.
+#ifdef HOST_SIM
+#define SI2C_PORT( port )     Host_gpioSync( port )
+#else
+#define SI2C_PORT( port )     ( port )
+#endif
+#define SI2C_SCL_HIGH( bus )  SI2C_PORT(( bus )->sclPort )->BSRR = ( bus )->sclMask
+#define SI2C_SCL_LOW( bus )   SI2C_PORT(( bus )->sclPort )->BSRR = ( bus )->sclMask << 16
+#define SI2C_SDA_HIGH( bus )  SI2C_PORT(( bus )->sdaPort )->BSRR = ( bus )->sdaMask
+#define SI2C_SDA_LOW( bus )   SI2C_PORT(( bus )->sdaPort )->BSRR = ( bus )->sdaMask << 16
+#define SI2C_SCL( bus )       ( SI2C_PORT(( bus )->sclPort )->IDR & ( bus )->sclMask )
+#define SI2C_SDA( bus )       ( SI2C_PORT(( bus )->sdaPort )->IDR & ( bus )->sdaMask )
+
+
+//  uint8_t
+//  SI2C_error( SI2C_Bus *bus, uint8_t error )
+//  Record error in bus->lastError and return it.
+static uint8_t
+SI2C_error( SI2C_Bus *bus, uint8_t error )
+{
+  bus->lastError = error;
+  return error;
+}
+
+
+//  uint8_t
+//  SI2C_sclRelease( SI2C_Bus *bus )
+//  Release SCL and wait until it is high. A device may hold SCL low (clock stretching) to
+//  make the master wait. Returns I2C_OK, or I2C_TIMEOUT if SCL stays low.
+static uint8_t
+SI2C_sclRelease( SI2C_Bus *bus )
+{
+  uint32_t loops = I2C_TIMEOUT_LOOPS;
+
+  SI2C_SCL_HIGH( bus );
+  do
+  {
+    DELAY_POLL( );
+    if( SI2C_SCL( bus ))
+      return I2C_OK;
+  } while( --loops );
+  return SI2C_error( bus, I2C_TIMEOUT );
+}
+
+
+//  void
+//  SI2C_pinInit( GPIO_TypeDef *port, uint8_t pin )
+//  Enable the clock of the GPIO port and set the pin as a released open-drain output.
+static void
+SI2C_pinInit( GPIO_TypeDef *port, uint8_t pin )
+{
+  RCC->AHBENR  |= ( port == GPIOB ) ? RCC_AHBENR_GPIOBEN : RCC_AHBENR_GPIOAEN;
+  port->BSRR    = 1UL << pin;                           // Released (high)
+  port->OTYPER |= 1UL << pin;                           // Open-drain
+  port->OSPEEDR = ( port->OSPEEDR & ~( 0b11UL << ( pin * 2 ))) | ( 0b01UL << ( pin * 2 ));
+  port->MODER   = ( port->MODER & ~( 0b11UL << ( pin * 2 ))) | ( 0b01UL << ( pin * 2 ));
+}
+
+
+//  void
+//  SI2C_init( SI2C_Bus *bus, GPIO_TypeDef *sclPort, uint8_t sclPin,
+//             GPIO_TypeDef *sdaPort, uint8_t sdaPin, uint32_t speed )
+//  Set up the pins and work out the delay for the requested speed. A half clock period is
+//  DELAY_CLK_MHZ * 1e6 / ( 2 * speed ) clock cycles, of which SI2C_OVERHEAD are spent in
+//  the code.
+void
+SI2C_init( SI2C_Bus *bus, GPIO_TypeDef *sclPort, uint8_t sclPin,
+           GPIO_TypeDef *sdaPort, uint8_t sdaPin, uint32_t speed )
+{
+  uint32_t halfCycles;
+
+  if( speed > 400E3 )
+    speed = 400E3;
+  else if( speed < 1E3 )
+    speed = 1E3;
+  halfCycles = (uint32_t)DELAY_CLK_MHZ * 500000UL / speed;
+
+  bus->sclPort   = sclPort;
+  bus->sclMask   = 1U << sclPin;
+  bus->sdaPort   = sdaPort;
+  bus->sdaMask   = 1U << sdaPin;
+  bus->halfLoops = ( halfCycles > SI2C_OVERHEAD ) ? ( halfCycles - SI2C_OVERHEAD ) / 4 : 0;
+  bus->lastError = I2C_OK;
+
+  SI2C_pinInit( sclPort, sclPin );
+  SI2C_pinInit( sdaPort, sdaPin );
+}
+
+
+//  void
+//  SI2C_recover( SI2C_Bus *bus )
+//  Clock SCL (up to 9 pulses) until the device holding SDA low releases it, then send a
+//  stop. The same procedure as I2C_recover for the hardware interface.
+void
+SI2C_recover( SI2C_Bus *bus )
+{
+  SI2C_SDA_HIGH( bus );
+  for( uint8_t pulse = 0; ( pulse < 9 ) && !SI2C_SDA( bus ); pulse++ )
+  {
+    SI2C_SCL_LOW( bus );
+    delay_us( 5 );
+    SI2C_SCL_HIGH( bus );
+    delay_us( 5 );
+  }
+  SI2C_SCL_LOW( bus );
+  delay_us( 5 );
+  SI2C_SDA_LOW( bus );
+  delay_us( 5 );
+  SI2C_SCL_HIGH( bus );
+  delay_us( 5 );
+  SI2C_SDA_HIGH( bus );
+  delay_us( 5 );
+}
+
+
+//  uint8_t
+//  SI2C_start( SI2C_Bus *bus )
+//  Send a start: SDA goes low while SCL is high. If SDA is already held low, the bus is
+//  recovered and checked again. Returns I2C_ARLO if SDA is still low.
+static uint8_t
+SI2C_start( SI2C_Bus *bus )
+{
+  uint8_t status;
+
+  SI2C_SDA_HIGH( bus );
+  if(( status = SI2C_sclRelease( bus )) != I2C_OK )
+    return status;
+  SI2C_wait( bus->halfLoops );
+  if( !SI2C_SDA( bus ))
+  {
+    SI2C_recover( bus );                // A device may be stuck in the middle of a byte
+    SI2C_wait( bus->halfLoops );
+    if( !SI2C_SDA( bus ))
+      return SI2C_error( bus, I2C_ARLO );
+  }
+  SI2C_SDA_LOW( bus );
+  SI2C_wait( bus->halfLoops );
+  SI2C_SCL_LOW( bus );
+  return I2C_OK;
+}
+
+
+//  uint8_t
+//  SI2C_stop( SI2C_Bus *bus )
+//  Send a stop: SDA goes high while SCL is high.
+static uint8_t
+SI2C_stop( SI2C_Bus *bus )
+{
+  uint8_t status;
+
+  SI2C_SDA_LOW( bus );
+  SI2C_wait( bus->halfLoops );
+  status = SI2C_sclRelease( bus );
+  SI2C_wait( bus->halfLoops );
+  SI2C_SDA_HIGH( bus );
+  SI2C_wait( bus->halfLoops );
+  return status;
+}
+
+
+//  uint8_t
+//  SI2C_bit( SI2C_Bus *bus, uint8_t bit, uint8_t *in )
+//  Clock one bit out and in. SDA is set to bit while SCL is low, SCL is released, and the
+//  state of SDA is read into *in while SCL is high. Sending a 1 leaves SDA released, so
+//  this is also how a bit from the device is read. If a 1 was sent but SDA reads 0 on a
+//  data bit, another master is driving the bus.
+static uint8_t
+SI2C_bit( SI2C_Bus *bus, uint8_t bit, uint8_t *in )
+{
+  uint8_t status;
+
+  if( bit )
+    SI2C_SDA_HIGH( bus );
+  else
+    SI2C_SDA_LOW( bus );
+  SI2C_wait( bus->halfLoops );
+  if(( status = SI2C_sclRelease( bus )) != I2C_OK )
+    return status;
+  SI2C_wait( bus->halfLoops );
+  *in = SI2C_SDA( bus ) ? 1 : 0;
+  SI2C_SCL_LOW( bus );
+  return I2C_OK;
+}
+
+
+//  uint8_t
+//  SI2C_writeByte( SI2C_Bus *bus, uint8_t data )
+//  Send 8 bits, most significant first, and read the acknowledge bit. Returns I2C_NACK if
+//  the device did not pull SDA low for the acknowledge.
+static uint8_t
+SI2C_writeByte( SI2C_Bus *bus, uint8_t data )
+{
+  uint8_t status, in, mask;
+
+  for( mask = 0x80; mask; mask >>= 1 )
+  {
+    if(( status = SI2C_bit( bus, data & mask, &in )) != I2C_OK )
+      return status;
+    if(( data & mask ) && !in )
+      return SI2C_error( bus, I2C_ARLO );
+  }
+  if(( status = SI2C_bit( bus, 1, &in )) != I2C_OK )     // Release SDA for the acknowledge
+    return status;
+  return in ? SI2C_error( bus, I2C_NACK ) : I2C_OK;
+}
+
+
+//  uint8_t
+//  SI2C_readByte( SI2C_Bus *bus, uint8_t *data, uint8_t ack )
+//  Read 8 bits, most significant first, then send an acknowledge (ack = 1) to ask for
+//  another byte, or leave SDA high (ack = 0) after the last byte.
+static uint8_t
+SI2C_readByte( SI2C_Bus *bus, uint8_t *data, uint8_t ack )
+{
+  uint8_t status, in, i, value = 0;
+
+  for( i = 0; i < 8; i++ )
+  {
+    if(( status = SI2C_bit( bus, 1, &in )) != I2C_OK )
+      return status;
+    value = ( value << 1 ) | in;
+  }
+  *data = value;
+  return SI2C_bit( bus, !ack, &in );
+}
+
+
+//  uint8_t
+//  SI2C_finish( SI2C_Bus *bus, uint8_t status )
+//  End a transaction. A stop is sent unless arbitration was lost, in which case the lines
+//  are released. If SDA is still low with SCL high a byte time later, a device rather than
+//  another master is holding it, and the bus is recovered. The bus is also recovered after
+//  a timeout. Returns the first error of the transaction.
+static uint8_t
+SI2C_finish( SI2C_Bus *bus, uint8_t status )
+{
+  uint8_t stopStatus = I2C_OK;
+
+  if( status == I2C_ARLO )
+  {
+    SI2C_SDA_HIGH( bus );
+    SI2C_SCL_HIGH( bus );
+    SI2C_wait( 18UL * bus->halfLoops );
+    if( SI2C_SCL( bus ) && !SI2C_SDA( bus ))
+      SI2C_recover( bus );
+  }
+  else
+    stopStatus = SI2C_stop( bus );
+  if( status == I2C_OK )
+    status = stopStatus;
+  if( status == I2C_TIMEOUT )
+    SI2C_recover( bus );
+  return status;
+}
+
+
+//  uint8_t
+//  SI2C_writeN( SI2C_Bus *bus, uint8_t address, const uint8_t *data, uint8_t n )
+//  Write n bytes to the device at address as one complete transaction. Returns I2C_OK or
+//  an error code.
+uint8_t
+SI2C_writeN( SI2C_Bus *bus, uint8_t address, const uint8_t *data, uint8_t n )
+{
+  uint8_t status = SI2C_start( bus );
+
+  if( status == I2C_OK )
+    status = SI2C_writeByte( bus, address << 1 );           // Address with write bit (0)
+  for( uint8_t i = 0; ( i < n ) && ( status == I2C_OK ); i++ )
+    status = SI2C_writeByte( bus, data[i] );
+  return SI2C_finish( bus, status );
+}
+
+
+//  uint8_t
+//  SI2C_readN( SI2C_Bus *bus, uint8_t address, uint8_t *data, uint8_t n )
+//  Read n bytes from the device at address as one complete transaction. Returns I2C_OK or
+//  an error code.
+uint8_t
+SI2C_readN( SI2C_Bus *bus, uint8_t address, uint8_t *data, uint8_t n )
+{
+  uint8_t status = SI2C_start( bus );
+
+  if( status == I2C_OK )
+    status = SI2C_writeByte( bus, ( address << 1 ) | 1 );   // Address with read bit (1)
+  for( uint8_t i = 0; ( i < n ) && ( status == I2C_OK ); i++ )
+    status = SI2C_readByte( bus, &data[i], i < n - 1 );
+  return SI2C_finish( bus, status );
+}
+
+#endif /* __STM32F030_SOFTI2C_LIB_C */
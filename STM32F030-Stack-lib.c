@@ -0,0 +1,126 @@
+//  ==========================================================================================
+//  STM32F030-Stack-lib.c
+//  ------------------------------------------------------------------------------------------
+//  Stack and heap high-water marks. At reset, before main() is called, the startup code
+//  fills all RAM between the end of the static data (_end) and the top of the stack with
+//  STACK_PAINT. Any word that the stack or the heap has ever used no longer holds the
+//  pattern, so the deepest point ever reached can be found later by looking for the first
+//  word that has been overwritten.
+//
+//  The Cortex-M0 runs interrupt handlers on the same (main) stack as the program. The stack
+//  high-water mark therefore includes the deepest interrupt nesting that has occurred so
+//  far, as long as the program has run long enough to hit it.
+//
+//  Use the results to set HEAP_SIZE and STACK_SIZE in the Makefile. These sizes only
+//  reserve RAM so the linker can report when the static data grows too large. They do not
+//  limit the stack or the heap.
+//  ------------------------------------------------------------------------------------------
+//  https://github.com/EZdenki/STM32F030-CMSIS-I2C-AHT10-lib
+//  Released under the MIT License
+//  Copyright (c) 2023
+//  Mike Shegedin, EZdenki.com
+//  ------------------------------------------------------------------------------------------
+//  Target Device: STM32F030Fxxx. Requires the stack painting in the startup file.
+//  ------------------------------------------------------------------------------------------
+//  Routines in this Library
+//
+//  uint32_t
+//  Stack_used( void )
+//    Return the largest number of bytes of stack used since reset.
+//
+//  uint32_t
+//  Stack_now( void )
+//    Return the number of bytes of stack in use right now.
+//
+//  uint32_t
+//  Heap_used( void )
+//    Return the largest number of bytes of heap used since reset. Memory that was allocated
+//    but never written is not counted.
+//
+//  uint32_t
+//  Stack_free( void )
+//    Return the number of bytes between the highest heap word and the lowest stack word ever
+//    used. This RAM has never been touched, and is the true safety margin.
+//  ==========================================================================================
+
+#ifndef __STM32F030_STACK_LIB_C
+#define __STM32F030_STACK_LIB_C
+
+#include "stm32f030x6.h"          // Primary CMSIS header file
+
+#define STACK_PAINT 0xC5C5C5C5UL  // Fill pattern. Must match the startup file.
+
+//  Defined by the linker script. _Min_Heap_Size is a size, so its "address" is the value.
+extern uint32_t _end, _estack, _Min_Heap_Size;
+
+
+//  uint32_t *
+//  Stack_lowest( void )
+//  Return the lowest word ever used by the stack. The search starts above the heap
+//  reservation and goes up, so heap use within the reservation is not counted as stack.
+static uint32_t *
+Stack_lowest( void )
+{
+  uint32_t *w = (uint32_t *)((uint32_t)&_end + (uint32_t)&_Min_Heap_Size );
+
+  while( w < &_estack && *w == STACK_PAINT )
+    w++;
+  return w;
+}
+
+
+//  uint32_t *
+//  Heap_highest( void )
+//  Return the word just above the highest heap word ever used. The search starts at the
+//  top of the heap reservation and goes down.
+static uint32_t *
+Heap_highest( void )
+{
+  uint32_t *w = (uint32_t *)((uint32_t)&_end + (uint32_t)&_Min_Heap_Size );
+
+  while( w > &_end && w[-1] == STACK_PAINT )
+    w--;
+  return w;
+}
+
+
+//  uint32_t
+//  Stack_used( void )
+//  Return the largest number of bytes of stack used since reset.
+uint32_t
+Stack_used( void )
+{
+  return (uint32_t)&_estack - (uint32_t)Stack_lowest( );
+}
+
+
+//  uint32_t
+//  Stack_now( void )
+//  Return the number of bytes of stack in use right now.
+uint32_t
+Stack_now( void )
+{
+  return (uint32_t)&_estack - __get_MSP( );
+}
+
+
+//  uint32_t
+//  Heap_used( void )
+//  Return the largest number of bytes of heap used since reset.
+uint32_t
+Heap_used( void )
+{
+  return (uint32_t)Heap_highest( ) - (uint32_t)&_end;
+}
+
+
+//  uint32_t
+//  Stack_free( void )
+//  Return the number of bytes of RAM that neither the stack nor the heap has ever used.
+uint32_t
+Stack_free( void )
+{
+  return (uint32_t)Stack_lowest( ) - (uint32_t)Heap_highest( );
+}
+
+#endif /* __STM32F030_STACK_LIB_C */
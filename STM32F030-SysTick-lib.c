@@ -0,0 +1,142 @@
+//  ==========================================================================================
+//  STM32F030-SysTick-lib.c
+//  ------------------------------------------------------------------------------------------
+//  Millisecond and microsecond timebase using the Cortex-M0 SysTick timer. SysTick is set
+//  to interrupt once per millisecond, and SysTick_Handler counts the milliseconds. The
+//  microsecond time is made from the millisecond count plus the current SysTick count.
+//  ------------------------------------------------------------------------------------------
+//  https://github.com/EZdenki/STM32F030-CMSIS-I2C-AHT10-lib
+//  Released under the MIT License
+//  Copyright (c) 2023
+//  Mike Shegedin, EZdenki.com
+//  ------------------------------------------------------------------------------------------
+//  Target Device: STM32F030Fxxx running at DELAY_CLK_MHZ (8 MHz by default)
+//  ------------------------------------------------------------------------------------------
+//  Routines in this Library
+//
+//  void
+//  SysTick_init( void )
+//    Start SysTick with a 1 ms interrupt. Must be called before the other routines.
+//
+//  uint32_t
+//  SysTick_ms( void )
+//    Return the number of milliseconds since SysTick_init. Wraps after approx. 49.7 days.
+//
+//  uint32_t
+//  SysTick_us( void )
+//    Return the number of microseconds since SysTick_init. Wraps after approx. 71.6 min.
+//    If called with interrupts disabled for more than 1 ms, the result may be up to 1 ms
+//    behind.
+//
+//  uint32_t
+//  SysTick_elapsed( uint32_t since )
+//    Return the number of milliseconds from since (an earlier SysTick_ms value) until now.
+//    Correct across a wrap of the millisecond count.
+//
+//  uint8_t
+//  SysTick_reached( uint32_t deadline )
+//    Return 1 if the millisecond count has reached deadline, otherwise 0. Deadlines may be
+//    up to approx. 24.8 days in the future and are correct across a wrap.
+//  ------------------------------------------------------------------------------------------
+//  Counter Wraps:
+//  --------------
+//  Time stamps should only ever be compared by subtracting them, as SysTick_elapsed and
+//  SysTick_reached do. Never compare two time stamps directly with < or >.
+//  To check long-running code for wrap problems without waiting 49.7 days, define
+//  SYSTICK_START_MS (for example, -DSYSTICK_START_MS=0xFFFF0000 wraps after about 65 s).
+//  SysTick_init then starts the millisecond count at that value instead of 0.
+//  ==========================================================================================
+
+#ifndef __STM32F030_SYSTICK_LIB_C
+#define __STM32F030_SYSTICK_LIB_C
+
+#include "stm32f030x6.h"          // Primary CMSIS header file
+#include "STM32F030-Delay-lib.c"  // DELAY_CLK_MHZ
+
+#define SYSTICK_LOAD ( DELAY_CLK_MHZ * 1000 - 1 )   // Reload value for a 1 ms period
+
+#ifndef SYSTICK_START_MS
+#define SYSTICK_START_MS 0                          // Millisecond count after SysTick_init
+#endif
+
+volatile uint32_t SysTick_msCount;    // Milliseconds since SysTick_init
+
+
+//  void
+//  SysTick_Handler( void )
+//  Count the milliseconds. Replaces the weak default handler from the startup file.
+void
+SysTick_Handler( void )
+{
+  SysTick_msCount++;
+}
+
+
+//  void
+//  SysTick_init( void )
+//  Start SysTick with a 1 ms interrupt, clocked from the CPU clock. The millisecond count
+//  starts at SYSTICK_START_MS.
+void
+SysTick_init( void )
+{
+  SysTick_msCount = SYSTICK_START_MS;
+  SysTick->LOAD = SYSTICK_LOAD;
+  SysTick->VAL  = 0;                      // Writing any value clears the counter
+  SysTick->CTRL = SysTick_CTRL_CLKSOURCE_Msk | SysTick_CTRL_TICKINT_Msk |
+                  SysTick_CTRL_ENABLE_Msk;
+}
+
+
+//  uint32_t
+//  SysTick_ms( void )
+//  Return the number of milliseconds since SysTick_init.
+static inline uint32_t
+SysTick_ms( void )
+{
+  return SysTick_msCount;
+}
+
+
+//  uint32_t
+//  SysTick_us( void )
+//  Return the number of microseconds since SysTick_init. The millisecond count is read
+//  before and after the SysTick counter, and the read is repeated if a tick occurred in
+//  between. SysTick counts down, so the time within the current millisecond is
+//  LOAD - VAL clock cycles.
+uint32_t
+SysTick_us( void )
+{
+  uint32_t ms, val;
+
+  do
+  {
+    ms  = SysTick_msCount;
+    val = SysTick->VAL;
+  } while( ms != SysTick_msCount );
+
+  return ms * 1000 + ( SYSTICK_LOAD - val ) / DELAY_CLK_MHZ;
+}
+
+
+//  uint32_t
+//  SysTick_elapsed( uint32_t since )
+//  Return the milliseconds from since until now. The unsigned subtraction gives the right
+//  answer even if the count wrapped in between.
+static inline uint32_t
+SysTick_elapsed( uint32_t since )
+{
+  return SysTick_msCount - since;
+}
+
+
+//  uint8_t
+//  SysTick_reached( uint32_t deadline )
+//  Return 1 once the millisecond count has reached deadline. The difference is taken as a
+//  signed value, so a deadline just past a wrap is still seen as being in the future.
+static inline uint8_t
+SysTick_reached( uint32_t deadline )
+{
+  return (int32_t)( SysTick_msCount - deadline ) >= 0;
+}
+
+#endif /* __STM32F030_SYSTICK_LIB_C */
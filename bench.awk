@@ -0,0 +1,144 @@
+##############################################################################################
+# bench.awk
+# Size, stack and timing history for "make bench". Runs in one of two modes:
+#
+#   awk -v mode=record -v commit=<hash> -v date=<date> -f bench.awk nm.txt main.su bench.cyc
+#     Read the symbol table ("arm-none-eabi-nm -S" output), the stack usage file written
+#     by -fstack-usage and the timings of host/bench ("symbol cycles"), and print one CSV
+#     record per routine or variable:
+#       commit,date,symbol,flash,ram,stack,cycles
+#     flash and ram are in bytes. Initialized data counts towards both. cycles is the time
+#     of one call on the virtual clock of the host simulation, 0 if not timed. A TOTAL
+#     record holds the sums, with the largest single stack frame in the stack column.
+#
+#   awk -v mode=report -v cur=<hash> -v prev=<hash> -f bench.awk bench-history.csv
+#     Compare the records of commit cur with those of commit prev ("make bench" passes
+#     HEAD and HEAD~1), and print a text report of every symbol whose flash, RAM, stack use
+#     or cycles changed, plus the totals. If a commit was recorded more than once, its
+#     last run counts; each run ends with its TOTAL record. Without cur, the last two
+#     commits recorded in the file are compared.
+#     Records from before the cycles column read as 0 cycles.
+#
+# Mike Shegedin, 2023
+##############################################################################################
+
+BEGIN {
+  FS = ( mode == "report" ) ? "," : "[ \t]+"
+  ended = 1                               # The next record starts a run
+}
+
+FNR == 1 { file++ }
+
+# ----- record mode: symbol table ("address size type name"), the first file ---------------
+mode == "record" && file == 1 {
+  if( NF != 4 ) next
+  size = hex( $2 )
+  type = toupper( $3 )
+  name = $4
+  if( type == "T" || type == "R" )       flash[name] += size
+  else if( type == "D" )               { flash[name] += size; ram[name] += size }
+  else if( type == "B" )                 ram[name] += size
+  else next
+  seen[name] = 1
+  next
+}
+
+# ----- record mode: stack usage ("file:line:col:name <tab> bytes <tab> kind") --------------
+mode == "record" && file == 2 {
+  split( $0, f, "\t" )
+  n = split( f[1], loc, ":" )
+  name = loc[n]
+  stack[name] = f[2]
+  seen[name] = 1
+  next
+}
+
+# ----- record mode: timings of host/bench ("symbol cycles") --------------------------------
+mode == "record" && file == 3 {
+  if( NF != 2 ) next
+  cycles[$1] = $2
+  seen[$1] = 1
+}
+
+# ----- report mode: keep the last run of every commit --------------------------------------
+mode == "report" && FNR > 1 {
+  if( ended )                             # A new run: drop an earlier run of the commit
+  {
+    for( s in sym )
+      delete row[$1, s]
+    if( last != "" && $1 != last )
+      before = last
+    last = $1
+  }
+  row[$1, $3] = $4 "," $5 "," $6 "," ( $7 == "" ? 0 : $7 )
+  sym[$3] = 1
+  when[$1] = $2
+  ended = ( $3 == "TOTAL" )
+}
+
+END {
+  if( mode == "record" )
+  {
+    for( s in seen )
+    {
+      printf "%s,%s,%s,%d,%d,%d,%d\n", commit, date, s, flash[s], ram[s], stack[s], cycles[s]
+      tf += flash[s]; tr += ram[s]; tc += cycles[s]
+      if( stack[s] > ts ) ts = stack[s]
+    }
+    printf "%s,%s,TOTAL,%d,%d,%d,%d\n", commit, date, tf, tr, ts, tc
+    exit
+  }
+
+  if( cur == "" )                         # Not told which: the last two in the file
+  {
+    cur  = last
+    prev = before
+  }
+  if( !( cur in when ))
+  {
+    printf "No record of commit %s in the history.\n", cur
+    exit
+  }
+  if( prev == "" || !( prev in when ))
+  {
+    printf "No record of the previous commit %s in the history, nothing to compare.\n", \
+           ( prev == "" ) ? "(none)" : prev
+    if( prev != "" )
+      printf "Check it out and run \"make bench\" there first.\n"
+    exit
+  }
+  printf "Size, stack and timing changes from %s to %s (%s)\n\n", prev, cur, when[cur]
+  printf "%-32s %14s %14s %14s %20s\n", "symbol", "flash", "ram", "stack", "cycles"
+  for( s in sym )
+  {
+    if( s == "TOTAL" || row[cur, s] == row[prev, s] ) continue
+    line( s )
+    changed++
+  }
+  if( !changed )
+    print "(no changes)"
+  print ""
+  line( "TOTAL" )
+}
+
+# Print a symbol's values for the newest commit with the change from the previous one.
+function line( s,    c, p, i, out )
+{
+  split( (( cur, s ) in row ) ? row[cur, s] : "0,0,0,0", c, "," )
+  split( (( prev, s ) in row ) ? row[prev, s] : "0,0,0,0", p, "," )
+  out = sprintf( "%-32s", s )
+  for( i = 1; i <= 3; i++ )
+    out = out sprintf( " %6d (%+5d)", c[i], c[i] - p[i] )
+  out = out sprintf( " %9d (%+8d)", c[4], c[4] - p[4] )
+  print out
+}
+
+# Convert a hexadecimal string to a number (strtonum is not available in every awk).
+function hex( h,    i, v )
+{
+  v = 0
+  h = tolower( h )
+  for( i = 1; i <= length( h ); i++ )
+    v = v * 16 + index( "0123456789abcdef", substr( h, i, 1 )) - 1
+  return v
+}
@@ -0,0 +1,58 @@
+//  ==========================================================================================
+//  examples/bme280.c
+//  ------------------------------------------------------------------------------------------
+//  Example for STM32F030-BME280-lib.c: a BME280 on I2C1, read every 5 seconds in forced
+//  mode by the sampling engine of STM32F030-Sensor-lib.c. The readings are kept in
+//  bmeTemp100, bmeHumid100 (x 100, as in main.c) and bmePress10 (hPa x 10), for reading
+//  with a debugger. bmeErrors counts the failed readings; after each, the sensor is reset
+//  and its calibration read again.
+//
+//  Built by "make examples". "make test" also builds it on the host.
+//  ------------------------------------------------------------------------------------------
+//  https://github.com/EZdenki/STM32F030-CMSIS-I2C-AHT10-lib
+//  Released under the MIT License
+//  Copyright (c) 2023
+//  Mike Shegedin, EZdenki.com
+//  ------------------------------------------------------------------------------------------
+//  Target Devices:
+//    STM32F030Fxxx running at 8 MHz internal clock
+//    BME280 Module with SDO to GND (address 0x76): SCL to A9 (Pin 17), SDA to A10 (Pin 18)
+//  ==========================================================================================
+
+#include "stm32f030x6.h"                  // Primary CMSIS header file
+#include "STM32F030-BME280-lib.c"         // BME280 driver
+#include "STM32F030-Sensor-lib.c"         // Sampling engine
+#include "STM32F030-Fixed-lib.c"          // fix16_to100
+
+#define SAMPLE_MS  5000                   // Time between readings
+
+BME280   bmeState;                        // Calibration and register cache
+Sensor   bme;
+Sensor  *sensors[] = { &bme };
+int16_t  bmeTemp100;                      // Temperature in C x 100
+int16_t  bmeHumid100;                     // Relative humidity in % x 100
+int16_t  bmePress10;                      // Air pressure in hPa x 10
+uint16_t bmeErrors;                       // Failed readings
+
+
+int
+main()
+{
+  I2C_init( I2C1, 100e3 );
+  SysTick_init( );
+  Sensor_init( &bme, &BME280_driver, I2C1, 0, 0, 0, BME280_ADD, &bmeState, SAMPLE_MS );
+
+  while( 1 )
+  {
+    Sensor_run( sensors, 1 );
+    if( bme.fresh )
+    {
+      bmeTemp100  = fix16_to100( bme.reading.temp );
+      bmeHumid100 = fix16_to100( bme.reading.humid );
+      bmePress10  = ( fix16_to100( bme.reading.press ) + 5 ) / 10;
+      bme.fresh   = 0;
+    }
+    bmeErrors = bme.errors;
+    __WFI( );                             // Sleep until the next SysTick
+  }
+}
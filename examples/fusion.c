@@ -0,0 +1,72 @@
+//  ==========================================================================================
+//  examples/fusion.c
+//  ------------------------------------------------------------------------------------------
+//  Example for STM32F030-Fusion-lib.c: three AHT10 sensors in the same room, read every
+//  10 seconds by the sampling engine of STM32F030-Sensor-lib.c and combined into one
+//  reading. Two sensors are on I2C1 at addresses 0x38 and 0x39, and the third, also at
+//  0x38, is on channel 0 of a TCA9548A multiplexer. A sensor that fails or drifts away
+//  from the other two is left out until it agrees with them again, and a Kalman filter
+//  smooths the result.
+//
+//  The output is kept in roomTemp100 and roomHumid100 (x 100, as in main.c), the number
+//  of sensors used in roomVoters, and the sensors left out as bits in roomDropped, for
+//  reading with a debugger.
+//
+//  Built by "make examples". "make test" also builds it on the host.
+//  ------------------------------------------------------------------------------------------
+//  https://github.com/EZdenki/STM32F030-CMSIS-I2C-AHT10-lib
+//  Released under the MIT License
+//  Copyright (c) 2023
+//  Mike Shegedin, EZdenki.com
+//  ------------------------------------------------------------------------------------------
+//  Target Devices:
+//    STM32F030Fxxx running at 8 MHz internal clock
+//    AHT10 Modules at 0x38 and 0x39 (ADDR high), and at 0x38 behind a TCA9548A at 0x70
+//    (channel 0). SCL to A9 (Pin 17), SDA to A10 (Pin 18)
+//  ==========================================================================================
+
+#include "stm32f030x6.h"                  // Primary CMSIS header file
+#include "STM32F030-AHT10-Sensor-lib.c"   // AHT10 driver
+#include "STM32F030-Fusion-lib.c"         // Voting and filtering
+#include "STM32F030-Sensor-lib.c"         // Sampling engine
+#include "STM32F030-Fixed-lib.c"          // fix16_to100
+
+#define SAMPLE_MS  10000                  // Time between readings, the same for all sensors
+
+I2C_Mux  mux;
+Sensor   a, b, c;
+Sensor  *room[] = { &a, &b, &c };
+Fusion   fused;
+int16_t  roomTemp100;                     // Temperature in C x 100
+int16_t  roomHumid100;                    // Relative humidity in % x 100
+uint8_t  roomVoters;                      // Sensors used in the last reading
+uint8_t  roomDropped;                     // Bit i set: sensor i is left out
+
+
+int
+main()
+{
+  I2C_init( I2C1, 100e3 );
+  SysTick_init( );
+  I2C_muxInit( &mux, I2C1, 0, 0x70 );
+  Sensor_init( &a, &AHT10_driver, I2C1, 0, 0,    0, AHT10_ADD,     0, SAMPLE_MS );
+  Sensor_init( &b, &AHT10_driver, I2C1, 0, 0,    0, AHT10_ADD + 1, 0, SAMPLE_MS );
+  Sensor_init( &c, &AHT10_driver, I2C1, 0, &mux, 0, AHT10_ADD,     0, SAMPLE_MS );
+  Fusion_init( &fused, room, 3, FUSION_KALMAN, FIX16( 0.001 ), FIX16( 0.01 ));
+
+  while( 1 )
+  {
+    Sensor_run( room, 3 );
+    if( Fusion_ready( &fused ) && Fusion_update( &fused ))
+    {
+      roomTemp100  = fix16_to100( fused.out.temp );
+      roomHumid100 = fix16_to100( fused.out.humid );
+      roomVoters   = fused.voters;
+      roomDropped  = 0;
+      for( uint8_t i = 0; i < 3; i++ )
+        if( fused.m[i].dropped )
+          roomDropped |= 1U << i;
+    }
+    __WFI( );                             // Sleep until the next SysTick
+  }
+}
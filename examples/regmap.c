@@ -0,0 +1,76 @@
+//  ==========================================================================================
+//  examples/regmap.c
+//  ------------------------------------------------------------------------------------------
+//  Example for STM32F030-Regmap-lib.c: a DS3231 real-time clock on I2C1, driven through a
+//  register map. The control register is set up once, the oscillator stop flag in the
+//  status register is cleared, and then the time registers are read once per second into
+//  rtcTime, for reading with a debugger. The control register is checked on every pass, but
+//  after the first pass it is only read from the cache.
+//
+//  Built by "make examples". "make test" also builds it on the host.
+//  ------------------------------------------------------------------------------------------
+//  https://github.com/EZdenki/STM32F030-CMSIS-I2C-AHT10-lib
+//  Released under the MIT License
+//  Copyright (c) 2023
+//  Mike Shegedin, EZdenki.com
+//  ------------------------------------------------------------------------------------------
+//  Target Devices:
+//    STM32F030Fxxx running at 8 MHz internal clock
+//    DS3231 Real-Time Clock Module: SCL to A9 (Pin 17), SDA to A10 (Pin 18)
+//  ==========================================================================================
+
+#include "stm32f030x6.h"                  // Primary CMSIS header file
+#include "STM32F030-Regmap-lib.c"         // Register map with cache
+#include "STM32F030-SysTick-lib.c"        // Millisecond timebase
+
+#define DS3231_ADD      0x68              // I2C address of the DS3231
+#define DS3231_TIME     0x00              // Seconds, minutes, hours, day, date, month, year
+#define DS3231_CONTROL  0x0E
+#define DS3231_STATUS   0x0F
+
+#define DS3231_INTCN    0x04              // Control: SQW pin is the alarm interrupt output
+#define DS3231_RS       0x18              // Control: Square-wave rate
+#define DS3231_OSF      0x80              // Status: The oscillator has stopped
+
+static const Regmap_Reg rtcRegs[] =       // Sorted by register address
+{
+  { DS3231_CONTROL, 0 },
+  { DS3231_STATUS,  REGMAP_VOLATILE },
+};
+static uint8_t rtcCache[ 2 ];
+
+I2C_Dev  rtcDev;
+Regmap   rtc;
+uint8_t  rtcTime[ 7 ];                    // Time registers in BCD, as read from the DS3231
+uint8_t  rtcLost;                         // 1 if the oscillator had stopped (time not valid)
+uint8_t  rtcStatus;                       // Result of the last access
+
+
+int
+main()
+{
+  uint8_t  status;
+  uint32_t last;
+
+  I2C_init( I2C1, 100e3 );
+  SysTick_init( );
+  I2C_devInit( &rtcDev, I2C1, 0, 0, 0, DS3231_ADD );
+  Regmap_init( &rtc, &rtcDev, rtcRegs, rtcCache, 2, REGMAP_BURST );
+
+  if( Regmap_read( &rtc, DS3231_STATUS, &status ) == I2C_OK )
+  {
+    rtcLost = ( status & DS3231_OSF ) ? 1 : 0;
+    Regmap_update( &rtc, DS3231_STATUS, DS3231_OSF, 0 );
+  }
+
+  last = SysTick_ms( );
+  while( 1 )
+  {
+    // Interrupt output on the SQW pin, no square wave. Written only if it changed.
+    Regmap_update( &rtc, DS3231_CONTROL, DS3231_INTCN | DS3231_RS, DS3231_INTCN );
+    rtcStatus = Regmap_readBlock( &rtc, DS3231_TIME, rtcTime, 7 );
+    while( !SysTick_reached( last + 1000 ))
+      __WFI( );
+    last += 1000;
+  }
+}
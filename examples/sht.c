@@ -0,0 +1,56 @@
+//  ==========================================================================================
+//  examples/sht.c
+//  ------------------------------------------------------------------------------------------
+//  Example for STM32F030-SHT-lib.c: an SHT3x and an SHT4x on I2C1, read every 2 seconds by
+//  the sampling engine of STM32F030-Sensor-lib.c. The conversions of both sensors run at
+//  the same time. The readings are kept in shtTemp100 (C x 100) and shtHumid100 (whole
+//  percent, as humid100 in main.c), for reading with a debugger, and the CPU sleeps
+//  between the steps.
+//
+//  Built by "make examples". "make test" also builds it on the host.
+//  ------------------------------------------------------------------------------------------
+//  https://github.com/EZdenki/STM32F030-CMSIS-I2C-AHT10-lib
+//  Released under the MIT License
+//  Copyright (c) 2023
+//  Mike Shegedin, EZdenki.com
+//  ------------------------------------------------------------------------------------------
+//  Target Devices:
+//    STM32F030Fxxx running at 8 MHz internal clock
+//    SHT3x Module with ADDR high (address 0x45) and SHT4x-A Module (address 0x44):
+//    SCL to A9 (Pin 17), SDA to A10 (Pin 18)
+//  ==========================================================================================
+
+#include "stm32f030x6.h"                  // Primary CMSIS header file
+#include "STM32F030-SHT-lib.c"            // SHT3x and SHT4x drivers
+#include "STM32F030-Sensor-lib.c"         // Sampling engine
+#include "STM32F030-Fixed-lib.c"          // fix16_to100 and fix16_round
+
+#define SAMPLE_MS  2000                   // Time between readings
+
+Sensor   sht3x, sht4x;
+Sensor  *sensors[] = { &sht3x, &sht4x };
+int16_t  shtTemp100[ 2 ];                 // Temperature in C x 100 of each sensor
+int16_t  shtHumid100[ 2 ];                // Relative humidity in whole % of each sensor
+
+
+int
+main()
+{
+  I2C_init( I2C1, 100e3 );
+  SysTick_init( );
+  Sensor_init( &sht3x, &SHT3x_driver, I2C1, 0, 0, 0, SHT3X_ADD + 1, 0, SAMPLE_MS );
+  Sensor_init( &sht4x, &SHT4x_driver, I2C1, 0, 0, 0, SHT4X_ADD, 0, SAMPLE_MS );
+
+  while( 1 )
+  {
+    Sensor_run( sensors, 2 );
+    for( uint8_t i = 0; i < 2; i++ )
+      if( sensors[ i ]->fresh )
+      {
+        shtTemp100[ i ]     = fix16_to100( sensors[ i ]->reading.temp );
+        shtHumid100[ i ]    = fix16_round( sensors[ i ]->reading.humid );
+        sensors[ i ]->fresh = 0;
+      }
+    __WFI( );                             // Sleep until the next SysTick
+  }
+}
@@ -0,0 +1,60 @@
+//  ==========================================================================================
+//  host/bench.c
+//  ------------------------------------------------------------------------------------------
+//  Times the routines of main.c that wait on the hardware, on the virtual clock of the
+//  host simulation (host/sim.c): the boot sequence, the LCD writes and the AHT10 and I2C
+//  transactions. Prints one line per routine:
+//    symbol cycles
+//  in CPU cycles at DELAY_CLK_MHZ. "make bench" adds the figures to the size and stack
+//  history (see bench.awk). The virtual clock only moves while the program waits, so the
+//  figures follow the delays, the bus speed and the protocol, not the code generated for
+//  the target. Routines that only compute take no virtual time and are left out.
+//  ------------------------------------------------------------------------------------------
+//  https://github.com/EZdenki/STM32F030-CMSIS-I2C-AHT10-lib
+//  Released under the MIT License
+//  Copyright (c) 2023
+//  Mike Shegedin, EZdenki.com
+//  ==========================================================================================
+
+#define SIM_NO_MAIN
+#include "host/sim.c"                   // main.c with the AHT10 and LCD models
+
+uint64_t Bench_start;
+
+
+//  Time one call. The name must be the symbol of the routine, so that bench.awk puts the
+//  figure in the same record as its size and stack use.
+#define BENCH( name, call )                                                      \
+  do {                                                                          \
+    Bench_start = Host_cycles;                                                  \
+    call;                                                                       \
+    printf( "%s %llu\n", name, (unsigned long long)( Host_cycles - Bench_start )); \
+  } while( 0 )
+
+
+int
+main( void )
+{
+  const uint8_t out[3] = { AHT10_TRIG_MEAS, AHT10_TRIG_D0, AHT10_TRIG_D1 };
+  uint8_t       in[6];
+  fix16_t       temp, humid;
+
+  memset( Sim_lcd.ddram, ' ', sizeof( Sim_lcd.ddram ));
+  Host_i2cAttach( &Sim_aht10 );
+  Host_gpioWatch = Sim_lcdPins;
+
+  SysTick_init( );
+  BENCH( "ADC_init",           ADC_init( LOW_VDD_MV ));
+  BENCH( "bootSequence",       bootSequence( &temp, &humid ));
+  BENCH( "LCD_cmd",            LCD_cmd( LCD_CLEAR ));
+  BENCH( "LCD_putc",           LCD_putc( 'A' ));
+  BENCH( "LCD_puts",           LCD_puts( "12345678" ));
+  BENCH( "AHT10_init",         AHT10_init( I2C1, I2C_SPEED ));
+  BENCH( "AHT10_trigger",      AHT10_trigger( ));
+  delay_us( AHT10_MEAS_MS * 1000 );
+  BENCH( "AHT10_readResult",   AHT10_readResult( in ));
+  BENCH( "AHT10_getTempHumid", AHT10_getTempHumid( &temp, &humid ));
+  BENCH( "I2C_writeN",         I2C_writeN( I2C1, AHT10_ADD, out, 3 ));
+  BENCH( "I2C_readN",          I2C_readN( I2C1, AHT10_ADD, in, 6 ));
+  return ( Sim_lcd.early == 0 ) ? 0 : 1;
+}
@@ -0,0 +1,288 @@
+//  ==========================================================================================
+//  host/i2c-replay.c
+//  ------------------------------------------------------------------------------------------
+//  Replays an I2C trace log against the I2C1 model of STM32F030-Host-lib.c. The log is
+//  recorded on the target by STM32F030-CMSIS-I2C-lib.c when it is built with -DI2C_TRACE
+//  (see "Transaction Trace" in that file for the record format), and saved with the
+//  debugger, for example in gdb:
+//
+//    dump binary memory trace.bin I2C_traceBuf I2C_traceBuf+I2C_traceLen
+//
+//  Each recorded transaction is run again through I2C_writeN or I2C_readN, at the same time
+//  after the previous one as in the log. A simulated device at each address sends back the
+//  bytes that were read, and the error of a failed transaction is injected with
+//  Host_i2cFault on the byte where it happened. The replay is itself traced, and each new
+//  record must match the original: address, direction, bytes and result. So a capture from
+//  the field becomes a regression test of the I2C library.
+//
+//  With -t, the duration of each transaction must also be within the given percentage of
+//  the recorded one, which makes a capture a performance baseline as well. Records that
+//  were cut short when the log filled up (I2C_TRACE_TRUNC) are replayed with the bytes
+//  that were recorded. A write with a NACK on its first byte is replayed as a NACK of the
+//  address, since the log does not tell them apart (see Replay_fault).
+//
+//  Usage:
+//    host/i2c-replay [-s speed] [-t percent] [-q] trace.bin
+//      -s  Bus speed in Hz, as given to I2C_init (default 100000)
+//      -t  Allowed difference of the durations in percent (default: not checked)
+//      -q  Only list the records that do not match
+//  Exits with 0 if every record matches, 1 if not, and 2 if the log cannot be read.
+//  Built by "make host/i2c-replay", and tested by test/test-trace.c.
+//  ------------------------------------------------------------------------------------------
+//  https://github.com/EZdenki/STM32F030-CMSIS-I2C-AHT10-lib
+//  Released under the MIT License
+//  Copyright (c) 2023
+//  Mike Shegedin, EZdenki.com
+//  ==========================================================================================
+
+#define I2C_TRACE                       // The replay is traced to compare it with the log
+#ifndef I2C_TRACE_SIZE
+#define I2C_TRACE_SIZE  8192            // Longest log that can be replayed
+#endif
+
+#include "STM32F030-Host-lib.c"         // Must come first
+#include "STM32F030-CMSIS-I2C-lib.c"    // Library under test
+
+const uint8_t  *Replay_data;            // Data bytes of the record being replayed
+uint8_t         Replay_n;               // Number of data bytes
+uint8_t         Replay_pos;             // Next byte to send
+Host_I2cDevice  Replay_dev[ HOST_I2C_DEVICES ];
+
+
+//  uint8_t
+//  Replay_start( uint8_t read )
+//  Every address in the log has a device, which acknowledges. A NACK in the log is
+//  injected as a fault instead.
+static uint8_t
+Replay_start( uint8_t read )
+{
+  Replay_pos = 0;
+  return 1;
+}
+
+
+//  uint8_t
+//  Replay_read( void )
+//  Send the bytes of the record, and 0xFF after them.
+static uint8_t
+Replay_read( void )
+{
+  return ( Replay_pos < Replay_n ) ? Replay_data[ Replay_pos++ ] : 0xFF;
+}
+
+
+//  uint8_t
+//  Replay_attach( uint8_t address )
+//  Make sure that there is a device at address. Returns 0 if there are too many addresses.
+static uint8_t
+Replay_attach( uint8_t address )
+{
+  for( uint8_t i = 0; i < HOST_I2C_DEVICES; i++ )
+  {
+    if( Replay_dev[ i ].start && Replay_dev[ i ].address == address )
+      return 1;
+    if( !Replay_dev[ i ].start )
+    {
+      Replay_dev[ i ].address = address;
+      Replay_dev[ i ].start   = Replay_start;
+      Replay_dev[ i ].read    = Replay_read;
+      Host_i2cAttach( &Replay_dev[ i ] );
+      return 1;
+    }
+  }
+  return 0;
+}
+
+
+//  void
+//  Replay_fault( const uint8_t *r )
+//  Arm the fault that gives the result of record r. A write records the byte that failed,
+//  so the fault goes on byte n. A read records only the bytes that arrived, so the fault
+//  goes on the byte after them. A timeout is a clock stretch of twice I2C_TIMEOUT_US.
+//  A NACK of a read is always on the address (n = 0). A write that is not acknowledged
+//  records the byte that was ready to go, so a NACK of the address and of the first data
+//  byte give the same record (n = 1). It is replayed as the common case, a device that does
+//  not answer to its address, so only the duration differs if it was the data byte.
+static void
+Replay_fault( const uint8_t *r )
+{
+  uint8_t n  = r[1];
+  uint8_t at = ( r[0] & 0x80 ) ? n + 1 : n;
+
+  if( r[2] & I2C_TRACE_NACK )
+    Host_i2cFault( HOST_FAULT_NACK, ( n > 1 ) ? n : 0, 0 );
+  else if( r[2] & I2C_TRACE_BERR )
+    Host_i2cFault( HOST_FAULT_BERR, at, 0 );
+  else if( r[2] & I2C_TRACE_ARLO )
+    Host_i2cFault( HOST_FAULT_ARLO, at, 0 );
+  else if( r[2] & I2C_TRACE_TIMEOUT )
+    Host_i2cFault( HOST_FAULT_STRETCH, at, 2 * I2C_TIMEOUT_US );
+  else
+    Host_i2cFault( 0, 0, 0 );
+}
+
+
+//  int32_t
+//  Replay_check( const uint8_t *log, uint32_t len )
+//  Return the number of records in the log, or -1 if the last record runs past its end.
+int32_t
+Replay_check( const uint8_t *log, uint32_t len )
+{
+  int32_t  records = 0;
+  uint32_t i       = 0;
+
+  while( i < len )
+  {
+    if( i + I2C_TRACE_HDR > len || i + I2C_TRACE_HDR + log[ i + 1 ] > len )
+      return -1;
+    i += I2C_TRACE_HDR + log[ i + 1 ];
+    records++;
+  }
+  return records;
+}
+
+
+//  void
+//  Replay_result( uint8_t result, char *s )
+//  Write the result bits of a record as text.
+static void
+Replay_result( uint8_t result, char *s )
+{
+  strcpy( s, result ? "" : "ok" );
+  if( result & I2C_TRACE_NACK )    strcat( s, "NACK " );
+  if( result & I2C_TRACE_BERR )    strcat( s, "BERR " );
+  if( result & I2C_TRACE_ARLO )    strcat( s, "ARLO " );
+  if( result & I2C_TRACE_TIMEOUT ) strcat( s, "TIMEOUT " );
+  if( result & I2C_TRACE_TRUNC )   strcat( s, "TRUNC " );
+}
+
+
+//  uint32_t
+//  Replay_run( const uint8_t *log, uint16_t len, uint32_t speed, uint16_t tolerance,
+//              uint8_t verbose )
+//  Replay a log that has passed Replay_check, on a bus at speed Hz. A tolerance other than
+//  0 also checks the durations. verbose 2 lists every record, 1 only the ones that do not
+//  match, and 0 none. Returns the number of records that do not match. The devices
+//  of the replay replace any that were attached before.
+uint32_t
+Replay_run( const uint8_t *log, uint16_t len, uint32_t speed, uint16_t tolerance,
+            uint8_t verbose )
+{
+  uint8_t  in[ 256 ];
+  char     was[ 40 ], now[ 40 ];
+  uint32_t bad   = 0;
+  uint64_t start = 0;
+
+  memset( Host_i2c.dev, 0, sizeof( Host_i2c.dev ));
+  memset( Replay_dev, 0, sizeof( Replay_dev ));
+  SysTick_init( );
+  I2C_init( I2C1, speed );
+  I2C_traceReset( );
+
+  for( uint16_t i = 0; i < len; i += I2C_TRACE_HDR + log[ i + 1 ] )
+  {
+    const uint8_t *r       = log + i;
+    const uint8_t *t       = I2C_traceBuf + I2C_traceLen;   // Where the replay is traced
+    uint8_t        address = r[0] & 0x7F;
+    uint8_t        n       = r[1];
+    uint8_t        result  = r[2] & ~I2C_TRACE_TRUNC;
+    uint32_t       gap     = r[3] | ( r[4] << 8 );
+    uint32_t       us      = r[5] | ( r[6] << 8 );
+    uint32_t       newUs;
+    uint8_t        ok;
+
+    if( i && Host_us( ) < start + gap )   // Same time from the previous start as in the log
+      delay_us( start + gap - Host_us( ));
+    start = Host_us( );
+
+    if( !Replay_attach( address ))
+    {
+      fprintf( stderr, "More than %u addresses in the log\n", HOST_I2C_DEVICES );
+      return bad + 1;
+    }
+    Replay_data = r + I2C_TRACE_HDR;
+    Replay_n    = n;
+    Replay_fault( r );
+    if( !( r[0] & 0x80 ))
+      I2C_writeN( I2C1, address, Replay_data, n );
+    else                                  // Ask for the byte that failed as well
+      I2C_readN( I2C1, address, in, ( result && n < 255 ) ? n + 1 : n );
+    Host_i2cFault( 0, 0, 0 );
+
+    newUs = t[5] | ( t[6] << 8 );
+    ok    = t[0] == r[0] && t[1] == n && t[2] == result &&
+            !memcmp( t + I2C_TRACE_HDR, r + I2C_TRACE_HDR, n );
+    if( tolerance && us != 0xFFFF &&
+        ( newUs > us ? newUs - us : us - newUs ) * 100 > us * tolerance )
+      ok = 0;
+    if( !ok )
+      bad++;
+
+    if( verbose > 1 || ( verbose && !ok ))
+    {
+      Replay_result( r[2], was );
+      Replay_result( t[2], now );
+      printf( "%5u  %c 0x%02X %3u bytes  +%5u us  %5u us  %-12s -> %5u us  %s%s\n",
+              i, ( r[0] & 0x80 ) ? 'R' : 'W', address, n, gap, us, was, newUs, now,
+              ok ? "" : "  DIFFERENT" );
+    }
+  }
+  return bad;
+}
+
+
+#ifndef REPLAY_NO_MAIN                  // test/test-trace.c uses the routines above
+
+int
+main( int argc, char **argv )
+{
+  static uint8_t log[ I2C_TRACE_SIZE + 1 ];
+  uint32_t speed     = 100000;
+  uint16_t tolerance = 0;
+  uint8_t  verbose   = 2;
+  uint32_t len, bad;
+  int32_t  records;
+  FILE    *f;
+  int      a;
+
+  for( a = 1; a < argc - 1 && argv[ a ][0] == '-'; a++ )
+    if( !strcmp( argv[ a ], "-s" ) && a < argc - 2 )
+      speed = atol( argv[ ++a ] );
+    else if( !strcmp( argv[ a ], "-t" ) && a < argc - 2 )
+      tolerance = atoi( argv[ ++a ] );
+    else if( !strcmp( argv[ a ], "-q" ))
+      verbose = 1;
+    else
+      break;
+  if( a != argc - 1 )
+  {
+    fprintf( stderr, "Usage: %s [-s speed] [-t percent] [-q] trace.bin\n", argv[0] );
+    return 2;
+  }
+
+  if( !( f = fopen( argv[ a ], "rb" )))
+  {
+    perror( argv[ a ] );
+    return 2;
+  }
+  len = fread( log, 1, sizeof( log ), f );
+  fclose( f );
+  if( len > I2C_TRACE_SIZE )
+  {
+    fprintf( stderr, "%s: longer than %u bytes\n", argv[ a ], I2C_TRACE_SIZE );
+    return 2;
+  }
+  if(( records = Replay_check( log, len )) < 0 )
+  {
+    fprintf( stderr, "%s: the last record runs past the end of the log\n", argv[ a ] );
+    return 2;
+  }
+
+  if( verbose > 1 )
+    printf( "  Pos  Address  Bytes     Gap    Time  Result          Replay\n" );
+  bad = Replay_run( log, len, speed, tolerance, verbose );
+  printf( "%s: %d records, %u different\n", argv[ a ], records, bad );
+  return bad ? 1 : 0;
+}
+
+#endif /* REPLAY_NO_MAIN */
@@ -0,0 +1,454 @@
+//  ==========================================================================================
+//  host/sim.c
+//  ------------------------------------------------------------------------------------------
+//  Runs the whole of main.c on the host, against the peripheral models of
+//  STM32F030-Host-lib.c and models of the parts on the board:
+//    - An AHT10 on the I2C1 bus, which measures a room that goes through a day of
+//      temperature and humidity (SIM_TEMP100 and SIM_HUMID100, with a 24 hour period).
+//    - The 8x2 HD44780 LCD on GPIOA, which takes the nibbles on the falling edge of EN and
+//      counts every nibble that comes while it is still busy with the last command, or
+//      before it has powered up.
+//    - The supply and die temperature seen by the ADC.
+//  The virtual clock jumps from event to event, so a simulated day takes seconds. SysTick
+//  starts one minute before its millisecond count wraps, as it would after 49.7 days, so
+//  every run also passes the wrap.
+//
+//  Each time the LCD has shown the same text for SIM_SETTLE_MS, the screen is checked: a
+//  reading must match what the AHT10 measured. At the end, the program must still be
+//  taking readings at the rate of its display cycle, the LCD timing must have held,
+//  SysTick_elapsed must have stayed right across the wrap, the boot times and the crash
+//  report must be as expected, and the diagnostics must agree with the models. The exit
+//  code is 0 if all checks pass.
+//
+//  Usage:
+//    host/sim [-v] [-c] [-b mV] [-d seconds] [hours]
+//      -v  Print each screen the LCD shows, with its time
+//      -c  Start as after a HardFault, so that main() reports and saves the crash record
+//      -b  Let the supply fall from 3300 mV to mV over the run (below 2500: "Low batt")
+//      -d  The sensor stops answering for this many seconds in the middle of the run
+//      hours  Virtual time to run (default 24)
+//  Built and run by "make sim". host/bench.c times the routines of main.c on the same
+//  models.
+//  ------------------------------------------------------------------------------------------
+//  https://github.com/EZdenki/STM32F030-CMSIS-I2C-AHT10-lib
+//  Released under the MIT License
+//  Copyright (c) 2023
+//  Mike Shegedin, EZdenki.com
+//  ==========================================================================================
+
+#define SYSTICK_START_MS ( 0U - 60000U )      // The millisecond count wraps after a minute
+
+#include "STM32F030-Host-lib.c"         // Must come first
+
+#define main firmware_main              // The program under test
+#include "main.c"
+#undef  main
+
+#include <math.h>
+#include <time.h>
+
+#define SIM_TEMP100( s )  ( 2200 + 400 * sin( 2 * M_PI * (s) / 86400 ))  // Room x 100
+#define SIM_HUMID100( s ) ( 5000 - 1500 * sin( 2 * M_PI * (s) / 86400 ))
+#define SIM_AHT_MEAS_MS   70            // AHT10 measurement time
+#define SIM_LCD_POWER_MS  40            // HD44780 power-up time
+#define SIM_DIE_K100      300           // The die runs 3 C warmer than the room
+#define SIM_SETTLE_MS     100           // A screen is checked once it is this old
+#define SIM_MS            ( 1000ULL * DELAY_CLK_MHZ )   // Cycles per millisecond
+
+typedef struct
+{
+  uint8_t  cal;                         // Initialized with 0xE1 0x08 0x00
+  uint8_t  cmd[ 3 ];                    // Command bytes of the write in progress
+  uint8_t  nCmd;
+  uint8_t  frame[ 6 ];                  // Status and data sent by a read
+  uint8_t  pos;                         // Next byte of frame to send
+  uint64_t ready;                       // Time when the measurement is done
+  int32_t  temp100, humid100;           // Last measurement
+  int32_t  readT100, readH100;          // Measurement of the last complete read
+} Sim_Aht10;
+
+typedef struct
+{
+  uint8_t  ddram[ 128 ];                // Display RAM: line 1 at 0x00, line 2 at 0x40
+  uint8_t  addr;
+  uint8_t  on;                          // Display on
+  uint8_t  fourBit;                     // 4-bit interface selected
+  uint8_t  half;                        // Upper nibble of a byte latched
+  uint8_t  upper;
+  uint64_t busy;                        // Time when the last command is done
+  uint32_t early;                       // Nibbles written too soon
+  uint8_t  changed;                     // Screen changed since it was last checked
+  uint64_t changedAt;
+} Sim_Lcd;
+
+Sim_Aht10 Sim_aht;
+Sim_Lcd   Sim_lcd;
+
+uint64_t Sim_end;                       // End of the run, in cycles
+uint64_t Sim_dropFrom, Sim_dropTo;      // The sensor does not answer in between
+uint16_t Sim_lowMv = 3300;              // Supply at the end of the run
+uint8_t  Sim_verbose;
+uint8_t  Sim_crash;                     // Started as after a HardFault
+clock_t  Sim_wall;                      // Host CPU time at the start
+
+uint32_t Sim_readings;                  // Readings shown
+uint32_t Sim_errors;                    // "Sensor error" screens
+uint32_t Sim_lowBatt;                   // "Low batt" screens
+uint32_t Sim_faults;                    // "Fault" screens
+uint64_t Sim_lastReading;               // Time of the last reading shown
+uint16_t Sim_lowBattMv;                 // Supply when "Low batt" was first shown
+uint32_t Sim_clockErrors;               // Times SysTick_elapsed was off
+
+
+//  double
+//  Sim_seconds( void )
+//  The virtual time in seconds.
+static double
+Sim_seconds( void )
+{
+  return (double)Host_cycles / ( SIM_MS * 1000 );
+}
+
+
+//  uint8_t
+//  Sim_ahtStart( uint8_t read )
+//  AHT10 addressed. It does not answer during the drop-out, or while its power pin is off
+//  in a build with AHT10_PWR_PIN. A read sends the status byte, with the busy bit until the
+//  measurement is done, and the 20-bit readings.
+static uint8_t
+Sim_ahtStart( uint8_t read )
+{
+  Sim_Aht10 *a = &Sim_aht;
+  uint32_t   h = (uint64_t)a->humid100 * 1048576 / 10000;
+  uint32_t   t = (uint64_t)( a->temp100 + 5000 ) * 1048576 / 20000;
+
+  if( Host_cycles >= Sim_dropFrom && Host_cycles < Sim_dropTo )
+    return 0;
+#ifdef AHT10_PWR_PIN
+  if( !( Host_gpioOdr[ 0 ] & ( 1U << AHT10_PWR_PIN )))  // Switched off: forgets its setup
+  {
+    a->cal = 0;
+    return 0;
+  }
+#endif
+  a->nCmd = 0;
+  a->pos  = 0;
+  if( read )
+  {
+    a->frame[0] = (( Host_cycles < a->ready ) ? AHT10_BUSY : 0 ) | ( a->cal ? 0x08 : 0 ) |
+                  0x11;
+    a->frame[1] = h >> 12;
+    a->frame[2] = h >> 4;
+    a->frame[3] = (( h & 0x0F ) << 4 ) | ( t >> 16 );
+    a->frame[4] = t >> 8;
+    a->frame[5] = t;
+  }
+  return 1;
+}
+
+
+//  uint8_t
+//  Sim_ahtWrite( uint8_t data )
+//  A command byte. The measurement takes the room values at the trigger.
+static uint8_t
+Sim_ahtWrite( uint8_t data )
+{
+  Sim_Aht10 *a = &Sim_aht;
+  double     s = Sim_seconds( );
+
+  if( a->nCmd < 3 )
+    a->cmd[ a->nCmd++ ] = data;
+  if( a->nCmd == 3 && a->cmd[0] == AHT10_INIT )
+    a->cal = 1;
+  if( a->nCmd == 3 && a->cmd[0] == AHT10_TRIG_MEAS && a->cmd[1] == AHT10_TRIG_D0 )
+  {
+    a->temp100  = lround( SIM_TEMP100( s ));
+    a->humid100 = lround( SIM_HUMID100( s ));
+    a->ready    = Host_cycles + SIM_AHT_MEAS_MS * SIM_MS;
+  }
+  return 1;
+}
+
+
+//  uint8_t
+//  Sim_ahtRead( void )
+//  Next byte of the frame. Once all 6 have been read, the measurement is the one the
+//  program will show.
+static uint8_t
+Sim_ahtRead( void )
+{
+  Sim_Aht10 *a = &Sim_aht;
+
+  if( a->pos >= 6 )
+    return 0xFF;
+  if( a->pos == 5 )
+  {
+    a->readT100 = a->temp100;
+    a->readH100 = a->humid100;
+  }
+  return a->frame[ a->pos++ ];
+}
+
+
+const Host_I2cDevice Sim_aht10 = { AHT10_ADD, Sim_ahtStart, Sim_ahtWrite, Sim_ahtRead, 0 };
+
+
+//  void
+//  Sim_lcdByte( uint8_t rs, uint8_t b )
+//  Carry out a command (rs 0) or write a character (rs 1), and note how long it takes.
+static void
+Sim_lcdByte( uint8_t rs, uint8_t b )
+{
+  Sim_Lcd *l = &Sim_lcd;
+  uint32_t us = 37;
+
+  if( rs )
+  {
+    l->ddram[ l->addr ] = b;
+    l->addr = ( l->addr + 1 ) & 0x7F;
+  }
+  else if( b == LCD_CLEAR )
+  {
+    memset( l->ddram, ' ', sizeof( l->ddram ));
+    l->addr = 0;
+    us      = 1520;
+  }
+  else if(( b & 0xFE ) == LCD_HOME )
+  {
+    l->addr = 0;
+    us      = 1520;
+  }
+  else if( b & 0x80 )                   // Set the display RAM address
+    l->addr = b & 0x7F;
+  else if( b & 0x20 )                   // Function set: DL selects 8 or 4 bits
+    l->fourBit = !( b & 0x10 );
+  else if( b & 0x08 )                   // Display on/off control
+    l->on = ( b & 0x04 ) != 0;
+  l->busy      = Host_cycles + us * DELAY_CLK_MHZ;
+  l->changed   = 1;
+  l->changedAt = Host_cycles;
+}
+
+
+//  void
+//  Sim_lcdPins( uint8_t port, uint32_t odr, uint32_t old )
+//  GPIO watcher: On the falling edge of EN, the LCD takes the nibble on A[3:0]. Until the
+//  4-bit interface is selected, each nibble is a whole command with the lower 4 bits 0.
+static void
+Sim_lcdPins( uint8_t port, uint32_t odr, uint32_t old )
+{
+  Sim_Lcd *l      = &Sim_lcd;
+  uint8_t  nibble = odr & LCD_DATA_MASK;
+  uint8_t  rs     = ( odr & LCD_RS_BIT ) != 0;
+
+  if( port != 0 || !( old & LCD_EN_BIT ) || ( odr & LCD_EN_BIT ))
+    return;
+  if( !l->half && ( Host_cycles < l->busy || Host_cycles < SIM_LCD_POWER_MS * SIM_MS ))
+  {
+    l->early++;
+    if( Sim_verbose )
+      printf( "%10.3f s  LCD written while busy\n", Sim_seconds( ));
+  }
+  if( !l->fourBit )
+    Sim_lcdByte( rs, nibble << 4 );
+  else if( !l->half )
+  {
+    l->upper = nibble;
+    l->half  = 1;
+  }
+  else
+  {
+    l->half = 0;
+    Sim_lcdByte( rs, l->upper << 4 | nibble );
+  }
+}
+
+
+#ifndef SIM_NO_MAIN                     // host/bench.c only uses the models above
+
+
+//  void
+//  Sim_line( uint8_t line, char *s )
+//  The 8 characters of a line of the LCD as text, with the degree sign as 'o'.
+static void
+Sim_line( uint8_t line, char *s )
+{
+  for( uint8_t i = 0; i < 8; i++ )
+  {
+    uint8_t c = Sim_lcd.on ? Sim_lcd.ddram[ line * 0x40 + i ] : ' ';
+
+    s[ i ] = ( c == AHT10_CHAR_DEG ) ? 'o' : ( c >= ' ' && c < 0x7F ) ? c : '?';
+  }
+  s[ 8 ] = 0;
+}
+
+
+//  void
+//  Sim_screen( void )
+//  Check a screen that has settled. A reading must be what the AHT10 measured: the
+//  temperature rounded to 0.1 C, and the humidity to whole percent.
+static void
+Sim_screen( void )
+{
+  char  l1[ 9 ], l2[ 9 ];
+  float temp;
+  int   humid;
+
+  Sim_line( 0, l1 );
+  Sim_line( 1, l2 );
+  if( Sim_verbose )
+    printf( "%10.3f s  [%s][%s]\n", Sim_seconds( ), l1, l2 );
+
+  if( sscanf( l1, "%f oC", &temp ) == 1 && sscanf( l2, "%d %% RH", &humid ) == 1 )
+  {
+    Sim_readings++;
+    Sim_lastReading = Host_cycles;
+    HOST_CHECK( fabs( temp * 100 - Sim_aht.readT100 ) <= 6 );
+    HOST_CHECK( abs( humid * 100 - Sim_aht.readH100 ) <= 51 );
+  }
+  else if( !strncmp( l1, "Sensor", 6 ))
+    Sim_errors++;
+  else if( !strncmp( l1, "Low batt", 8 ))
+  {
+    if( !Sim_lowBatt++ )
+      Sim_lowBattMv = Host_vddMv;
+  }
+  else if( !strncmp( l1, "Fault", 5 ))
+    Sim_faults++;
+}
+
+
+//  void
+//  Sim_finish( void )
+//  End of the run: the checks over the whole run, and a summary. Exits.
+static void
+Sim_finish( void )
+{
+  double   s     = Sim_seconds( );
+  double   wall  = (double)( clock( ) - Sim_wall ) / CLOCKS_PER_SEC;
+  double   drop  = (double)( Sim_dropTo - Sim_dropFrom ) / ( SIM_MS * 1000 );
+  uint32_t cycle = SAMPLE_MS + (( Sim_lowMv < LOW_VDD_MV ) ? 2000 : 0 ) + 500;
+
+  HOST_EQ( Sim_lcd.early, 0 );
+  HOST_CHECK( bootSampleMs >= AHT10_POWERUP_MS + AHT10_MEAS_MS &&   // Inside the LCD
+              bootSampleMs < LCD_POWERUP_MS );                       // power-up wait
+  HOST_CHECK( bootDisplayMs > LCD_POWERUP_MS &&                      // The fault report
+              bootDisplayMs < LCD_POWERUP_MS + 100 + ( Sim_crash ? 3000 : 0 ));  // is first
+  HOST_CHECK( Sim_readings >= ( s - drop ) * 1000 / cycle - 1 );
+  HOST_CHECK( Host_cycles - Sim_lastReading < 2ULL * SAMPLE_MS * SIM_MS );
+  HOST_CHECK( s < 60 || SysTick_ms( ) < SYSTICK_START_MS );           // Wrapped
+  HOST_EQ( Sim_clockErrors, 0 );
+  HOST_CHECK( Sim_dropTo ? Sim_errors > 0 : Sim_errors == 0 );
+  HOST_CHECK(( Sim_lowMv < LOW_VDD_MV - 100 ) ? Sim_lowBatt > 0 : Sim_lowBatt == 0 );
+  if( Sim_lowBatt )
+    HOST_CHECK( Sim_lowBattMv < LOW_VDD_MV && Sim_lowBattMv > LOW_VDD_MV - 100 );
+  HOST_CHECK( Sim_crash ? Sim_faults == 1 && Crash_saved( ) && Crash_saved( )->count == 1
+                        : Sim_faults == 0 );
+  HOST_CHECK( abs( diagVddMv - Host_vddMv ) <= 20 );
+  HOST_CHECK( abs( diagDie100 - Host_dieTemp100 ) <= 100 );
+
+  printf( "%.1f hours simulated in %.1f s (%.0f times real time)\n", s / 3600, wall,
+          wall > 0 ? s / wall : 0 );
+  printf( "Readings shown: %u, sensor errors: %u, low supply: %u, faults: %u\n",
+          Sim_readings, Sim_errors, Sim_lowBatt, Sim_faults );
+  printf( "Boot: first sample %u ms, first display %u ms\n", bootSampleMs, bootDisplayMs );
+  printf( "I2C: %u ok, %u NACK, %u bus error, %u arbitration lost, %u timeout, "
+          "load %u.%u %%\n", I2C1_health.results[ I2C_OK ], I2C1_health.results[ I2C_NACK ],
+          I2C1_health.results[ I2C_BUSERR ], I2C1_health.results[ I2C_ARLO ],
+          I2C1_health.results[ I2C_TIMEOUT ], diagI2CLoad / 10, diagI2CLoad % 10 );
+  printf( "ADC: %u mV (model %u), die %d.%02d C (model %d.%02d)\n", diagVddMv, Host_vddMv,
+          diagDie100 / 100, abs( diagDie100 % 100 ), Host_dieTemp100 / 100,
+          abs( Host_dieTemp100 % 100 ));
+  exit( Host_summary( "sim" ));
+}
+
+
+//  void
+//  Sim_timer( void )
+//  Every SIM_SETTLE_MS: Move the room and the supply on, check that SysTick_elapsed since
+//  SysTick_init agrees with the virtual clock, and check the screen once it has settled.
+static void
+Sim_timer( void )
+{
+  double   s  = Sim_seconds( );
+  uint64_t ms = ( Host_cycles - Host_tickStart ) / SIM_MS;   // Since main started SysTick
+
+  Host_dieTemp100 = lround( SIM_TEMP100( s )) + SIM_DIE_K100;
+  Host_vddMv      = 3300 - ( 3300 - Sim_lowMv ) * (double)Host_cycles / Sim_end;
+  if( Host_tickOn && ( SysTick_elapsed( SYSTICK_START_MS ) + 1 < ms ||
+                       SysTick_elapsed( SYSTICK_START_MS ) > ms ))
+    Sim_clockErrors++;
+  if( Sim_lcd.changed && Host_cycles - Sim_lcd.changedAt >= SIM_SETTLE_MS * SIM_MS )
+  {
+    Sim_lcd.changed = 0;
+    Sim_screen( );
+  }
+  if( Host_cycles >= Sim_end )
+    Sim_finish( );
+  Host_timerAt += SIM_SETTLE_MS * SIM_MS;
+}
+
+
+//  void
+//  Sim_crashRecord( void )
+//  Leave a crash record in .noinit RAM, as HardFault_Handler would before the reset.
+static void
+Sim_crashRecord( void )
+{
+  Crash_Record *rec = &Crash_noinit;
+
+  memset( rec, 0, sizeof( *rec ));
+  rec->pc    = 0x08000ABC;
+  rec->lr    = 0x08000A51;
+  rec->xpsr  = 0x01000000;
+  rec->sp    = 0x20000F00;
+  rec->magic = CRASH_MAGIC;
+  rec->check = Crash_sum( rec );
+}
+
+
+int
+main( int argc, char **argv )
+{
+  double hours = 24, drop = 0;
+  int    a;
+
+  for( a = 1; a < argc && argv[ a ][0] == '-'; a++ )
+    if( !strcmp( argv[ a ], "-v" ))
+      Sim_verbose = 1;
+    else if( !strcmp( argv[ a ], "-c" ))
+      Sim_crash = 1;
+    else if( !strcmp( argv[ a ], "-b" ) && a < argc - 1 )
+      Sim_lowMv = atoi( argv[ ++a ] );
+    else if( !strcmp( argv[ a ], "-d" ) && a < argc - 1 )
+      drop = atof( argv[ ++a ] );
+    else
+      break;
+  if( a < argc )
+    hours = atof( argv[ a++ ] );
+  if( a != argc || hours <= 0 || Sim_lowMv < 1000 || Sim_lowMv > 3300 )
+  {
+    fprintf( stderr, "Usage: %s [-v] [-c] [-b mV] [-d seconds] [hours]\n", argv[0] );
+    return 2;
+  }
+
+  Sim_end = hours * 3600 * 1000 * SIM_MS;
+  if( drop > 0 )
+  {
+    Sim_dropFrom = Sim_end / 2;
+    Sim_dropTo   = Sim_dropFrom + drop * 1000 * SIM_MS;
+  }
+  if( Sim_crash )
+    Sim_crashRecord( );
+  memset( Sim_lcd.ddram, ' ', sizeof( Sim_lcd.ddram ));
+  Host_i2cAttach( &Sim_aht10 );
+  Host_gpioWatch = Sim_lcdPins;
+  Host_timer     = Sim_timer;
+  Host_timerAt   = SIM_SETTLE_MS * SIM_MS;
+  Sim_wall       = clock( );
+
+  firmware_main( );                     // Never returns. Sim_finish ends the run.
+  return 2;
+}
+
+#endif /* SIM_NO_MAIN */
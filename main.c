@@ -2,7 +2,8 @@
 //  main.c for STM32F030-CMSIS-I2C-AHT10-lib.c
 //  ------------------------------------------------------------------------------------------
 //  Reads in temperature and humidity data from an AHT10 I2C temperature and humidity
-//  sensor, and displays this data along with comfort level phrases to an LCD module.
+//  sensor, and displays this data along with the dew point and comfort level phrases to an
+//  LCD module.
 //  ------------------------------------------------------------------------------------------
 //  https://github.com/EZdenki/STM32F030-CMSIS-I2C-AHT10-lib
 //  Released under the MIT License
@@ -25,7 +26,7 @@
 //                          GND ---------- GND
 //                          VCC ---------- 3.3V
 //
-//         |  VIN ------------------------ 5V
+//         |  VIN ------------------------ 5V    (or A7/Pin13, see AHT10_PWR_PIN)
 //   AHT10 |  GND ------------------------ GND
 //  Module |  SCL -- A9 /Pin17 SCK |I2C1
 //         |  SDA -- A10/Pin18 SDA |
@@ -47,28 +48,68 @@
 //
 // ===========================================================================================
 
-#include <string.h>
-#include <stdlib.h>
-#include <stdio.h>
+#ifndef I2C_STATS
+#define I2C_STATS                         // Keep I2C transaction statistics (I2C_stats)
+#endif
+
 #include "stm32f030x6.h"                  // Primary CMSIS header file
+#include "STM32F030-MiniLibc-lib.c"       // itoa, or the C library version
 
 #include "STM32F030-CMSIS-LCD-lib.c"      // LCD driver library
 #include "STM32F030-CMSIS-AHT10-lib.c"    // AHT10 sensor library
+#include "STM32F030-Fixed-lib.c"          // Fixed-point math for the heat index
+#include "STM32F030-Psychro-lib.c"        // Table-based dew point
+#include "STM32F030-SysTick-lib.c"        // Millisecond timebase for the boot sequence
+#include "STM32F030-Crash-lib.c"          // HardFault capture and report
+#include "STM32F030-Stack-lib.c"          // Stack and heap high-water marks
+#include "STM32F030-ADC-lib.c"            // Supply voltage and die temperature
+
+#define I2C_SPEED      100e3              // Starting I2C bus speed
+#define I2C_SPEED_MIN   25e3              // The bus speed is adapted to the error rate
+#define I2C_SPEED_MAX  400e3              // between these limits.
+
+// #define AHT10_PWR_PIN  7               // Power the AHT10 from PA7 (or a load switch on
+                                          // PA7) and switch it off between readings
+#define SAMPLE_MS     17000               // Time between readings (one display cycle)
+
+#ifdef AHT10_PWR_PIN
+#include "STM32F030-AHT10-Sensor-lib.c"   // AHT10 power gating
+#define AHT10_read AHT10_getTempHumidGated  // Power the AHT10 up for each reading
+#else
+#define AHT10_read AHT10_getTempHumid
+#endif
+
+#define LOW_VDD_MV     2500               // Show "Low batt" below this supply voltage
+#define SELF_HEAT_K    FIX16( 0.0 )       // Share of the board warming (die temperature
+                                          // minus sensor reading) that reaches the AHT10.
+                                          // 0 turns the correction off. Calibrate against
+                                          // a reference thermometer for each enclosure.
+
+//  Diagnostics, for reading with a debugger. The boot milestones are in milliseconds after
+//  SysTick_init. The RAM figures are in bytes and are updated once per display cycle.
+uint32_t bootSampleMs;                    // First sensor reading converted
+uint32_t bootDisplayMs;                   // First reading shown on the LCD
+uint32_t diagStackUsed;                   // Stack high-water mark, including interrupts
+uint32_t diagHeapUsed;                    // Heap high-water mark
+uint32_t diagRamFree;                     // RAM never touched by the stack or heap
+uint16_t diagI2CLoad;                     // I2C bus busy time, in tenths of a percent
+uint16_t diagVddMv;                       // Supply voltage, in millivolts
+int16_t  diagDie100;                      // MCU die temperature x 100
 
 
 
-//  float
-//  heatIndex( float tempC, float humid )
-//  Returns the "heat index" given the temperature in Celsius and relative humidity as a
-//  whole number, i.e. 67.3% humidity is represented as 67 (not 0.673). Note that the values
-//  returned by this function are not likely to be particularly accurate for temperatures
-//  below 20 degrees Celsius or humidity values below 40%.
+//  fix16_t
+//  heatIndex( fix16_t tempC, fix16_t humid )
+//  Returns the "heat index" given the temperature in Celsius and relative humidity in
+//  percent, i.e. 67.3% humidity is represented as 67.3 (not 0.673). All values are Q16.16
+//  fixed-point (see STM32F030-Fixed-lib.c). Note that the values returned by this function
+//  are not likely to be particularly accurate for temperatures below 20 degrees Celsius or
+//  humidity values below 40%.
 //  Constants and formula for this routine taken from:
 //    https://en.wikipedia.org/wiki/Heat_index
-float
-heatIndex( float t, float r )
+fix16_t
+heatIndex( fix16_t t, fix16_t r )
 {
-  float htIdx;  // Holds calculated heat index value
 /*
 //  These constants are for Fahrenheit calculations:
   const float c1 = -42.379;
@@ -82,23 +123,61 @@ heatIndex( float t, float r )
   const float c9 =  -1.99e-6;
 */
 
-//  These following constants are for Celsius calculations:
-  const float c1 = -8.78470    ;
-  const float c2 =  1.61139    ;
-  const float c3 =  2.33855    ;
-  const float c4 = -1.46116e-1 ;
-  const float c5 = -1.23081e-2 ;
-  const float c6 = -1.64248e-2 ;
-  const float c7 =  2.21173e-3 ;
-  const float c8 =  7.25460e-4 ;
-  const float c9 = -3.58200e-6 ;
-  
-  htIdx = c1 + c2*t + c3*r + c4*t*r + c5*t*t + c6*r*r + c7*t*t*r + c8*t*r*r + c9*t*t*r*r;
+//  These following constants are for Celsius calculations. c1 to c3 are Q16.16. c4 to c9
+//  are too small for Q16.16, so c4 is stored as Q4.27 and c5 to c9 as Q0.31. A Q0.31
+//  constant times a Q16.16 value is shifted down by 31 bits for a Q16.16 result, or by 20
+//  bits for a Q4.27 result.
+  const fix16_t c1 = FIX16( -8.78470 );
+  const fix16_t c2 = FIX16(  1.61139 );
+  const fix16_t c3 = FIX16(  2.33855 );
+  const int32_t c4 = FIXQ(  -1.46116e-1, 27 );
+  const int32_t c5 = FIXQ(  -1.23081e-2, 31 );
+  const int32_t c6 = FIXQ(  -1.64248e-2, 31 );
+  const int32_t c7 = FIXQ(   2.21173e-3, 31 );
+  const int32_t c8 = FIXQ(   7.25460e-4, 31 );
+  const int32_t c9 = FIXQ(  -3.58200e-6, 31 );
+
+  fix16_t tr = fix16_mul( t, r );
+  int32_t k;      // Q4.27 coefficient of the t*r term
+  fix16_t htIdx;  // Holds calculated heat index value
+
+//  htIdx = c1 + c2*t + c3*r + c4*t*r + c5*t*t + c6*r*r + c7*t*t*r + c8*t*r*r + c9*t*t*r*r
+//  is grouped as
+//  htIdx = c1 + t*( c2 + c5*t ) + r*( c3 + c6*r ) + t*r*( c4 + c7*t + c8*r + c9*t*r )
+//  which keeps every intermediate value well within range. The t*r coefficient is kept in
+//  Q4.27 since it is multiplied by t*r, which can be several thousand.
+  k     = c4 + fix_mulq( c7, t, 20 ) + fix_mulq( c8, r, 20 ) + fix_mulq( c9, tr, 20 );
+  htIdx = fix_mulq( tr, k, 27 );
+  htIdx = fix16_add( htIdx, fix16_mul( t, fix16_add( c2, fix_mulq( c5, t, 31 ))));
+  htIdx = fix16_add( htIdx, fix16_mul( r, fix16_add( c3, fix_mulq( c6, r, 31 ))));
+  htIdx = fix16_add( htIdx, c1 );
 
   return htIdx;
 }  
 
 
+//  void
+//  selfHeat( fix16_t *temp, fix16_t *humid )
+//  Remove the part of the sensor reading caused by heat from the board. The MCU die
+//  temperature stands in for the board temperature, and SELF_HEAT_K of its difference from
+//  the sensor reading is taken off. The die temperature has a large absolute error, which
+//  the calibration of SELF_HEAT_K takes up along with the thermal coupling. The warmer
+//  sensor also reads a lower relative humidity than the room has, so the humidity is moved
+//  to the corrected temperature with humidAt. The heat index and dew point then use a
+//  matching pair of values.
+void
+selfHeat( fix16_t *temp, fix16_t *humid )
+{
+  fix16_t t;
+
+  if( SELF_HEAT_K == 0 || !ADC_ready( ))
+    return;
+  t      = fix16_sub( *temp, fix16_mul( SELF_HEAT_K, fix16_sub( ADC_dieTemp( ), *temp )));
+  *humid = humidAt( *humid, *temp, t );
+  *temp  = t;
+}
+
+
 //  void
 //  outFuzzyHeatIndex( int heatIndex )
 //  Output a 10-character string to the LCD describing the current heat index in English.
@@ -122,6 +201,59 @@ outFuzzyHeatIndex( int temp )
 }
 
 
+//  uint8_t
+//  bootSequence( fix16_t *temp, fix16_t *humid )
+//  Bring up the LCD and the AHT10 and take the first reading, all overlapped. The LCD needs
+//  LCD_POWERUP_MS (300 ms) after power-up before it accepts commands. The AHT10 needs
+//  AHT10_POWERUP_MS before it can be initialized, and then AHT10_MEAS_MS for the first
+//  measurement. Each step has a deadline relative to boot, and the loop below runs
+//  whichever step is due, sleeping until the next SysTick in between. The first reading is
+//  therefore ready long before the LCD is, and is shown as soon as the LCD is up.
+//  Returns the sensor status byte of the first reading, or AHT10_ERROR if it failed.
+uint8_t
+bootSequence( fix16_t *temp, fix16_t *humid )
+{
+  uint8_t  ahtData[6];                // Raw data of the first reading
+  uint8_t  status = AHT10_ERROR;
+  uint8_t  lcdReady = 0;
+  uint8_t  ahtStep  = 0;              // 0: Wait for power-up, 1: Measuring, 2: Done
+  uint32_t ahtDue   = AHT10_POWERUP_MS;
+
+  LCD_initPins( );
+
+  while( !lcdReady || ahtStep < 2 )
+  {
+    if( ahtStep == 0 && SysTick_reached( SYSTICK_START_MS + ahtDue ))
+    {
+      if( AHT10_init( I2C1, I2C_SPEED ) == I2C_OK && AHT10_trigger( ) == I2C_OK )
+      {
+        ahtDue  = SysTick_elapsed( SYSTICK_START_MS ) + AHT10_MEAS_MS;
+        ahtStep = 1;
+      }
+      else
+        ahtStep = 2;                  // No sensor. The main loop reports the error.
+    }
+    else if( ahtStep == 1 && SysTick_reached( SYSTICK_START_MS + ahtDue ))
+    {
+      if( AHT10_readResult( ahtData ) == I2C_OK )
+      {
+        status = AHT10_convert( ahtData, temp, humid );
+        bootSampleMs = SysTick_elapsed( SYSTICK_START_MS );
+      }
+      ahtStep = 2;
+    }
+    else if( !lcdReady && SysTick_reached( SYSTICK_START_MS + LCD_POWERUP_MS ))
+    {
+      LCD_initDisplay( );
+      lcdReady = 1;
+    }
+    else
+      __WFI( );                       // Sleep until the next SysTick interrupt
+  }
+  return status;
+}
+
+
 // ============================================================================================
 // main
 // ============================================================================================
@@ -130,22 +262,64 @@ main()
 {
   char     myString[16];            // Will hold printable strings
   int16_t  temp100, humid100;       // Used in conversion from raw to real data
-  float    rTemp, rHumid, heatIdx;  // Used to pass values to/from heat index routine
+  fix16_t  temp, humid, heatIdx;    // Used to pass values to/from heat index routine
+  uint8_t  status;                  // Sensor status byte or AHT10_ERROR
+  uint8_t  crashed;                 // CRASH_NONE, or CRASH_SAVED/UNSAVED after a HardFault
 
-  LCD_init( );                  // Set the LCD interface to I2C1 and initialize it
-  LCD_cmd( LCD_4B_58F_2L );
-  // Get LCD into 4-bit mode
-  LCD_cmd( LCD_ON_NO_CURSOR );  // LCD ON, Cursor OFF
-  LCD_cmd( LCD_CLEAR );         // Clear the LCD screen
-  LCD_cmd( LCD_HOME );          // Set the LCD to the home position
-  
-  AHT10_init( I2C1, 100e3 );               // Initialize AHT10 sensor, set sensor to I2C2
+  crashed = Crash_check( );         // Save the record of a crash before anything else
+  SysTick_init( );                  // Start the millisecond timebase
+  ADC_init( LOW_VDD_MV );           // Start the supply and die temperature scan
+#ifdef AHT10_PWR_PIN
+  AHT10_powerInit( GPIOA, AHT10_PWR_PIN, 0, SAMPLE_MS );  // Power on for the boot sequence
+#endif
+  I2C_statsReset( );                // Start the I2C statistics from now
+  status = bootSequence( &temp, &humid );  // Start the LCD and take the first reading
+  I2C_setSpeedLimits( I2C1, I2C_SPEED_MIN, I2C_SPEED_MAX );
+
+  if( crashed )                     // Show where the last crash happened
+  {
+    LCD_puts( "Fault " );
+    itoa( Crash_last.count, myString, 10 );
+    LCD_puts( myString );
+    if( crashed == CRASH_UNSAVED )  // The record is lost at the next power cycle
+      LCD_puts( " unsaved" );
+    LCD_cmd( LCD_2ND_LINE );
+    itoa( Crash_last.pc, myString, 16 );
+    LCD_puts( myString );
+    delay_us( 3e6 );
+  }
 
   while ( 1 )                           // Repeat this block forever
   {
   LCD_cmd( LCD_CLEAR );         // Clear the LCD screen
-    //AHT10_readSensorData( gotData );  // Get data from sensor
-    AHT10_getTempHumid100( &temp100, &humid100  );
+    if( status == AHT10_ERROR )
+    {
+      LCD_puts( "Sensor" );             // The sensor did not answer. Show the error, then
+      LCD_cmd( LCD_2ND_LINE );          // re-initialize it and try again.
+      LCD_puts( "error " );
+      LCD_putc( '0' + I2C_lastError );
+      I2C_lastError = I2C_OK;
+      delay_us( 2e6 );
+#ifdef AHT10_PWR_PIN
+      if( !Sensor_gated( &AHT10_sensor ))     // A gated sensor is initialized when it
+#endif                                        // is powered up. Keep the adapted speed.
+        AHT10_init( I2C1, I2C1_health.speed );
+      status = AHT10_read( &temp, &humid );
+      continue;
+    }
+    selfHeat( &temp, &humid );
+    if( ADC_lowVdd )                      // The supply fell below LOW_VDD_MV
+    {
+      LCD_puts( "Low batt" );
+      LCD_cmd( LCD_2ND_LINE );
+      itoa( ADC_vddMv( ), myString, 10 );
+      LCD_puts( myString );
+      LCD_puts( " mV" );
+      delay_us( 2e6 );
+      LCD_cmd( LCD_CLEAR );
+    }
+    temp100  = fix16_to100( temp );       // Temperature x 100, rounded
+    humid100 = fix16_round( humid );      // Humidity in whole percent, rounded
 
     // Separate out humidity and temperature data
     LCD_cmd( LCD_1ST_LINE );    // Position LCD to display temperature and humidity
@@ -162,32 +336,47 @@ main()
     LCD_puts( myString );           // which is equiv. to ( humidV / 10486 ).
     LCD_puts( " % RH " );           // Display % character and spaces to ensure the old
                                         // display is cleared.
+    if( !bootDisplayMs )
+      bootDisplayMs = SysTick_elapsed( SYSTICK_START_MS );
     delay_us( 4e6 );                  // Pause for a few seconds
 
     LCD_cmd( LCD_1ST_LINE );        // Display the temperature index value
     LCD_puts( " Feels  " );
     LCD_cmd( LCD_2ND_LINE );
     LCD_puts( "like " );
-    rTemp   = temp100 / 100;            // Get "real" floating point temperature value
-    rHumid  = humid100;                 // get "real" floating point humidity value
-    heatIdx = heatIndex ( rTemp, rHumid );  // Get heat index
+    heatIdx = heatIndex ( temp, humid );  // Get heat index
 
-    // Round floating heatIdx to nearest int
-    if( heatIdx < 0 )
-      heatIdx -= 0.5;
-    else
-      heatIdx += 0.5;
-    
-    itoa( (int)heatIdx, myString, 10 );  // Convert integer part of 
+    itoa( fix16_round( heatIdx ), myString, 10 );  // Convert heat index rounded to nearest
+                                                   // whole degree
     LCD_puts( myString );
     LCD_putc( 0xDF );
 
     delay_us( 5e6 );                    // Pause approx. 1:0 s between measurements. Excessive
                                         // measurements can lead to self-heating of the sensor.
     LCD_cmd( LCD_2ND_LINE );
-    outFuzzyHeatIndex( heatIdx );
+    outFuzzyHeatIndex( fix16_round( heatIdx ));
+
+    delay_us( 4e6 );
+
+    LCD_cmd( LCD_CLEAR );               // Display the dew point
+    LCD_cmd( LCD_1ST_LINE );
+    LCD_puts( "Dew pt  " );
+    LCD_cmd( LCD_2ND_LINE );
+    i100toa( fix16_to100( dewPoint( temp, humid )), myString );
+    LCD_puts( myString );
+    LCD_putc( ' ' );
+    LCD_putc( 0xDF );                   // Display the degree character
+    LCD_puts( "C" );
 
     delay_us( 4e6 );
+    status = AHT10_read( &temp, &humid );  // Get full-resolution readings
+
+    diagStackUsed = Stack_used( );
+    diagHeapUsed  = Heap_used( );
+    diagRamFree   = Stack_free( );
+    diagI2CLoad   = I2C_statsLoad( );
+    diagVddMv     = ADC_vddMv( );
+    diagDie100    = fix16_to100( ADC_dieTemp( ));
   }
   return 1;
 }
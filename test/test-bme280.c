@@ -0,0 +1,261 @@
+//  ==========================================================================================
+//  test/test-bme280.c
+//  ------------------------------------------------------------------------------------------
+//  Host test of STM32F030-BME280-lib.c:
+//    - BME280_compensate gives the results of the worked example in the Bosch datasheet
+//      (BMP280 datasheet section 3.12, the same temperature and pressure formulas):
+//      25.08 C and 100656 Pa with the 32-bit integer formulas.
+//    - Over the whole range of raw values, the integer results agree with the
+//      floating-point formulas of the BME280 datasheet (section 8.1) within 0.01 C,
+//      0.1 hPa and 0.02 %RH. A calibration with dig_P1 = 0 is rejected.
+//    - BME280_driver resets a simulated BME280 on the I2C1 model, reads its calibration,
+//      writes the configuration in one transaction, and takes a forced-mode reading.
+//  Run with "make test".
+//  ------------------------------------------------------------------------------------------
+//  https://github.com/EZdenki/STM32F030-CMSIS-I2C-AHT10-lib
+//  Released under the MIT License
+//  Copyright (c) 2023
+//  Mike Shegedin, EZdenki.com
+//  ==========================================================================================
+
+#include "STM32F030-Host-lib.c"         // Must come first
+#include "STM32F030-BME280-lib.c"       // Library under test
+#include <math.h>
+
+//  Calibration of the datasheet example. The humidity values are those of a real sensor,
+//  since the datasheet has no example for humidity.
+const BME280_Calib example =
+{
+  27504, 26435, -1000,
+  36477, -10685, 3024, 2855, 140, -7, 15500, -14600, 6000,
+  75, 0, 370, 306, 50, 30
+};
+
+uint8_t  bmeReg[ 256 ];                 // Registers of the simulated BME280
+uint8_t  bmePtr, bmePos;                // Register pointer, byte of the transaction
+uint32_t bmeWrites;                     // Write transactions
+uint8_t  bmeTxLen;                      // Bytes in the last write transaction
+uint64_t bmeReadyUs;                    // End of the conversion
+
+
+//  Simulated BME280. Writes are register address and data pairs; reads continue from the
+//  last register address. A write of BME280_FORCED to ctrl_meas starts a 9.3 ms conversion,
+//  shown by the measuring bit of the status register.
+static uint8_t
+bmeStart( uint8_t read )
+{
+  if( !read )
+  {
+    bmeWrites++;
+    bmeTxLen = 0;
+  }
+  bmePos = 0;
+  return 1;
+}
+
+
+static uint8_t
+bmeWrite( uint8_t data )
+{
+  if( bmePos++ & 1 )
+  {
+    bmeReg[ bmePtr ] = data;
+    if( bmePtr == BME280_CTRL_MEAS && ( data & 3 ) == BME280_FORCED )
+      bmeReadyUs = Host_us( ) + 9300;
+  }
+  else
+    bmePtr = data;
+  bmeTxLen++;
+  return 1;
+}
+
+
+static uint8_t
+bmeRead( void )
+{
+  if( bmePtr == BME280_STATUS )
+    return ( Host_us( ) < bmeReadyUs ) ? BME280_MEASURING : 0;
+  return bmeReg[ bmePtr++ ];
+}
+
+
+const Host_I2cDevice bmeDev = { BME280_ADD, bmeStart, bmeWrite, bmeRead, 0 };
+
+
+//  void
+//  bmeRaw( uint8_t *raw, int32_t adcP, int32_t adcT, int32_t adcH )
+//  Pack raw values as they are read from 0xF7 to 0xFE.
+static void
+bmeRaw( uint8_t *raw, int32_t adcP, int32_t adcT, int32_t adcH )
+{
+  raw[0] = adcP >> 12;
+  raw[1] = adcP >> 4;
+  raw[2] = adcP << 4;
+  raw[3] = adcT >> 12;
+  raw[4] = adcT >> 4;
+  raw[5] = adcT << 4;
+  raw[6] = adcH >> 8;
+  raw[7] = adcH;
+}
+
+
+//  void
+//  reference( const BME280_Calib *c, int32_t adcP, int32_t adcT, int32_t adcH,
+//             double *t, double *p, double *h )
+//  The floating-point compensation of the BME280 datasheet, section 8.1. p is in Pa.
+static void
+reference( const BME280_Calib *c, int32_t adcP, int32_t adcT, int32_t adcH,
+           double *t, double *p, double *h )
+{
+  double v1, v2, tFine;
+
+  v1    = ( adcT / 16384.0 - c->T1 / 1024.0 ) * c->T2;
+  v2    = ( adcT / 131072.0 - c->T1 / 8192.0 );
+  v2    = v2 * v2 * c->T3;
+  tFine = v1 + v2;
+  *t    = tFine / 5120.0;
+
+  v1 = tFine / 2.0 - 64000.0;
+  v2 = v1 * v1 * c->P6 / 32768.0;
+  v2 = v2 + v1 * c->P5 * 2.0;
+  v2 = v2 / 4.0 + c->P4 * 65536.0;
+  v1 = ( c->P3 * v1 * v1 / 524288.0 + c->P2 * v1 ) / 524288.0;
+  v1 = ( 1.0 + v1 / 32768.0 ) * c->P1;
+  *p = ( 1048576.0 - adcP - v2 / 4096.0 ) * 6250.0 / v1;
+  v1 = c->P9 * *p * *p / 2147483648.0;
+  v2 = *p * c->P8 / 32768.0;
+  *p = *p + ( v1 + v2 + c->P7 ) / 16.0;
+
+  v1 = tFine - 76800.0;
+  v1 = ( adcH - ( c->H4 * 64.0 + c->H5 / 16384.0 * v1 )) *
+       ( c->H2 / 65536.0 * ( 1.0 + c->H6 / 67108864.0 * v1 *
+                             ( 1.0 + c->H3 / 67108864.0 * v1 )));
+  v1 = v1 * ( 1.0 - c->H1 * v1 / 524288.0 );
+  *h = ( v1 > 100.0 ) ? 100.0 : ( v1 < 0.0 ) ? 0.0 : v1;
+}
+
+
+//  void
+//  testExample( void )
+//  The worked example of the datasheet, and a bad calibration.
+static void
+testExample( void )
+{
+  BME280_Calib   bad = example;
+  Sensor_Reading r   = { 0 };
+  uint8_t        raw[8];
+
+  bmeRaw( raw, 415148, 519888, 0 );
+  HOST_EQ( BME280_compensate( &example, raw, &r ), I2C_OK );
+  HOST_EQ( r.valid, SENSOR_TEMP | SENSOR_HUMID | SENSOR_PRESS );
+  HOST_EQ( fix16_to100( r.temp ), 2508 );
+  HOST_EQ( fix16_to100( r.press ), 100656 );
+  HOST_EQ( r.humid, 0 );
+
+  bad.P1  = 0;
+  r.valid = 0;
+  HOST_EQ( BME280_compensate( &bad, raw, &r ), SENSOR_BADDATA );
+  HOST_EQ( r.valid, 0 );
+}
+
+
+//  void
+//  testRange( void )
+//  Integer against floating-point results from -40 to 85 C, 300 to 1100 hPa and the full
+//  humidity range.
+static void
+testRange( void )
+{
+  Sensor_Reading r;
+  uint8_t        raw[8];
+  double         t, p, h, errT = 0, errP = 0, errH = 0;
+
+  for( int32_t adcT = 380000; adcT <= 640000; adcT += 2600 )
+    for( int32_t adcP = 200000; adcP <= 560000; adcP += 3600 )
+    {
+      int32_t adcH = 10000 + ( adcT + adcP ) % 50000;
+
+      bmeRaw( raw, adcP, adcT, adcH );
+      reference( &example, adcP, adcT, adcH, &t, &p, &h );
+      if( t < -40 || t > 85 || p < 30000 || p > 110000 )
+        continue;
+      HOST_EQ( BME280_compensate( &example, raw, &r ), I2C_OK );
+      errT = fmax( errT, fabs( r.temp  / 65536.0 - t ));
+      errP = fmax( errP, fabs( r.press / 65536.0 - p / 100 ));
+      errH = fmax( errH, fabs( r.humid / 65536.0 - h ));
+    }
+  HOST_CHECK( errT < 0.01 );
+  HOST_CHECK( errP < 0.1 );             // The 32-bit formula is off by up to 6 Pa
+  HOST_CHECK( errH < 0.02 );
+}
+
+
+//  void
+//  testDriver( void )
+//  Init and one reading through BME280_driver.
+static void
+testDriver( void )
+{
+  const BME280_Calib *c = &example;
+  BME280              state;
+  Sensor              s;
+  Sensor_Reading      r;
+  double              t, p, h;
+
+  // Calibration registers, in the order of the datasheet memory map
+  const uint16_t calib[12] = { c->T1, c->T2, c->T3, c->P1, c->P2, c->P3,
+                               c->P4, c->P5, c->P6, c->P7, c->P8, c->P9 };
+  for( uint8_t i = 0; i < 12; i++ )
+  {
+    bmeReg[ BME280_CALIB00 + 2 * i ]     = calib[ i ];
+    bmeReg[ BME280_CALIB00 + 2 * i + 1 ] = calib[ i ] >> 8;
+  }
+  bmeReg[ 0xA1 ] = c->H1;
+  bmeReg[ 0xE1 ] = c->H2;
+  bmeReg[ 0xE2 ] = c->H2 >> 8;
+  bmeReg[ 0xE3 ] = c->H3;
+  bmeReg[ 0xE4 ] = c->H4 >> 4;
+  bmeReg[ 0xE5 ] = ( c->H4 & 0x0F ) | ( c->H5 << 4 );
+  bmeReg[ 0xE6 ] = c->H5 >> 4;
+  bmeReg[ 0xE7 ] = c->H6;
+  bmeRaw( bmeReg + BME280_DATA, 415148, 519888, 30000 );
+
+  // Wrong chip id
+  memset( &state, 0, sizeof( state ));  // So that the padding compares equal below
+  Sensor_init( &s, &BME280_driver, I2C1, 0, 0, 0, BME280_ADD, &state, 5000 );
+  bmeReg[ BME280_ID ] = 0x58;           // BMP280
+  HOST_EQ( s.drv->init( &s ), SENSOR_BADDATA );
+
+  // Reset, then ctrl_hum and config together
+  bmeReg[ BME280_ID ] = BME280_CHIP_ID;
+  bmeWrites = 0;
+  HOST_EQ( s.drv->init( &s ), I2C_OK );
+  HOST_CHECK( !memcmp( &state.cal, c, sizeof( *c )));
+  HOST_EQ( bmeReg[ BME280_RESET ], BME280_RESET_CMD );
+  HOST_EQ( bmeReg[ BME280_CTRL_HUM ], BME280_OSRS_H );
+  HOST_EQ( bmeWrites, 5 );              // Reset, three register addresses, sync
+  HOST_EQ( bmeTxLen, 4 );
+
+  // Forced-mode reading
+  HOST_EQ( Sensor_read( &s, &r ), I2C_OK );
+  HOST_EQ( bmeReg[ BME280_CTRL_MEAS ],
+           BME280_OSRS_T << 5 | BME280_OSRS_P << 2 | BME280_FORCED );
+  reference( c, 415148, 519888, 30000, &t, &p, &h );
+  HOST_EQ( fix16_to100( r.temp ), 2508 );
+  HOST_EQ( fix16_to100( r.press ), 100656 );
+  HOST_CHECK( fabs( r.humid / 65536.0 - h ) < 0.02 );
+}
+
+
+int
+main( void )
+{
+  SysTick_init( );
+  I2C_init( I2C1, 100000 );
+  Host_i2cAttach( &bmeDev );
+
+  testExample( );
+  testRange( );
+  testDriver( );
+  return Host_summary( "test-bme280" );
+}
@@ -0,0 +1,173 @@
+//  ==========================================================================================
+//  test/test-convert.c
+//  ------------------------------------------------------------------------------------------
+//  Host test of the AHT10 conversion, the Q16.16 routines and i100toa:
+//    - Every one of the 2^20 raw temperature codes and every raw humidity code is packed
+//      into a 6-byte frame as the sensor sends it, converted by AHT10_convert and compared
+//      with the formula of the datasheet, and the results must follow the order of the
+//      codes.
+//    - Every int16_t value is formatted by i100toa and compared with a reference
+//      formatting. The output must fit in 7 characters.
+//    - Random operands check that the Q16.16 routines match double-precision math within
+//      their rounding.
+//  Run with "make test".
+//  ------------------------------------------------------------------------------------------
+//  https://github.com/EZdenki/STM32F030-CMSIS-I2C-AHT10-lib
+//  Released under the MIT License
+//  Copyright (c) 2023
+//  Mike Shegedin, EZdenki.com
+//  ==========================================================================================
+
+#include "STM32F030-Host-lib.c"         // Must come first
+#include "STM32F030-CMSIS-AHT10-lib.c"  // AHT10_convert, i100toa
+#include "STM32F030-Fixed-lib.c"        // Q16.16 routines
+
+#include <math.h>
+
+#define FUZZ_N 1000000                  // Random cases for each property
+
+uint32_t fuzzState = 0x12345678;        // Fixed seed, so that every run is the same
+
+
+//  uint32_t
+//  fuzz( void )
+//  xorshift32 pseudo-random numbers.
+static uint32_t
+fuzz( void )
+{
+  fuzzState ^= fuzzState << 13;
+  fuzzState ^= fuzzState >> 17;
+  fuzzState ^= fuzzState << 5;
+  return fuzzState;
+}
+
+
+//  void
+//  testRawCodes( void )
+//  All 2^20 codes of each reading, through AHT10_convert. The temperature code runs down
+//  while the humidity code runs up, so that the two halves of the shared byte data[3]
+//  differ. fix16_fromRaw20 truncates, so the result is within one Q16.16 step below the
+//  exact value.
+static void
+testRawCodes( void )
+{
+  fix16_t temp, humid, lastT = FIX16_MAX, lastH = FIX16_MIN;
+  int32_t temp100, humid100;
+  double  exactT, exactH;
+  uint32_t bad = 0;
+
+  for( uint32_t raw = 0; raw < ( 1UL << 20 ); raw++ )
+  {
+    uint32_t rawT = 0xFFFFF - raw;
+    uint8_t  frame[6] = { 0x19, raw >> 12, raw >> 4, ( raw & 0x0F ) << 4 | rawT >> 16,
+                          rawT >> 8, rawT };
+
+    exactT = rawT / 1048576.0 * 200 - 50;
+    exactH = raw / 1048576.0 * 100;
+
+    // Count failures here and check once, to keep the output short
+    if( AHT10_convert( frame, &temp, &humid ) != 0x19 )
+      bad++;
+    temp100  = fix16_to100( temp );
+    humid100 = fix16_round( humid );
+    if( exactT * 65536 - temp  < 0 || exactT * 65536 - temp  >= 1 ||
+        exactH * 65536 - humid < 0 || exactH * 65536 - humid >= 1 ||
+        temp > lastT || humid < lastH ||
+        labs( temp100 - lround( exactT * 100 )) > 1 ||
+        labs( humid100 - lround( exactH )) > 1 )
+    {
+      if( !bad++ )
+        fprintf( stderr, "raw %05X/%05X: temp %f humid %f\n", rawT, raw, temp / 65536.0,
+                 humid / 65536.0 );
+    }
+    lastT = temp;
+    lastH = humid;
+  }
+  HOST_EQ( bad, 0 );
+}
+
+
+//  void
+//  refI100( int16_t v, char *s )
+//  Reference for i100toa: v / 100 rounded to one decimal place, halves away from zero, and
+//  no sign on a result of zero.
+static void
+refI100( int16_t v, char *s )
+{
+  long a      = labs( (long)v );
+  long tenths = ( a + 5 ) / 10;
+
+  sprintf( s, "%s%ld.%ld", ( v < 0 && tenths ) ? "-" : "", tenths / 10, tenths % 10 );
+}
+
+
+//  void
+//  testI100toa( void )
+//  Every int16_t value. The buffer is filled with a marker first, to catch writes past
+//  the 7 characters that i100toa is documented to need.
+static void
+testI100toa( void )
+{
+  char     out[16], ref[16];
+  uint32_t bad = 0, overrun = 0;
+
+  for( int32_t v = -32768; v <= 32767; v++ )
+  {
+    memset( out, 0x5A, sizeof( out ));
+    i100toa( v, out );
+    refI100( v, ref );
+    if( strcmp( out, ref ) && !bad++ )
+      fprintf( stderr, "i100toa( %d ) = \"%s\", expected \"%s\"\n", v, out, ref );
+    for( uint8_t i = 7; i < sizeof( out ); i++ )
+      if( out[i] != 0x5A )
+        overrun++;
+  }
+  HOST_EQ( bad, 0 );
+  HOST_EQ( overrun, 0 );
+}
+
+
+//  void
+//  fuzzFixed( void )
+//  Random operands for the Q16.16 routines that the conversions build on.
+static void
+fuzzFixed( void )
+{
+  uint32_t bad = 0;
+
+  for( uint32_t i = 0; i < FUZZ_N; i++ )
+  {
+    fix16_t a  = fuzz( ), b = fuzz( );
+    double  da = a / 65536.0;
+    double  p  = floor( (double)a * b / 65536.0 );           // Rounds toward minus infinity
+    double  s  = (double)a + b;
+    int16_t v100 = fuzz( );
+
+    if( p > FIX16_MAX ) p = FIX16_MAX;
+    if( p < FIX16_MIN ) p = FIX16_MIN;
+    if( fix16_mul( a, b ) != p )
+      bad++;
+    if( s > FIX16_MAX ) s = FIX16_MAX;
+    if( s < FIX16_MIN ) s = FIX16_MIN;
+    if( fix16_add( a, b ) != s )
+      bad++;
+    if( fabs( fix16_from100( v100 ) / 65536.0 - v100 / 100.0 ) > 1.0 / 65536 )
+      bad++;
+    if( a < FIX16( 30000 ) && a > FIX16( -30000 ) &&
+        fix16_to100( a ) != (int32_t)floor( da * 100 + 0.5 ))
+      bad++;
+    if( a < FIX16_MAX - FIX16_ONE && fix16_round( a ) != (int32_t)floor( da + 0.5 ))
+      bad++;
+  }
+  HOST_EQ( bad, 0 );
+}
+
+
+int
+main( void )
+{
+  testRawCodes( );
+  testI100toa( );
+  fuzzFixed( );
+  return Host_summary( "test-convert" );
+}
@@ -0,0 +1,418 @@
+//  ==========================================================================================
+//  test/test-fusion.c
+//  ------------------------------------------------------------------------------------------
+//  Host test of STM32F030-Fusion-lib.c with simulated sensors:
+//    - The median of three sensors follows the majority. A sensor out of line is dropped
+//      after FUSION_DROP samples and rejoins after FUSION_REJOIN samples in agreement. A
+//      sensor that fails is dropped too.
+//    - Two sensors give the mean, and a disagreement drops neither of them. If every
+//      sensor is dropped, all readings are used.
+//    - Each field is voted over the sensors that measure it.
+//    - Fusion_ready waits for every sensor in the vote, but not for dropped ones.
+//    - The complementary filter moves by a of each step and jumps on a large one. The
+//      Kalman filter gives the gain and the output of the same filter in floating point.
+//    - Fusion_read starts and reads every sensor, and counts the ones that fail.
+//    - With Sensor_run, a sensor that fails a fetch is back in step with the others from
+//      the next sample on, so every later vote is over readings of the same period.
+//  Run with "make test".
+//  ------------------------------------------------------------------------------------------
+//  https://github.com/EZdenki/STM32F030-CMSIS-I2C-AHT10-lib
+//  Released under the MIT License
+//  Copyright (c) 2023
+//  Mike Shegedin, EZdenki.com
+//  ==========================================================================================
+
+#include "STM32F030-Host-lib.c"         // Must come first
+#include "STM32F030-Fusion-lib.c"       // Library under test
+#include <math.h>
+
+typedef struct
+{
+  fix16_t temp;                         // Temperature the sensor measures
+  uint8_t fail;                         // 1 to fail the start of a conversion
+  uint8_t failFetch;                    // Number of fetches to fail
+} Fake;
+
+Fake    fake[ FUSION_MAX ];
+Sensor  sensor[ FUSION_MAX ];
+Sensor *group[ FUSION_MAX ] = { &sensor[0], &sensor[1], &sensor[2], &sensor[3] };
+Fusion  f;
+
+
+//  A simulated sensor for Fusion_read and Sensor_run. The temperature comes from its Fake,
+//  and the humidity is always 50 %.
+static uint8_t
+fakeInit( Sensor *s )
+{
+  return I2C_OK;
+}
+
+
+static uint8_t
+fakeStart( Sensor *s )
+{
+  return ((Fake *)s->priv )->fail ? I2C_NACK : I2C_OK;
+}
+
+
+static uint8_t
+fakeFetch( Sensor *s, uint8_t *raw )
+{
+  Fake *fk = s->priv;
+
+  if( fk->failFetch )
+  {
+    fk->failFetch--;
+    return I2C_NACK;
+  }
+  return I2C_OK;
+}
+
+
+static uint8_t
+fakeDecode( Sensor *s, const uint8_t *raw, Sensor_Reading *r )
+{
+  r->temp  = ((Fake *)s->priv )->temp;
+  r->humid = FIX16( 50 );
+  r->valid = SENSOR_TEMP | SENSOR_HUMID;
+  return I2C_OK;
+}
+
+
+const Sensor_Driver fakeDriver =
+{
+  "Fake", SENSOR_TEMP | SENSOR_HUMID, 1, 0, 5, 0, fakeStart, 0, fakeFetch, fakeDecode, 0
+};
+
+//  The same sensor with the power-up and conversion times of an AHT10, for Sensor_run
+const Sensor_Driver runDriver =
+{
+  "Run", SENSOR_TEMP | SENSOR_HUMID, 1, 40, 75, fakeInit, fakeStart, 0, fakeFetch,
+  fakeDecode, 0
+};
+
+
+//  void
+//  setup( uint8_t n, uint8_t mode, fix16_t a, fix16_t b )
+//  Set up n simulated sensors and the fusion of them.
+static void
+setup( uint8_t n, uint8_t mode, fix16_t a, fix16_t b )
+{
+  for( uint8_t i = 0; i < n; i++ )
+  {
+    fake[i].temp = FIX16( 20 );
+    fake[i].fail = 0;
+    fake[i].failFetch = 0;
+    Sensor_init( &sensor[i], &fakeDriver, I2C1, 0, 0, 0, 0x38 + i, &fake[i], 1000 );
+  }
+  Fusion_init( &f, group, n, mode, a, b );
+}
+
+
+//  void
+//  give( uint8_t i, fix16_t temp )
+//  Give sensor i a fresh temperature and humidity reading.
+static void
+give( uint8_t i, fix16_t temp )
+{
+  sensor[i].reading.temp  = temp;
+  sensor[i].reading.humid = FIX16( 50 );
+  sensor[i].reading.valid = SENSOR_TEMP | SENSOR_HUMID;
+  sensor[i].fresh         = 1;
+}
+
+
+//  void
+//  testVote( void )
+//  Majority voting, dropping and rejoining with three sensors.
+static void
+testVote( void )
+{
+  setup( 3, FUSION_MEDIAN, 0, 0 );
+
+  // Sensor 2 reads 10 degrees high: out of line, dropped after FUSION_DROP samples
+  for( uint8_t k = 0; k < FUSION_DROP; k++ )
+  {
+    HOST_EQ( f.m[2].dropped, 0 );
+    give( 0, FIX16( 20 ));
+    give( 1, FIX16( 21 ));
+    give( 2, FIX16( 31 ));
+    HOST_EQ( Fusion_update( &f ), 3 );
+    HOST_EQ( f.median.temp, FIX16( 21 ));
+    HOST_EQ( f.out.temp, FIX16( 21 ));
+    HOST_EQ( f.out.humid, FIX16( 50 ));
+    HOST_EQ( f.out.valid, SENSOR_TEMP | SENSOR_HUMID );
+    HOST_CHECK( !sensor[0].fresh && !sensor[1].fresh && !sensor[2].fresh );
+  }
+  HOST_EQ( f.m[2].dropped, 1 );
+  HOST_EQ( f.m[2].drops, 1 );
+  HOST_EQ( f.m[2].disagree, FUSION_DROP );
+  HOST_EQ( f.m[2].dev, FIX16( 10 ));
+  HOST_EQ( f.m[0].disagree + f.m[1].disagree, 0 );
+
+  // Without sensor 2, the median is the mean of the other two
+  give( 0, FIX16( 20 ));
+  give( 1, FIX16( 21 ));
+  give( 2, FIX16( 31 ));
+  HOST_EQ( Fusion_update( &f ), 2 );
+  HOST_EQ( f.median.temp, FIX16( 20.5 ));
+
+  // Back in line: rejoins after FUSION_REJOIN samples
+  for( uint8_t k = 0; k < FUSION_REJOIN; k++ )
+  {
+    HOST_EQ( f.m[2].dropped, 1 );
+    give( 0, FIX16( 20 ));
+    give( 1, FIX16( 21 ));
+    give( 2, FIX16( 20.75 ));
+    HOST_EQ( Fusion_update( &f ), 2 );
+  }
+  HOST_EQ( f.m[2].dropped, 0 );
+  give( 0, FIX16( 20 ));
+  give( 1, FIX16( 21 ));
+  give( 2, FIX16( 20.75 ));
+  HOST_EQ( Fusion_update( &f ), 3 );
+  HOST_EQ( f.median.temp, FIX16( 20.75 ));
+
+  // Sensor 0 fails: dropped after FUSION_DROP samples without a reading
+  for( uint8_t k = 0; k < FUSION_DROP; k++ )
+  {
+    give( 1, FIX16( 21 ));
+    give( 2, FIX16( 22 ));
+    HOST_EQ( Fusion_update( &f ), 2 );
+  }
+  HOST_EQ( f.m[0].dropped, 1 );
+  HOST_EQ( f.m[0].missed, FUSION_DROP );
+  HOST_EQ( f.median.temp, FIX16( 21.5 ));
+}
+
+
+//  void
+//  testTwo( void )
+//  Two sensors cannot outvote each other, and dropped sensors are used if all are dropped.
+static void
+testTwo( void )
+{
+  setup( 2, FUSION_MEDIAN, 0, 0 );
+  for( uint8_t k = 0; k < 2 * FUSION_DROP; k++ )
+  {
+    give( 0, FIX16( 20 ));
+    give( 1, FIX16( 24 ));
+    HOST_EQ( Fusion_update( &f ), 2 );
+    HOST_EQ( f.median.temp, FIX16( 22 ));
+  }
+  HOST_EQ( f.m[0].disagree, 2 * FUSION_DROP );
+  HOST_EQ( f.m[1].disagree, 2 * FUSION_DROP );
+  HOST_EQ( f.m[0].dropped + f.m[1].dropped, 0 );
+
+  // Both fail until they are dropped, then come back
+  for( uint8_t k = 0; k < FUSION_DROP; k++ )
+    HOST_EQ( Fusion_update( &f ), 0 );
+  HOST_CHECK( f.m[0].dropped && f.m[1].dropped );
+  HOST_EQ( f.out.temp, FIX16( 22 ));    // Not changed without readings
+  give( 1, FIX16( 23 ));
+  HOST_EQ( Fusion_update( &f ), 1 );
+  HOST_EQ( f.median.temp, FIX16( 23 ));
+}
+
+
+//  void
+//  testFields( void )
+//  Pressure from the one sensor that measures it.
+static void
+testFields( void )
+{
+  setup( 3, FUSION_MEDIAN, 0, 0 );
+  give( 0, FIX16( 20 ));
+  give( 1, FIX16( 21 ));
+  give( 2, FIX16( 22 ));
+  sensor[2].reading.press  = FIX16( 1013.25 );
+  sensor[2].reading.valid |= SENSOR_PRESS;
+  sensor[1].reading.valid  = SENSOR_TEMP;
+  sensor[2].reading.humid  = FIX16( 60 );
+  HOST_EQ( Fusion_update( &f ), 3 );
+  HOST_EQ( f.median.valid, SENSOR_TEMP | SENSOR_HUMID | SENSOR_PRESS );
+  HOST_EQ( f.median.press, FIX16( 1013.25 ));
+  HOST_EQ( f.median.humid, FIX16( 55 ));
+  HOST_EQ( f.median.temp, FIX16( 21 ));
+  HOST_EQ( f.m[2].disagree, 0 );
+}
+
+
+//  void
+//  testReady( void )
+//  Fusion_ready with fresh readings, errors and a dropped sensor.
+static void
+testReady( void )
+{
+  setup( 3, FUSION_MEDIAN, 0, 0 );
+  HOST_EQ( Fusion_ready( &f ), 0 );
+  give( 0, FIX16( 20 ));
+  give( 1, FIX16( 20 ));
+  HOST_EQ( Fusion_ready( &f ), 0 );
+  sensor[2].errors++;                   // A failed reading also counts as done
+  HOST_EQ( Fusion_ready( &f ), 1 );
+  Fusion_update( &f );
+  HOST_EQ( Fusion_ready( &f ), 0 );
+
+  f.m[2].dropped = 1;                   // Not waited for
+  give( 0, FIX16( 20 ));
+  give( 1, FIX16( 20 ));
+  HOST_EQ( Fusion_ready( &f ), 1 );
+  HOST_EQ( Fusion_update( &f ), 2 );
+
+  // An error of the dropped sensor does not end the wait for the others, which would
+  // charge them a missed sample
+  sensor[2].errors++;
+  HOST_EQ( Fusion_ready( &f ), 0 );
+  give( 0, FIX16( 20 ));
+  HOST_EQ( Fusion_ready( &f ), 0 );
+  give( 1, FIX16( 20 ));
+  HOST_EQ( Fusion_ready( &f ), 1 );
+  HOST_EQ( Fusion_update( &f ), 2 );
+  HOST_EQ( f.m[0].missed + f.m[1].missed, 0 );
+  HOST_EQ( f.m[0].bad + f.m[1].bad, 0 );
+
+  // With all of them dropped, the first one done is used
+  f.m[0].dropped = f.m[1].dropped = 1;
+  HOST_EQ( Fusion_ready( &f ), 0 );
+  sensor[2].errors++;
+  HOST_EQ( Fusion_ready( &f ), 1 );
+}
+
+
+//  void
+//  testFilters( void )
+//  The complementary filter step by step, and the Kalman filter against a floating-point
+//  version of the same filter.
+static void
+testFilters( void )
+{
+  const double a = 0.001, b = 0.01;
+  double       x = 0, p = 0;
+
+  setup( 1, FUSION_COMPL, FIX16( 0.25 ), 0 );
+  give( 0, FIX16( 20 ));
+  Fusion_update( &f );
+  HOST_EQ( f.out.temp, FIX16( 20 ));    // Starts at the first median
+  give( 0, FIX16( 21 ));
+  Fusion_update( &f );
+  HOST_EQ( f.out.temp, FIX16( 20.25 ));
+  give( 0, FIX16( 21 ));
+  Fusion_update( &f );
+  HOST_EQ( f.out.temp, FIX16( 20.4375 ));
+  give( 0, FIX16( 25 ));                // More than twice the tolerance: jump
+  Fusion_update( &f );
+  HOST_EQ( f.out.temp, FIX16( 25 ));
+
+  // Kalman filter on a reading that alternates by 0.2 degrees around 20
+  setup( 1, FUSION_KALMAN, FIX16( a ), FIX16( b ));
+  for( uint8_t k = 0; k < 50; k++ )
+  {
+    double z = ( k & 1 ) ? 20.1 : 19.9;
+
+    give( 0, (fix16_t)lround( z * 65536 ));
+    Fusion_update( &f );
+    if( k == 0 )
+    {
+      x = z;
+      p = b;
+    }
+    else
+    {
+      double g;
+
+      p += a;
+      g  = p / ( p + b );
+      x += g * ( z - x );
+      p -= g * p;
+    }
+  }
+  HOST_CHECK( fabs( f.out.temp / 65536.0 - x ) < 0.002 );
+  HOST_CHECK( fabs( f.est[0].p / 65536.0 - p ) < 0.0005 );
+  HOST_CHECK( fabs( f.out.temp / 65536.0 - 20 ) < 0.05 );   // Smoothed
+  HOST_EQ( f.out.humid, FIX16( 50 ));
+}
+
+
+//  void
+//  testRead( void )
+//  Blocking reads of all sensors, with one that fails.
+static void
+testRead( void )
+{
+  uint64_t start;
+
+  setup( 3, FUSION_MEDIAN, 0, 0 );
+  fake[0].temp = FIX16( 19 );
+  fake[1].temp = FIX16( 20 );
+  fake[2].temp = FIX16( 30 );
+  start = Host_us( );
+  HOST_EQ( Fusion_read( &f ), 3 );
+  HOST_CHECK( Host_us( ) - start >= fakeDriver.convMs * 1000 );
+  HOST_EQ( f.median.temp, FIX16( 20 ));
+  HOST_EQ( f.m[2].disagree, 1 );
+
+  fake[1].fail = 1;
+  HOST_EQ( Fusion_read( &f ), 2 );
+  HOST_EQ( sensor[1].errors, 1 );
+  HOST_EQ( sensor[1].status, I2C_NACK );
+  HOST_EQ( f.m[1].missed, 1 );
+  HOST_EQ( f.median.temp, FIX16( 24.5 ));
+}
+
+
+//  void
+//  testRun( void )
+//  Three sensors with the same period under Sensor_run. Sensor 0 fails its first fetch.
+//  That vote goes ahead without it, and from the next sample on it is started together
+//  with the others again, so no vote uses a reading from an earlier period.
+static void
+testRun( void )
+{
+  uint8_t  updates = 0;
+  uint32_t end;
+
+  for( uint8_t i = 0; i < 3; i++ )
+  {
+    fake[i].temp      = FIX16( 20 );
+    fake[i].fail      = 0;
+    fake[i].failFetch = 0;
+    Sensor_init( &sensor[i], &runDriver, I2C1, 0, 0, 0, 0x38 + i, &fake[i], 10000 );
+  }
+  Fusion_init( &f, group, 3, FUSION_MEDIAN, 0, 0 );
+  fake[0].failFetch = 1;
+
+  end = SysTick_ms( ) + 50000;
+  while( !SysTick_reached( end ))
+  {
+    Sensor_run( group, 3 );
+    if( Fusion_ready( &f ))
+    {
+      for( uint8_t i = 0; i < 3; i++ )
+        if( sensor[i].fresh )
+          HOST_EQ( sensor[i].startMs, sensor[1].startMs );   // Same period
+      HOST_EQ( Fusion_update( &f ), updates ? 3 : 2 );
+      updates++;
+    }
+    __WFI( );
+  }
+  HOST_EQ( updates, 5 );
+  HOST_EQ( sensor[0].errors, 1 );
+  HOST_EQ( f.m[0].missed, 1 );
+  HOST_EQ( f.m[0].dropped, 0 );
+}
+
+
+int
+main( void )
+{
+  SysTick_init( );
+  testVote( );
+  testTwo( );
+  testFields( );
+  testReady( );
+  testFilters( );
+  testRead( );
+  testRun( );
+  return Host_summary( "test-fusion" );
+}
@@ -0,0 +1,570 @@
+//  ==========================================================================================
+//  test/test-i2c.c
+//  ------------------------------------------------------------------------------------------
+//  Host test of STM32F030-CMSIS-I2C-lib.c against the I2C1 model of STM32F030-Host-lib.c:
+//    - Writes and reads reach a simulated device, take the time the bus speed gives them,
+//      and are recorded in the trace.
+//    - Every error path, with the faults of Host_i2cFault: a NACK of the address or of a
+//      data byte, a bus error, arbitration loss, a clock stretch longer than the timeout,
+//      and a device that holds SDA low, which only I2C_recover can free.
+//    - After each fault, the status returned, I2C_lastError, the counts in I2C1_health and
+//      the trace record all agree, and the next transaction works.
+//    - The channel cache of STM32F030-I2C-Dev-lib.c, with two simulated TCA9548As: a
+//      selection is only written when the channel changes, and is forgotten after an error.
+//    - I2C_batchRun runs the jobs of the selected channel first, then one channel after the
+//      other, and switches a multiplexer off before moving to the next, so that a device
+//      address used behind both only ever answers once.
+//    - The statistics of I2C_STATS against the virtual clock: the counts, bytes, longest
+//      time and histogram bucket of each device, the transactions of devices that do not
+//      fit, the busy time and the bus load.
+//  Run with "make test".
+//  ------------------------------------------------------------------------------------------
+//  https://github.com/EZdenki/STM32F030-CMSIS-I2C-AHT10-lib
+//  Released under the MIT License
+//  Copyright (c) 2023
+//  Mike Shegedin, EZdenki.com
+//  ==========================================================================================
+
+#define I2C_TRACE                       // Test the trace records too
+#define I2C_STATS                       // And the statistics
+
+#include "STM32F030-Host-lib.c"         // Must come first
+#include "STM32F030-CMSIS-I2C-lib.c"    // Library under test
+#include "STM32F030-I2C-Dev-lib.c"      // Multiplexers and batches under test
+
+#define DEV_ADD 0x38                    // Address of the simulated device
+#define MUX_ADD 0x70                    // Addresses of the simulated multiplexers
+#define TWIN_ADD 0x40                   // Address of a sensor behind each multiplexer
+
+uint8_t devMem[ 16 ];                   // Bytes written to the device, and read back
+uint8_t devWritten, devRead, devStops;
+uint32_t results[ 5 ];                  // Expected I2C1_health.results
+
+
+//  Simulated device: stores the bytes written to it, and sends them back when read.
+static uint8_t
+devStart( uint8_t read )
+{
+  if( read )
+    devRead = 0;
+  else
+    devWritten = 0;
+  return 1;
+}
+
+
+static uint8_t
+devWrite( uint8_t data )
+{
+  devMem[ devWritten++ & 15 ] = data;
+  return 1;
+}
+
+
+static uint8_t
+devReadByte( void )
+{
+  return devMem[ devRead++ & 15 ];
+}
+
+
+static void
+devStop( void )
+{
+  devStops++;
+}
+
+
+const Host_I2cDevice dev = { DEV_ADD, devStart, devWrite, devReadByte, devStop };
+
+uint8_t muxCtl[ 2 ];                    // Control register of each multiplexer
+uint8_t muxWrites[ 2 ];                 // Control register writes to each multiplexer
+uint8_t muxCur;                         // Multiplexer addressed by the transaction
+uint8_t twinHits[ 2 ];                  // Writes to the sensor behind each multiplexer
+uint8_t twinCur;                        // Sensor that answered the transaction
+uint8_t twinClashes;                    // Transactions that reached both sensors
+
+
+//  Simulated TCA9548As at MUX_ADD and MUX_ADD + 1: a write sets the control register.
+//  A sensor at TWIN_ADD is on channel 2 of the first and on channel 5 of the second.
+static uint8_t
+mux0Start( uint8_t read )
+{
+  muxCur = 0;
+  return 1;
+}
+
+
+static uint8_t
+mux1Start( uint8_t read )
+{
+  muxCur = 1;
+  return 1;
+}
+
+
+static uint8_t
+muxWrite( uint8_t data )
+{
+  muxCtl[ muxCur ] = data;
+  muxWrites[ muxCur ]++;
+  return 1;
+}
+
+
+static uint8_t
+twinStart( uint8_t read )
+{
+  uint8_t on0 = ( muxCtl[0] & ( 1 << 2 )) != 0;
+  uint8_t on1 = ( muxCtl[1] & ( 1 << 5 )) != 0;
+
+  if( on0 && on1 )
+    twinClashes++;
+  twinCur = on1;
+  return on0 || on1;
+}
+
+
+static uint8_t
+twinWrite( uint8_t data )
+{
+  twinHits[ twinCur ]++;
+  return 1;
+}
+
+
+const Host_I2cDevice mux0Dev = { MUX_ADD,     mux0Start, muxWrite,  0, 0 };
+const Host_I2cDevice mux1Dev = { MUX_ADD + 1, mux1Start, muxWrite,  0, 0 };
+const Host_I2cDevice twinDev = { TWIN_ADD,    twinStart, twinWrite, 0, 0 };
+
+I2C_Mux mux[ 2 ];
+I2C_Dev twin[ 2 ];                      // The sensor behind each multiplexer
+I2C_Dev empty;                          // Channel 6 of the first multiplexer, with nothing
+uint8_t jobOrder[ 8 ], jobs;            // Devices in the order their jobs ran
+
+
+//  uint8_t *
+//  lastRecord( void )
+//  The last record in the trace.
+static uint8_t *
+lastRecord( void )
+{
+  uint16_t rec = 0, last = 0;
+
+  while( rec < I2C_traceLen )
+  {
+    last = rec;
+    rec += I2C_TRACE_HDR + I2C_traceBuf[ rec + 1 ];
+  }
+  return I2C_traceBuf + last;
+}
+
+
+//  void
+//  checkFault( uint8_t status, uint8_t expect, uint8_t traceBit )
+//  A transaction returned status: It must be expect, and be recorded as such.
+static void
+checkFault( uint8_t status, uint8_t expect, uint8_t traceBit )
+{
+  results[ expect ]++;
+  HOST_EQ( status, expect );
+  if( expect != I2C_OK )
+    HOST_EQ( I2C_lastError, expect );
+  HOST_CHECK( !memcmp( I2C1_health.results, results, sizeof( results )));
+  HOST_EQ( lastRecord( )[2], traceBit );
+}
+
+
+//  void
+//  checkBus( void )
+//  The bus works: a write and a read back.
+static void
+checkBus( void )
+{
+  const uint8_t out[3] = { 0x11, 0x22, 0x33 };
+  uint8_t       in[3]  = { 0 };
+
+  checkFault( I2C_writeN( I2C1, DEV_ADD, out, 3 ), I2C_OK, 0 );
+  checkFault( I2C_readN( I2C1, DEV_ADD, in, 3 ), I2C_OK, 0 );
+  HOST_CHECK( !memcmp( in, out, 3 ));
+}
+
+
+//  void
+//  testTransfers( void )
+//  Normal transactions, their timing and their trace records.
+static void
+testTransfers( void )
+{
+  const uint8_t out[4] = { 0xAC, 0x33, 0x00, 0x5A };
+  uint8_t       in[4]  = { 0 };
+  uint8_t       stops  = devStops;
+  uint64_t      t      = Host_us( );
+  uint16_t      us;
+
+  I2C_traceReset( );
+  HOST_EQ( I2C_writeN( I2C1, DEV_ADD, out, 4 ), I2C_OK );
+  HOST_EQ( devWritten, 4 );
+  HOST_CHECK( !memcmp( devMem, out, 4 ));
+
+  // 100 kHz: START, 9-bit address and 4 x 9 bits, STOP = 48 bits of approx. 9 us each
+  t  = Host_us( ) - t;
+  us = I2C_traceBuf[5] | ( I2C_traceBuf[6] << 8 );
+  HOST_CHECK( t > 400 && t < 520 );
+  HOST_CHECK( us > 400 && us <= t );
+
+  HOST_EQ( I2C_readN( I2C1, DEV_ADD, in, 4 ), I2C_OK );
+  HOST_CHECK( !memcmp( in, out, 4 ));
+  HOST_EQ( devStops, stops + 2 );
+
+  // Trace: write record, then read record with the same 4 bytes
+  HOST_EQ( I2C_traceLen, 2 * ( I2C_TRACE_HDR + 4 ));
+  HOST_EQ( I2C_traceBuf[0], DEV_ADD );
+  HOST_EQ( I2C_traceBuf[1], 4 );
+  HOST_EQ( I2C_traceBuf[2], 0 );
+  HOST_CHECK( !memcmp( I2C_traceBuf + I2C_TRACE_HDR, out, 4 ));
+  HOST_EQ( I2C_traceBuf[11], DEV_ADD | 0x80 );
+  HOST_EQ( I2C_traceBuf[12], 4 );
+  HOST_EQ( I2C_traceBuf[13], 0 );
+  HOST_CHECK( !memcmp( I2C_traceBuf + 11 + I2C_TRACE_HDR, out, 4 ));
+
+  // 400 kHz takes well under a third of the time
+  I2C_setSpeed( I2C1, 400000 );
+  t = Host_us( );
+  HOST_EQ( I2C_writeN( I2C1, DEV_ADD, out, 4 ), I2C_OK );
+  t = Host_us( ) - t;
+  HOST_CHECK( t > 50 && t < 140 );
+  I2C_setSpeed( I2C1, 100000 );
+}
+
+
+//  void
+//  testErrors( void )
+//  NACK, bus error and arbitration loss. These end at once, without a timeout.
+static void
+testErrors( void )
+{
+  const uint8_t out[3] = { 1, 2, 3 };
+  uint8_t       in[3];
+  uint64_t      t;
+
+  I2C_traceReset( );
+  memcpy( results, I2C1_health.results, sizeof( results ));
+  t = Host_us( );
+  checkFault( I2C_writeN( I2C1, 0x50, out, 3 ), I2C_NACK, I2C_TRACE_NACK );  // No device
+  HOST_CHECK( Host_us( ) - t < 200 );
+  checkFault( I2C_readN( I2C1, 0x50, in, 3 ), I2C_NACK, I2C_TRACE_NACK );
+  checkBus( );
+
+  Host_i2cFault( HOST_FAULT_NACK, 2, 0 );               // Second data byte
+  checkFault( I2C_writeN( I2C1, DEV_ADD, out, 3 ), I2C_NACK, I2C_TRACE_NACK );
+  HOST_EQ( devWritten, 1 );
+  checkBus( );
+
+  Host_i2cFault( HOST_FAULT_BERR, 1, 0 );
+  checkFault( I2C_writeN( I2C1, DEV_ADD, out, 3 ), I2C_BUSERR, I2C_TRACE_BERR );
+  checkBus( );
+
+  Host_i2cFault( HOST_FAULT_ARLO, 0, 0 );               // During the address of a read
+  checkFault( I2C_readN( I2C1, DEV_ADD, in, 3 ), I2C_ARLO, I2C_TRACE_ARLO );
+  checkBus( );
+
+  Host_i2cFault( HOST_FAULT_ARLO, 3, 0 );               // Last byte of a read
+  checkFault( I2C_readN( I2C1, DEV_ADD, in, 3 ), I2C_ARLO, I2C_TRACE_ARLO );
+  HOST_EQ( lastRecord( )[1], 2 );                      // 2 bytes were read
+  checkBus( );
+  HOST_EQ( Host_sclPulses, 0 );                         // None of these needs a recovery
+}
+
+
+//  void
+//  testTimeouts( void )
+//  A stretch beyond I2C_TIMEOUT_US ends in I2C_waitISR, a device that holds SDA low in
+//  I2C_waitCR2Clear. Both are recorded as timeouts, and I2C_recover frees the bus.
+static void
+testTimeouts( void )
+{
+  const uint8_t out[3] = { 1, 2, 3 };
+  uint8_t       in[3];
+  uint64_t      t;
+
+  I2C_traceReset( );
+
+  // A stretch that ends before the timeout only slows the transaction down
+  Host_i2cFault( HOST_FAULT_STRETCH, 2, 5000 );
+  t = Host_us( );
+  checkFault( I2C_writeN( I2C1, DEV_ADD, out, 3 ), I2C_OK, 0 );
+  HOST_CHECK( Host_us( ) - t > 5000 );
+
+  // Too long: I2C_waitISR times out. No pulses are needed, since SDA is free.
+  Host_i2cFault( HOST_FAULT_STRETCH, 1, I2C_TIMEOUT_US + 5000 );
+  t = Host_us( );
+  checkFault( I2C_writeN( I2C1, DEV_ADD, out, 3 ), I2C_TIMEOUT, I2C_TRACE_TIMEOUT );
+  HOST_CHECK( Host_us( ) - t >= I2C_TIMEOUT_US );
+  HOST_EQ( Host_sclPulses, 0 );
+  checkBus( );
+
+  // SDA stuck low during a read: the read and then the STOP time out, and 3 pulses free it
+  Host_i2cFault( HOST_FAULT_STUCK, 2, 3 );
+  t = Host_us( );
+  checkFault( I2C_readN( I2C1, DEV_ADD, in, 3 ), I2C_TIMEOUT, I2C_TRACE_TIMEOUT );
+  HOST_CHECK( Host_us( ) - t >= 2 * I2C_TIMEOUT_US );
+  HOST_EQ( Host_sclPulses, 3 );
+  HOST_EQ( Host_i2c.stuck, 0 );
+  checkBus( );
+
+  // Stuck before the START: I2C_waitCR2Clear times out. 12 pulses need two recoveries.
+  Host_sclPulses = 0;
+  Host_i2cFault( HOST_FAULT_STUCK, 0, 12 );
+  checkFault( I2C_writeN( I2C1, DEV_ADD, out, 3 ), I2C_TIMEOUT, I2C_TRACE_TIMEOUT );
+  HOST_EQ( Host_sclPulses, 9 );
+  checkFault( I2C_writeN( I2C1, DEV_ADD, out, 3 ), I2C_TIMEOUT, I2C_TRACE_TIMEOUT );
+  HOST_EQ( Host_sclPulses, 12 );
+  checkBus( );
+}
+
+
+//  void
+//  testMuxCache( void )
+//  Selections are written once per channel change, and forgotten after an error.
+static void
+testMuxCache( void )
+{
+  const uint8_t cmd = 0xAC;
+
+  I2C_traceReset( );
+  I2C_muxInit( &mux[0], I2C1, 0, MUX_ADD );
+  I2C_muxInit( &mux[1], I2C1, 0, MUX_ADD + 1 );
+  I2C_devInit( &twin[0], 0, 0, &mux[0], 2, TWIN_ADD );
+  I2C_devInit( &twin[1], 0, 0, &mux[1], 5, TWIN_ADD );
+  I2C_devInit( &empty, 0, 0, &mux[0], 6, TWIN_ADD );
+  HOST_CHECK( twin[0].hw == I2C1 );
+  HOST_EQ( mux[0].known, 0 );
+
+  // The first access writes the selection, the next ones skip it
+  HOST_EQ( I2C_devWrite( &twin[0], &cmd, 1 ), I2C_OK );
+  HOST_EQ( muxCtl[0], 1 << 2 );
+  HOST_EQ( mux[0].known, 1 );
+  HOST_EQ( mux[0].control, 1 << 2 );
+  HOST_EQ( I2C_devWrite( &twin[0], &cmd, 1 ), I2C_OK );
+  HOST_EQ( muxWrites[0], 1 );
+  HOST_EQ( mux[0].muxSelects, 1 );
+  HOST_EQ( mux[0].muxSkips, 1 );
+  HOST_EQ( twinHits[0], 2 );
+
+  // A NACK behind the multiplexer forgets the channel, so the next access writes it again
+  HOST_EQ( I2C_devWrite( &empty, &cmd, 1 ), I2C_NACK );
+  HOST_EQ( muxCtl[0], 1 << 6 );
+  HOST_EQ( mux[0].known, 0 );
+  HOST_EQ( I2C_devWrite( &twin[0], &cmd, 1 ), I2C_OK );
+  HOST_EQ( muxWrites[0], 3 );
+  HOST_EQ( mux[0].known, 1 );
+  HOST_EQ( twinHits[0], 3 );
+
+  // The other multiplexer switches the first one off before it selects a channel. If the
+  // first one does not answer, the channel is not selected, and the switch-off is tried
+  // again the next time.
+  HOST_CHECK( I2C_muxActive == &mux[0] );
+  Host_i2cFault( HOST_FAULT_NACK, 0, 0 );
+  HOST_EQ( I2C_muxSelect( &mux[1], 5 ), I2C_NACK );
+  HOST_EQ( mux[0].known, 0 );
+  HOST_EQ( mux[1].muxSelects, 0 );
+  HOST_EQ( muxCtl[0], 1 << 2 );
+  HOST_CHECK( I2C_muxActive == &mux[0] );
+  HOST_EQ( I2C_devWrite( &twin[1], &cmd, 1 ), I2C_OK );
+  HOST_EQ( muxCtl[0], 0 );
+  HOST_EQ( muxCtl[1], 1 << 5 );
+  HOST_CHECK( I2C_muxActive == &mux[1] );
+  HOST_EQ( twinHits[1], 1 );
+
+  // Switching off all channels
+  HOST_EQ( I2C_muxSelect( &mux[1], I2C_MUX_NONE ), I2C_OK );
+  HOST_EQ( mux[1].known, 1 );
+  HOST_EQ( mux[1].control, 0 );
+  HOST_CHECK( I2C_muxActive == 0 );
+  HOST_EQ( I2C_writeN( I2C1, TWIN_ADD, &cmd, 1 ), I2C_NACK );  // Nothing connected
+  HOST_EQ( twinClashes, 0 );
+}
+
+
+//  uint8_t
+//  job( I2C_Dev *d, void *arg )
+//  Batch job: note the device, and write to it unless it is the empty channel.
+static uint8_t
+job( I2C_Dev *d, void *arg )
+{
+  const uint8_t cmd = 0xAC;
+
+  jobOrder[ jobs++ ] = (uint8_t)(uintptr_t)arg;
+  return ( d == &empty ) ? I2C_OK : I2C_devWrite( d, &cmd, 1 );
+}
+
+
+//  void
+//  testBatch( void )
+//  Grouping by channel and switching between the two multiplexers.
+static void
+testBatch( void )
+{
+  I2C_Batch batch = { 0, 0 };
+
+  // Channel 2 of the first multiplexer is selected, so its jobs run first, then channel 6
+  jobs = 0;
+  HOST_EQ( I2C_muxSelect( &mux[0], 2 ), I2C_OK );
+  HOST_CHECK( I2C_batchAdd( &batch, &empty,   job, (void *)6 ));
+  HOST_CHECK( I2C_batchAdd( &batch, &twin[0], job, (void *)2 ));
+  HOST_CHECK( I2C_batchAdd( &batch, &empty,   job, (void *)7 ));
+  HOST_CHECK( I2C_batchAdd( &batch, &twin[0], job, (void *)3 ));
+  muxWrites[0] = 0;
+  HOST_EQ( I2C_batchRun( &batch ), 0 );
+  HOST_EQ( jobs, 4 );
+  HOST_CHECK( !memcmp( jobOrder, "\2\3\6\7", 4 ));
+  HOST_EQ( muxWrites[0], 1 );
+  HOST_EQ( muxCtl[0], 1 << 6 );
+  HOST_CHECK( !batch.first );
+
+  // The same address behind both: each job reaches only its own sensor
+  jobs = 0;
+  twinHits[0] = twinHits[1] = 0;
+  HOST_CHECK( I2C_batchAdd( &batch, &twin[1], job, (void *)1 ));
+  HOST_CHECK( I2C_batchAdd( &batch, &twin[0], job, (void *)0 ));
+  HOST_CHECK( I2C_batchAdd( &batch, &twin[1], job, (void *)1 ));
+  HOST_CHECK( I2C_batchAdd( &batch, &twin[0], job, (void *)0 ));
+  HOST_EQ( I2C_batchRun( &batch ), 0 );
+  HOST_CHECK( !memcmp( jobOrder, "\1\1\0\0", 4 ));
+  HOST_EQ( twinHits[0], 2 );
+  HOST_EQ( twinHits[1], 2 );
+  HOST_EQ( muxCtl[1], 0 );              // Switched off before the first one was used
+  HOST_EQ( muxCtl[0], 1 << 2 );
+
+  // And back again
+  jobs = 0;
+  HOST_CHECK( I2C_batchAdd( &batch, &twin[1], job, (void *)1 ));
+  HOST_CHECK( I2C_batchAdd( &batch, &twin[0], job, (void *)0 ));
+  HOST_EQ( I2C_batchRun( &batch ), 0 );
+  HOST_CHECK( !memcmp( jobOrder, "\1\0", 2 ));
+  HOST_EQ( twinHits[0], 3 );
+  HOST_EQ( twinHits[1], 3 );
+  HOST_EQ( twinClashes, 0 );
+  HOST_EQ( I2C_jobPool.used, 0 );
+}
+
+
+//  uint8_t
+//  bucket( uint32_t us )
+//  Histogram bucket of a transaction of us microseconds: log2( us ), at most the last one.
+static uint8_t
+bucket( uint32_t us )
+{
+  uint8_t k = 0;
+
+  while(( us >>= 1 ) && k < I2C_STATS_BUCKETS - 1 )
+    k++;
+  return k;
+}
+
+
+//  uint32_t
+//  timed( uint8_t status, uint8_t expect, uint64_t start )
+//  Check the status of a transaction that started at start, and return its time in us.
+static uint32_t
+timed( uint8_t status, uint8_t expect, uint64_t start )
+{
+  HOST_EQ( status, expect );
+  return Host_us( ) - start;
+}
+
+
+//  void
+//  testStats( void )
+//  Transactions of known length on the virtual clock, and what the statistics make of them.
+static void
+testStats( void )
+{
+  const uint8_t out[4] = { 1, 2, 3, 4 };
+  uint8_t       in[4];
+  uint32_t      us[4], busy, sum = 0;
+  uint32_t      hist[ I2C_STATS_BUCKETS ] = { 0 };
+  uint64_t      t;
+
+  I2C_traceReset( );
+  I2C_statsReset( );
+  HOST_EQ( I2C_stats.startMs, SysTick_ms( ));
+  HOST_EQ( I2C_statsLoad( ), 0 );
+
+  t = Host_us( );
+  us[0] = timed( I2C_writeN( I2C1, DEV_ADD, out, 4 ), I2C_OK, t );
+  t = Host_us( );
+  us[1] = timed( I2C_readN( I2C1, DEV_ADD, in, 2 ), I2C_OK, t );
+  t = Host_us( );
+  us[2] = timed( I2C_writeN( I2C1, 0x50, out, 4 ), I2C_NACK, t );
+  Host_i2cFault( HOST_FAULT_STRETCH, 1, 5000 );
+  t = Host_us( );
+  us[3] = timed( I2C_writeN( I2C1, DEV_ADD, out, 4 ), I2C_OK, t );
+  HOST_CHECK( us[3] > 5000 );
+
+  // The device in dev[0], the address that was not acknowledged in dev[1]
+  HOST_EQ( I2C_stats.bytes, 4 + 2 + 4 );
+  HOST_EQ( I2C_stats.dev[0].address, DEV_ADD );
+  HOST_EQ( I2C_stats.dev[0].count, 3 );
+  HOST_EQ( I2C_stats.dev[0].errors, 0 );
+  HOST_CHECK( I2C_stats.dev[0].maxUs + 1 >= us[3] && I2C_stats.dev[0].maxUs <= us[3] + 1 );
+  hist[ bucket( us[0] ) ]++;
+  hist[ bucket( us[1] ) ]++;
+  hist[ bucket( us[3] ) ]++;
+  HOST_CHECK( !memcmp( I2C_stats.dev[0].hist, hist, sizeof( hist )));
+  HOST_EQ( bucket( us[3] ), I2C_STATS_BUCKETS - 1 );   // 5 ms goes in the last bucket
+  HOST_EQ( I2C_stats.dev[1].address, 0x50 );
+  HOST_EQ( I2C_stats.dev[1].count, 1 );
+  HOST_EQ( I2C_stats.dev[1].errors, 1 );
+  HOST_EQ( I2C_stats.dev[1].hist[ bucket( us[2] ) ], 1 );
+  HOST_EQ( I2C_stats.dropped, 0 );
+
+  // Busy time: the sum of the transactions, to within a microsecond each
+  for( uint8_t i = 0; i < 4; i++ )
+    sum += us[i];
+  busy = I2C_stats.busyMs * 1000 + I2C_stats.busyUs;
+  HOST_CHECK( I2C_stats.busyUs < 1000 );
+  HOST_CHECK( busy + 4 >= sum && busy <= sum + 4 );
+
+  // Two more addresses fill dev[], and the one after that is only counted as dropped
+  I2C_writeN( I2C1, 0x51, out, 1 );
+  I2C_writeN( I2C1, 0x52, out, 1 );
+  I2C_writeN( I2C1, 0x53, out, 1 );
+  I2C_writeN( I2C1, 0x53, out, 1 );
+  HOST_EQ( I2C_stats.dev[3].address, 0x52 );
+  HOST_EQ( I2C_stats.dropped, 2 );
+
+  // Load: the busy time over the wall time since the reset, in tenths of a percent
+  I2C_traceReset( );
+  I2C_statsReset( );
+  for( uint8_t i = 0; i < 20; i++ )
+    I2C_writeN( I2C1, DEV_ADD, out, 4 );
+  busy = I2C_stats.busyMs * 1000 + I2C_stats.busyUs;
+  delay_us( 100000 - SysTick_elapsed( I2C_stats.startMs ) * 1000 );
+  HOST_EQ( SysTick_elapsed( I2C_stats.startMs ), 100 );
+  HOST_EQ( I2C_statsLoad( ), I2C_stats.busyMs * 1000 / 100 );
+  HOST_CHECK( busy > 8000 && busy < 11000 );          // Approx. 470 us each
+  HOST_CHECK( I2C_statsLoad( ) >= 80 && I2C_statsLoad( ) <= 110 );
+}
+
+
+int
+main( void )
+{
+  SysTick_init( );
+  I2C_init( I2C1, 100000 );
+  Host_i2cAttach( &dev );
+  Host_i2cAttach( &mux0Dev );
+  Host_i2cAttach( &mux1Dev );
+  Host_i2cAttach( &twinDev );
+
+  testTransfers( );
+  testErrors( );
+  testTimeouts( );
+  testMuxCache( );
+  testBatch( );
+  testStats( );
+  HOST_EQ( I2C_traceDropped, 0 );
+  return Host_summary( "test-i2c" );
+}
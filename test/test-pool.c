@@ -0,0 +1,193 @@
+//  ==========================================================================================
+//  test/test-pool.c
+//  ------------------------------------------------------------------------------------------
+//  Host test of STM32F030-Pool-lib.c, built with POOL_DEBUG:
+//    - A pool hands out every block once, word-aligned and without overlap, and then fails
+//      until a block is freed. used, peak and fails follow.
+//    - Freed blocks are handed out again, the last one freed first, and a null pointer is
+//      ignored.
+//    - Freeing a block twice, a pointer into the middle of a block, a block that was never
+//      handed out or a pointer from outside the pool is counted in errors and ignored.
+//    - A write to a freed block is found when the block is allocated again.
+//    - A block that is too small to hold anything but the free list link still gets a
+//      poisoned word, so freeing it twice is found.
+//    - PRIMASK is the same after each call as before it.
+//  Run with "make test".
+//  ==========================================================================================
+
+#define POOL_DEBUG                      // Check the frees and the freed blocks
+
+#include "STM32F030-Host-lib.c"         // Must come first
+#include "STM32F030-Pool-lib.c"         // Library under test
+
+#define N_BLOCKS 5
+
+POOL_DEFINE( pool, 10, N_BLOCKS );      // 10 bytes: rounded up to 3 words
+POOL_DEFINE( tiny, 1, 2 );              // 1 byte: the link and one word of poison
+
+
+//  void *
+//  take( Pool *p )
+//  Allocate a block and write to all of it, as its user would. Freeing a block that still
+//  holds the poison counts as freeing it twice.
+static void *
+take( Pool *p )
+{
+  void *block = Pool_alloc( p );
+
+  if( block )
+    memset( block, 0x55, p->words * 4 );
+  return block;
+}
+
+
+//  void
+//  testExhaust( void )
+//  Allocate until the pool is empty, then free and allocate again.
+static void
+testExhaust( void )
+{
+  uint8_t *b[ N_BLOCKS ];
+
+  HOST_EQ( pool.words, 3 );
+  for( uint8_t i = 0; i < N_BLOCKS; i++ )
+  {
+    b[i] = Pool_alloc( &pool );
+    HOST_CHECK( b[i] != 0 );
+    HOST_EQ( (uintptr_t)b[i] % 4, 0 );
+    HOST_CHECK( (uint32_t *)b[i] >= pool_mem &&
+                (uint32_t *)b[i] + 3 <= pool_mem + N_BLOCKS * 3 );
+    for( uint8_t j = 0; j < i; j++ )
+      HOST_CHECK( b[i] >= b[j] + 12 || b[j] >= b[i] + 12 );
+    memset( b[i], i, 12 );              // Overwrites nothing but its own block
+  }
+  HOST_EQ( pool.used, N_BLOCKS );
+  HOST_EQ( pool.peak, N_BLOCKS );
+  for( uint8_t i = 0; i < N_BLOCKS; i++ )
+    HOST_EQ( b[i][11], i );
+
+  HOST_CHECK( Pool_alloc( &pool ) == 0 );
+  HOST_CHECK( Pool_alloc( &pool ) == 0 );
+  HOST_EQ( pool.fails, 2 );
+
+  Pool_free( &pool, b[1] );
+  Pool_free( &pool, b[3] );
+  Pool_free( &pool, 0 );
+  HOST_EQ( pool.used, N_BLOCKS - 2 );
+  HOST_CHECK( take( &pool ) == b[3] );  // Last freed, first reused
+  HOST_CHECK( take( &pool ) == b[1] );
+  HOST_CHECK( take( &pool ) == 0 );
+  HOST_EQ( pool.used, N_BLOCKS );
+  HOST_EQ( pool.peak, N_BLOCKS );
+  HOST_EQ( pool.fails, 3 );
+  HOST_EQ( pool.errors, 0 );
+
+  for( uint8_t i = 0; i < N_BLOCKS; i++ )
+    Pool_free( &pool, b[i] );
+  HOST_EQ( pool.used, 0 );
+  HOST_EQ( pool.errors, 0 );
+}
+
+
+//  void
+//  testBadFree( void )
+//  Frees that POOL_DEBUG rejects. None of them may change the free list.
+static void
+testBadFree( void )
+{
+  uint32_t  other[ 3 ];
+  uint16_t  errors = pool.errors;
+  uint8_t  *a, *b;
+
+  a = take( &pool );
+  b = take( &pool );
+  Pool_free( &pool, a );
+  Pool_free( &pool, a );                // Twice
+  HOST_EQ( pool.errors, errors + 1 );
+  Pool_free( &pool, b + 4 );            // Not the start of a block
+  HOST_EQ( pool.errors, errors + 2 );
+  Pool_free( &pool, other );            // Not in the pool
+  HOST_EQ( pool.errors, errors + 3 );
+  Pool_free( &pool, pool_mem + N_BLOCKS * 3 );  // Just past the end
+  HOST_EQ( pool.errors, errors + 4 );
+  HOST_EQ( pool.used, 1 );
+
+  HOST_CHECK( take( &pool ) == a );
+  HOST_EQ( pool.errors, errors + 4 );   // Its poison was intact
+
+  // The never-used pool has handed out nothing yet, so no pointer belongs to it
+  Pool_free( &tiny, tiny_mem );
+  HOST_EQ( tiny.errors, 1 );
+  HOST_EQ( tiny.used, 0 );
+
+  Pool_free( &pool, a );
+  Pool_free( &pool, b );
+  HOST_EQ( pool.used, 0 );
+}
+
+
+//  void
+//  testPoison( void )
+//  A write through a pointer to a freed block is found by the next Pool_alloc of it. The
+//  list link at the start of the block (one word on the target, two on a 64-bit host) cannot
+//  be checked.
+static void
+testPoison( void )
+{
+  uint32_t *a      = take( &pool );
+  uint16_t  errors = pool.errors;
+
+  Pool_free( &pool, a );
+  for( uint16_t i = POOL_LINK_WORDS; i < pool.words; i++ )
+    HOST_EQ( a[i], POOL_POISON );
+  a[2] = 0;                             // Use after free
+  HOST_CHECK( Pool_alloc( &pool ) == a );
+  HOST_EQ( pool.errors, errors + 1 );
+  Pool_free( &pool, a );
+
+  // Blocks smaller than the link get one word of poison after it
+  a = take( &tiny );
+  HOST_EQ( tiny.words, POOL_LINK_WORDS + 1 );
+  Pool_free( &tiny, a );
+  HOST_EQ( a[ POOL_LINK_WORDS ], POOL_POISON );
+  Pool_free( &tiny, a );                // Twice
+  HOST_EQ( tiny.errors, 2 );            // One more than in testBadFree
+  HOST_EQ( tiny.used, 0 );
+  a[ POOL_LINK_WORDS ] = 0;             // Use after free
+  HOST_CHECK( take( &tiny ) == a );
+  HOST_EQ( tiny.errors, 3 );
+  Pool_free( &tiny, a );
+}
+
+
+//  void
+//  testPrimask( void )
+//  The routines leave PRIMASK as they found it, so they may be called with the interrupts
+//  off.
+static void
+testPrimask( void )
+{
+  void *a;
+
+  __disable_irq( );
+  a = take( &pool );
+  HOST_EQ( __get_PRIMASK( ), 1 );
+  Pool_free( &pool, a );
+  HOST_EQ( __get_PRIMASK( ), 1 );
+  __enable_irq( );
+  a = take( &pool );
+  HOST_EQ( __get_PRIMASK( ), 0 );
+  Pool_free( &pool, a );
+  HOST_EQ( __get_PRIMASK( ), 0 );
+}
+
+
+int
+main( void )
+{
+  testExhaust( );
+  testBadFree( );
+  testPoison( );
+  testPrimask( );
+  return Host_summary( "test-pool" );
+}
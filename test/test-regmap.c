@@ -0,0 +1,263 @@
+//  ==========================================================================================
+//  test/test-regmap.c
+//  ------------------------------------------------------------------------------------------
+//  Host test of STM32F030-Regmap-lib.c against a simulated device with 256 registers on
+//  the I2C1 model of STM32F030-Host-lib.c:
+//    - Non-volatile registers are read from the device once, then from the cache, and
+//      writes of the value they already hold are skipped. Volatile registers always go to
+//      the device.
+//    - Regmap_update writes only when a bit changes. Undeclared registers give
+//      REGMAP_NOREG.
+//    - Regmap_sync writes consecutive dirty registers in one transaction in REGMAP_BURST
+//      mode, and all of them as address and data pairs in REGMAP_PAIRS mode, in
+//      transactions of at most REGMAP_SYNC_MAX bytes.
+//    - After a failed write, the register is read from the device again, and after a
+//      failed sync, the registers that were not written stay dirty.
+//  Run with "make test".
+//  ------------------------------------------------------------------------------------------
+//  https://github.com/EZdenki/STM32F030-CMSIS-I2C-AHT10-lib
+//  Released under the MIT License
+//  Copyright (c) 2023
+//  Mike Shegedin, EZdenki.com
+//  ==========================================================================================
+
+#include "STM32F030-Host-lib.c"         // Must come first
+#include "STM32F030-Regmap-lib.c"       // Library under test
+
+#define DEV_ADD 0x76                    // Address of the simulated device
+
+uint8_t devReg[ 256 ];                  // Registers of the device
+uint8_t devPtr, devFirst, devPairs;     // Register pointer, first byte, write mode
+uint8_t devTx[ 32 ], devTxLen;          // Bytes of the last write transaction
+uint32_t devWrites, devReads;           // Transactions seen by the device
+
+
+//  Simulated device. In burst mode the first byte written sets the register pointer, and
+//  the rest are written from there on. In pairs mode every byte at an even position is a
+//  register address and the byte after it its value. Reads continue from the pointer.
+static uint8_t
+devStart( uint8_t read )
+{
+  if( read )
+    devReads++;
+  else
+  {
+    devWrites++;
+    devTxLen = 0;
+  }
+  devFirst = 1;
+  return 1;
+}
+
+
+static uint8_t
+devWrite( uint8_t data )
+{
+  if( devTxLen < sizeof( devTx ))
+    devTx[ devTxLen ] = data;
+  if( devFirst || ( devPairs && !( devTxLen & 1 )))
+    devPtr = data;
+  else
+    devReg[ devPtr++ ] = data;
+  devTxLen++;
+  devFirst = 0;
+  return 1;
+}
+
+
+static uint8_t
+devRead( void )
+{
+  return devReg[ devPtr++ ];
+}
+
+
+const Host_I2cDevice dev = { DEV_ADD, devStart, devWrite, devRead, 0 };
+
+static const Regmap_Reg regs[] =
+{
+  { 0x10, 0 },
+  { 0x11, 0 },
+  { 0x12, 0 },
+  { 0x13, REGMAP_VOLATILE },
+  { 0x20, 0 },
+};
+
+static const Regmap_Reg many[] =        // Nine registers, more than fit in one sync
+{
+  { 0x40, 0 }, { 0x41, 0 }, { 0x42, 0 }, { 0x43, 0 }, { 0x44, 0 },
+  { 0x45, 0 }, { 0x46, 0 }, { 0x47, 0 }, { 0x48, 0 },
+};
+
+I2C_Dev i2cDev;
+Regmap  map;
+uint8_t cache[ 9 ];
+
+
+//  Count the transactions of one call: reads are a register address write and a read.
+#define TRANSACTIONS( w, r, call )                                              \
+  do {                                                                          \
+    uint32_t w0 = devWrites, r0 = devReads;                                     \
+    call;                                                                       \
+    HOST_EQ( devWrites - w0, w );                                               \
+    HOST_EQ( devReads - r0, r );                                                \
+  } while( 0 )
+
+
+//  void
+//  testCache( void )
+//  Reads and writes of single registers in burst mode.
+static void
+testCache( void )
+{
+  uint8_t v;
+
+  for( uint16_t i = 0; i < 256; i++ )
+    devReg[ i ] = i ^ 0x5A;
+  Regmap_init( &map, &i2cDev, regs, cache, 5, REGMAP_BURST );
+
+  // Non-volatile: read once, then from the cache even if the device changes
+  TRANSACTIONS( 1, 1, HOST_EQ( Regmap_read( &map, 0x10, &v ), I2C_OK ));
+  HOST_EQ( v, 0x10 ^ 0x5A );
+  devReg[ 0x10 ] = 0x99;
+  TRANSACTIONS( 0, 0, HOST_EQ( Regmap_read( &map, 0x10, &v ), I2C_OK ));
+  HOST_EQ( v, 0x10 ^ 0x5A );
+  HOST_EQ( map.reads, 1 );
+  HOST_EQ( map.hits, 1 );
+
+  // Volatile: always from the device
+  TRANSACTIONS( 1, 1, HOST_EQ( Regmap_read( &map, 0x13, &v ), I2C_OK ));
+  HOST_EQ( v, 0x13 ^ 0x5A );
+  devReg[ 0x13 ] = 0x42;
+  TRANSACTIONS( 1, 1, HOST_EQ( Regmap_read( &map, 0x13, &v ), I2C_OK ));
+  HOST_EQ( v, 0x42 );
+  TRANSACTIONS( 1, 0, HOST_EQ( Regmap_write( &map, 0x13, 0x42 ), I2C_OK ));
+
+  // Writes of the cached value are skipped, others go through to the device
+  TRANSACTIONS( 0, 0, HOST_EQ( Regmap_write( &map, 0x10, 0x10 ^ 0x5A ), I2C_OK ));
+  TRANSACTIONS( 1, 0, HOST_EQ( Regmap_write( &map, 0x10, 0x21 ), I2C_OK ));
+  HOST_EQ( devReg[ 0x10 ], 0x21 );
+  HOST_EQ( devTxLen, 2 );
+  HOST_EQ( devTx[0], 0x10 );
+  TRANSACTIONS( 0, 0, HOST_EQ( Regmap_read( &map, 0x10, &v ), I2C_OK ));
+  HOST_EQ( v, 0x21 );
+
+  // Update: read once, written only if a bit changes
+  TRANSACTIONS( 1, 1, HOST_EQ( Regmap_update( &map, 0x11, 0x0F, 0x11 ^ 0x5A ), I2C_OK ));
+  TRANSACTIONS( 1, 0, HOST_EQ( Regmap_update( &map, 0x11, 0xF0, 0xA0 ), I2C_OK ));
+  HOST_EQ( devReg[ 0x11 ], (( 0x11 ^ 0x5A ) & 0x0F ) | 0xA0 );
+  TRANSACTIONS( 0, 0, HOST_EQ( Regmap_update( &map, 0x11, 0xF0, 0xA0 ), I2C_OK ));
+
+  // Undeclared registers, and volatile registers in Regmap_set
+  TRANSACTIONS( 0, 0, HOST_EQ( Regmap_read( &map, 0x30, &v ), REGMAP_NOREG ));
+  TRANSACTIONS( 0, 0, HOST_EQ( Regmap_write( &map, 0x14, 0 ), REGMAP_NOREG ));
+  TRANSACTIONS( 0, 0, HOST_EQ( Regmap_update( &map, 0x00, 1, 1 ), REGMAP_NOREG ));
+  TRANSACTIONS( 0, 0, HOST_EQ( Regmap_set( &map, 0x13, 0xFF, 0 ), REGMAP_NOREG ));
+
+  // A failed write forgets the value, so the register is read again
+  Host_i2cFault( HOST_FAULT_NACK, 2, 0 );
+  TRANSACTIONS( 1, 0, HOST_EQ( Regmap_write( &map, 0x10, 0x33 ), I2C_NACK ));
+  TRANSACTIONS( 1, 1, HOST_EQ( Regmap_read( &map, 0x10, &v ), I2C_OK ));
+  HOST_EQ( v, devReg[ 0x10 ] );
+
+  // Invalidate: everything is read again
+  Regmap_invalidate( &map );
+  TRANSACTIONS( 1, 1, HOST_EQ( Regmap_read( &map, 0x10, &v ), I2C_OK ));
+
+  // Bit fields
+  HOST_EQ( REGMAP_GET( 0xB4, 0x1C ), 5 );
+  HOST_EQ( REGMAP_PUT( 0x1C, 5 ), 0x14 );
+  HOST_EQ( REGMAP_PUT( 0x1C, 0xFF ), 0x1C );
+}
+
+
+//  void
+//  testSync( void )
+//  Changes collected with Regmap_set and written by Regmap_sync, in both write modes.
+static void
+testSync( void )
+{
+  uint8_t v;
+
+  // Burst: 0x10 to 0x12 in one transaction, 0x20 in another
+  devPairs = 0;
+  Regmap_init( &map, &i2cDev, regs, cache, 5, REGMAP_BURST );
+  TRANSACTIONS( 0, 0, HOST_EQ( Regmap_set( &map, 0x10, 0xFF, 0xA1 ), I2C_OK ));
+  TRANSACTIONS( 0, 0, HOST_EQ( Regmap_set( &map, 0x11, 0xFF, 0xA2 ), I2C_OK ));
+  TRANSACTIONS( 1, 1, HOST_EQ( Regmap_set( &map, 0x12, 0x0F, 0x03 ), I2C_OK ));
+  TRANSACTIONS( 0, 0, HOST_EQ( Regmap_set( &map, 0x20, 0xFF, 0xA4 ), I2C_OK ));
+  v = ( devReg[ 0x12 ] & 0xF0 ) | 0x03;
+  TRANSACTIONS( 2, 0, HOST_EQ( Regmap_sync( &map ), I2C_OK ));
+  HOST_EQ( devReg[ 0x10 ], 0xA1 );
+  HOST_EQ( devReg[ 0x11 ], 0xA2 );
+  HOST_EQ( devReg[ 0x12 ], v );
+  HOST_EQ( devReg[ 0x20 ], 0xA4 );
+  HOST_EQ( devTxLen, 2 );
+  HOST_EQ( devTx[0], 0x20 );
+  TRANSACTIONS( 0, 0, HOST_EQ( Regmap_sync( &map ), I2C_OK ));
+  TRANSACTIONS( 0, 0, HOST_EQ( Regmap_read( &map, 0x11, &v ), I2C_OK ));
+  HOST_EQ( v, 0xA2 );
+
+  // Setting the value a register already holds leaves nothing to write
+  TRANSACTIONS( 0, 0, HOST_EQ( Regmap_set( &map, 0x11, 0xFF, 0xA2 ), I2C_OK ));
+  TRANSACTIONS( 0, 0, HOST_EQ( Regmap_sync( &map ), I2C_OK ));
+
+  // A failed transaction leaves its registers dirty, the other one is written
+  Regmap_set( &map, 0x10, 0xFF, 0xB1 );
+  Regmap_set( &map, 0x11, 0xFF, 0xB2 );
+  Regmap_set( &map, 0x20, 0xFF, 0xB4 );
+  Host_i2cFault( HOST_FAULT_NACK, 1, 0 );
+  TRANSACTIONS( 2, 0, HOST_EQ( Regmap_sync( &map ), I2C_NACK ));
+  HOST_EQ( devReg[ 0x10 ], 0xA1 );
+  HOST_EQ( devReg[ 0x20 ], 0xB4 );
+  TRANSACTIONS( 0, 0, HOST_EQ( Regmap_read( &map, 0x10, &v ), I2C_OK ));
+  HOST_EQ( v, 0xB1 );
+  TRANSACTIONS( 1, 0, HOST_EQ( Regmap_sync( &map ), I2C_OK ));
+  HOST_EQ( devReg[ 0x10 ], 0xB1 );
+  HOST_EQ( devReg[ 0x11 ], 0xB2 );
+  HOST_EQ( devTxLen, 3 );
+
+  // Pairs: all dirty registers in one transaction, whatever their addresses
+  devPairs = 1;
+  Regmap_init( &map, &i2cDev, regs, cache, 5, REGMAP_PAIRS );
+  Regmap_set( &map, 0x10, 0xFF, 0xC1 );
+  Regmap_set( &map, 0x20, 0xFF, 0xC4 );
+  TRANSACTIONS( 1, 0, HOST_EQ( Regmap_sync( &map ), I2C_OK ));
+  HOST_EQ( devTxLen, 4 );
+  HOST_CHECK( devTx[0] == 0x10 && devTx[1] == 0xC1 && devTx[2] == 0x20 && devTx[3] == 0xC4 );
+  HOST_EQ( devReg[ 0x10 ], 0xC1 );
+  HOST_EQ( devReg[ 0x20 ], 0xC4 );
+  HOST_EQ( map.writes, 1 );
+
+  // Nine pairs do not fit in REGMAP_SYNC_MAX bytes
+  Regmap_init( &map, &i2cDev, many, cache, 9, REGMAP_PAIRS );
+  for( uint8_t i = 0; i < 9; i++ )
+    Regmap_set( &map, 0x40 + i, 0xFF, 0xD0 + i );
+  TRANSACTIONS( 2, 0, HOST_EQ( Regmap_sync( &map ), I2C_OK ));
+  HOST_EQ( devTxLen, 2 );
+  for( uint8_t i = 0; i < 9; i++ )
+    HOST_EQ( devReg[ 0x40 + i ], 0xD0 + i );
+
+  // The same in burst mode takes one transaction
+  devPairs = 0;
+  Regmap_init( &map, &i2cDev, many, cache, 9, REGMAP_BURST );
+  for( uint8_t i = 0; i < 9; i++ )
+    Regmap_set( &map, 0x40 + i, 0xFF, 0xE0 + i );
+  TRANSACTIONS( 1, 0, HOST_EQ( Regmap_sync( &map ), I2C_OK ));
+  HOST_EQ( devTxLen, 10 );
+  for( uint8_t i = 0; i < 9; i++ )
+    HOST_EQ( devReg[ 0x40 + i ], 0xE0 + i );
+}
+
+
+int
+main( void )
+{
+  I2C_init( I2C1, 100000 );
+  Host_i2cAttach( &dev );
+  I2C_devInit( &i2cDev, I2C1, 0, 0, 0, DEV_ADD );
+
+  testCache( );
+  testSync( );
+  return Host_summary( "test-regmap" );
+}
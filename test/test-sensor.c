@@ -0,0 +1,190 @@
+//  ==========================================================================================
+//  test/test-sensor.c
+//  ------------------------------------------------------------------------------------------
+//  Host test of the sampling engine of STM32F030-Sensor-lib.c, with simulated sensors on
+//  the I2C1 model:
+//    - A gated sensor that shares I2C1 with a sensor that stays powered (busPort of 0)
+//      switches its power between samples, but leaves the I2C interface on, so the other
+//      sensor never fails.
+//    - Sensor_run starts every sensor that is due before it collects any result, so a slow
+//      fetch of one sensor does not delay the start of another.
+//  Run with "make test".
+//  ------------------------------------------------------------------------------------------
+//  https://github.com/EZdenki/STM32F030-CMSIS-I2C-AHT10-lib
+//  Released under the MIT License
+//  Copyright (c) 2023
+//  Mike Shegedin, EZdenki.com
+//  ==========================================================================================
+
+#include "STM32F030-Host-lib.c"         // Must come first
+#include "STM32F030-Sensor-lib.c"       // Library under test
+
+#define FAKE_ADD 0x40                   // Address of the first simulated sensor
+
+uint8_t fakeValue[ 2 ];                 // Result of each simulated sensor
+uint8_t fakeCur;                        // Sensor addressed by the transaction
+uint32_t fakeFetchUs;                   // Extra time taken by each fetch, as a clock stretch
+
+
+//  Simulated sensors at FAKE_ADD and FAKE_ADD + 1: writes are commands, and a read
+//  returns the value of the sensor.
+static uint8_t
+fakeStart0( uint8_t read )
+{
+  fakeCur = 0;
+  return 1;
+}
+
+
+static uint8_t
+fakeStart1( uint8_t read )
+{
+  fakeCur = 1;
+  return 1;
+}
+
+
+static uint8_t
+fakeRead( void )
+{
+  return fakeValue[ fakeCur ];
+}
+
+
+const Host_I2cDevice fakeDev0 = { FAKE_ADD,     fakeStart0, 0, fakeRead, 0 };
+const Host_I2cDevice fakeDev1 = { FAKE_ADD + 1, fakeStart1, 0, fakeRead, 0 };
+
+
+//  Driver of the simulated sensors. Each step is one transaction on the bus, so it fails
+//  if the I2C interface is off.
+static uint8_t
+fakeCommand( Sensor *s )
+{
+  uint8_t cmd = 0xAC;
+
+  return I2C_devWrite( &s->dev, &cmd, 1 );
+}
+
+
+static uint8_t
+fakeFetch( Sensor *s, uint8_t *raw )
+{
+  delay_us( fakeFetchUs );
+  return I2C_devRead( &s->dev, raw, 1 );
+}
+
+
+static uint8_t
+fakeDecode( Sensor *s, const uint8_t *raw, Sensor_Reading *r )
+{
+  r->temp  = FIX16( raw[0] );
+  r->valid = SENSOR_TEMP;
+  return I2C_OK;
+}
+
+
+const Sensor_Driver fakeDriver =
+{
+  "Fake", SENSOR_TEMP, 1, 5, 10, fakeCommand, fakeCommand, 0, fakeFetch, fakeDecode, 0
+};
+
+//  The same sensor with a longer power-up time, so that its first start falls on the
+//  first collect of a fakeDriver sensor that was set up at the same time.
+const Sensor_Driver lateDriver =
+{
+  "Late", SENSOR_TEMP, 1, 15, 10, fakeCommand, fakeCommand, 0, fakeFetch, fakeDecode, 0
+};
+
+
+//  void
+//  testSharedPower( void )
+//  Sensor 0 is gated, sensor 1 on the same bus is not. Their periods differ, so sensor 1
+//  is also read while sensor 0 is off.
+static void
+testSharedPower( void )
+{
+  Sensor       s0, s1;
+  Sensor      *sensors[] = { &s0, &s1 };
+  Sensor_Power power;
+  uint16_t     reads[ 2 ] = { 0, 0 };
+  uint16_t     offs = 0;
+  uint8_t      wasOn = 1;
+  uint32_t     end;
+
+  Sensor_init( &s0, &fakeDriver, I2C1, 0, 0, 0, FAKE_ADD,     0, 1000 );
+  Sensor_init( &s1, &fakeDriver, I2C1, 0, 0, 0, FAKE_ADD + 1, 0, 300 );
+  Sensor_powerInit( &power, GPIOB, 1, 0, 0, 0 );
+  Sensor_setPower( &s0, &power );
+  HOST_CHECK( Sensor_gated( &s0 ));
+  HOST_CHECK( !Sensor_gated( &s1 ));
+  HOST_CHECK( GPIOB->ODR & ( 1U << 1 ));
+
+  fakeValue[0] = 20;
+  fakeValue[1] = 30;
+  end = SysTick_ms( ) + 10000;
+  while( !SysTick_reached( end ))
+  {
+    Sensor_run( sensors, 2 );
+    for( uint8_t i = 0; i < 2; i++ )
+      if( sensors[i]->fresh )
+      {
+        HOST_EQ( sensors[i]->reading.temp, FIX16( fakeValue[i] ));
+        sensors[i]->fresh = 0;
+        reads[i]++;
+      }
+    if( wasOn && !power.on )
+    {
+      offs++;
+      HOST_CHECK( !( GPIOB->ODR & ( 1U << 1 )));
+    }
+    wasOn = power.on;
+    HOST_CHECK( I2C1->CR1 & I2C_CR1_PE );
+    __WFI( );
+  }
+  HOST_EQ( s0.errors, 0 );
+  HOST_EQ( s1.errors, 0 );
+  HOST_EQ( reads[0], 10 );
+  HOST_EQ( reads[1], 34 );
+  HOST_EQ( offs, 10 );
+}
+
+
+//  void
+//  testOverlap( void )
+//  Sensor 0 is collected when sensor 1 is started, and its fetch takes 15 ms. Sensor 1
+//  still starts on time, even though it comes later in the list.
+static void
+testOverlap( void )
+{
+  Sensor   s0, s1;
+  Sensor  *sensors[] = { &s0, &s1 };
+  uint32_t end;
+
+  Sensor_init( &s0, &fakeDriver, I2C1, 0, 0, 0, FAKE_ADD,     0, 1000 );
+  Sensor_init( &s1, &lateDriver, I2C1, 0, 0, 0, FAKE_ADD + 1, 0, 1000 );
+  fakeFetchUs = 15000;
+  end = SysTick_ms( ) + 100;
+  while( !SysTick_reached( end ))
+  {
+    Sensor_run( sensors, 2 );
+    __WFI( );
+  }
+  HOST_EQ( s0.errors + s1.errors, 0 );
+  HOST_CHECK( s0.fresh && s1.fresh );
+  HOST_EQ( s1.startMs - s0.startMs, fakeDriver.convMs );
+  fakeFetchUs = 0;
+}
+
+
+int
+main( void )
+{
+  SysTick_init( );
+  I2C_init( I2C1, 100000 );
+  Host_i2cAttach( &fakeDev0 );
+  Host_i2cAttach( &fakeDev1 );
+
+  testSharedPower( );
+  testOverlap( );
+  return Host_summary( "test-sensor" );
+}
@@ -0,0 +1,195 @@
+//  ==========================================================================================
+//  test/test-sht.c
+//  ------------------------------------------------------------------------------------------
+//  Host test of STM32F030-SHT-lib.c:
+//    - SHT_crc8 gives the check values of the Sensirion datasheets (0xBEEF -> 0x92).
+//    - SHT_convert of every raw word is within 0.003 C and 0.002 %RH of the datasheet
+//      formulas, the SHT4x humidity is limited to 0 .. 100 %, and a wrong CRC in either
+//      word gives SENSOR_CRC_ERR and leaves the results unchanged.
+//    - Sensor_read with SHT3x_driver and SHT4x_driver sends the right commands to a
+//      simulated sensor on the I2C1 model, which does not answer until its conversion
+//      time has passed, and decodes its result.
+//  Run with "make test".
+//  ------------------------------------------------------------------------------------------
+//  https://github.com/EZdenki/STM32F030-CMSIS-I2C-AHT10-lib
+//  Released under the MIT License
+//  Copyright (c) 2023
+//  Mike Shegedin, EZdenki.com
+//  ==========================================================================================
+
+#include "STM32F030-Host-lib.c"         // Must come first
+#include "STM32F030-SHT-lib.c"          // Library under test
+#include <math.h>
+
+uint8_t  shtCmd[ 2 ], shtCmdLen;        // Command bytes of the last write
+uint8_t  shtOut[ 6 ], shtPos;           // Result sent by the sensor
+uint64_t shtReadyUs;                    // The result can be read from this time on
+uint32_t shtConvUs;                     // Conversion time of the simulated sensor
+
+
+//  Simulated SHT3x or SHT4x: a write is a command, and a measurement command starts a
+//  conversion of shtConvUs. Reads are not acknowledged until the conversion is done.
+static uint8_t
+shtStart( uint8_t read )
+{
+  if( read && Host_us( ) < shtReadyUs )
+    return 0;
+  if( !read )
+    shtCmdLen = 0;
+  shtPos = 0;
+  return 1;
+}
+
+
+static uint8_t
+shtWrite( uint8_t data )
+{
+  if( shtCmdLen < 2 )
+    shtCmd[ shtCmdLen++ ] = data;
+  shtReadyUs = Host_us( ) + shtConvUs;
+  return 1;
+}
+
+
+static uint8_t
+shtRead( void )
+{
+  return ( shtPos < 6 ) ? shtOut[ shtPos++ ] : 0xFF;
+}
+
+
+const Host_I2cDevice shtDev = { SHT3X_ADD, shtStart, shtWrite, shtRead, 0 };
+
+
+//  void
+//  shtResult( uint8_t *raw, uint16_t t, uint16_t h )
+//  Fill raw with the temperature and humidity words and their CRCs.
+static void
+shtResult( uint8_t *raw, uint16_t t, uint16_t h )
+{
+  raw[0] = t >> 8;
+  raw[1] = t;
+  raw[2] = SHT_crc8( raw, 2 );
+  raw[3] = h >> 8;
+  raw[4] = h;
+  raw[5] = SHT_crc8( raw + 3, 2 );
+}
+
+
+//  void
+//  testCrc( void )
+//  Check values from the datasheets, and CRC errors.
+static void
+testCrc( void )
+{
+  const uint8_t beef[2] = { 0xBE, 0xEF };
+  const uint8_t zero[2] = { 0x00, 0x00 };
+  uint8_t       raw[6];
+  fix16_t       temp = 123, humid = 456;
+
+  HOST_EQ( SHT_crc8( beef, 2 ), 0x92 );
+  HOST_EQ( SHT_crc8( zero, 2 ), 0x81 );
+  HOST_EQ( SHT_crc8( beef, 0 ), 0xFF );
+
+  for( uint8_t i = 0; i < 6; i++ )
+  {
+    shtResult( raw, 0x6666, 0x8000 );
+    raw[ i ] ^= 0x04;
+    HOST_EQ( SHT_convert( raw, 0, &temp, &humid ), SENSOR_CRC_ERR );
+    HOST_EQ( SHT_convert( raw, 1, &temp, &humid ), SENSOR_CRC_ERR );
+  }
+  HOST_EQ( temp, 123 );
+  HOST_EQ( humid, 456 );
+}
+
+
+//  void
+//  testConvert( void )
+//  Every raw word against the datasheet formulas.
+static void
+testConvert( void )
+{
+  uint8_t raw[6];
+  fix16_t temp, humid, humid4;
+  double  errT = 0, errH = 0, errH4 = 0;
+
+  for( uint32_t r = 0; r < 65536; r++ )
+  {
+    double rh4 = -6 + 125.0 * r / 65535;
+
+    shtResult( raw, r, r );
+    if( SHT_convert( raw, 0, &temp, &humid ) != I2C_OK ||
+        SHT_convert( raw, 1, &temp, &humid4 ) != I2C_OK )
+    {
+      HOST_CHECK( !"SHT_convert failed" );
+      return;
+    }
+    rh4   = ( rh4 < 0 ) ? 0 : ( rh4 > 100 ) ? 100 : rh4;
+    errT  = fmax( errT,  fabs( temp   / 65536.0 - ( -45 + 175.0 * r / 65535 )));
+    errH  = fmax( errH,  fabs( humid  / 65536.0 - 100.0 * r / 65535 ));
+    errH4 = fmax( errH4, fabs( humid4 / 65536.0 - rh4 ));
+  }
+  HOST_CHECK( errT < 0.003 );
+  HOST_CHECK( errH < 0.002 );
+  HOST_CHECK( errH4 < 0.002 );
+
+  // Ends of the ranges
+  shtResult( raw, 0, 0 );
+  SHT_convert( raw, 1, &temp, &humid4 );
+  HOST_EQ( temp, FIX16( -45 ));
+  HOST_EQ( humid4, 0 );
+  shtResult( raw, 0xFFFF, 0xFFFF );
+  SHT_convert( raw, 1, &temp, &humid4 );
+  HOST_EQ( humid4, FIX16( 100 ));
+  HOST_EQ( fix16_to100( temp ), 13000 );
+  shtResult( raw, 0x6666, 0x8000 );
+  SHT_convert( raw, 0, &temp, &humid );
+  HOST_EQ( fix16_to100( temp ), 2500 );
+  HOST_EQ( fix16_to100( humid ), 5000 );
+}
+
+
+//  void
+//  testDriver( const Sensor_Driver *drv, uint32_t convUs, uint16_t cmd, uint8_t cmdLen )
+//  Take one reading through drv from a sensor with a conversion time of convUs, and check
+//  the command it was sent.
+static void
+testDriver( const Sensor_Driver *drv, uint32_t convUs, uint16_t cmd, uint8_t cmdLen )
+{
+  Sensor         s;
+  Sensor_Reading r;
+
+  shtConvUs = convUs;
+  Sensor_init( &s, drv, I2C1, 0, 0, 0, SHT3X_ADD, 0, 1000 );
+  shtResult( shtOut, 0x6666, 0x8000 );
+  HOST_EQ( Sensor_read( &s, &r ), I2C_OK );
+  HOST_EQ( shtCmdLen, cmdLen );
+  HOST_EQ( cmdLen == 2 ? shtCmd[0] << 8 | shtCmd[1] : shtCmd[0], cmd );
+  HOST_EQ( r.valid, SENSOR_TEMP | SENSOR_HUMID );
+  HOST_EQ( fix16_to100( r.temp ), 2500 );
+  HOST_EQ( fix16_to100( r.humid ), drv == &SHT4x_driver ? 5650 : 5000 );
+
+  // A conversion that takes longer than convMs is not acknowledged
+  shtConvUs = drv->convMs * 1000 + 500;
+  HOST_EQ( Sensor_read( &s, &r ), I2C_NACK );
+
+  // A damaged result
+  shtConvUs = convUs;
+  shtOut[4] ^= 1;
+  HOST_EQ( Sensor_read( &s, &r ), SENSOR_CRC_ERR );
+}
+
+
+int
+main( void )
+{
+  SysTick_init( );
+  I2C_init( I2C1, 100000 );
+  Host_i2cAttach( &shtDev );
+
+  testCrc( );
+  testConvert( );
+  testDriver( &SHT3x_driver, 15500, SHT3X_MEAS_HIGH, 2 );
+  testDriver( &SHT4x_driver, 8300, SHT4X_MEAS_HIGH, 1 );
+  return Host_summary( "test-sht" );
+}
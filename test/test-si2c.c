@@ -0,0 +1,365 @@
+//  ==========================================================================================
+//  test/test-si2c.c
+//  ------------------------------------------------------------------------------------------
+//  Host test of STM32F030-SoftI2C-lib.c. A simulated device on PA6 (SCL) and PA7 (SDA)
+//  follows the bus bit by bit through Host_gpioWatch, and pulls the open-drain lines low
+//  through Host_gpioIn:
+//    - Writes and reads reach the device, and the last byte read is not acknowledged.
+//    - An address nobody answers gives I2C_NACK, and the next transaction works.
+//    - A clock stretch slows the transaction down, and one longer than I2C_TIMEOUT_US gives
+//      I2C_TIMEOUT.
+//    - A device that holds SDA low before the start is freed by the recovery that the start
+//      runs, and the transaction goes ahead.
+//    - Another master that pulls SDA low while this one sends a 1 gives I2C_ARLO. If it
+//      lets go, the lines are only released. If it is left holding SDA, the bus is
+//      recovered.
+//  Run with "make test".
+//  ------------------------------------------------------------------------------------------
+//  https://github.com/EZdenki/STM32F030-CMSIS-I2C-AHT10-lib
+//  Released under the MIT License
+//  Copyright (c) 2023
+//  Mike Shegedin, EZdenki.com
+//  ==========================================================================================
+
+#include "STM32F030-Host-lib.c"         // Must come first
+#include "STM32F030-SoftI2C-lib.c"      // Library under test
+
+#define SCL_PIN  6                      // Bus pins on port A
+#define SDA_PIN  7
+#define SCL_MASK ( 1U << SCL_PIN )
+#define SDA_MASK ( 1U << SDA_PIN )
+#define DEV_ADD  0x48                   // Address of the simulated device
+
+#define SL_IDLE  0                      // States of the device: Not addressed
+#define SL_ADDR  1                      //   Receiving the address byte
+#define SL_WRITE 2                      //   Receiving a data byte
+#define SL_ACK   3                      //   Sending the acknowledge bit
+#define SL_READ  4                      //   Sending a data byte
+#define SL_RACK  5                      //   Receiving the acknowledge bit of the master
+
+SI2C_Bus bus;
+
+uint8_t  devMem[ 16 ];                  // Bytes written to the device, and read back
+uint8_t  devWritten, devRead;
+uint8_t  slState, slBits, slShift, slByte;
+uint8_t  slReading;                     // The transaction is a read
+uint8_t  slMasterAck;                   // The master acknowledged the last byte read
+uint8_t  slSdaLow;                      // The device pulls SDA low
+uint8_t  slSclLow;                      // The device holds SCL low (clock stretch)
+uint8_t  slStuck;                       // Rising SCL edges until a stuck SDA is let go
+uint32_t slStretchUs;                   // Stretch after the next address, then cleared
+uint16_t slStarts, slStops;             // START and STOP conditions seen
+
+uint8_t  rivalArmed;                    // Another master starts with the next START
+uint8_t  rivalOn;                       // The other master is sending rivalByte
+uint8_t  rivalByte;                     // Address byte of the other master
+int8_t   rivalBit;                      // Bit of rivalByte on the bus, -1 before the first
+uint8_t  rivalLow;                      // The other master pulls SDA low
+
+
+//  void
+//  slLines( void )
+//  Apply the lines pulled low by the device and the other master to Host_gpioIn.
+static void
+slLines( void )
+{
+  uint32_t in = 0xFFFF;
+
+  if( slSdaLow || slStuck || rivalLow )
+    in &= ~SDA_MASK;
+  if( slSclLow )
+    in &= ~SCL_MASK;
+  Host_gpioIn[ 0 ] = in;
+}
+
+
+//  void
+//  slRelease( void )
+//  Host_timer at the end of a clock stretch.
+static void
+slRelease( void )
+{
+  slSclLow   = 0;
+  Host_timer = 0;
+  slLines( );
+}
+
+
+//  void
+//  slRising( uint8_t sda )
+//  SCL rises: the receiver takes the bit on SDA.
+static void
+slRising( uint8_t sda )
+{
+  if( slStuck )
+  {
+    slStuck--;
+    return;
+  }
+  if( slState == SL_ADDR || slState == SL_WRITE )
+  {
+    slShift = ( slShift << 1 ) | sda;
+    slBits++;
+  }
+  else if( slState == SL_RACK )
+    slMasterAck = !sda;
+}
+
+
+//  void
+//  slFalling( void )
+//  SCL falls: the transmitters put the next bit on SDA.
+static void
+slFalling( void )
+{
+  if( rivalOn )
+  {
+    if( ++rivalBit < 8 )
+      rivalLow = !( rivalByte & ( 0x80 >> rivalBit ));
+    else
+      rivalOn = rivalLow = 0;
+  }
+  switch( slState )
+  {
+    case SL_ADDR:
+    case SL_WRITE:
+      if( slBits < 8 )
+        break;
+      if( slState == SL_WRITE )
+        devMem[ devWritten++ & 15 ] = slShift;
+      else if(( slShift >> 1 ) != DEV_ADD )
+      {
+        slState = SL_IDLE;
+        break;
+      }
+      else if(( slReading = slShift & 1 ))
+        devRead = 0;
+      else
+        devWritten = 0;
+      slSdaLow = 1;
+      slState  = SL_ACK;
+      break;
+
+    case SL_ACK:
+      slSdaLow = 0;
+      if( slStretchUs )
+      {
+        slSclLow     = 1;
+        Host_timer   = slRelease;
+        Host_timerAt = Host_cycles + (uint64_t)slStretchUs * DELAY_CLK_MHZ;
+        slStretchUs  = 0;
+      }
+      slBits  = 0;
+      slShift = 0;
+      slState = SL_WRITE;
+      if( !slReading )
+        break;
+      // Fall through: Send the first byte
+
+    case SL_RACK:
+      if( slState == SL_RACK && !slMasterAck )
+      {
+        slState = SL_IDLE;
+        break;
+      }
+      slByte   = devMem[ devRead++ & 15 ];
+      slBits   = 0;
+      slSdaLow = !( slByte & 0x80 );
+      slState  = SL_READ;
+      break;
+
+    case SL_READ:
+      if( ++slBits < 8 )
+        slSdaLow = !( slByte & ( 0x80 >> slBits ));
+      else
+      {
+        slSdaLow = 0;
+        slState  = SL_RACK;
+      }
+      break;
+  }
+}
+
+
+//  void
+//  slWatch( uint8_t port, uint32_t odr, uint32_t old )
+//  Host_gpioWatch: Follow the levels that the master sets. SDA changing while SCL is high
+//  is a START or STOP, otherwise the SCL edges move the bits.
+static void
+slWatch( uint8_t port, uint32_t odr, uint32_t old )
+{
+  uint8_t scl = ( odr & SCL_MASK ) != 0;
+  uint8_t sda = ( odr & SDA_MASK ) != 0;
+
+  if( port != 0 )
+    return;
+  if( scl && ( old & SCL_MASK ) && sda != (( old & SDA_MASK ) != 0 ))
+  {
+    if( sda )
+    {
+      slStops++;
+      slState = SL_IDLE;
+    }
+    else if( !slStuck )
+    {
+      slStarts++;
+      slState    = SL_ADDR;
+      slBits     = 0;
+      slShift    = 0;
+      slSdaLow   = 0;
+      rivalOn    = rivalArmed;
+      rivalBit   = -1;
+      rivalArmed = 0;
+    }
+  }
+  else if( scl && !( old & SCL_MASK ))
+    slRising( sda && ( Host_gpioIn[ 0 ] & SDA_MASK ));
+  else if( !scl && ( old & SCL_MASK ))
+    slFalling( );
+  slLines( );
+}
+
+
+//  void
+//  checkBus( void )
+//  The bus works: a write and a read back.
+static void
+checkBus( void )
+{
+  const uint8_t out[3] = { 0x11, 0x22, 0x33 };
+  uint8_t       in[3]  = { 0 };
+
+  HOST_EQ( SI2C_writeN( &bus, DEV_ADD, out, 3 ), I2C_OK );
+  HOST_EQ( SI2C_readN( &bus, DEV_ADD, in, 3 ), I2C_OK );
+  HOST_CHECK( !memcmp( in, out, 3 ));
+  HOST_EQ( slState, SL_IDLE );
+  HOST_EQ( Host_gpioIn[ 0 ], 0xFFFF );
+}
+
+
+//  void
+//  testTransfers( void )
+//  A write and a read, and an address that nobody answers.
+static void
+testTransfers( void )
+{
+  const uint8_t out[4] = { 0xAC, 0x33, 0x00, 0x5A };
+  uint8_t       in[4]  = { 0 };
+  uint16_t      starts = slStarts, stops = slStops;
+
+  HOST_EQ( SI2C_writeN( &bus, DEV_ADD, out, 4 ), I2C_OK );
+  HOST_EQ( devWritten, 4 );
+  HOST_CHECK( !memcmp( devMem, out, 4 ));
+  HOST_EQ( SI2C_readN( &bus, DEV_ADD, in, 4 ), I2C_OK );
+  HOST_CHECK( !memcmp( in, out, 4 ));
+  HOST_EQ( devRead, 4 );
+  HOST_EQ( slMasterAck, 0 );            // The last byte is not acknowledged
+  HOST_EQ( slStarts, starts + 2 );
+  HOST_EQ( slStops, stops + 2 );
+  HOST_EQ( bus.lastError, I2C_OK );
+
+  HOST_EQ( SI2C_writeN( &bus, 0x50, out, 4 ), I2C_NACK );
+  HOST_EQ( bus.lastError, I2C_NACK );
+  HOST_EQ( SI2C_readN( &bus, 0x50, in, 4 ), I2C_NACK );
+  HOST_EQ( slStops, stops + 4 );
+  checkBus( );
+}
+
+
+//  void
+//  testStretch( void )
+//  A stretch after the address, first short, then longer than the timeout.
+static void
+testStretch( void )
+{
+  const uint8_t out[2] = { 1, 2 };
+  uint64_t      t;
+
+  slStretchUs = 5000;
+  t = Host_us( );
+  HOST_EQ( SI2C_writeN( &bus, DEV_ADD, out, 2 ), I2C_OK );
+  HOST_CHECK( Host_us( ) - t >= 5000 );
+  HOST_CHECK( Host_us( ) - t < I2C_TIMEOUT_US );
+  HOST_EQ( devWritten, 2 );
+
+  slStretchUs = I2C_TIMEOUT_US + 5000;
+  t = Host_us( );
+  HOST_EQ( SI2C_writeN( &bus, DEV_ADD, out, 2 ), I2C_TIMEOUT );
+  HOST_EQ( bus.lastError, I2C_TIMEOUT );
+  HOST_CHECK( Host_us( ) - t >= I2C_TIMEOUT_US );
+  HOST_EQ( slSclLow, 0 );
+  checkBus( );
+}
+
+
+//  void
+//  testStuck( void )
+//  A device holds SDA low for 3 clocks. The start recovers the bus and goes ahead.
+static void
+testStuck( void )
+{
+  const uint8_t out[2] = { 7, 8 };
+  uint16_t      stops = slStops;
+
+  slStuck = 3;
+  slLines( );
+  HOST_EQ( SI2C_writeN( &bus, DEV_ADD, out, 2 ), I2C_OK );
+  HOST_EQ( slStuck, 0 );
+  HOST_EQ( devWritten, 2 );
+  HOST_EQ( devMem[1], 8 );
+  HOST_EQ( slStops, stops + 2 );        // One from the recovery
+
+  // Held for longer than the 9 clocks of a recovery: the start gives up with I2C_ARLO, and
+  // SDA is still held afterwards, so the bus is recovered once more
+  slStuck = 25;
+  slLines( );
+  HOST_EQ( SI2C_writeN( &bus, DEV_ADD, out, 2 ), I2C_ARLO );
+  HOST_EQ( slStuck, 5 );                // 9 pulses and the STOP of each recovery
+  HOST_EQ( SI2C_writeN( &bus, DEV_ADD, out, 2 ), I2C_OK );
+  HOST_EQ( slStuck, 0 );
+  checkBus( );
+}
+
+
+//  void
+//  testArbitration( void )
+//  Another master sends its address at the same time, and wins with its first bit.
+static void
+testArbitration( void )
+{
+  const uint8_t out[2] = { 1, 2 };
+  uint16_t      stops  = slStops;
+
+  // It lets go of SDA with its next bit: the lines are released, and no STOP is sent
+  rivalByte  = 0x40;
+  rivalArmed = 1;
+  HOST_EQ( SI2C_writeN( &bus, DEV_ADD, out, 2 ), I2C_ARLO );
+  HOST_EQ( bus.lastError, I2C_ARLO );
+  HOST_EQ( slStops, stops );
+  HOST_EQ( rivalLow, 0 );
+  checkBus( );
+
+  // It is left holding SDA low: the bus is recovered
+  stops      = slStops;
+  rivalByte  = 0x00;
+  rivalArmed = 1;
+  HOST_EQ( SI2C_readN( &bus, DEV_ADD, (uint8_t *)out, 2 ), I2C_ARLO );
+  HOST_EQ( rivalLow, 0 );
+  HOST_EQ( slStops, stops + 1 );
+  checkBus( );
+}
+
+
+int
+main( void )
+{
+  Host_gpioWatch = slWatch;
+  SI2C_init( &bus, GPIOA, SCL_PIN, GPIOA, SDA_PIN, 100000 );
+  HOST_EQ( GPIOA->OTYPER & ( SCL_MASK | SDA_MASK ), SCL_MASK | SDA_MASK );
+
+  testTransfers( );
+  testStretch( );
+  testStuck( );
+  testArbitration( );
+  return Host_summary( "test-si2c" );
+}
@@ -0,0 +1,150 @@
+//  ==========================================================================================
+//  test/test-trace.c
+//  ------------------------------------------------------------------------------------------
+//  Host test of the trace replay of host/i2c-replay.c. A log is recorded on the I2C1 model
+//  with every kind of result (NACK, bus error, arbitration loss and timeouts) and with
+//  gaps between the transactions, then replayed:
+//    - At the recorded speed, every record must match, including the durations and the
+//      gaps, and the replay must give the same log byte for byte apart from the times.
+//    - At a higher speed, the durations must no longer match.
+//    - A log whose last record is cut off must be rejected.
+//  Run with "make test".
+//  ------------------------------------------------------------------------------------------
+//  https://github.com/EZdenki/STM32F030-CMSIS-I2C-AHT10-lib
+//  Released under the MIT License
+//  Copyright (c) 2023
+//  Mike Shegedin, EZdenki.com
+//  ==========================================================================================
+
+#define REPLAY_NO_MAIN
+#include "host/i2c-replay.c"            // Replay_check and Replay_run, with the I2C library
+
+uint8_t regs[ 2 ][ 8 ];                 // Registers of the two devices
+uint8_t regDev, regPtr, regFirst;
+
+
+//  Two simulated devices with 8 registers each: the first byte written sets the register
+//  pointer, and the rest are written from there. Reads continue from the pointer.
+static uint8_t
+regStart( uint8_t read )
+{
+  regFirst = !read;
+  return 1;
+}
+
+
+static uint8_t
+regWrite( uint8_t data )
+{
+  if( regFirst )
+    regPtr = data & 7;
+  else
+    regs[ regDev ][ regPtr++ & 7 ] = data;
+  regFirst = 0;
+  return 1;
+}
+
+
+static uint8_t
+regRead( void )
+{
+  return regs[ regDev ][ regPtr++ & 7 ];
+}
+
+
+static uint8_t
+start0( uint8_t read )
+{
+  regDev = 0;
+  return regStart( read );
+}
+
+
+static uint8_t
+start1( uint8_t read )
+{
+  regDev = 1;
+  return regStart( read );
+}
+
+
+const Host_I2cDevice dev0 = { 0x38, start0, regWrite, regRead, 0 };
+const Host_I2cDevice dev1 = { 0x76, start1, regWrite, regRead, 0 };
+
+
+//  uint16_t
+//  record( uint8_t *log )
+//  Record a log of mixed transactions into log. Returns its length.
+static uint16_t
+record( uint8_t *log )
+{
+  const uint8_t set[4] = { 2, 0xA5, 0x5A, 0x3C };
+  const uint8_t ptr[1] = { 2 };
+  uint8_t       in[8];
+
+  SysTick_init( );
+  I2C_init( I2C1, 100000 );
+  Host_i2cAttach( &dev0 );
+  Host_i2cAttach( &dev1 );
+  I2C_traceReset( );
+
+  HOST_EQ( I2C_writeN( I2C1, 0x38, set, 4 ), I2C_OK );
+  delay_us( 2000 );
+  HOST_EQ( I2C_writeN( I2C1, 0x38, ptr, 1 ), I2C_OK );
+  HOST_EQ( I2C_readN( I2C1, 0x38, in, 3 ), I2C_OK );
+  HOST_CHECK( !memcmp( in, set + 1, 3 ));
+  delay_us( 500 );
+  HOST_EQ( I2C_writeN( I2C1, 0x76, set, 2 ), I2C_OK );
+  HOST_EQ( I2C_readN( I2C1, 0x76, in, 8 ), I2C_OK );
+
+  HOST_EQ( I2C_writeN( I2C1, 0x50, set, 2 ), I2C_NACK );    // No device
+  HOST_EQ( I2C_readN( I2C1, 0x51, in, 2 ), I2C_NACK );
+  Host_i2cFault( HOST_FAULT_NACK, 3, 0 );
+  HOST_EQ( I2C_writeN( I2C1, 0x38, set, 4 ), I2C_NACK );
+  Host_i2cFault( HOST_FAULT_BERR, 2, 0 );
+  HOST_EQ( I2C_readN( I2C1, 0x76, in, 4 ), I2C_BUSERR );
+  Host_i2cFault( HOST_FAULT_ARLO, 1, 0 );
+  HOST_EQ( I2C_writeN( I2C1, 0x38, set, 4 ), I2C_ARLO );
+  delay_us( 30000 );
+  Host_i2cFault( HOST_FAULT_STRETCH, 2, 2 * I2C_TIMEOUT_US );
+  HOST_EQ( I2C_writeN( I2C1, 0x38, set, 4 ), I2C_TIMEOUT );
+  Host_i2cFault( HOST_FAULT_STRETCH, 1, 2 * I2C_TIMEOUT_US );
+  HOST_EQ( I2C_readN( I2C1, 0x76, in, 2 ), I2C_TIMEOUT );
+  HOST_EQ( I2C_readN( I2C1, 0x76, in, 2 ), I2C_OK );
+
+  HOST_EQ( Replay_check( I2C_traceBuf, I2C_traceLen ), 13 );
+  memcpy( log, I2C_traceBuf, I2C_traceLen );
+  return I2C_traceLen;
+}
+
+
+int
+main( void )
+{
+  static uint8_t log[ I2C_TRACE_SIZE ];
+  uint16_t       len = record( log );
+
+  // Same speed: everything matches, the durations within 2 %
+  HOST_EQ( Replay_run( log, len, 100000, 2, 0 ), 0 );
+  HOST_EQ( I2C_traceLen, len );
+  for( uint16_t i = 0; i < len; i += I2C_TRACE_HDR + log[ i + 1 ] )
+  {
+    int32_t gap = ( log[ i + 3 ] | log[ i + 4 ] << 8 ) -
+                  ( I2C_traceBuf[ i + 3 ] | I2C_traceBuf[ i + 4 ] << 8 );
+
+    if( i )
+      HOST_CHECK( gap >= -2 && gap <= 2 );
+    HOST_CHECK( !memcmp( log + i, I2C_traceBuf + i, 3 ));
+    HOST_CHECK( !memcmp( log + i + I2C_TRACE_HDR, I2C_traceBuf + i + I2C_TRACE_HDR,
+                         log[ i + 1 ] ));
+  }
+
+  // Faster bus: the same results, but the durations differ
+  HOST_EQ( Replay_run( log, len, 400000, 0, 0 ), 0 );
+  HOST_CHECK( Replay_run( log, len, 400000, 10, 0 ) >= 8 );
+
+  // Cut off log
+  HOST_EQ( Replay_check( log, len - 1 ), -1 );
+  HOST_EQ( Replay_check( log, 3 ), -1 );
+  return Host_summary( "test-trace" );
+}